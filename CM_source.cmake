@@ -48,6 +48,7 @@ ADD_SUBDIRECTORY ( src-onnx	)
 ADD_SUBDIRECTORY ( src-main		)
 ADD_SUBDIRECTORY ( src-dox		)
 ADD_SUBDIRECTORY ( src-find-dup	)
+ADD_SUBDIRECTORY ( src-bench	)
 
 IF (UNIX AND NOT APPLE)
 	ADD_SUBDIRECTORY ( src-ubuntu	)
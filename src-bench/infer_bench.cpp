@@ -0,0 +1,529 @@
+// DarkMark (C) 2019-2026 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+#include "OnnxHelp.hpp"
+#include "OpenCVNN.hpp"
+#include <iomanip>
+#include <numeric>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+/* Measure the latency and throughput of a neural network on real images, using the same OnnxHelp::NN, OpenCVNN, and
+ * DarkHelp::NN code as DarkMark.  The results are written as JSON or CSV so they can be compared between models and
+ * between versions of DarkMark.
+ *
+ * 1) Latency:  the sampled images are decoded and predicted one at a time, and the p50/p95/p99 of every stage is
+ *    reported.  The preprocess, inference, and decode stages are only measured separately for ONNX models.  DarkHelp
+ *    and OpenCV report the entire call as "inference".
+ *
+ * 2) Throughput:  the images are decoded once, then predicted by several threads at once, each with its own instance
+ *    of the neural network, for every combination of thread count and batch size.
+ */
+
+
+namespace
+{
+	struct Options
+	{
+		std::string	model;
+		std::string	darknet_cfg;
+		std::string	names;
+		std::string	backend;
+		std::string	images;
+		std::string	preprocess	= "yolox";
+		std::string	format		= "json";
+		std::string	output;
+		size_t		samples		= 100;
+		std::vector<size_t> threads	= {1, 2, 4};
+		std::vector<size_t> batches	= {1, 4, 8};
+		float		conf_threshold	= 0.25f;
+		float		nms_threshold	= 0.45f;
+		bool		darkhelp_concurrent	= false;
+	};
+
+
+	/// Latency of every image, in milliseconds.
+	using Samples = std::vector<double>;
+
+
+	struct Stats
+	{
+		size_t count	= 0;
+		double mean		= 0.0;
+		double p50		= 0.0;
+		double p95		= 0.0;
+		double p99		= 0.0;
+	};
+
+
+	struct Throughput
+	{
+		size_t threads				= 0;
+		size_t batch_size			= 0;
+		size_t images				= 0;
+		double seconds				= 0.0;
+		double images_per_second	= 0.0;
+	};
+
+
+	std::vector<size_t> parse_list(const std::string & str)
+	{
+		std::vector<size_t> v;
+		std::stringstream ss(str);
+		std::string item;
+		while (std::getline(ss, item, ','))
+		{
+			v.push_back(std::max(1, std::stoi(item)));
+		}
+
+		return v;
+	}
+
+
+	/// Nearest-rank percentiles.
+	Stats get_stats(Samples samples)
+	{
+		Stats stats;
+		stats.count = samples.size();
+		if (samples.empty())
+		{
+			return stats;
+		}
+
+		std::sort(samples.begin(), samples.end());
+		auto percentile = [&](const double p)
+		{
+			const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+			return samples[std::min(samples.size(), std::max(size_t(1), rank)) - 1];
+		};
+
+		stats.mean	= std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+		stats.p50	= percentile(50.0);
+		stats.p95	= percentile(95.0);
+		stats.p99	= percentile(99.0);
+
+		return stats;
+	}
+
+
+	/// Find the images in the directory (recursively), and pick a random sample which is the same every time.
+	dm::VStr find_images(const std::string & directory, const size_t samples)
+	{
+		const std::regex image_regex(".+\\.(jpe?g|png|bmp|tiff?|webp)", std::regex::icase | std::regex::nosubs | std::regex::optimize);
+
+		dm::VStr filenames;
+		for (auto dir_entry : RangedDirectoryIterator(File(directory), true))
+		{
+			const std::string filename = dir_entry.getFile().getFullPathName().toStdString();
+			if (std::regex_match(filename, image_regex) and filename.find("darkmark_image_cache") == std::string::npos)
+			{
+				filenames.push_back(filename);
+			}
+		}
+
+		if (filenames.empty())
+		{
+			throw std::invalid_argument("no images found in " + directory);
+		}
+
+		std::sort(filenames.begin(), filenames.end());
+		std::mt19937 rng(1234);
+		std::shuffle(filenames.begin(), filenames.end(), rng);
+		if (filenames.size() > samples)
+		{
+			filenames.resize(samples);
+		}
+
+		return filenames;
+	}
+
+
+	/** Wraps the 3 kinds of neural networks so the rest of the benchmark doesn't need to know which one is used.  Each
+	 * thread needs its own instance.
+	 */
+	class Model final
+	{
+		public:
+
+			Model(const Options & options, const size_t batch_size)
+			{
+				if (options.backend == "onnx")
+				{
+					onnx.reset(new OnnxHelp::NN(options.model));
+					onnx->set_preprocess_config(options.preprocess == "dfine" ? OnnxHelp::PreprocessConfig::dfine() : OnnxHelp::PreprocessConfig::yolox());
+					onnx->set_max_batch_size(batch_size);
+				}
+				else if (options.backend == "opencv" or options.backend == "openvino")
+				{
+					opencv.reset(new OnnxHelp::OpenCVNN(options.darknet_cfg, options.model, {}, options.backend == "openvino"));
+				}
+				else
+				{
+					darkhelp.reset(new DarkHelp::NN(options.darknet_cfg, options.model, options.names));
+					darkhelp->config.threshold = options.conf_threshold;
+					darkhelp->config.non_maximal_suppression_threshold = options.nms_threshold;
+				}
+			}
+
+			/// Predict the images, and add the time spent in each stage to the samples.  Returns the number of detections.
+			size_t predict(const std::vector<cv::Mat> & mats, const Options & options, std::map<std::string, Samples> * samples = nullptr)
+			{
+				size_t detections = 0;
+
+				const auto start = std::chrono::high_resolution_clock::now();
+				if (onnx)
+				{
+					onnx->reset_stage_times();
+					const auto all_candidates = onnx->predict_candidates_batch(mats, 0.01f);
+					const auto post_start = std::chrono::high_resolution_clock::now();
+					for (const auto & candidates : all_candidates)
+					{
+						detections += OnnxHelp::NN::filter(candidates, options.conf_threshold, options.nms_threshold).size();
+					}
+					const auto end = std::chrono::high_resolution_clock::now();
+
+					if (samples)
+					{
+						// the post-processing is the decoding of the output tensor plus the thresholds and NMS
+						const auto times = onnx->get_stage_times();
+						(*samples)["preprocess"	].push_back(times.preprocess_ms);
+						(*samples)["inference"	].push_back(times.inference_ms);
+						(*samples)["postprocess"].push_back(times.decode_ms + std::chrono::duration<double, std::milli>(end - post_start).count());
+					}
+				}
+				else if (opencv)
+				{
+					for (const auto & mat : mats)
+					{
+						detections += opencv->predict(mat, options.conf_threshold, options.nms_threshold).size();
+					}
+				}
+				else
+				{
+					for (const auto & mat : mats)
+					{
+						detections += darkhelp->predict(mat).size();
+					}
+				}
+
+				if (samples and not onnx)
+				{
+					(*samples)["inference"].push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+				}
+
+				return detections;
+			}
+
+		private:
+
+			std::unique_ptr<OnnxHelp::NN>		onnx;
+			std::unique_ptr<OnnxHelp::OpenCVNN>	opencv;
+			std::unique_ptr<DarkHelp::NN>		darkhelp;
+	};
+
+
+	Throughput measure_throughput(const Options & options, const std::vector<cv::Mat> & mats, const size_t number_of_threads, const size_t batch_size)
+	{
+		// load every instance before starting the clock
+		std::vector<std::unique_ptr<Model>> models;
+		for (size_t idx = 0; idx < number_of_threads; idx ++)
+		{
+			models.emplace_back(new Model(options, batch_size));
+		}
+
+		// warm up each instance so the one-time allocations are not measured
+		for (auto & model : models)
+		{
+			model->predict({mats.front()}, options);
+		}
+
+		std::atomic<size_t> next_index(0);
+		auto worker = [&](Model & model)
+		{
+			while (true)
+			{
+				const size_t first = next_index.fetch_add(batch_size);
+				if (first >= mats.size())
+				{
+					break;
+				}
+
+				const std::vector<cv::Mat> batch(mats.begin() + first, mats.begin() + std::min(mats.size(), first + batch_size));
+				model.predict(batch, options);
+			}
+		};
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		dm::VThreads threads;
+		for (auto & model : models)
+		{
+			threads.emplace_back(worker, std::ref(*model));
+		}
+		for (auto & t : threads)
+		{
+			t.join();
+		}
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		Throughput throughput;
+		throughput.threads				= number_of_threads;
+		throughput.batch_size			= batch_size;
+		throughput.images				= mats.size();
+		throughput.seconds				= std::chrono::duration<double>(end - start).count();
+		throughput.images_per_second	= mats.size() / std::max(0.000001, throughput.seconds);
+
+		return throughput;
+	}
+
+
+	void write_json(std::ostream & os, const Options & options, const std::map<std::string, Stats> & latency, const std::vector<Throughput> & throughput)
+	{
+		json root;
+		root["version"]					= DARKMARK_VERSION;
+		root["model"]					= options.model;
+		root["backend"]					= options.backend;
+		root["images"]					= options.images;
+		root["samples"]					= options.samples;
+		root["conf_threshold"]			= options.conf_threshold;
+		root["nms_threshold"]			= options.nms_threshold;
+
+		for (const auto & [stage, stats] : latency)
+		{
+			root["latency_ms"][stage]["count"]	= stats.count;
+			root["latency_ms"][stage]["mean"]	= stats.mean;
+			root["latency_ms"][stage]["p50"]	= stats.p50;
+			root["latency_ms"][stage]["p95"]	= stats.p95;
+			root["latency_ms"][stage]["p99"]	= stats.p99;
+		}
+
+		for (size_t idx = 0; idx < throughput.size(); idx ++)
+		{
+			const auto & t = throughput[idx];
+			root["throughput"][idx]["threads"]				= t.threads;
+			root["throughput"][idx]["batch_size"]			= t.batch_size;
+			root["throughput"][idx]["images"]				= t.images;
+			root["throughput"][idx]["seconds"]				= t.seconds;
+			root["throughput"][idx]["images_per_second"]	= t.images_per_second;
+		}
+
+		os << root.dump(1, '\t') << std::endl;
+
+		return;
+	}
+
+
+	void write_csv(std::ostream & os, const Options & options, const std::map<std::string, Stats> & latency, const std::vector<Throughput> & throughput)
+	{
+		os << "section,model,backend,stage,threads,batch_size,count,mean_ms,p50_ms,p95_ms,p99_ms,images_per_second" << std::endl;
+		os << std::fixed << std::setprecision(3);
+
+		for (const auto & [stage, stats] : latency)
+		{
+			os << "latency," << options.model << "," << options.backend << "," << stage << ",1,1," << stats.count << "," << stats.mean << "," << stats.p50 << "," << stats.p95 << "," << stats.p99 << "," << std::endl;
+		}
+
+		for (const auto & t : throughput)
+		{
+			os << "throughput," << options.model << "," << options.backend << ",total," << t.threads << "," << t.batch_size << "," << t.images << ",,,,," << t.images_per_second << std::endl;
+		}
+
+		return;
+	}
+}
+
+
+int main(int argc, char * argv[])
+{
+	int rc = 1;
+
+	try
+	{
+		Options options;
+
+		for (int i = 1; i < argc; i ++)
+		{
+			const std::string arg = argv[i];
+			const size_t pos = arg.find('=');
+			const std::string key = arg.substr(0, pos);
+			const std::string val = (pos == std::string::npos ? "" : arg.substr(pos + 1));
+
+			if (arg == "-h" or arg == "--help")
+			{
+				std::cout
+					<< "Measure the latency and throughput of a neural network on the images of a project." << std::endl
+					<< "" << std::endl
+					<< "Usage:" << std::endl
+					<< "" << std::endl
+					<< "\t" << argv[0] << " model=<file.onnx|file.weights> images=<directory> [cfg=<file.cfg>] [names=<file.names>] [backend=onnx|darkhelp|opencv|openvino]" << std::endl
+					<< "\t\t[samples=" << options.samples << "] [threads=1,2,4] [batches=1,4,8] [preprocess=yolox|dfine]" << std::endl
+					<< "\t\t[conf=" << options.conf_threshold << "] [nms=" << options.nms_threshold << "] [format=json|csv] [output=<filename>] [darkhelp_concurrent=false|true]" << std::endl
+					<< "" << std::endl
+					<< "The .cfg file is required for Darknet models.  The backend defaults to \"onnx\" for .onnx files and" << std::endl
+					<< "\"darkhelp\" for everything else.  Batch sizes only apply to ONNX models with a dynamic batch dimension." << std::endl
+					<< "The results are written to infer_bench.json or infer_bench.csv unless an output file is specified." << std::endl
+					<< "Running several instances of libdarknet at once has not been shown to be safe, so the darkhelp backend" << std::endl
+					<< "only uses 1 thread unless darkhelp_concurrent=true." << std::endl;
+				return 0;
+			}
+			else if (key == "model"		) options.model			= val;
+			else if (key == "cfg"		) options.darknet_cfg	= val;
+			else if (key == "names"		) options.names			= val;
+			else if (key == "backend"	) options.backend		= val;
+			else if (key == "images"	) options.images		= val;
+			else if (key == "preprocess") options.preprocess	= val;
+			else if (key == "format"	) options.format		= val;
+			else if (key == "output"	) options.output		= val;
+			else if (key == "samples"	) options.samples		= std::max(1, std::stoi(val));
+			else if (key == "threads"	) options.threads		= parse_list(val);
+			else if (key == "batches"	) options.batches		= parse_list(val);
+			else if (key == "conf"		) options.conf_threshold= std::stof(val);
+			else if (key == "nms"		) options.nms_threshold	= std::stof(val);
+			else if (key == "darkhelp_concurrent") options.darkhelp_concurrent = (val == "true" or val == "1");
+			else
+			{
+				throw std::invalid_argument("unknown argument " + arg);
+			}
+		}
+
+		if (options.model.empty() or options.images.empty())
+		{
+			throw std::invalid_argument("both model=... and images=... are required (see --help)");
+		}
+		if (options.backend.empty())
+		{
+			options.backend = (String(options.model).endsWithIgnoreCase(".onnx") ? "onnx" : "darkhelp");
+		}
+		if (options.backend != "onnx" and options.darknet_cfg.empty())
+		{
+			throw std::invalid_argument("the " + options.backend + " backend needs the Darknet configuration file (cfg=...)");
+		}
+		if (options.backend == "darkhelp")
+		{
+			const bool concurrent = std::any_of(options.threads.begin(), options.threads.end(), [](const size_t n) { return n > 1; });
+			if (concurrent and options.darkhelp_concurrent)
+			{
+				std::cout << "WARNING: running several DarkHelp instances at once has not been shown to be safe with libdarknet, the results may be wrong or the benchmark may crash" << std::endl;
+			}
+			else if (concurrent)
+			{
+				std::cout << "WARNING: the darkhelp backend only uses 1 thread (see darkhelp_concurrent=true)" << std::endl;
+				options.threads = {1};
+			}
+		}
+		if (options.format != "json" and options.format != "csv")
+		{
+			throw std::invalid_argument("unknown format " + options.format);
+		}
+		if (options.output.empty())
+		{
+			options.output = "infer_bench." + options.format;
+		}
+
+		const auto filenames = find_images(options.images, options.samples);
+		std::cout << "model: " << options.model << ", backend: " << options.backend << ", images: " << filenames.size() << std::endl;
+
+		// 1) latency of each stage, one image at a time
+		std::map<std::string, Samples> samples;
+		std::vector<cv::Mat> mats;
+		{
+			Model model(options, 1);
+			bool warmed_up = false;
+			for (const auto & fn : filenames)
+			{
+				const auto start = std::chrono::high_resolution_clock::now();
+				cv::Mat mat = cv::imread(fn);
+				const auto end = std::chrono::high_resolution_clock::now();
+				if (mat.empty())
+				{
+					std::cout << "skipping " << fn << " (failed to decode)" << std::endl;
+					continue;
+				}
+				mats.push_back(mat);
+
+				if (not warmed_up)
+				{
+					// the first call allocates the buffers and is much slower than the rest
+					model.predict({mat}, options);
+					warmed_up = true;
+				}
+
+				const auto predict_start = std::chrono::high_resolution_clock::now();
+				model.predict({mat}, options, &samples);
+				const auto predict_end = std::chrono::high_resolution_clock::now();
+
+				samples["decode"].push_back(std::chrono::duration<double, std::milli>(end - start).count());
+				samples["total"	].push_back(std::chrono::duration<double, std::milli>((end - start) + (predict_end - predict_start)).count());
+			}
+		}
+
+		if (mats.empty())
+		{
+			throw std::runtime_error("none of the images could be decoded");
+		}
+
+		std::map<std::string, Stats> latency;
+		for (const auto & [stage, v] : samples)
+		{
+			latency[stage] = get_stats(v);
+		}
+
+		std::cout << std::fixed << std::setprecision(3);
+		for (const std::string stage : {"decode", "preprocess", "inference", "postprocess", "total"})
+		{
+			if (latency.count(stage))
+			{
+				const auto & stats = latency.at(stage);
+				std::cout
+					<< std::left << std::setw(12) << stage << std::right
+					<< " p50=" << std::setw(9) << stats.p50 << " ms"
+					<< " p95=" << std::setw(9) << stats.p95 << " ms"
+					<< " p99=" << std::setw(9) << stats.p99 << " ms"
+					<< " mean=" << std::setw(9) << stats.mean << " ms" << std::endl;
+			}
+		}
+
+		// 2) throughput with the images already decoded
+		std::vector<Throughput> throughput;
+		for (const size_t number_of_threads : options.threads)
+		{
+			for (const size_t batch_size : options.batches)
+			{
+				if (options.backend != "onnx" and batch_size > 1)
+				{
+					// Darknet models are always run one image at a time
+					continue;
+				}
+
+				const auto t = measure_throughput(options, mats, number_of_threads, batch_size);
+				throughput.push_back(t);
+				std::cout << "threads=" << std::setw(2) << t.threads << " batch=" << std::setw(2) << t.batch_size << " " << std::setprecision(1) << std::setw(8) << t.images_per_second << " images/second" << std::setprecision(3) << std::endl;
+			}
+		}
+
+		std::ofstream ofs(options.output);
+		if (options.format == "csv")
+		{
+			write_csv(ofs, options, latency, throughput);
+		}
+		else
+		{
+			write_json(ofs, options, latency, throughput);
+		}
+		if (ofs.fail())
+		{
+			throw std::runtime_error("failed to write " + options.output);
+		}
+		std::cout << "results saved to " << options.output << std::endl;
+
+		rc = 0;
+	}
+	catch (const std::exception & e)
+	{
+		std::cout << "ERROR: " << e.what() << std::endl;
+		rc = 1;
+	}
+
+	return rc;
+}
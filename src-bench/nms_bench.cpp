@@ -0,0 +1,192 @@
+// DarkMark (C) 2019-2026 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+#include "OnnxHelp.hpp"
+#include <functional>
+#include <iomanip>
+
+
+/* Measure the cost of the ONNX post-processing NMS in OnnxHelp::NMS against a single call to cv::dnn::NMSBoxes() across
+ * all classes, which is what OnnxHelp::NN used to do.  The detections are synthetic:  dense clusters of jittered boxes,
+ * similar to what DETR-style models and tiled images produce.
+ */
+
+
+namespace
+{
+	/// Create clusters of overlapping boxes spread across a 1920x1080 image.
+	OnnxHelp::PredictionResults synthetic_detections(const size_t count, const int number_of_classes, std::mt19937 & rng)
+	{
+		std::uniform_int_distribution<int> x_dist(0, 1800);
+		std::uniform_int_distribution<int> y_dist(0, 960);
+		std::uniform_int_distribution<int> size_dist(20, 120);
+		std::uniform_int_distribution<int> jitter_dist(-8, 8);
+		std::uniform_int_distribution<int> class_dist(0, number_of_classes - 1);
+		std::uniform_real_distribution<float> score_dist(0.01f, 1.0f);
+
+		OnnxHelp::PredictionResults results;
+		results.reserve(count);
+
+		// each object is seen several times with slightly different boxes, and sometimes with a different class
+		while (results.size() < count)
+		{
+			const cv::Rect object(x_dist(rng), y_dist(rng), size_dist(rng), size_dist(rng));
+			const int class_idx = class_dist(rng);
+			for (int i = 0; i < 6 and results.size() < count; i ++)
+			{
+				OnnxHelp::PredictionResult res;
+				res.rect = cv::Rect(object.x + jitter_dist(rng), object.y + jitter_dist(rng), object.width + jitter_dist(rng), object.height + jitter_dist(rng));
+				res.probability = score_dist(rng);
+				res.class_idx = (i % 3 == 2 ? class_dist(rng) : class_idx);
+				results.push_back(res);
+			}
+		}
+
+		return results;
+	}
+
+
+	/// The original post-processing:  one call to NMSBoxes() across all classes.
+	std::vector<int> reference_nms(const OnnxHelp::PredictionResults & candidates, const float conf_threshold, const float nms_threshold)
+	{
+		std::vector<cv::Rect> boxes;
+		std::vector<float> scores;
+		for (const auto & candidate : candidates)
+		{
+			boxes.push_back(candidate.rect);
+			scores.push_back(candidate.probability);
+		}
+
+		std::vector<int> indexes;
+		cv::dnn::NMSBoxes(boxes, scores, conf_threshold, nms_threshold, indexes);
+
+		return indexes;
+	}
+
+
+	/// Run the function the requested number of times and return the average time in microseconds.
+	double time_it(const size_t iterations, std::function<void()> f)
+	{
+		// warm up (allocate buffers, load code into cache, etc)
+		f();
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < iterations; i ++)
+		{
+			f();
+		}
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+	}
+}
+
+
+int main(int argc, char * argv[])
+{
+	int rc = 1;
+
+	try
+	{
+		size_t iterations		= 200;
+		int number_of_classes	= 80;
+		float conf_threshold	= 0.05f;
+		float nms_threshold		= 0.45f;
+
+		for (int i = 1; i < argc; i ++)
+		{
+			const std::string arg = argv[i];
+			if (arg == "-h" or arg == "--help")
+			{
+				std::cout
+					<< "Measure the time needed to apply NMS to ONNX detections." << std::endl
+					<< "" << std::endl
+					<< "Usage:" << std::endl
+					<< "" << std::endl
+					<< "\t" << argv[0] << " [iterations=" << iterations << "] [classes=" << number_of_classes << "] [conf=" << conf_threshold << "] [nms=" << nms_threshold << "]" << std::endl;
+				return 0;
+			}
+			else if (arg.find("iterations=") == 0)
+			{
+				iterations = std::max(1, std::stoi(arg.substr(11)));
+			}
+			else if (arg.find("classes=") == 0)
+			{
+				number_of_classes = std::max(1, std::stoi(arg.substr(8)));
+			}
+			else if (arg.find("conf=") == 0)
+			{
+				conf_threshold = std::stof(arg.substr(5));
+			}
+			else if (arg.find("nms=") == 0)
+			{
+				nms_threshold = std::stof(arg.substr(4));
+			}
+			else
+			{
+				throw std::invalid_argument("unknown argument " + arg);
+			}
+		}
+
+		std::cout << "iterations: " << iterations << ", classes: " << number_of_classes << ", conf: " << conf_threshold << ", nms: " << nms_threshold << std::endl;
+
+		std::mt19937 rng(1234);
+		OnnxHelp::NMS agnostic(false, 0);
+		OnnxHelp::NMS class_aware(true, 0);
+		OnnxHelp::NMS class_aware_top_k(true, 1000);
+
+		rc = 0;
+		for (const size_t count : {100, 300, 1000, 3000, 10000})
+		{
+			const auto candidates = synthetic_detections(count, number_of_classes, rng);
+
+			std::vector<int> reference;
+			const double reference_us = time_it(iterations, [&]
+			{
+				reference = reference_nms(candidates, conf_threshold, nms_threshold);
+			});
+
+			std::vector<size_t> agnostic_kept;
+			const double agnostic_us = time_it(iterations, [&]
+			{
+				agnostic_kept = agnostic.run(candidates, conf_threshold, nms_threshold);
+			});
+
+			std::vector<size_t> class_aware_kept;
+			const double class_aware_us = time_it(iterations, [&]
+			{
+				class_aware_kept = class_aware.run(candidates, conf_threshold, nms_threshold);
+			});
+
+			std::vector<size_t> top_k_kept;
+			const double top_k_us = time_it(iterations, [&]
+			{
+				top_k_kept = class_aware_top_k.run(candidates, conf_threshold, nms_threshold);
+			});
+
+			// when it isn't class-aware, the new code must give exactly the same results as NMSBoxes()
+			const bool identical = (std::vector<size_t>(reference.begin(), reference.end()) == agnostic_kept);
+			if (not identical)
+			{
+				rc = 2;
+			}
+
+			std::cout
+				<< std::right << std::fixed << std::setprecision(1)
+				<< "candidates=" << std::setw(5) << count
+				<< " NMSBoxes=" << std::setw(9) << reference_us << " us (" << std::setw(4) << reference.size() << " kept)"
+				<< " agnostic=" << std::setw(9) << agnostic_us << " us"
+				<< " class-aware=" << std::setw(9) << class_aware_us << " us (" << std::setw(4) << class_aware_kept.size() << " kept)"
+				<< " top-k=" << std::setw(9) << top_k_us << " us (" << std::setw(4) << top_k_kept.size() << " kept)"
+				<< (identical ? "" : " MISMATCH")
+				<< std::endl;
+		}
+	}
+	catch (const std::exception & e)
+	{
+		std::cout << "ERROR: " << e.what() << std::endl;
+		rc = 1;
+	}
+
+	return rc;
+}
@@ -0,0 +1,185 @@
+// DarkMark (C) 2019-2026 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+#include "OnnxHelp.hpp"
+#include <functional>
+#include <iomanip>
+#include <cmath>
+
+
+/* Compare the ONNX preprocessing in OnnxHelp::NN::blob_from_image() against the original implementation, which built a
+ * letterboxed 8-bit image and then copied it to the input tensor one pixel at a time.
+ */
+
+
+namespace
+{
+	/// The original preprocessing, kept here as the baseline.
+	void reference_blob_from_image(const cv::Mat & image, const cv::Size & input_size, const OnnxHelp::PreprocessConfig & config, float * blob)
+	{
+		cv::Mat mat_rs;
+		if (config.maintain_aspect_ratio)
+		{
+			mat_rs = cv::Mat(input_size.height, input_size.width, CV_8UC3, cv::Scalar(114, 114, 114));
+
+			const float ratio = std::min((float)input_size.width / (float)image.cols, (float)input_size.height / (float)image.rows);
+			const int new_unpad_w = static_cast<int>((float)image.cols * ratio);
+			const int new_unpad_h = static_cast<int>((float)image.rows * ratio);
+
+			cv::Mat new_unpad_mat;
+			cv::resize(image, new_unpad_mat, cv::Size(new_unpad_w, new_unpad_h));
+			new_unpad_mat.copyTo(mat_rs(cv::Rect(0, 0, new_unpad_w, new_unpad_h)));
+		}
+		else
+		{
+			cv::resize(image, mat_rs, input_size);
+		}
+
+		const int plane_size = input_size.width * input_size.height;
+		for (int i = 0; i < input_size.height; i++)
+		{
+			for (int j = 0; j < input_size.width; j++)
+			{
+				const cv::Vec3b & pixel = mat_rs.at<cv::Vec3b>(i, j);
+				for (int c = 0; c < 3; c++)
+				{
+					const int plane_idx = config.bgr_to_rgb ? 2 - c : c;
+					blob[plane_idx * plane_size + i * input_size.width + j] = pixel[c] * config.scale_factor;
+				}
+			}
+		}
+
+		return;
+	}
+
+
+	/// Run the function the requested number of times and return the average time in milliseconds.
+	double time_it(const size_t iterations, std::function<void()> f)
+	{
+		// warm up (allocate buffers, load code into cache, etc)
+		f();
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < iterations; i ++)
+		{
+			f();
+		}
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+	}
+}
+
+
+int main(int argc, char * argv[])
+{
+	int rc = 1;
+
+	try
+	{
+		std::string filename;
+		size_t iterations = 50;
+
+		for (int i = 1; i < argc; i ++)
+		{
+			const std::string arg = argv[i];
+			if (arg == "-h" or arg == "--help")
+			{
+				std::cout
+					<< "Measure the time needed to convert an image to an ONNX input tensor." << std::endl
+					<< "" << std::endl
+					<< "Usage:" << std::endl
+					<< "" << std::endl
+					<< "\t" << argv[0] << " [iterations=" << iterations << "] [image.jpg]" << std::endl
+					<< "" << std::endl
+					<< "If no image is specified, a random 1920x1080 image is used." << std::endl;
+				return 0;
+			}
+			else if (arg.find("iterations=") == 0)
+			{
+				iterations = std::max(1, std::stoi(arg.substr(11)));
+			}
+			else
+			{
+				filename = arg;
+			}
+		}
+
+		cv::Mat image;
+		if (filename.empty())
+		{
+			image = cv::Mat(1080, 1920, CV_8UC3);
+			cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+		}
+		else
+		{
+			image = cv::imread(filename);
+			if (image.empty())
+			{
+				throw std::invalid_argument("failed to read image " + filename);
+			}
+		}
+
+		std::cout << "image: " << image.cols << "x" << image.rows << ", iterations: " << iterations << ", threads: " << cv::getNumThreads() << std::endl;
+
+		const std::vector<std::pair<std::string, OnnxHelp::PreprocessConfig>> presets =
+		{
+			{"yolox", OnnxHelp::PreprocessConfig::yolox()},
+			{"dfine", OnnxHelp::PreprocessConfig::dfine()},
+		};
+
+		rc = 0;
+		for (const auto & [name, config] : presets)
+		{
+			for (const int dimension : {640, 1280})
+			{
+				const cv::Size input_size(dimension, dimension);
+				std::vector<float> expected(3 * input_size.area());
+				std::vector<float> actual(3 * input_size.area());
+
+				const double reference_ms = time_it(iterations, [&]
+				{
+					reference_blob_from_image(image, input_size, config, expected.data());
+				});
+
+				const double fused_ms = time_it(iterations, [&]
+				{
+					float scale_x = 0.0f;
+					float scale_y = 0.0f;
+					OnnxHelp::NN::blob_from_image(image, input_size, config, actual.data(), scale_x, scale_y);
+				});
+
+				float max_difference = 0.0f;
+				for (size_t i = 0; i < expected.size(); i ++)
+				{
+					max_difference = std::max(max_difference, std::abs(expected[i] - actual[i]));
+				}
+
+				// the only difference should be floating point rounding
+				const bool identical = (max_difference <= 1e-4f * std::max(1.0f, 255.0f * config.scale_factor));
+				if (not identical)
+				{
+					rc = 2;
+				}
+
+				std::cout
+					<< std::left << std::setw(6) << name
+					<< " " << std::setw(9) << (std::to_string(dimension) + "x" + std::to_string(dimension))
+					<< std::right << std::fixed << std::setprecision(3)
+					<< " reference=" << std::setw(8) << reference_ms << " ms"
+					<< " fused=" << std::setw(8) << fused_ms << " ms"
+					<< " speedup=" << std::setprecision(1) << std::setw(5) << (reference_ms / fused_ms) << "x"
+					<< " max_difference=" << std::setprecision(6) << max_difference
+					<< (identical ? "" : " MISMATCH")
+					<< std::endl;
+			}
+		}
+	}
+	catch (const std::exception & e)
+	{
+		std::cout << "ERROR: " << e.what() << std::endl;
+		rc = 1;
+	}
+
+	return rc;
+}
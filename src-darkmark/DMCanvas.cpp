@@ -3,10 +3,96 @@
 #include "DarkMark.hpp"
 
 
+namespace
+{
+	//						blue   green red
+	const cv::Scalar black	(0x00, 0x00, 0x00);
+	const cv::Scalar white	(0xff, 0xff, 0xff);
+
+	const auto fontface			= cv::FONT_HERSHEY_PLAIN;
+	const auto fontscale		= 1.0;
+	const auto fontthickness	= 1;
+}
+
+
+dm::OverlayMark::OverlayMark() :
+	thickness(1),
+	alpha(1.0),
+	shade_alpha(0.0),
+	draw_dot(false),
+	draw_x(false),
+	corner_size(0)
+{
+	return;
+}
+
+
+cv::Rect dm::OverlayMark::area() const
+{
+	// everything drawn for a mark is clipped to the mark itself, except for the label
+	cv::Rect r = rect;
+	r |= label_rect;
+
+	return r;
+}
+
+
+bool dm::OverlayMark::operator==(const OverlayMark & rhs) const
+{
+	return
+		rect		== rhs.rect			and
+		label_rect	== rhs.label_rect	and
+		label		== rhs.label		and
+		colour		== rhs.colour		and
+		thickness	== rhs.thickness	and
+		alpha		== rhs.alpha		and
+		shade_alpha	== rhs.shade_alpha	and
+		draw_dot	== rhs.draw_dot		and
+		draw_x		== rhs.draw_x		and
+		corner_size	== rhs.corner_size;
+}
+
+
+bool dm::OverlayMark::operator!=(const OverlayMark & rhs) const
+{
+	return not operator==(rhs);
+}
+
+
+cv::Rect dm::OverlayText::area() const
+{
+	cv::Rect r;
+	for (size_t idx = 0; idx < lines.size(); idx ++)
+	{
+		int baseline = 0;
+		const auto text_size = cv::getTextSize(lines[idx], fontface, fontscale, fontthickness, &baseline);
+		const cv::Point p = origin + cv::Point(10, 25 + 15 * static_cast<int>(idx));
+
+		// add a few pixels all around to account for anti-aliasing
+		r |= cv::Rect(p.x - 2, p.y - text_size.height - 2, text_size.width + 4, text_size.height + baseline + 4);
+	}
+
+	return r;
+}
+
+
+bool dm::OverlayText::operator==(const OverlayText & rhs) const
+{
+	return origin == rhs.origin and lines == rhs.lines;
+}
+
+
+bool dm::OverlayText::operator!=(const OverlayText & rhs) const
+{
+	return not operator==(rhs);
+}
+
+
 dm::DMCanvas::DMCanvas(DMContent & c) :
 	CrosshairComponent(c),
 	content(c),
 	is_panning(false),
+	render_entire_image(false),
 	mark_was_selected_for_merge(false),
 	mark_original_selection_position(-1),
 	resized_mark_class_idx(-1)
@@ -32,10 +118,6 @@ void dm::DMCanvas::rebuild_cache_image()
 {
 	//	Log("redrawing layers...");
 
-	//						blue   green red
-	const cv::Scalar black	(0x00, 0x00, 0x00);
-	const cv::Scalar white	(0xff, 0xff, 0xff);
-
 	if (content.images_are_loading or content.original_image.empty())
 	{
 		// nothing we can do
@@ -50,49 +132,15 @@ void dm::DMCanvas::rebuild_cache_image()
 		);
 #endif
 
-	cv::Mat image_to_use;
-
-	if (content.black_and_white_mode_enabled)
-	{
-		content.create_threshold_image();
-
-		image_to_use = content.black_and_white_image;
-	}
-	else
-	{
-		image_to_use = content.original_image;
-	}
-
-	if (image_to_use.size() != content.scaled_image_size)
-	{
-		content.scaled_image = DarkHelp::resize_keeping_aspect_ratio(image_to_use, content.scaled_image_size);
-	}
-	else
-	{
-		content.scaled_image = image_to_use.clone();
-	}
-
-	if (content.heatmap_enabled and not content.heatmap_image.empty())
-	{
-		cv::Mat heatmap = DarkHelp::fast_resize_ignore_aspect_ratio(content.heatmap_image, content.scaled_image.size());
-
-		if (content.heatmap_visualize < 0)
-		{
-			cv::cvtColor(heatmap, heatmap, cv::COLOR_GRAY2BGR);
-		}
-		else
-		{
-			cv::applyColorMap(heatmap, heatmap, content.heatmap_visualize);
-		}
-
-		const double alpha = 1.0 - content.heatmap_alpha_blend;
-		const double beta = 1.0 - alpha;
-		cv::addWeighted(content.scaled_image, alpha, heatmap, beta, 0, content.scaled_image);
-	}
+	/* The image is drawn in 2 layers.  The base layer is the scaled image with the optional heatmap or black-and-white
+	 * mode, which only needs to be rebuilt when the image, the zoom, or one of those modes changes.  The marks and text
+	 * are then drawn on top of a copy of the base layer.  When only a few marks have changed -- such as when the user is
+	 * dragging the corner of a mark -- only the areas around those marks are restored from the base layer and redrawn.
+	 */
+	const bool base_layer_was_rebuilt = rebuild_base_layer();
 
-	const auto fontface			= cv::FONT_HERSHEY_PLAIN;
-	const auto fontscale		= 1.0;
-	const auto fontthickness	= 1;
+	// this is the size of the entire scaled image, even if only a portion of it was rendered
+	const cv::Size & full_size = base_layer.full_size;
 
 	content.marks_are_shown			= content.show_marks;
 	content.predictions_are_shown	= content.show_predictions != EToggle::kOff;
@@ -139,6 +187,10 @@ void dm::DMCanvas::rebuild_cache_image()
 		content.marks_are_shown = false;
 	}
 
+	// figure out exactly what needs to be drawn for each mark, but don't draw anything yet
+	std::vector<OverlayMark> overlay;
+	overlay.reserve(content.marks.size());
+
 	bool must_exit_loop = false;
 	for (size_t idx = 0; must_exit_loop == false and (content.image_is_completely_empty or idx < content.marks.size()); idx ++)
 	{
@@ -172,66 +224,38 @@ void dm::DMCanvas::rebuild_cache_image()
 		const bool is_selected_for_merge = content.multi_bbox_mode and 
 			std::find(content.selected_marks_for_merge.begin(), content.selected_marks_for_merge.end(), static_cast<int>(idx)) != content.selected_marks_for_merge.end();
 		const std::string name	= m.description;
-		const cv::Rect r		= m.get_bounding_rect(content.scaled_image.size());
+		const cv::Rect r		= m.get_bounding_rect(full_size);
 		
 		// Skip marks with invalid bounding rectangles
 		if (r.width <= 0 || r.height <= 0 ||
 			r.x < 0 || r.y < 0 ||
-			r.x + r.width > content.scaled_image.cols ||
-			r.y + r.height > content.scaled_image.rows)
+			r.x + r.width > full_size.width ||
+			r.y + r.height > full_size.height)
 		{
 			continue;
 		}
 		
-		cv::Scalar colour		= m.get_colour();
-		int thickness			= (mouse_drag_is_active == false and (is_selected or content.all_marks_are_bold) ? 2 : 1);
+		OverlayMark om;
+		om.rect			= r;
+		om.colour		= m.get_colour();
+		om.thickness	= (mouse_drag_is_active == false and (is_selected or content.all_marks_are_bold) ? 2 : 1);
 		
 		// Highlight selected marks for merge in multi-bbox mode
 		if (is_selected_for_merge)
 		{
-			colour = cv::Scalar(0, 80, 255); // Bright orange color for selected marks (not in class palette)
-			thickness = 3; // Thicker border for selected marks
+			om.colour = cv::Scalar(0, 80, 255); // Bright orange color for selected marks (not in class palette)
+			om.thickness = 3; // Thicker border for selected marks
 		}
 
-		cv::Mat tmp = content.scaled_image(r).clone();
-
-		if (content.shade_rectangles and not content.show_dots)
-		{
-			const double shade_divider = (is_selected ? 4.0 : 2.0);
-			cv::rectangle(tmp, cv::Rect(0, 0, tmp.cols, tmp.rows), colour, CV_FILLED);
-			const double alpha = content.alpha_blend_percentage / shade_divider;
-			const double beta = 1.0 - alpha;
-			cv::addWeighted(tmp, alpha, content.scaled_image(r), beta, 0, tmp);
-		}
-
-		if (is_selected or content.show_dots == false)
-		{
-			cv::rectangle(tmp, cv::Rect(0, 0, tmp.cols, tmp.rows), colour, thickness, cv::LINE_8);
-		}
-		else
-		{
-			cv::circle(tmp, {tmp.cols/2, tmp.rows/2}, 10 * thickness, colour, cv::FILLED, cv::LINE_8);
-		}
-
-		if (m.is_prediction)
-		{
-			// draw an "X" through the middle of the rectangle
-			cv::line(tmp, cv::Point(0, 0), cv::Point(tmp.cols, tmp.rows), colour, 1, cv::LINE_8);
-			cv::line(tmp, cv::Point(0, tmp.rows), cv::Point(tmp.cols, 0), colour, 1, cv::LINE_8);
-		}
-
-		const double alpha = (mouse_drag_is_active == false and (is_selected or content.all_marks_are_bold) ? 1.0 : content.alpha_blend_percentage);
-		const double beta = 1.0 - alpha;
-		cv::addWeighted(tmp, alpha, content.scaled_image(r), beta, 0, content.scaled_image(r));
+		om.alpha		= (mouse_drag_is_active == false and (is_selected or content.all_marks_are_bold) ? 1.0 : content.alpha_blend_percentage);
+		om.shade_alpha	= (content.shade_rectangles and not content.show_dots ? content.alpha_blend_percentage / (is_selected ? 4.0 : 2.0) : 0.0);
+		om.draw_dot		= (is_selected == false and content.show_dots);
+		om.draw_x		= m.is_prediction;
 
 		// draw the drag corners (only if the annotation is large enough to accommodate them)
-		if (mouse_drag_is_active == false and is_selected and tmp.cols > content.corner_size * 2 and tmp.rows > content.corner_size * 2)
+		if (mouse_drag_is_active == false and is_selected and r.width > content.corner_size * 2 and r.height > content.corner_size * 2)
 		{
-			tmp = content.scaled_image(r);
-			cv::circle(tmp, cv::Point(0				, 0				), content.corner_size, colour, CV_FILLED, cv::LINE_AA);
-			cv::circle(tmp, cv::Point(tmp.cols - 1	, 0				), content.corner_size, colour, CV_FILLED, cv::LINE_AA);
-			cv::circle(tmp, cv::Point(tmp.cols - 1	, tmp.rows - 1	), content.corner_size, colour, CV_FILLED, cv::LINE_AA);
-			cv::circle(tmp, cv::Point(0				, tmp.rows - 1	), content.corner_size, colour, CV_FILLED, cv::LINE_AA);
+			om.corner_size = content.corner_size;
 		}
 
 		// We calculate the width and height of the text compared to the mark rectangle to determine if the label
@@ -246,8 +270,8 @@ void dm::DMCanvas::rebuild_cache_image()
 				(content.show_labels == EToggle::kOn	or
 				(content.show_labels == EToggle::kAuto	and
 					(is_selected or
-						(	text_size.width		<= tmp.cols and
-							text_size.height	<= tmp.rows
+						(	text_size.width		<= r.width and
+							text_size.height	<= r.height
 						)
 					)
 				)))
@@ -258,14 +282,14 @@ void dm::DMCanvas::rebuild_cache_image()
 			// Rectangle for the label needs the TL and BR coordinates.
 			// But putText() needs the BL point where to start writing the text, and we want to add a 1x1 pixel border
 			cv::Rect text_rect = cv::Rect(x_offset + r.x, r.y, text_size.width + 2, text_size.height + baseline + 2);
-			if (is_selected or content.all_marks_are_bold or text_rect.br().y >= content.scaled_image.rows)
+			if (is_selected or content.all_marks_are_bold or text_rect.br().y >= full_size.height)
 			{
 				// move the text label above the rectangle
 				text_rect.y = r.y - text_size.height - baseline;
 			}
 
 #if 0
-			Log("scaled image cols=" + std::to_string(content.scaled_image.cols) + " rows=" + std::to_string(content.scaled_image.rows));
+			Log("scaled image cols=" + std::to_string(full_size.width) + " rows=" + std::to_string(full_size.height));
 			Log("text size for " + name + ": w=" + std::to_string(text_size.width) + " h=" + std::to_string(text_size.height) + " baseline=" + std::to_string(baseline));
 			Log("mark rectangle:  "
 				" x=" + std::to_string(r.x) +
@@ -280,15 +304,15 @@ void dm::DMCanvas::rebuild_cache_image()
 #endif
 			// check to see if the label is going to be off-screen, and if so slide it to a better position
 			if (text_rect.x < 0) text_rect.x = r.x;				// first attempt to fix this is to make it left-aligned
-			if (text_rect.x + text_rect.width >= content.scaled_image.cols)	text_rect.x = content.scaled_image.cols - text_rect.width;
+			if (text_rect.x + text_rect.width >= full_size.width)	text_rect.x = full_size.width - text_rect.width;
 			if (text_rect.x < 0) text_rect.x = 0;				// ...and if that didn't work, slide it to the left edge
-			if (text_rect.x + text_rect.width >= content.scaled_image.cols) text_rect.width = content.scaled_image.cols - text_rect.x;
+			if (text_rect.x + text_rect.width >= full_size.width) text_rect.width = full_size.width - text_rect.x;
 
 			if (text_rect.y < 0) text_rect.y = r.y + r.height;	// vertically, we need to place the label underneath instead of above
 
 			// if the mark is from the top of the image to the bottom of the image, then we still haven't
 			// found a good place to put the label, in which case we'll move it to a spot inside the mark
-			if (text_rect.y + r.height >= content.scaled_image.rows) text_rect.y = r.y + 2;
+			if (text_rect.y + r.height >= full_size.height) text_rect.y = r.y + 2;
 
 #if 0
 			Log("text_rect after: "
@@ -298,125 +322,488 @@ void dm::DMCanvas::rebuild_cache_image()
 				" h=" + std::to_string(text_rect.height));
 #endif
 
-			tmp = cv::Mat(text_rect.size(), CV_8UC3, colour);
-			cv::putText(tmp, name, cv::Point(1, tmp.rows - 5), fontface, fontscale, black, fontthickness, cv::LINE_AA);
-			cv::addWeighted(tmp, alpha, content.scaled_image(text_rect), beta, 0, content.scaled_image(text_rect));
+			om.label		= name;
+			om.label_rect	= text_rect;
 		}
+
+		overlay.push_back(om);
 	}
 
-	if (content.user_specified_zoom_factor <= 0.0)
+	// the text is drawn in the top-left corner of the canvas, meaning it moves with the zoom image offset
+	OverlayText text;
+	text.origin = zoom_image_offset;
+	if (content.predictions_are_shown and content.show_processing_time and content.darknet_image_processing_time.empty() == false)
 	{
-		zoom_image_offset = cv::Point(0, 0);
+		text.lines.push_back(content.darknet_image_processing_time);
+		text.lines.push_back("predictions: " + std::to_string(content.number_of_predictions));
+		if (number_of_hidden_marks)
+		{
+			text.lines.push_back("user marks: " + std::to_string(number_of_hidden_marks));
+		}
+	}
+
+	if (content.user_specified_zoom_factor > 0.0)
+	{
+		const int percentage = std::round(content.user_specified_zoom_factor * 100.0);
+		text.lines.push_back("zoom: " + std::to_string(percentage) + "%");
+	}
+
+	// now figure out which areas of the image need to be redrawn
+
+	const cv::Rect & rendered_rect = base_layer.rect;
+
+	bool redraw_everything =
+		base_layer_was_rebuilt											or
+		cached_image.isNull()											or
+		cached_image.getWidth()		!= content.scaled_image.cols		or
+		cached_image.getHeight()	!= content.scaled_image.rows		or
+		content.scaled_image.size()	!= base_layer.image.size();
+
+	std::vector<cv::Rect> dirty_rects;
+	if (redraw_everything == false)
+	{
+		for (size_t idx = 0; idx < std::max(overlay.size(), previous_overlay.size()); idx ++)
+		{
+			if (idx >= previous_overlay.size())
+			{
+				dirty_rects.push_back(overlay[idx].area());
+			}
+			else if (idx >= overlay.size())
+			{
+				dirty_rects.push_back(previous_overlay[idx].area());
+			}
+			else if (overlay[idx] != previous_overlay[idx])
+			{
+				// both the old and the new location need to be redrawn
+				dirty_rects.push_back(previous_overlay[idx].area());
+				dirty_rects.push_back(overlay[idx].area());
+			}
+		}
+
+		if (text != previous_text)
+		{
+			dirty_rects.push_back(previous_text.area());
+			dirty_rects.push_back(text.area());
+		}
+
+		dirty_rects = merge_dirty_rects(dirty_rects, rendered_rect);
+
+		size_t dirty_area = 0;
+		for (const auto & r : dirty_rects)
+		{
+			dirty_area += r.area();
+		}
+
+		if (dirty_area * 2 >= static_cast<size_t>(rendered_rect.area()))
+		{
+			// so much has changed that it is simpler to redraw the entire image
+			redraw_everything = true;
+		}
+	}
+
+	if (redraw_everything)
+	{
+		// the marks are drawn on a copy of the base layer (this re-uses the existing buffer when the size has not changed)
+		base_layer.image.copyTo(content.scaled_image);
+		dirty_rects = {rendered_rect};
 	}
 	else
 	{
-		// figure out what zoom offset we need to apply to the image
+		// restore the dirty areas from the base layer
+		for (const auto & dirty : dirty_rects)
+		{
+			base_layer.image(dirty - rendered_rect.tl()).copyTo(content.scaled_image(dirty - rendered_rect.tl()));
+		}
+	}
 
-		const int h = content.canvas.getHeight();
-		const int w = content.canvas.getWidth();
+	for (const auto & dirty : dirty_rects)
+	{
+		// draw everything which overlaps this area, in the same order as when the entire image is drawn
+		for (const auto & om : overlay)
+		{
+			if ((om.area() & dirty).area() > 0)
+			{
+				draw_overlay_mark(om, dirty);
+			}
+		}
+
+		if ((text.area() & dirty).area() > 0)
+		{
+			draw_overlay_text(text, dirty);
+		}
+	}
+
+	if (redraw_everything)
+	{
+		cached_image = convert_opencv_mat_to_juce_image(content.scaled_image);
+	}
+	else
+	{
+		for (const auto & dirty : dirty_rects)
+		{
+			copy_opencv_mat_to_juce_image(content.scaled_image, cached_image, dirty - rendered_rect.tl());
+		}
+	}
 
 #if 0
-		Log(std::string(__PRETTY_FUNCTION__) + ": need to find a RoI because we're zooming " + std::to_string(content.user_specified_zoom_factor) +
-			", original image measures " +
-			std::to_string(content.original_image.cols) +
-			" x " +
-			std::to_string(content.original_image.rows) +
-			", scaled image measures " +
-			std::to_string(content.scaled_image.cols) +
-			" x " +
-			std::to_string(content.scaled_image.rows) +
-			" canvas measures"
-			" w=" + std::to_string(w) +
-			" h=" + std::to_string(h)
-			);
+	Log("rebuild_cache_image: base=" + std::string(base_layer_was_rebuilt ? "rebuilt" : "cached") +
+		" marks=" + std::to_string(overlay.size()) +
+		" dirty=" + (redraw_everything ? std::string("everything") : std::to_string(dirty_rects.size())));
 #endif
 
-		const int anchor_x = (content.zoom_viewport_anchor.x >= 0 ? content.zoom_viewport_anchor.x : (w / 2));
-		const int anchor_y = (content.zoom_viewport_anchor.y >= 0 ? content.zoom_viewport_anchor.y : (h / 2));
+	previous_overlay.swap(overlay);
+	previous_text = text;
+	need_to_rebuild_cache_image = false;
+
+	return;
+}
+
+
+bool dm::DMCanvas::rebuild_base_layer()
+{
+	cv::Mat image_to_use;
+
+	if (content.black_and_white_mode_enabled)
+	{
+		content.create_threshold_image();
 
-		cv::Rect r(
-			std::round(content.user_specified_zoom_factor * content.zoom_point_of_interest.x - anchor_x),
-			std::round(content.user_specified_zoom_factor * content.zoom_point_of_interest.y - anchor_y),
-			w, h);
+		image_to_use = content.black_and_white_image;
+	}
+	else
+	{
+		image_to_use = content.original_image;
+	}
+
+	cv::Mat heatmap_to_use;
+	if (content.heatmap_enabled and not content.heatmap_image.empty())
+	{
+		heatmap_to_use = content.heatmap_image;
+	}
+
+	// figure out which portion of the scaled image will be visible on the screen
+	const cv::Rect viewport = find_viewport(content.scaled_image_size);
+
+	/* When zoomed in, the scaled image can be many times larger than the canvas.  Rather than resizing the entire image
+	 * and then drawing all the marks onto a huge buffer only to display a small portion of it, only the visible portion
+	 * of the image is resampled.  This way memory and redraw time depend on the window size, not on the zoom level.
+	 */
+	const bool render_viewport_only =
+		render_entire_image == false						and
+		content.user_specified_zoom_factor > 0.0			and
+		viewport.size() != content.scaled_image_size;
+
+	// Since the base layer keeps a reference to the source images, their buffers cannot be released and re-used for a
+	// different image, so comparing the data pointers is enough to know whether the image has changed.
+	const bool base_layer_is_valid =
+		base_layer.image.empty()		== false						and
+		base_layer.source.data			== image_to_use.data			and
+		base_layer.source.size()		== image_to_use.size()			and
+		base_layer.heatmap.data			== heatmap_to_use.data			and
+		base_layer.scaled_size			== content.scaled_image_size	and
+		base_layer.heatmap_alpha		== content.heatmap_alpha_blend	and
+		base_layer.heatmap_visualize	== content.heatmap_visualize	and
+		(render_viewport_only
+			? (base_layer.entire_image == false and (viewport & base_layer.rect) == viewport)
+			: base_layer.entire_image);
+
+	if (base_layer_is_valid)
+	{
+		return false;
+	}
+
+	base_layer.source				= image_to_use;
+	base_layer.heatmap				= heatmap_to_use;
+	base_layer.scaled_size			= content.scaled_image_size;
+	base_layer.heatmap_alpha		= content.heatmap_alpha_blend;
+	base_layer.heatmap_visualize	= content.heatmap_visualize;
+	base_layer.entire_image			= not render_viewport_only;
+	base_layer.full_size			= content.scaled_image_size;
+
+	if (render_viewport_only)
+	{
+		// include a margin around the viewport so the user can pan a short distance before the image must be rebuilt
+		const int margin_x = viewport.width		/ 2;
+		const int margin_y = viewport.height	/ 2;
+		const cv::Rect r = cv::Rect(viewport.x - margin_x, viewport.y - margin_y, viewport.width + 2 * margin_x, viewport.height + 2 * margin_y) & cv::Rect(cv::Point(0, 0), base_layer.full_size);
+
+		base_layer.image = resample_viewport(image_to_use, r);
+		base_layer.rect = r;
+	}
+	else
+	{
+		if (image_to_use.size() != content.scaled_image_size)
+		{
+			base_layer.image = DarkHelp::resize_keeping_aspect_ratio(image_to_use, content.scaled_image_size);
+		}
+		else
+		{
+			base_layer.image = image_to_use.clone();
+		}
+		base_layer.full_size = base_layer.image.size();
+		base_layer.rect = cv::Rect(cv::Point(0, 0), base_layer.full_size);
+	}
 
-		if (r.width < std::min(content.scaled_image.cols, w))
+	if (heatmap_to_use.empty() == false)
+	{
+		cv::Mat heatmap;
+		if (render_viewport_only)
 		{
-			// our rectangle can be made wider to include more of the image
-			const double delta = (std::min(content.scaled_image.cols, w) - r.width) / 2.0;
-			r.x -= delta;
-			r.width += std::round(delta * 2.0);
+			heatmap = resample_viewport(heatmap_to_use, base_layer.rect, cv::INTER_NEAREST);
 		}
-		if (r.height < std::min(content.scaled_image.rows, h))
+		else
 		{
-			const double delta = (std::min(content.scaled_image.rows, h) - r.height) / 2.0;
-			r.y -= delta;
-			r.height += std::round(delta * 2.0);
+			heatmap = DarkHelp::fast_resize_ignore_aspect_ratio(heatmap_to_use, base_layer.image.size());
 		}
-		if (r.x < 0)
+
+		if (content.heatmap_visualize < 0)
 		{
-			r.width -= r.x;
-			r.x = 0;
+			cv::cvtColor(heatmap, heatmap, cv::COLOR_GRAY2BGR);
 		}
-		if (r.y < 0)
+		else
 		{
-			r.height -= r.y;
-			r.y = 0;
+			cv::applyColorMap(heatmap, heatmap, content.heatmap_visualize);
 		}
 
-		// we now have a rectangle that would fit the canvas -- but is the image large enough to accommodate this rectangle?
+		const double alpha = 1.0 - content.heatmap_alpha_blend;
+		const double beta = 1.0 - alpha;
+		cv::addWeighted(base_layer.image, alpha, heatmap, beta, 0, base_layer.image);
+	}
+
+	cached_image_offset = base_layer.rect.tl();
+
+	return true;
+}
+
 
-		if (r.x + r.width > content.scaled_image.cols)
+void dm::DMCanvas::draw_overlay_mark(const OverlayMark & om, const cv::Rect & clip)
+{
+	const cv::Point origin = base_layer.rect.tl();
+	const cv::Rect & r = om.rect;
+
+	// Only the part of the mark which falls within the clip rectangle is drawn.  Everything drawn into "tmp" is offset by
+	// "o", the position of the mark's top-left corner relative to the visible part of the mark.
+	const cv::Rect visible = r & clip;
+	if (visible.area() > 0)
+	{
+		cv::Mat roi = content.scaled_image(visible - origin);
+		const cv::Point o = r.tl() - visible.tl();
+		cv::Mat tmp = roi.clone();
+
+		if (om.shade_alpha > 0.0)
+		{
+			cv::rectangle(tmp, cv::Rect(0, 0, tmp.cols, tmp.rows), om.colour, CV_FILLED);
+			cv::addWeighted(tmp, om.shade_alpha, roi, 1.0 - om.shade_alpha, 0, tmp);
+		}
+
+		if (om.draw_dot)
 		{
-			r.x = std::max(0, content.scaled_image.cols - r.width);
-			r.width = content.scaled_image.cols - r.x;
+			cv::circle(tmp, o + cv::Point(r.width/2, r.height/2), 10 * om.thickness, om.colour, cv::FILLED, cv::LINE_8);
 		}
-		if (r.y + r.height > content.scaled_image.rows)
+		else
 		{
-			r.y = std::max(0, content.scaled_image.rows - r.height);
-			r.height = content.scaled_image.rows - r.y;
+			cv::rectangle(tmp, cv::Rect(o.x, o.y, r.width, r.height), om.colour, om.thickness, cv::LINE_8);
 		}
 
+		if (om.draw_x)
+		{
+			// draw an "X" through the middle of the rectangle
+			cv::line(tmp, o + cv::Point(0, 0), o + cv::Point(r.width, r.height), om.colour, 1, cv::LINE_8);
+			cv::line(tmp, o + cv::Point(0, r.height), o + cv::Point(r.width, 0), om.colour, 1, cv::LINE_8);
+		}
+
+		cv::addWeighted(tmp, om.alpha, roi, 1.0 - om.alpha, 0, roi);
+
+		if (om.corner_size > 0)
+		{
+			cv::circle(roi, o + cv::Point(0				, 0				), om.corner_size, om.colour, CV_FILLED, cv::LINE_AA);
+			cv::circle(roi, o + cv::Point(r.width - 1	, 0				), om.corner_size, om.colour, CV_FILLED, cv::LINE_AA);
+			cv::circle(roi, o + cv::Point(r.width - 1	, r.height - 1	), om.corner_size, om.colour, CV_FILLED, cv::LINE_AA);
+			cv::circle(roi, o + cv::Point(0				, r.height - 1	), om.corner_size, om.colour, CV_FILLED, cv::LINE_AA);
+		}
+	}
+
+	const cv::Rect visible_text = om.label_rect & clip;
+	if (visible_text.area() > 0)
+	{
+		cv::Mat tmp = cv::Mat(om.label_rect.size(), CV_8UC3, om.colour);
+		cv::putText(tmp, om.label, cv::Point(1, tmp.rows - 5), fontface, fontscale, black, fontthickness, cv::LINE_AA);
+		cv::Mat roi = content.scaled_image(visible_text - origin);
+		cv::addWeighted(tmp(visible_text - om.label_rect.tl()), om.alpha, roi, 1.0 - om.alpha, 0, roi);
+	}
+
+	return;
+}
+
+
+void dm::DMCanvas::draw_overlay_text(const OverlayText & text, const cv::Rect & clip)
+{
+	cv::Mat roi = content.scaled_image(clip - base_layer.rect.tl());
+
+	for (size_t idx = 0; idx < text.lines.size(); idx ++)
+	{
+		const cv::Point p = text.origin + cv::Point(10, 25 + 15 * static_cast<int>(idx)) - clip.tl();
+		cv::putText(roi, text.lines[idx], p, fontface, fontscale, white, fontthickness, cv::LINE_AA);
+	}
+
+	return;
+}
+
+
+std::vector<cv::Rect> dm::DMCanvas::merge_dirty_rects(const std::vector<cv::Rect> & rects, const cv::Rect & bounds)
+{
+	std::vector<cv::Rect> merged;
+	for (const auto & r : rects)
+	{
+		const cv::Rect tmp = r & bounds;
+		if (tmp.area() > 0)
+		{
+			merged.push_back(tmp);
+		}
+	}
+
+	// keep combining overlapping rectangles until none of them overlap, otherwise areas would be drawn more than once
+	bool done = false;
+	while (not done)
+	{
+		done = true;
+		for (size_t i = 0; done and i < merged.size(); i ++)
+		{
+			for (size_t j = i + 1; j < merged.size(); j ++)
+			{
+				if ((merged[i] & merged[j]).area() > 0)
+				{
+					merged[i] |= merged[j];
+					merged.erase(merged.begin() + j);
+					done = false;
+					break;
+				}
+			}
+		}
+	}
+
+	return merged;
+}
+
+
+cv::Rect dm::DMCanvas::find_viewport(const cv::Size & full_size)
+{
+	if (content.user_specified_zoom_factor <= 0.0)
+	{
+		zoom_image_offset = cv::Point(0, 0);
+		return cv::Rect(cv::Point(0, 0), full_size);
+	}
+
+	// figure out what zoom offset we need to apply to the image
+
+	const int h = content.canvas.getHeight();
+	const int w = content.canvas.getWidth();
+
 #if 0
-		Log(std::string(__PRETTY_FUNCTION__) + ": zoom=" + std::to_string(content.user_specified_zoom_factor) +
-			" r.x=" + std::to_string(r.x) +
-			" r.y=" + std::to_string(r.y) +
-			" r.w=" + std::to_string(r.width) +
-			" r.h=" + std::to_string(r.height) +
-			" canvas.width=" + std::to_string(w) +
-			" canvas.height=" + std::to_string(h));
+	Log(std::string(__PRETTY_FUNCTION__) + ": need to find a RoI because we're zooming " + std::to_string(content.user_specified_zoom_factor) +
+		", original image measures " +
+		std::to_string(content.original_image.cols) +
+		" x " +
+		std::to_string(content.original_image.rows) +
+		", scaled image measures " +
+		std::to_string(full_size.width) +
+		" x " +
+		std::to_string(full_size.height) +
+		" canvas measures"
+		" w=" + std::to_string(w) +
+		" h=" + std::to_string(h)
+		);
 #endif
 
-		// this next line is what tells the crosshair component what portion of the image we want to show on the screen
-		zoom_image_offset = r.tl();
+	const int anchor_x = (content.zoom_viewport_anchor.x >= 0 ? content.zoom_viewport_anchor.x : (w / 2));
+	const int anchor_y = (content.zoom_viewport_anchor.y >= 0 ? content.zoom_viewport_anchor.y : (h / 2));
+
+	cv::Rect r(
+		std::round(content.user_specified_zoom_factor * content.zoom_point_of_interest.x - anchor_x),
+		std::round(content.user_specified_zoom_factor * content.zoom_point_of_interest.y - anchor_y),
+		w, h);
+
+	if (r.width < std::min(full_size.width, w))
+	{
+		// our rectangle can be made wider to include more of the image
+		const double delta = (std::min(full_size.width, w) - r.width) / 2.0;
+		r.x -= delta;
+		r.width += std::round(delta * 2.0);
+	}
+	if (r.height < std::min(full_size.height, h))
+	{
+		const double delta = (std::min(full_size.height, h) - r.height) / 2.0;
+		r.y -= delta;
+		r.height += std::round(delta * 2.0);
+	}
+	if (r.x < 0)
+	{
+		r.width -= r.x;
+		r.x = 0;
 	}
+	if (r.y < 0)
+	{
+		r.height -= r.y;
+		r.y = 0;
+	}
+
+	// we now have a rectangle that would fit the canvas -- but is the image large enough to accommodate this rectangle?
+
+	if (r.x + r.width > full_size.width)
+	{
+		r.x = std::max(0, full_size.width - r.width);
+		r.width = full_size.width - r.x;
+	}
+	if (r.y + r.height > full_size.height)
+	{
+		r.y = std::max(0, full_size.height - r.height);
+		r.height = full_size.height - r.y;
+	}
+
+#if 0
+	Log(std::string(__PRETTY_FUNCTION__) + ": zoom=" + std::to_string(content.user_specified_zoom_factor) +
+		" r.x=" + std::to_string(r.x) +
+		" r.y=" + std::to_string(r.y) +
+		" r.w=" + std::to_string(r.width) +
+		" r.h=" + std::to_string(r.height) +
+		" canvas.width=" + std::to_string(w) +
+		" canvas.height=" + std::to_string(h));
+#endif
+
+	// this next line is what tells the crosshair component what portion of the image we want to show on the screen
+	zoom_image_offset = r.tl();
 
 //	Log(std::string(__PRETTY_FUNCTION__) + ": zoom image offset: x=" + std::to_string(zoom_image_offset.x) + " y=" + std::to_string(zoom_image_offset.y));
 
-	int next_text_row = 25;
-	if (content.predictions_are_shown and content.show_processing_time and content.darknet_image_processing_time.empty() == false)
+	return r & cv::Rect(cv::Point(0, 0), full_size);
+}
+
+
+cv::Mat dm::DMCanvas::resample_viewport(const cv::Mat & mat, const cv::Rect & viewport, int interpolation)
+{
+	const double scale_x = static_cast<double>(content.scaled_image_size.width)	/ mat.cols;
+	const double scale_y = static_cast<double>(content.scaled_image_size.height)	/ mat.rows;
+
+	if (interpolation < 0)
 	{
-		cv::putText(content.scaled_image, content.darknet_image_processing_time, zoom_image_offset + cv::Point(10, next_text_row), fontface, fontscale, white, fontthickness, cv::LINE_AA);
-		next_text_row += 15;
-		cv::putText(content.scaled_image, "predictions: " + std::to_string(content.number_of_predictions), zoom_image_offset + cv::Point(10, next_text_row), fontface, fontscale, white, fontthickness, cv::LINE_AA);
-		next_text_row += 15;
-		if (number_of_hidden_marks)
+		// same choice as a normal resize:  area when shrinking, cubic when enlarging
+		interpolation = (scale_x < 1.0 ? cv::INTER_AREA : cv::INTER_CUBIC);
+		if (interpolation == cv::INTER_AREA)
 		{
-			cv::putText(content.scaled_image, "user marks: " + std::to_string(number_of_hidden_marks), zoom_image_offset + cv::Point(10, next_text_row), fontface, fontscale, white, fontthickness, cv::LINE_AA);
-			next_text_row += 15;
+			// warpAffine() does not support INTER_AREA
+			interpolation = cv::INTER_LINEAR;
 		}
 	}
 
-	if (content.user_specified_zoom_factor > 0.0)
-	{
-		const int percentage = std::round(content.user_specified_zoom_factor * 100.0);
-		cv::putText(content.scaled_image, "zoom: " + std::to_string(percentage) + "%", zoom_image_offset + cv::Point(10, next_text_row), fontface, fontscale, white, fontthickness, cv::LINE_AA);
-		next_text_row += 15;
-	}
+	// Map the viewport back into the source image using the same pixel-centre convention as cv::resize(), so the pixels
+	// line up exactly with what would have been drawn had the entire image been resized.
+	const cv::Matx23d m(
+		scale_x, 0.0, 0.5 * scale_x - 0.5 - viewport.x,
+		0.0, scale_y, 0.5 * scale_y - 0.5 - viewport.y);
 
-	cached_image = convert_opencv_mat_to_juce_image(content.scaled_image);
-	need_to_rebuild_cache_image = false;
+	cv::Mat dst;
+	cv::warpAffine(mat, dst, m, viewport.size(), interpolation, cv::BORDER_REPLICATE);
 
-	return;
+	return dst;
 }
 
 
@@ -637,8 +1024,8 @@ void dm::DMCanvas::mouseDoubleClick(const MouseEvent & event)
 	}
 
 	content.push_undo_state();
-	double x = double(event.x + zoom_image_offset.x) / cached_image.getWidth();
-	double y = double(event.y + zoom_image_offset.y) / cached_image.getHeight();
+	double x = double(event.x + zoom_image_offset.x) / content.scaled_image_size.width;
+	double y = double(event.y + zoom_image_offset.y) / content.scaled_image_size.height;
 
 	Mark m(	cv::Point2d(x, y), content.most_recent_size, content.original_image.size(), content.most_recent_class_idx);
 	m.name			= content.names.at(content.most_recent_class_idx);
@@ -671,8 +1058,8 @@ void dm::DMCanvas::mouseDrag(const MouseEvent & event)
 		zoom_image_offset.y -= delta.y;
 
 		// don't allow panning past the edges of the image
-		const int image_width	= content.scaled_image.cols;
-		const int image_height	= content.scaled_image.rows;
+		const int image_width	= content.scaled_image_size.width;
+		const int image_height	= content.scaled_image_size.height;
 		const int canvas_width	= content.canvas.getWidth();
 		const int canvas_height	= content.canvas.getHeight();
 
@@ -682,6 +1069,17 @@ void dm::DMCanvas::mouseDrag(const MouseEvent & event)
 		if (zoom_image_offset.x					< 0)			zoom_image_offset.x = 0;
 		if (zoom_image_offset.y					< 0)			zoom_image_offset.y = 0;
 
+		const cv::Rect visible(zoom_image_offset, cv::Size(std::min(canvas_width, image_width), std::min(canvas_height, image_height)));
+		const cv::Rect rendered(cached_image_offset, cv::Size(cached_image.getWidth(), cached_image.getHeight()));
+		if ((visible & rendered) != visible)
+		{
+			// we've panned beyond the portion of the image which was rendered, so re-centre the viewport and rebuild
+			content.zoom_point_of_interest.x = (zoom_image_offset.x + (canvas_width  / 2)) / content.current_zoom_factor;
+			content.zoom_point_of_interest.y = (zoom_image_offset.y + (canvas_height / 2)) / content.current_zoom_factor;
+			content.zoom_viewport_anchor = cv::Point(-1, -1);
+			need_to_rebuild_cache_image = true;
+		}
+
 		repaint();
 	}
 
@@ -719,8 +1117,8 @@ void dm::DMCanvas::mouseDragFinished(juce::Rectangle<int> drag_rect, const Mouse
 	double midy			= drag_rect.getCentreY() + zoom_image_offset.y;
 	double width		= drag_rect.getWidth();
 	double height		= drag_rect.getHeight();
-	double image_width	= cached_image.getWidth();
-	double image_height	= cached_image.getHeight();
+	double image_width	= content.scaled_image_size.width;
+	double image_height	= content.scaled_image_size.height;
 
 #if 0
 	Log("mouse drag rectangle:"
@@ -7,6 +7,44 @@
 
 namespace dm
 {
+	/** Everything needed to draw a single mark onto the image.  The previous set is remembered by @ref DMCanvas so only
+	 * the marks which have changed need to be redrawn.
+	 */
+	struct OverlayMark
+	{
+		cv::Rect	rect;			///< Location of the mark within the scaled image.
+		cv::Rect	label_rect;		///< Location of the label, or an empty rectangle if the label is not shown.
+		std::string	label;
+		cv::Scalar	colour;
+		int			thickness;
+		double		alpha;
+		double		shade_alpha;	///< Zero when the rectangle is not shaded.
+		bool		draw_dot;		///< Draw a dot instead of a rectangle.
+		bool		draw_x;			///< Predictions have an "X" drawn through them.
+		int			corner_size;	///< Zero when the drag corners are not shown.
+
+		OverlayMark();
+
+		/// The area of the scaled image which is modified when this mark is drawn.
+		cv::Rect area() const;
+
+		bool operator==(const OverlayMark & rhs) const;
+		bool operator!=(const OverlayMark & rhs) const;
+	};
+
+	/// Lines of text drawn in the top-left corner of the canvas, such as the zoom level and the prediction time.
+	struct OverlayText
+	{
+		cv::Point	origin;	///< Top-left corner of the canvas within the scaled image.
+		VStr		lines;
+
+		/// The area of the scaled image which is modified when this text is drawn.
+		cv::Rect area() const;
+
+		bool operator==(const OverlayText & rhs) const;
+		bool operator!=(const OverlayText & rhs) const;
+	};
+
 	/** This is the actual class that draws the current image and all of the annotations/marks.  Most of the work is performed
 	 * in @ref rebuild_cache_image().  Also of importance is the mouse event handling to ensure that marks are created and
 	 * stretched correctly.
@@ -32,8 +70,59 @@ namespace dm
 			/// Link to the parent which manages the content, including all the marks.
 			DMContent & content;
 
+			/** Rebuild the base layer if the image, zoom, or display mode has changed since it was last built.
+			 * @returns @p true if the base layer was rebuilt, meaning everything else must also be redrawn.
+			 */
+			bool rebuild_base_layer();
+
+			/// Draw the parts of the mark which fall within @p clip, a rectangle in the coordinates of the scaled image.
+			void draw_overlay_mark(const OverlayMark & om, const cv::Rect & clip);
+
+			/// Draw the parts of the text which fall within @p clip, a rectangle in the coordinates of the scaled image.
+			void draw_overlay_text(const OverlayText & text, const cv::Rect & clip);
+
+			/// Clip the rectangles to @p bounds, and combine those which overlap so no area is drawn more than once.
+			std::vector<cv::Rect> merge_dirty_rects(const std::vector<cv::Rect> & rects, const cv::Rect & bounds);
+
+			/** Find the portion of the scaled image that fits on the canvas, and set @ref zoom_image_offset accordingly.
+			 * @p full_size is the size of the entire scaled image.  When not zoomed, this returns the entire image.
+			 */
+			cv::Rect find_viewport(const cv::Size & full_size);
+
+			/** Resample only the given rectangle of the scaled image directly from @p mat, which is the unscaled image.
+			 * The pixels line up exactly with those obtained by resizing the entire image and then cropping.  When
+			 * @p interpolation is negative, the interpolation is chosen based on whether the image is enlarged or reduced.
+			 */
+			cv::Mat resample_viewport(const cv::Mat & mat, const cv::Rect & viewport, int interpolation = -1);
+
 		/// If the CTRL key is held down while zooming, then we'll pan the image instead of creating a bounding box.
 		bool is_panning;
+
+		/** When zoomed in, normally only the visible portion of the image (plus a margin) is rendered.  Set this to
+		 * @p true to force the entire image to be rendered, such as when saving a screenshot.
+		 */
+		bool render_entire_image;
+
+		/** The scaled image, with the heatmap or black-and-white mode already applied.  This is only rebuilt when
+		 * the image, the zoom, or one of those modes changes.  The marks are drawn on a copy of this image.
+		 */
+		struct BaseLayer
+		{
+			cv::Mat		image;
+			cv::Mat		source;				///< Reference to the unscaled image used to build the layer.
+			cv::Mat		heatmap;			///< Reference to the unscaled heatmap used to build the layer, or empty.
+			cv::Size	scaled_size;		///< The value of @ref DMContent::scaled_image_size used to build the layer.
+			cv::Size	full_size;			///< Size of the entire scaled image, even if only a portion was rendered.
+			cv::Rect	rect;				///< The portion of the scaled image which was rendered into @ref image.
+			bool		entire_image;
+			double		heatmap_alpha;
+			int			heatmap_visualize;
+		};
+		BaseLayer base_layer;
+
+		/// The marks and text which were drawn the last time @ref rebuild_cache_image() was called.
+		std::vector<OverlayMark> previous_overlay;
+		OverlayText previous_text;
 		
 		/// Track if the mark being resized was selected for merge (to restore selection after resize)
 		bool mark_was_selected_for_merge;
@@ -6,9 +6,71 @@
 #include "json.hpp"
 using json = nlohmann::json;
 
+
+namespace
+{
+	/// Convert the pixel coordinates returned by OnnxHelp to the normalized detections stored in the prediction cache.
+	dm::PredictionCache::Detections onnx_to_detections(const OnnxHelp::PredictionResults & results, const cv::Size & image_size)
+	{
+		dm::PredictionCache::Detections detections;
+		detections.reserve(results.size());
+
+		for (const auto & prediction : results)
+		{
+			dm::PredictionCache::Detection d;
+			d.rect = cv::Rect2f(
+				static_cast<float>(prediction.rect.x)		/ image_size.width,
+				static_cast<float>(prediction.rect.y)		/ image_size.height,
+				static_cast<float>(prediction.rect.width)	/ image_size.width,
+				static_cast<float>(prediction.rect.height)	/ image_size.height);
+			d.class_idx			= prediction.class_idx;
+			d.probability		= prediction.probability;
+			d.all_probabilities	= {{prediction.class_idx, prediction.probability}};
+			detections.push_back(d);
+		}
+
+		return detections;
+	}
+
+
+	/// Convert the normalized results returned by DarkHelp to the detections stored in the prediction cache.
+	dm::PredictionCache::Detections darkhelp_to_detections(const DarkHelp::PredictionResults & results)
+	{
+		dm::PredictionCache::Detections detections;
+		detections.reserve(results.size());
+
+		for (const auto & prediction : results)
+		{
+			dm::PredictionCache::Detection d;
+			d.rect = cv::Rect2f(
+				prediction.original_point.x - prediction.original_size.width	/ 2.0f,
+				prediction.original_point.y - prediction.original_size.height	/ 2.0f,
+				prediction.original_size.width,
+				prediction.original_size.height);
+			d.class_idx			= prediction.best_class;
+			d.probability		= prediction.best_probability;
+			d.all_probabilities	= prediction.all_probabilities;
+			detections.push_back(d);
+		}
+
+		return detections;
+	}
+
+
+	/// Wrap a value which is already known in a future, so it can be returned the same way as the asynchronous results.
+	std::future<dm::PredictionCache::Detections> ready_future(const dm::PredictionCache::Detections & detections)
+	{
+		std::promise<dm::PredictionCache::Detections> promise;
+		promise.set_value(detections);
+
+		return promise.get_future();
+	}
+}
+
+
 dm::DMContent::DMContent(const std::string & prefix) :
 	cfg_prefix(prefix),
-	show_window(not (dmapp().cli_options.count("editor") and dmapp().cli_options.at("editor") == "gen-darknet")),
+	show_window(not (dmapp().cli_options.count("editor") and (dmapp().cli_options.at("editor") == "gen-darknet" or dmapp().cli_options.at("editor") == "pre-annotate"))),
 	canvas(*this),
 	scrollfield(*this),
 	scrollfield_width(cfg().get_int("scrollfield_width")),
@@ -39,6 +101,7 @@ dm::DMContent::DMContent(const std::string & prefix) :
 	corner_size(cfg().get_int("corner_size")),
 	selected_mark(-1),
 	images_are_loading(false),
+	prediction_generation(0),
 	black_and_white_mode_enabled(cfg().get_bool("black_and_white_mode_enabled")),
 	black_and_white_threshold_blocksize(cfg().get_int("black_and_white_threshold_blocksize")),
 	black_and_white_threshold_constant(cfg().get_double("black_and_white_threshold_constant")),
@@ -79,6 +142,10 @@ dm::DMContent::DMContent(const std::string & prefix) :
 
 	setWantsKeyboardFocus(true);
 
+	annotation_index.open(project_info.project_dir);
+	image_cache.configure(cfg().get_int("image_cache_megabytes"), cfg().get_int("image_cache_threads"));
+	prediction_thread.reset(new DMContentPredict(*this));
+
 	VStr json_filenames;
 	images_without_json.clear();
 	std::atomic<bool> done = false;
@@ -108,7 +175,7 @@ dm::DMContent::DMContent(const std::string & prefix) :
 		{
 			v.swap(image_filenames);
 
-			if (action != "gen-darknet")
+			if (action != "gen-darknet" and action != "pre-annotate")
 			{
 				AlertWindow::showMessageBoxAsync(AlertWindow::AlertIconType::InfoIcon, "DarkMark",
 						"This project has a regex filter:\n\n"
@@ -140,12 +207,17 @@ dm::DMContent::~DMContent(void)
 {
 	stopTimer();
 
+	prediction_thread.reset(nullptr);
+	inference_pool.reset();
+
 	if (need_to_save)
 	{
 		save_json();
 		save_text();
 	}
 
+	annotation_index.save();
+
 	return;
 }
 
@@ -266,8 +338,33 @@ void dm::DMContent::start_darknet()
 	const std::string names_filename	= cfg().get_str(cfg_prefix + "names"	);
 	names.clear();
 
-	dmapp().darkhelp_nn.reset(nullptr);
-	dmapp().onnx_nn.reset(nullptr);
+	if (true)
+	{
+		// the prediction thread may still be using the previous neural network
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+
+		// the replicas in the pool are copies of the previous neural network
+		inference_pool.reset();
+
+		dmapp().darkhelp_nn.reset(nullptr);
+		dmapp().onnx_nn.reset(nullptr);
+		dmapp().opencv_nn.reset(nullptr);
+	}
+
+	/* Loading a neural network can take a long time, so the new network is loaded without holding the lock, and is only
+	 * installed once it is ready.  In the meantime, anyone asking for predictions gets an empty set of results.
+	 */
+	std::unique_ptr<DarkHelp::NN>		darkhelp;
+	std::unique_ptr<OnnxHelp::NN>		onnx;
+	std::unique_ptr<OnnxHelp::OpenCVNN>	opencv;
+
+	// Darknet models can be run by libdarknet (0), or by OpenCV DNN on the CPU (1) or with OpenVINO (2)
+	int darknet_backend = cfg().get_int(cfg_prefix + "darknet_backend", 0);
+	if (dmapp().cli_options.count("darknet_backend"))
+	{
+		const auto & backend = dmapp().cli_options.at("darknet_backend");
+		darknet_backend = (backend == "openvino" ? 2 : backend == "opencv" ? 1 : 0);
+	}
 
 	if (weights_filename.empty() == false and String(weights_filename).endsWith(".onnx"))
 	{
@@ -286,10 +383,11 @@ void dm::DMContent::start_darknet()
 				}
 				
 				Log("attempting to load ONNX model " + weights_filename);
-				dmapp().onnx_nn.reset(new OnnxHelp::NN(weights_filename, names));
+				apply_onnx_session_settings();
+				onnx.reset(new OnnxHelp::NN(weights_filename, names));
 				
 				// Check if this model has dynamic height/width dimensions and set custom input size if configured
-				if (dmapp().onnx_nn && dmapp().onnx_nn->is_dynamic())
+				if (onnx && onnx->is_dynamic())
 				{
 					int configured_width = cfg().get_int(cfg_prefix + "onnx_input_width");
 					int configured_height = cfg().get_int(cfg_prefix + "onnx_input_height");
@@ -297,13 +395,13 @@ void dm::DMContent::start_darknet()
 					if (configured_width > 0 && configured_height > 0)
 					{
 						cv::Size custom_size(configured_width, configured_height);
-						dmapp().onnx_nn->set_input_size(custom_size);
+						onnx->set_input_size(custom_size);
 						Log("Set custom input size for ONNX model with dynamic height/width: " + std::to_string(configured_width) + "x" + std::to_string(configured_height));
 					}
 				}
 				
 				// Set preprocessing configuration based on config or auto-detect from filename
-				if (dmapp().onnx_nn)
+				if (onnx)
 				{
 					// Check for explicit config setting first (0=auto, 1=yolox, 2=dfine)
 					int preprocess_mode = cfg().get_int(cfg_prefix + "onnx_preprocess_mode");
@@ -319,32 +417,37 @@ void dm::DMContent::start_darknet()
 							lower_filename.find("rt-detr") != std::string::npos ||
 							lower_filename.find("detr") != std::string::npos)
 						{
-							dmapp().onnx_nn->set_preprocess_config(OnnxHelp::PreprocessConfig::dfine());
+							onnx->set_preprocess_config(OnnxHelp::PreprocessConfig::dfine());
 							Log("Auto-detected D-FINE/DETR-style model, using direct resize preprocessing");
 						}
 						else
 						{
-							dmapp().onnx_nn->set_preprocess_config(OnnxHelp::PreprocessConfig::yolox());
+							onnx->set_preprocess_config(OnnxHelp::PreprocessConfig::yolox());
 							Log("Using YOLOX-style preprocessing (letterbox)");
 						}
 					}
 					else if (preprocess_mode == 2)
 					{
-						dmapp().onnx_nn->set_preprocess_config(OnnxHelp::PreprocessConfig::dfine());
+						onnx->set_preprocess_config(OnnxHelp::PreprocessConfig::dfine());
 						Log("Using D-FINE/DETR-style preprocessing (direct resize)");
 					}
 					else
 					{
-						dmapp().onnx_nn->set_preprocess_config(OnnxHelp::PreprocessConfig::yolox());
+						onnx->set_preprocess_config(OnnxHelp::PreprocessConfig::yolox());
 						Log("Using YOLOX-style preprocessing (letterbox)");
 					}
 				}
 				
+				onnx->set_max_batch_size(cfg().get_int("onnx_batch_size"));
+				onnx->set_tiling(cfg().get_bool("darknet_image_tiling"), cfg().get_int("onnx_tile_overlap") / 100.0f);
+				onnx->set_tile_nms_threshold(cfg().get_int("onnx_nms_threshold") / 100.0f);
+				onnx->set_rectangular(use_rectangular_inference());
+
 				Log("ONNX model loaded.");
 			}
 			catch (const std::exception & e)
 			{
-				dmapp().onnx_nn.reset(nullptr);
+				onnx.reset(nullptr);
 				Log("failed to load ONNX model (" + weights_filename + "): " + e.what());
 				AlertWindow::showMessageBoxAsync(
 					AlertWindow::AlertIconType::WarningIcon, "DarkMark",
@@ -352,38 +455,52 @@ void dm::DMContent::start_darknet()
 			}
 		}
 	}
-	else if (File(weights_filename).existsAsFile())
+	else if (File(weights_filename).existsAsFile() and darknet_backend > 0)
 	{
 		try
 		{
 			const std::string darknet_cfg = cfg().get_str(cfg_prefix + "cfg");
-			Log("attempting to load neural network " + darknet_cfg + " / " + weights_filename + " / " + names_filename);
-			dmapp().darkhelp_nn.reset(new DarkHelp::NN(darknet_cfg, weights_filename, names_filename));
-			Log("neural network loaded in " + darkhelp_nn().duration_string());
-
-			darkhelp_nn().config.threshold							= cfg().get_int("darknet_threshold")			/ 100.0f;
-			darkhelp_nn().config.hierarchy_threshold				= cfg().get_int("darknet_hierarchy_threshold")	/ 100.0f;
-			darkhelp_nn().config.non_maximal_suppression_threshold	= cfg().get_int("darknet_nms_threshold")		/ 100.0f;
-			darkhelp_nn().config.enable_tiles						= cfg().get_bool("darknet_image_tiling");
-			names = darkhelp_nn().names;
+			Log("attempting to load neural network with OpenCV DNN " + darknet_cfg + " / " + weights_filename);
+			const auto start_time = std::chrono::high_resolution_clock::now();
+			opencv.reset(new OnnxHelp::OpenCVNN(darknet_cfg, weights_filename, {}, darknet_backend == 2));
+			const auto end_time = std::chrono::high_resolution_clock::now();
+			Log("neural network loaded in " + std::to_string(std::chrono::duration<double, std::milli>(end_time - start_time).count()) + " ms");
 
-			// see if we have a TL or TR classes
-			for (size_t idx = 0; idx < names.size(); idx ++)
+			// OpenCV does not read the .names file, so the names are parsed further down
+		}
+		catch (const std::exception & e)
+		{
+			opencv.reset(nullptr);
+			Log("failed to load darknet with OpenCV DNN (weights=" + weights_filename + "): " + e.what());
+			if (show_window)
 			{
-				const auto & name = names.at(idx);
-				if (name == "TL")
-				{
-					tl_name_index = idx;
-				}
-				else if (name == "TR")
-				{
-					tr_name_index = idx;
-				}
+				AlertWindow::showMessageBoxAsync(
+					AlertWindow::AlertIconType::WarningIcon,
+					"DarkMark",
+					"Failed to load the darknet neural network with OpenCV DNN. The error message returned was:\n" +
+					String("\n") +
+					e.what());
 			}
 		}
+	}
+	else if (File(weights_filename).existsAsFile())
+	{
+		try
+		{
+			const std::string darknet_cfg = cfg().get_str(cfg_prefix + "cfg");
+			Log("attempting to load neural network " + darknet_cfg + " / " + weights_filename + " / " + names_filename);
+			darkhelp.reset(new DarkHelp::NN(darknet_cfg, weights_filename, names_filename));
+			Log("neural network loaded in " + darkhelp->duration_string());
+
+			darkhelp->config.threshold							= cfg().get_int("darknet_threshold")			/ 100.0f;
+			darkhelp->config.hierarchy_threshold				= cfg().get_int("darknet_hierarchy_threshold")	/ 100.0f;
+			darkhelp->config.non_maximal_suppression_threshold	= cfg().get_int("darknet_nms_threshold")		/ 100.0f;
+			darkhelp->config.enable_tiles						= cfg().get_bool("darknet_image_tiling");
+			names = darkhelp->names;
+		}
 		catch (const std::exception & e)
 		{
-			dmapp().darkhelp_nn.reset(nullptr);
+			darkhelp.reset(nullptr);
 			Log("failed to load darknet (weights=" + weights_filename + ", names=" + names_filename + "): " + e.what());
 			if (show_window)
 			{
@@ -398,7 +515,7 @@ void dm::DMContent::start_darknet()
 	}
 	else
 	{
-		dmapp().darkhelp_nn.reset(nullptr);
+		darkhelp.reset(nullptr);
 		Log("skipped loading neural network due to missing or invalid weights filename");
 #if 0
 		if (show_window)
@@ -411,6 +528,14 @@ void dm::DMContent::start_darknet()
 #endif
 	}
 
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+		dmapp().darkhelp_nn	= std::move(darkhelp);
+		dmapp().onnx_nn		= std::move(onnx);
+		dmapp().opencv_nn	= std::move(opencv);
+	}
+
 	if (names.empty() and names_filename.empty() == false)
 	{
 		Log("manually parsing " + names_filename);
@@ -446,6 +571,20 @@ void dm::DMContent::start_darknet()
 
 	Log("number of name entries: " + std::to_string(names.size()));
 
+	// see if we have a TL or TR classes
+	for (size_t idx = 0; idx < names.size(); idx ++)
+	{
+		const auto & name = names.at(idx);
+		if (name == "TL")
+		{
+			tl_name_index = idx;
+		}
+		else if (name == "TR")
+		{
+			tr_name_index = idx;
+		}
+	}
+
 	// add 1 more special entry to the end of the "names" so we can deal with empty images
 	empty_image_name_index = names.size();
 	names.push_back("* empty image *");
@@ -792,8 +931,12 @@ dm::DMContent & dm::DMContent::load_image(const size_t new_idx, const bool full_
 		save_text();
 	}
 
+	// new predictions are only kept in memory, so regularly write them to disk in case DarkMark doesn't exit cleanly
+	prediction_cache.save_periodically();
+
 	zoom_review_marks_remaining.clear();
 	darknet_image_processing_time = "";
+	prediction_generation ++; // any predictions still pending for the previous image are now stale
 	selected_mark	= -1;
 	selected_marks.clear();
 	zoom_viewport_anchor = cv::Point(-1, -1);
@@ -812,6 +955,9 @@ dm::DMContent & dm::DMContent::load_image(const size_t new_idx, const bool full_
 	marks.clear();
 	image_is_completely_empty = false;
 
+	// remember which direction the user is moving so we know which images to prefetch
+	const bool moving_backwards = (new_idx < image_filename_index);
+
 	if (new_idx >= image_filenames.size())
 	{
 		image_filename_index = image_filenames.size() - 1;
@@ -845,7 +991,7 @@ dm::DMContent & dm::DMContent::load_image(const size_t new_idx, const bool full_
 		task = "loading image file " + long_filename;
 //		Log("loading image " + long_filename);
 		heatmap_image = cv::Mat();
-		original_image = cv::imread(long_filename);
+		original_image = image_cache.get(long_filename);
 		if (original_image.empty())
 		{
 			// something has gone *very* wrong if we cannot read the image
@@ -853,6 +999,33 @@ dm::DMContent & dm::DMContent::load_image(const size_t new_idx, const bool full_
 			throw std::runtime_error("failed to open or read the image " + long_filename);
 		}
 
+		// start decoding the images the user is most likely to look at next:  several images in the direction of travel,
+		// and a few in the opposite direction in case the user goes back
+		task = "prefetching images";
+		const int ahead		= std::max(0, cfg().get_int("image_cache_prefetch_next"));
+		const int behind	= std::max(0, cfg().get_int("image_cache_prefetch_previous"));
+		const int direction	= (moving_backwards ? -1 : 1);
+		VStr filenames_to_prefetch;
+		auto add_to_prefetch = [&](const int idx)
+		{
+			if (idx >= 0 and idx < static_cast<int>(image_filenames.size()))
+			{
+				filenames_to_prefetch.push_back(image_filenames.at(idx));
+			}
+		};
+		for (int i = 1; i <= std::max(ahead, behind); i ++)
+		{
+			if (i <= ahead)
+			{
+				add_to_prefetch(static_cast<int>(image_filename_index) + i * direction);
+			}
+			if (i <= behind)
+			{
+				add_to_prefetch(static_cast<int>(image_filename_index) - i * direction);
+			}
+		}
+		image_cache.prefetch(filenames_to_prefetch);
+
 		if (full_load)
 		{
 			task = "loading json file " + json_filename;
@@ -870,115 +1043,27 @@ dm::DMContent & dm::DMContent::load_image(const size_t new_idx, const bool full_
 				need_to_save = true;
 			}
 
-			if (show_predictions != EToggle::kOff)
-			{
-				if (dmapp().darkhelp_nn)
-				{
-					task = "getting predictions";
-					darkhelp_nn().predict(original_image);
-					darknet_image_processing_time = darkhelp_nn().duration_string();
-					Log("darkhelp processed " + short_filename + " in " + darknet_image_processing_time);
-
-//					std::cout << darkhelp_nn().prediction_results << std::endl;
-
-					// convert the predictions into marks
-					task = "converting predictions";
-					for (auto prediction : darkhelp_nn().prediction_results)
-					{
-						Mark m(prediction.original_point, prediction.original_size, original_image.size(), prediction.best_class);
-						m.name = names.at(m.class_idx);
-						m.description = prediction.name;
-						m.is_prediction = true;
-						marks.push_back(m);
-					}
-				}
-				else if (dmapp().onnx_nn)
-				{
-					task = "getting predictions with ONNX";
-					auto start_time = std::chrono::high_resolution_clock::now();
-					
-					// Get configured thresholds
-					float conf_threshold = cfg().get_int("onnx_threshold") / 100.0f;
-					float nms_threshold = cfg().get_int("onnx_nms_threshold") / 100.0f;
-					
-					auto results = onnx_nn().predict(original_image, conf_threshold, nms_threshold);
-					auto end_time = std::chrono::high_resolution_clock::now();
-					double duration_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
-					darknet_image_processing_time = std::to_string(duration_ms) + " ms (ONNX)";
-					Log("ONNX processed " + short_filename + " in " + darknet_image_processing_time);
-
-					task = "converting ONNX predictions";
-					for (auto& prediction : results)
-					{
-						Mark m;
-						m.image_dimensions = original_image.size();
-						m.set(prediction.rect);
-						m.class_idx = prediction.class_idx;
-						m.name = prediction.name;
-						m.description = prediction.name;
-						m.is_prediction = true;
-						marks.push_back(m);
-					}
-				}
-			}
-
-			if (heatmap_enabled and dmapp().darkhelp_nn)
+			if (show_predictions != EToggle::kOff and (dmapp().darkhelp_nn or dmapp().onnx_nn or dmapp().opencv_nn))
 			{
-				task = "generating heatmap";
-				auto mm = darkhelp_nn().heatmaps_all(heatmap_threshold);
-				if (mm.count(heatmap_class_idx) > 0)
+				if (prediction_thread and juce::MessageManager::existsAndIsCurrentThread())
 				{
-					heatmap_image = mm.at(heatmap_class_idx);
+					// show the image immediately, and merge the predictions into the marks once the neural network is done
+					task = "queueing predictions";
+					darknet_image_processing_time = "waiting for predictions...";
+					prediction_thread->submit(prediction_generation, long_filename, original_image);
 				}
-				else if (mm.count(-1) > 0)
-				{
-					heatmap_image = mm.at(-1);
-				}
-
-				if (not heatmap_image.empty())
+				else
 				{
-					// normalize the image ONCE on load, so we don't have to keep doing it during display
-					//
-					// see: Darknet::visualize_heatmap()
-
-					task = "normalizing heatmap";
-
-					double min_val = 0.0;
-					double max_val = 0.0;
-					cv::minMaxLoc(heatmap_image, &min_val, &max_val);
-
-					// normalize the heatmap values
-					cv::Mat mat = (heatmap_image - min_val) / (max_val - min_val);
-
-					// convert the heatmap to a single-channel image with values ranging from zero to 255
-					mat.convertTo(heatmap_image, CV_8UC1, 255.0);
+					// we're running on a background thread (such as rotate, flip, or reload-and-resave) which expects
+					// the predictions to be available as soon as the image has been loaded
+					task = "getting predictions";
+					const auto prediction_marks = predict_marks(long_filename, original_image, darknet_image_processing_time, heatmap_image);
+					marks.insert(marks.end(), prediction_marks.begin(), prediction_marks.end());
 				}
 			}
 
-			// Sort the marks based on a gross (rounded) X and Y position of the midpoint.  This way when
-			// the user presses TAB or SHIFT+TAB the marks appear in a consistent and predictable order.
 			task = "sorting marks";
-			std::sort(marks.begin(), marks.end(),
-					[](auto & lhs, auto & rhs)
-					{
-						const auto & p1 = lhs.get_normalized_midpoint();
-						const auto & p2 = rhs.get_normalized_midpoint();
-
-						const int y1 = std::round(15.0 * p1.y);
-						const int y2 = std::round(15.0 * p2.y);
-
-						if (y1 < y2) return true;
-						if (y2 < y1) return false;
-
-						// if we get here then y1 and y2 are the same, so now we compare x1 and x2
-
-						const int x1 = std::round(15.0 * p1.x);
-						const int x2 = std::round(15.0 * p2.x);
-
-						if (x1 < x2) return true;
-
-						return false;
-					} );
+			sort_marks();
 		}
 	}
 	catch(const std::exception & e)
@@ -1023,206 +1108,647 @@ dm::DMContent & dm::DMContent::load_image(const size_t new_idx, const bool full_
 }
 
 
-dm::DMContent & dm::DMContent::save_text()
+dm::PredictionCache::Detections dm::DMContent::get_detections(const std::string & filename, const cv::Mat & mat, std::string & processing_time, cv::Mat * heatmap)
 {
-	if (text_filename.empty() == false)
+	PredictionCache::Detections candidates;
+	if (heatmap)
 	{
-		bool delete_txt_file = true;
+		*heatmap = cv::Mat();
+	}
 
-		if (image_is_completely_empty)
+	bool need_heatmap = false;
+	std::string key;
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+
+		if (not dmapp().darkhelp_nn and not dmapp().onnx_nn and not dmapp().opencv_nn)
 		{
-			delete_txt_file = false;
+			return candidates;
 		}
 
-		std::ofstream fs(text_filename);
-		fs.imbue(std::locale("C"));
+		open_prediction_cache();
+		key = prediction_cache.key;
+		need_heatmap = (heatmap and heatmap_enabled and dmapp().darkhelp_nn);
+	}
 
-		for (const auto & m : marks)
+	// the prediction cache has its own lock, so the inference mutex is only needed while the neural network is in use
+	if (need_heatmap == false and prediction_cache.get(filename, candidates))
+	{
+		processing_time = "cached";
+		return filter_detections(candidates, mat.size());
+	}
+
+	DarkHelp::PredictionResults darkhelp_results;
+	OnnxHelp::PredictionResults onnx_results;
+	bool use_darkhelp = false;
+
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+
+		// the neural network may have been unloaded while the lock was released
+		if (not dmapp().darkhelp_nn and not dmapp().onnx_nn and not dmapp().opencv_nn)
 		{
-			if (m.is_prediction)
+			return candidates;
+		}
+
+		const auto start_time = std::chrono::high_resolution_clock::now();
+
+		if (dmapp().darkhelp_nn)
+		{
+			// temporarily lower the threshold so we get every candidate, not only those above the current threshold
+			use_darkhelp = true;
+			const float threshold = darkhelp_nn().config.threshold;
+			darkhelp_nn().config.threshold = candidate_threshold;
+			darkhelp_results = darkhelp_nn().predict(mat);
+			darkhelp_nn().config.threshold = threshold;
+
+			processing_time = darkhelp_nn().duration_string();
+
+			if (need_heatmap)
 			{
-				// skip this one since it is a prediction, not a full mark
-				continue;
+				auto mm = darkhelp_nn().heatmaps_all(heatmap_threshold);
+				if (mm.count(heatmap_class_idx) > 0)
+				{
+					*heatmap = mm.at(heatmap_class_idx);
+				}
+				else if (mm.count(-1) > 0)
+				{
+					*heatmap = mm.at(-1);
+				}
 			}
+		}
+		else if (dmapp().opencv_nn)
+		{
+			onnx_results = opencv_nn().predict_candidates(mat, candidate_threshold);
+			processing_time = std::to_string(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count()) + " ms (OpenCV)";
+		}
+		else
+		{
+			onnx_results = onnx_nn().predict_candidates(mat, candidate_threshold);
+			processing_time = std::to_string(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count()) + " ms (ONNX)";
+		}
+	}
 
-			delete_txt_file = false;
+	Log("processed " + filename + " in " + processing_time);
+	candidates = (use_darkhelp ? darkhelp_to_detections(darkhelp_results) : onnx_to_detections(onnx_results, mat.size()));
+	// if the settings changed while the network was running, then these candidates don't belong in the new cache
+	prediction_cache.set(filename, candidates, key);
 
-			const cv::Rect2d r	= m.get_normalized_bounding_rect();
-			const double w		= r.width;
-			const double h		= r.height;
-			const double x		= r.x + w / 2.0;
-			const double y		= r.y + h / 2.0;
-			fs << std::fixed << std::setprecision(10) << m.class_idx << " " << x << " " << y << " " << w << " " << h << std::endl;
-		}
+	if (heatmap and not heatmap->empty())
+	{
+		// normalize the image ONCE on load, so we don't have to keep doing it during display
+		//
+		// see: Darknet::visualize_heatmap()
+
+		cv::Mat & hm = *heatmap;
+		double min_val = 0.0;
+		double max_val = 0.0;
+		cv::minMaxLoc(hm, &min_val, &max_val);
+
+		// normalize the heatmap values
+		cv::Mat normalized = (hm - min_val) / (max_val - min_val);
+
+		// convert the heatmap to a single-channel image with values ranging from zero to 255
+		normalized.convertTo(hm, CV_8UC1, 255.0);
+	}
+
+	return filter_detections(candidates, mat.size());
+}
+
+
+std::future<dm::PredictionCache::Detections> dm::DMContent::submit_detections(const std::string & filename, const cv::Mat & mat)
+{
+	std::shared_ptr<InferencePool> pool;
+	std::string key;
+
+	{
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
 
-		if (fs.fail())
+		if (not dmapp().darkhelp_nn and not dmapp().onnx_nn and not dmapp().opencv_nn)
 		{
-			Log("Error saving text file " + text_filename);
-			AlertWindow::showMessageBox(
-				AlertWindow::AlertIconType::WarningIcon,
-				"DarkMark",
-				"Failed to save the text annotations to " + text_filename + ".\n"
-				"\n"
-				"Is the drive full?  Perhaps a read-only file or directory?");
+			return ready_future({});
 		}
 
-		fs.close();
+		open_prediction_cache();
+		key = prediction_cache.key;
+
+		PredictionCache::Detections candidates;
+		if (prediction_cache.get(filename, candidates))
+		{
+			return ready_future(filter_detections(candidates, mat.size()));
+		}
 
-		if (delete_txt_file)
+		if (not inference_pool)
 		{
-			// there was no legitimate reason to keep the .txt file
-			std::remove(text_filename.c_str());
+			start_inference_pool();
 		}
+		pool = inference_pool;
 	}
 
-	return *this;
+	if (not pool)
+	{
+		// the pool has been disabled, so use the interactive neural network instead
+		std::string processing_time;
+		return ready_future(get_detections(filename, mat, processing_time));
+	}
+
+	// the lock is no longer held, so the editor can keep using the interactive neural network while we wait for room in the pool
+	const cv::Size image_size = mat.size();
+	return pool->submit(mat, [this, filename, image_size, key](const PredictionCache::Detections & candidates)
+		{
+			// if the settings changed while this image was queued, then these candidates don't belong in the new cache
+			prediction_cache.set(filename, candidates, key);
+			return filter_detections(candidates, image_size);
+		});
 }
 
 
-dm::DMContent & dm::DMContent::save_json()
+size_t dm::DMContent::images_in_flight()
 {
-	if (json_filename.empty() == false)
+	std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+
+	if (not dmapp().darkhelp_nn and not dmapp().onnx_nn and not dmapp().opencv_nn)
 	{
-		json root;
-		size_t next_id = 0;
-		for (auto & m : marks)
-		{
-			if (m.is_prediction)
-			{
-				// skip this one since it is a prediction, not a full mark
-				continue;
-			}
+		return 1;
+	}
+
+	// the pool is restarted when the cache key changes, so check the key before starting it
+	open_prediction_cache();
+	if (not inference_pool)
+	{
+		start_inference_pool();
+	}
+	if (not inference_pool)
+	{
+		// every image is predicted by the interactive neural network as soon as it is submitted
+		return 1;
+	}
+
+	return 2 * inference_pool->size() * inference_pool->get_batch_size();
+}
 
-			root["mark"][next_id]["class_idx"	] = m.class_idx;
-			root["mark"][next_id]["name"		] = m.name;
 
-			const cv::Rect2d	r1 = m.get_normalized_bounding_rect();
-			const cv::Rect		r2 = m.get_bounding_rect(original_image.size());
+void dm::DMContent::start_inference_pool()
+{
+	// The lock on the inference mutex must be held.  Each replica is a new instance of the interactive neural network
+	// with the same settings.  The interactive network is not part of the pool, so it remains available to the editor.
+
+	// Each DarkHelp replica loads another copy of the network in GPU memory, and it has not been established that several
+	// copies of libdarknet can safely run concurrently.  So Darknet models only get replicas when the user asks for them.
+	int number_of_replicas = cfg().get_int(dmapp().darkhelp_nn ? "darkhelp_inference_replicas" : "inference_replicas");
+	if (dmapp().cli_options.count("inference_replicas"))
+	{
+		number_of_replicas = toInt(dmapp().cli_options.at("inference_replicas"));
+	}
+	if (number_of_replicas <= 0)
+	{
+		return;
+	}
 
-			root["mark"][next_id]["rect"]["x"]		= r1.x;
-			root["mark"][next_id]["rect"]["y"]		= r1.y;
-			root["mark"][next_id]["rect"]["w"]		= r1.width;
-			root["mark"][next_id]["rect"]["h"]		= r1.height;
-			root["mark"][next_id]["rect"]["int_x"]	= r2.x;
-			root["mark"][next_id]["rect"]["int_y"]	= r2.y;
-			root["mark"][next_id]["rect"]["int_w"]	= r2.width;
-			root["mark"][next_id]["rect"]["int_h"]	= r2.height;
+	const std::string weights_filename	= cfg().get_str(cfg_prefix + "weights"	);
+	const std::string names_filename	= cfg().get_str(cfg_prefix + "names"	);
+	const std::string darknet_cfg		= cfg().get_str(cfg_prefix + "cfg"		);
+	size_t batch_size = 1;
 
-			for (size_t point_idx = 0; point_idx < m.normalized_all_points.size(); point_idx ++)
+	std::vector<InferencePool::Replica> replicas;
+	try
+	{
+		for (int idx = 0; idx < number_of_replicas; idx ++)
+		{
+			if (dmapp().onnx_nn)
+			{
+				// all the replicas share the ONNX Runtime session of the interactive network, which supports concurrent runs
+				std::shared_ptr<OnnxHelp::NN> nn(new OnnxHelp::NN(weights_filename));
+				if (nn->is_dynamic())
+				{
+					nn->set_input_size(onnx_nn().get_input_size());
+				}
+				nn->set_preprocess_config(onnx_nn().get_preprocess_config());
+				nn->set_max_batch_size(onnx_nn().get_max_batch_size());
+				nn->set_tiling(onnx_nn().get_tiling(), onnx_nn().get_tile_overlap());
+				nn->set_tile_nms_threshold(onnx_nn().get_tile_nms_threshold());
+				nn->set_rectangular(onnx_nn().get_rectangular());
+				batch_size = nn->get_max_batch_size();
+
+				replicas.push_back([nn](const std::vector<cv::Mat> & mats)
+					{
+						std::vector<PredictionCache::Detections> all_candidates;
+						const auto all_results = nn->predict_candidates_batch(mats, candidate_threshold);
+						for (size_t i = 0; i < mats.size(); i ++)
+						{
+							all_candidates.push_back(onnx_to_detections(all_results.at(i), mats[i].size()));
+						}
+						return all_candidates;
+					});
+			}
+			else if (dmapp().opencv_nn)
 			{
-				const cv::Point2d & p = m.normalized_all_points.at(point_idx);
-				root["mark"][next_id]["points"][point_idx]["x"] = p.x;
-				root["mark"][next_id]["points"][point_idx]["y"] = p.y;
+				std::shared_ptr<OnnxHelp::OpenCVNN> nn(new OnnxHelp::OpenCVNN(darknet_cfg, weights_filename, {}, opencv_nn().is_using_openvino()));
 
-				// DarkMark doesn't use these integer values, but make them available for 3rd party software which wants to reads the .json file
-				root["mark"][next_id]["points"][point_idx]["int_x"] = (int)(std::round(p.x * (double)original_image.cols));
-				root["mark"][next_id]["points"][point_idx]["int_y"] = (int)(std::round(p.y * (double)original_image.rows));
+				replicas.push_back([nn](const std::vector<cv::Mat> & mats)
+					{
+						std::vector<PredictionCache::Detections> all_candidates;
+						const auto all_results = nn->predict_candidates_batch(mats, candidate_threshold);
+						for (size_t i = 0; i < mats.size(); i ++)
+						{
+							all_candidates.push_back(onnx_to_detections(all_results.at(i), mats[i].size()));
+						}
+						return all_candidates;
+					});
 			}
+			else
+			{
+				std::shared_ptr<DarkHelp::NN> nn(new DarkHelp::NN(darknet_cfg, weights_filename, names_filename));
+				nn->config.hierarchy_threshold					= darkhelp_nn().config.hierarchy_threshold;
+				nn->config.non_maximal_suppression_threshold	= darkhelp_nn().config.non_maximal_suppression_threshold;
+				nn->config.enable_tiles							= darkhelp_nn().config.enable_tiles;
+				nn->config.threshold							= candidate_threshold;
 
-			next_id ++;
+				replicas.push_back([nn](const std::vector<cv::Mat> & mats)
+					{
+						std::vector<PredictionCache::Detections> all_candidates;
+						for (const auto & mat : mats)
+						{
+							all_candidates.push_back(darkhelp_to_detections(nn->predict(mat)));
+						}
+						return all_candidates;
+					});
+			}
 		}
-		root["image"]["scale"]	= scale_factor;
-		root["image"]["width"]	= original_image.cols;
-		root["image"]["height"]	= original_image.rows;
-		root["timestamp"]		= std::time(nullptr);
-		root["version"]			= DARKMARK_VERSION;
+	}
+	catch (const std::exception & e)
+	{
+		// run with however many replicas we managed to load
+		Log("failed to load replica #" + std::to_string(replicas.size() + 1) + " of the neural network: " + e.what());
+	}
 
-		if (next_id == 0 and image_is_completely_empty)
-		{
-			// no marks were written out, so this must be an empty image
-			root["completely_empty"] = true;
-		}
-		else
+	if (replicas.empty() == false)
+	{
+		// allow enough images to be queued for every replica to have a full batch waiting while it processes the current one
+		inference_pool.reset(new InferencePool(replicas, batch_size, 2 * replicas.size() * batch_size));
+	}
+
+	return;
+}
+
+
+void dm::DMContent::open_prediction_cache()
+{
+	// The cache key needs to change whenever a setting which changes the candidates is modified.  The detection
+	// thresholds (and NMS for ONNX without tiling) are not part of the key since they are applied later by
+	// filter_detections().
+	const std::string weights_filename = cfg().get_str(cfg_prefix + "weights");
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(2);
+	cv::Size input_size;
+	if (dmapp().darkhelp_nn)
+	{
+		input_size = darkhelp_nn().network_size();
+		ss	<< "darknet"
+			<< "_h"		<< darkhelp_nn().config.hierarchy_threshold
+			<< "_nms"	<< darkhelp_nn().config.non_maximal_suppression_threshold
+			<< "_tiles"	<< darkhelp_nn().config.enable_tiles;
+	}
+	else if (dmapp().opencv_nn)
+	{
+		// the OpenVINO and OpenCV backends give slightly different results
+		input_size = opencv_nn().get_input_size();
+		ss	<< "opencv"
+			<< "_ov"	<< opencv_nn().is_using_openvino();
+	}
+	else
+	{
+		const auto preprocess = onnx_nn().get_preprocess_config();
+		input_size = onnx_nn().get_input_size();
+		ss	<< "onnx"
+			<< "_pre"	<< preprocess.maintain_aspect_ratio << preprocess.bgr_to_rgb << preprocess.scale_factor
+			<< "_tiles"	<< onnx_nn().get_tiling() << onnx_nn().get_tile_overlap()
+			<< "_rect"	<< onnx_nn().get_rectangular();
+		if (onnx_nn().get_tiling())
 		{
-			root["completely_empty"] = false;
+			// the duplicates along the tile seams are merged using the NMS threshold before the candidates are cached
+			ss << "_tnms" << onnx_nn().get_tile_nms_threshold();
 		}
+	}
+	ss << "_min" << candidate_threshold;
+	const std::string key = PredictionCache::model_key(weights_filename, input_size, ss.str());
 
-		if (next_id > 0 or image_is_completely_empty)
+	if (inference_pool and key != prediction_cache.key)
+	{
+		// the replicas copied the settings of the interactive network when they were created, so they are now stale
+		Log("settings which change the candidates have been modified, stopping the inference pool");
+		inference_pool.reset();
+	}
+
+	prediction_cache.open(project_info.project_dir, key);
+
+	return;
+}
+
+
+void dm::DMContent::apply_onnx_session_settings()
+{
+	OnnxHelp::SessionSettings settings;
+	settings.intra_op_threads	= cfg().get_int	(cfg_prefix + "onnx_intra_threads"		, 0		);
+	settings.inter_op_threads	= cfg().get_int	(cfg_prefix + "onnx_inter_threads"		, 0		);
+	settings.parallel_execution	= cfg().get_bool(cfg_prefix + "onnx_parallel_execution"	, false	);
+	settings.memory_pattern		= cfg().get_bool(cfg_prefix + "onnx_memory_pattern"		, true	);
+	settings.cpu_arena			= cfg().get_bool(cfg_prefix + "onnx_cpu_arena"			, true	);
+
+	// "auto" is stored as zero
+	const auto & options = dmapp().cli_options;
+	if (options.count("onnx_intra_threads"		))	settings.intra_op_threads	= toInt(options.at("onnx_intra_threads"			));
+	if (options.count("onnx_inter_threads"		))	settings.inter_op_threads	= toInt(options.at("onnx_inter_threads"			));
+	if (options.count("onnx_parallel_execution"	))	settings.parallel_execution	= toBool(options.at("onnx_parallel_execution"	));
+	if (options.count("onnx_memory_pattern"		))	settings.memory_pattern		= toBool(options.at("onnx_memory_pattern"		));
+	if (options.count("onnx_cpu_arena"			))	settings.cpu_arena			= toBool(options.at("onnx_cpu_arena"			));
+
+	OnnxHelp::NN::set_session_settings(settings);
+
+	return;
+}
+
+
+bool dm::DMContent::use_rectangular_inference() const
+{
+	const auto & options = dmapp().cli_options;
+	if (options.count("onnx_rectangular"))
+	{
+		return toBool(options.at("onnx_rectangular"));
+	}
+
+	return cfg().get_bool(cfg_prefix + "onnx_rectangular", false);
+}
+
+
+dm::PredictionCache::Detections dm::DMContent::filter_detections(const PredictionCache::Detections & candidates, const cv::Size & image_size) const
+{
+	PredictionCache::Detections detections;
+
+	if (dmapp().darkhelp_nn)
+	{
+		// Darknet already applied NMS to the candidates.  A candidate can only be suppressed by a candidate with a higher
+		// probability, so removing the candidates below the threshold gives the same results as running Darknet again.
+		const float threshold = cfg().get_int("darknet_threshold") / 100.0f;
+		for (const auto & candidate : candidates)
 		{
-			std::ofstream fs(json_filename);
-			fs.imbue(std::locale("C"));
-			fs << root.dump(1, '\t') << std::endl;
+			if (candidate.probability < threshold)
+			{
+				continue;
+			}
 
-			if (fs.fail())
+			auto d = candidate;
+			for (auto iter = d.all_probabilities.begin(); iter != d.all_probabilities.end(); )
 			{
-				Log("Error saving " + json_filename);
-				AlertWindow::showMessageBox(
-					AlertWindow::AlertIconType::WarningIcon,
-					"DarkMark",
-					"Failed to save the annotations to " + json_filename + ".\n"
-					"\n"
-					"Is the drive full?  Perhaps a read-only file or directory?");
+				if (iter->second < threshold and iter->first != d.class_idx)
+				{
+					iter = d.all_probabilities.erase(iter);
+				}
+				else
+				{
+					iter ++;
+				}
 			}
+			detections.push_back(d);
 		}
-		else
+	}
+	else if (dmapp().onnx_nn or dmapp().opencv_nn)
+	{
+		// Darknet models run by OpenCV use the Darknet thresholds, but NMS is applied here like it is for ONNX
+		const float conf_threshold	= (dmapp().onnx_nn ? cfg().get_int("onnx_threshold")		: cfg().get_int("darknet_threshold")		) / 100.0f;
+		const float nms_threshold	= (dmapp().onnx_nn ? cfg().get_int("onnx_nms_threshold")	: cfg().get_int("darknet_nms_threshold")	) / 100.0f;
+
+		// convert back to the image coordinates used by OnnxHelp
+		OnnxHelp::PredictionResults results;
+		results.reserve(candidates.size());
+		for (const auto & candidate : candidates)
 		{
-			// image has no markup -- delete the .json file if it existed
-			std::remove(json_filename.c_str());
+			OnnxHelp::PredictionResult res;
+			res.rect = cv::Rect(
+				std::round(candidate.rect.x			* image_size.width),
+				std::round(candidate.rect.y			* image_size.height),
+				std::round(candidate.rect.width		* image_size.width),
+				std::round(candidate.rect.height	* image_size.height));
+			res.probability	= candidate.probability;
+			res.class_idx	= candidate.class_idx;
+			results.push_back(res);
 		}
 
-		if (scrollfield_width > 0)
+		// the indexes are used to return the original detections
+		for (const auto idx : OnnxHelp::NN::filter_indexes(results, conf_threshold, nms_threshold))
 		{
-			scrollfield.update_index(image_filename_index);
-			scrollfield.need_to_rebuild_cache_image = true;
+			detections.push_back(candidates.at(idx));
 		}
 	}
 
-	need_to_save = false;
+	return detections;
+}
+
+
+dm::VMarks dm::DMContent::detections_to_marks(const PredictionCache::Detections & detections, const cv::Size & image_size) const
+{
+	auto class_name = [&](const int class_idx) -> std::string
+	{
+		if (class_idx >= 0 and static_cast<size_t>(class_idx) < names.size())
+		{
+			return names.at(class_idx);
+		}
+		return "class_" + std::to_string(class_idx);
+	};
+
+	VMarks prediction_marks;
+	for (const auto & d : detections)
+	{
+		const cv::Point2d midpoint(d.rect.x + d.rect.width / 2.0, d.rect.y + d.rect.height / 2.0);
+		Mark m(midpoint, cv::Size2d(d.rect.width, d.rect.height), image_size, d.class_idx);
+		m.name = class_name(d.class_idx);
+		m.is_prediction = true;
+
+		// describe the prediction the same way Darknet does, such as "car 87%, truck 12%"
+		std::multimap<float, int, std::greater<float>> ordered;
+		for (const auto & [class_idx, probability] : d.all_probabilities)
+		{
+			ordered.insert({probability, class_idx});
+		}
+		for (const auto & [probability, class_idx] : ordered)
+		{
+			if (m.description.empty() == false)
+			{
+				m.description += ", ";
+			}
+			m.description += class_name(class_idx) + " " + std::to_string(static_cast<int>(std::round(100.0f * probability))) + "%";
+		}
+
+		prediction_marks.push_back(m);
+	}
+
+	return prediction_marks;
+}
+
+
+dm::VMarks dm::DMContent::predict_marks(const std::string & filename, const cv::Mat & mat, std::string & processing_time, cv::Mat & heatmap)
+{
+	return detections_to_marks(get_detections(filename, mat, processing_time, &heatmap), mat.size());
+}
+
+
+dm::DMContent & dm::DMContent::refilter_predictions()
+{
+	if (show_predictions == EToggle::kOff or original_image.empty() or (not dmapp().darkhelp_nn and not dmapp().onnx_nn and not dmapp().opencv_nn))
+	{
+		return *this;
+	}
+
+	PredictionCache::Detections candidates;
+	if (prediction_cache.get(long_filename, candidates) == false)
+	{
+		// predictions for this image are not yet available, so nothing to filter
+		return *this;
+	}
+
+	// replace the previous predictions, but keep the user's own marks
+	marks.erase(std::remove_if(marks.begin(), marks.end(), [](const Mark & m) { return m.is_prediction; }), marks.end());
+	selected_mark = -1;
+	selected_marks.clear();
+
+	const auto prediction_marks = detections_to_marks(filter_detections(candidates, original_image.size()), original_image.size());
+	marks.insert(marks.end(), prediction_marks.begin(), prediction_marks.end());
+	sort_marks();
+
+	rebuild_image_and_repaint();
 
 	return *this;
 }
 
 
-dm::DMContent & dm::DMContent::import_text_annotations(const VStr & images_fn)
+dm::DMContent & dm::DMContent::merge_predictions(const size_t generation, const PredictionCache::Detections & detections, const cv::Size & image_size, const std::string & processing_time, const cv::Mat & heatmap)
 {
-	if (images_fn.empty() == false)
+	if (generation != prediction_generation or show_predictions == EToggle::kOff)
 	{
-		DMContentImportTxt helper(*this, images_fn);
-		helper.runThread(); // waits for this to finish before continuing
+		// these predictions are for an image which is no longer shown
+		return *this;
 	}
 
+	const auto prediction_marks = detections_to_marks(detections, image_size);
+
+	darknet_image_processing_time	= processing_time;
+	heatmap_image					= heatmap;
+	marks.insert(marks.end(), prediction_marks.begin(), prediction_marks.end());
+
+	if (selected_mark < 0 and selected_marks.empty())
+	{
+		// nothing is selected, so it is safe to re-order the marks
+		sort_marks();
+	}
+
+	rebuild_image_and_repaint();
+
 	return *this;
 }
 
 
-size_t dm::DMContent::build_id_from_classes(File & f)
+dm::DMContent & dm::DMContent::sort_marks()
 {
-	// assigns a numeric ID to each class so images can be sorted by "similarity" of annotations
+	// Sort the marks based on a gross (rounded) X and Y position of the midpoint.  This way when
+	// the user presses TAB or SHIFT+TAB the marks appear in a consistent and predictable order.
+	std::sort(marks.begin(), marks.end(),
+			[](auto & lhs, auto & rhs)
+			{
+				const auto & p1 = lhs.get_normalized_midpoint();
+				const auto & p2 = rhs.get_normalized_midpoint();
 
-	size_t result = 0;
+				const int y1 = std::round(15.0 * p1.y);
+				const int y2 = std::round(15.0 * p2.y);
 
-	if (f.existsAsFile())
+				if (y1 < y2) return true;
+				if (y2 < y1) return false;
+
+				// if we get here then y1 and y2 are the same, so now we compare x1 and x2
+
+				const int x1 = std::round(15.0 * p1.x);
+				const int x2 = std::round(15.0 * p2.x);
+
+				if (x1 < x2) return true;
+
+				return false;
+			} );
+
+	return *this;
+}
+
+
+dm::DMContent & dm::DMContent::save_text()
+{
+	if (text_filename.empty() == false)
 	{
 		try
 		{
-			json root = json::parse(f.loadFileAsString().toStdString());
+			save_text_annotations(text_filename, marks, image_is_completely_empty);
+		}
+		catch (const std::exception & e)
+		{
+			Log("Error saving text file " + text_filename + ": " + e.what());
+			AlertWindow::showMessageBox(
+				AlertWindow::AlertIconType::WarningIcon,
+				"DarkMark",
+				"Failed to save the text annotations to " + text_filename + ".\n"
+				"\n"
+				"Is the drive full?  Perhaps a read-only file or directory?");
+		}
+	}
 
-			// now we walk through the marks and turn on bits for whichever class has been annotated
-			for (size_t idx = 0; idx < root["mark"].size(); idx ++)
-			{
-				const size_t class_id = root["mark"][idx]["class_idx"];
-				result |= (0x01 << (empty_image_name_index - class_id));
-			}
+	return *this;
+}
 
-			if (result == 0 and root.value("completely_empty", false))
-			{
-				// assign a value to completely empty images so they don't mix with non-annotated images
-				result = 1;
-			}
+
+dm::DMContent & dm::DMContent::save_json()
+{
+	if (json_filename.empty() == false)
+	{
+		const std::time_t now = std::time(nullptr);
+		size_t number_of_marks = 0;
+		try
+		{
+			number_of_marks = save_json_annotations(json_filename, marks, original_image.size(), scale_factor, image_is_completely_empty, now);
 		}
 		catch (const std::exception & e)
 		{
-			Log("Error parsing " + f.getFullPathName().toStdString() + ": " + e.what());
+			Log("Error saving " + json_filename + ": " + e.what());
 			AlertWindow::showMessageBox(
 				AlertWindow::AlertIconType::WarningIcon,
 				"DarkMark",
-				"Failed to read or parse the .json file " + f.getFullPathName().toStdString() + ":\n"
-				"\n" +
-				e.what());
+				"Failed to save the annotations to " + json_filename + ".\n"
+				"\n"
+				"Is the drive full?  Perhaps a read-only file or directory?");
+		}
+
+		// remember what was just saved so neither sorting nor the scrollfield need to re-parse this .json file
+		const auto entry = annotation_index.update(long_filename, marks, number_of_marks == 0 and image_is_completely_empty, now);
+
+		if (scrollfield_width > 0)
+		{
+			scrollfield.update_index(image_filename_index, entry);
+			scrollfield.need_to_rebuild_cache_image = true;
 		}
 	}
 
-	return result;
+	need_to_save = false;
+
+	return *this;
+}
+
+
+dm::DMContent & dm::DMContent::import_text_annotations(const VStr & images_fn)
+{
+	if (images_fn.empty() == false)
+	{
+		DMContentImportTxt helper(*this, images_fn);
+		helper.runThread(); // waits for this to finish before continuing
+	}
+
+	return *this;
 }
 
 
@@ -1413,6 +1939,8 @@ dm::DMContent & dm::DMContent::delete_image(const std::string & fn_to_delete)
 		f.moveToTrash();
 		f.withFileExtension(".txt").moveToTrash();
 		f.withFileExtension(".json").moveToTrash();
+		annotation_index.remove(fn_to_delete);
+		image_cache.invalidate(fn_to_delete);
 
 		image_filenames.erase(it);
 
@@ -1441,6 +1969,8 @@ dm::DMContent & dm::DMContent::delete_current_image()
 		f.moveToTrash();
 		f.withFileExtension(".txt"	).moveToTrash();
 		f.withFileExtension(".json"	).moveToTrash();
+		annotation_index.remove(image_filenames[image_filename_index]);
+		image_cache.invalidate(image_filenames[image_filename_index]);
 
 		image_filenames.erase(image_filenames.begin() + image_filename_index);
 		load_image(image_filename_index);
@@ -1897,7 +2427,7 @@ PopupMenu dm::DMContent::create_popup_menu()
 	PopupMenu review;
 	review.addItem("zoom-and-review"		, std::function<void()>( [&]{ zoom_and_review();	} ));
 	review.addItem("review annotations..."	, std::function<void()>( [&]{ review_marks();		} ));
-	if (dmapp().darkhelp_nn or dmapp().onnx_nn)
+	if (dmapp().darkhelp_nn or dmapp().onnx_nn or dmapp().opencv_nn)
 	{
 		review.addItem("review IoU..."		, std::function<void()>( [&]{ review_iou();			} ));
 	}
@@ -1994,6 +2524,23 @@ dm::DMContent & dm::DMContent::review_iou()
 }
 
 
+dm::DMContent & dm::DMContent::pre_annotate()
+{
+	// this runs without a progress window since the editor is hidden when pre-annotating from the CLI
+	try
+	{
+		DMContentPreAnnotate helper(*this);
+		helper.run();
+	}
+	catch (const std::exception & e)
+	{
+		Log("pre-annotate: failed to annotate the images: " + std::string(e.what()));
+	}
+
+	return *this;
+}
+
+
 dm::DMContent & dm::DMContent::zoom_and_review()
 {
 	bool use_current_image = false;
@@ -2289,9 +2836,12 @@ dm::DMContent & dm::DMContent::save_screenshot(const bool full_size, const std::
 			// we want to save the full-size image, not the resized one we're currently viewing,
 			// so swap out a few things, re-build the annotated image, and save *those* results
 			scaled_image_size = original_image.size();
-			canvas.rebuild_cache_image();
 		}
 
+		// when zoomed in the canvas normally renders only the visible portion of the image, but the screenshot needs all of it
+		canvas.render_entire_image = true;
+		canvas.rebuild_cache_image();
+
 		if (f.hasFileExtension(".png"))
 		{
 			cv::imwrite(f.getFullPathName().toStdString(), scaled_image, {CV_IMWRITE_PNG_COMPRESSION, 9});
@@ -2301,12 +2851,10 @@ dm::DMContent & dm::DMContent::save_screenshot(const bool full_size, const std::
 			cv::imwrite(f.getFullPathName().toStdString(), scaled_image, {CV_IMWRITE_JPEG_QUALITY, 75});
 		}
 
-		if (scaled_image_size != old_scaled_image_size)
-		{
-			// now put back the scaled image we expect to be there
-			scaled_image_size = old_scaled_image_size;
-			canvas.rebuild_cache_image();
-		}
+		// now put back the scaled image we expect to be there
+		canvas.render_entire_image = false;
+		scaled_image_size = old_scaled_image_size;
+		canvas.rebuild_cache_image();
 	}
 
 	return *this;
@@ -3166,16 +3714,22 @@ bool dm::DMContent::handleKeybindAction(KeybindAction action)
 			return true;
 			
 		case KeybindAction::NavigateUp:
-			if (dmapp().darkhelp_nn)
+			// the thresholds are applied to the cached candidates, so there is no need to reload the image or run the network
+			if (dmapp().darkhelp_nn or dmapp().opencv_nn)
 			{
-				float threshold = dmapp().darkhelp_nn->config.threshold;
-				threshold += 0.05f;
-				threshold = std::min(std::max(threshold, 0.05f), 0.95f);
-				if (threshold != dmapp().darkhelp_nn->config.threshold)
+				int threshold = cfg().get_int("darknet_threshold");
+				threshold += 5;
+				threshold = std::min(std::max(threshold, 5), 95);
+				if (threshold != cfg().get_int("darknet_threshold"))
 				{
-					dmapp().darkhelp_nn->config.threshold = threshold;
-					load_image(image_filename_index);
-					show_message("darknet threshold: " + std::to_string((int)std::round(100.0 * threshold)) + "%");
+					cfg().setValue("darknet_threshold", threshold);
+					if (dmapp().darkhelp_nn)
+					{
+						std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+						dmapp().darkhelp_nn->config.threshold = threshold / 100.0f;
+					}
+					refilter_predictions();
+					show_message("darknet threshold: " + std::to_string(threshold) + "%");
 				}
 			}
 			else if (dmapp().onnx_nn)
@@ -3186,23 +3740,28 @@ bool dm::DMContent::handleKeybindAction(KeybindAction action)
 				if (threshold != cfg().get_int("onnx_threshold"))
 				{
 					cfg().setValue("onnx_threshold", threshold);
-					load_image(image_filename_index);
+					refilter_predictions();
 					show_message("ONNX threshold: " + std::to_string(threshold) + "%");
 				}
 			}
 			return true;
 			
 		case KeybindAction::NavigateDown:
-			if (dmapp().darkhelp_nn)
+			if (dmapp().darkhelp_nn or dmapp().opencv_nn)
 			{
-				float threshold = dmapp().darkhelp_nn->config.threshold;
-				threshold -= 0.05f;
-				threshold = std::min(std::max(threshold, 0.05f), 0.95f);
-				if (threshold != dmapp().darkhelp_nn->config.threshold)
+				int threshold = cfg().get_int("darknet_threshold");
+				threshold -= 5;
+				threshold = std::min(std::max(threshold, 5), 95);
+				if (threshold != cfg().get_int("darknet_threshold"))
 				{
-					dmapp().darkhelp_nn->config.threshold = threshold;
-					load_image(image_filename_index);
-					show_message("darknet threshold: " + std::to_string((int)std::round(100.0 * threshold)) + "%");
+					cfg().setValue("darknet_threshold", threshold);
+					if (dmapp().darkhelp_nn)
+					{
+						std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+						dmapp().darkhelp_nn->config.threshold = threshold / 100.0f;
+					}
+					refilter_predictions();
+					show_message("darknet threshold: " + std::to_string(threshold) + "%");
 				}
 			}
 			else if (dmapp().onnx_nn)
@@ -3213,7 +3772,7 @@ bool dm::DMContent::handleKeybindAction(KeybindAction action)
 				if (threshold != cfg().get_int("onnx_threshold"))
 				{
 					cfg().setValue("onnx_threshold", threshold);
-					load_image(image_filename_index);
+					refilter_predictions();
 					show_message("ONNX threshold: " + std::to_string(threshold) + "%");
 				}
 			}
@@ -3675,6 +4234,20 @@ bool dm::DMContent::handleKeybindAction(KeybindAction action)
 				load_image(image_filename_index);
 				cfg().setValue("darknet_image_tiling", dmapp().darkhelp_nn->config.enable_tiles);
 			}
+			else if (dmapp().onnx_nn)
+			{
+				{
+					std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+					dmapp().onnx_nn->set_tiling(not dmapp().onnx_nn->get_tiling(), dmapp().onnx_nn->get_tile_overlap());
+				}
+				show_message("image tiling: " + std::string(dmapp().onnx_nn->get_tiling() ? "enable" : "disable"));
+				load_image(image_filename_index);
+				cfg().setValue("darknet_image_tiling", dmapp().onnx_nn->get_tiling());
+			}
+			else if (dmapp().opencv_nn)
+			{
+				show_message("image tiling is not supported by OpenCV DNN");
+			}
 			return true;
 			
 		// Sorting
@@ -81,14 +81,75 @@ namespace dm
 
 			DMContent & load_image(const size_t new_idx, const bool full_load = true, const bool display_immediately = false);
 
+			/** Get the detections for the given image.  The unfiltered candidates come either from @ref prediction_cache or
+			 * from running the neural network, and are then passed through @ref filter_detections().  If heatmaps are enabled
+			 * and @p heatmap is not @p nullptr, the network is always run so the heatmap can be set.  This can be called from
+			 * any thread.
+			 */
+			PredictionCache::Detections get_detections(const std::string & filename, const cv::Mat & mat, std::string & processing_time, cv::Mat * heatmap = nullptr);
+
+			/** Similar to @ref get_detections(), but meant for bulk operations which need to predict many images.  Images
+			 * which are not yet in @ref prediction_cache are given to @ref inference_pool, so several images can be
+			 * processed at the same time without blocking the interactive neural network used by the editor.  This blocks
+			 * while the pool's queue is full.  When the pool is disabled (@p inference_replicas=0) the image is predicted
+			 * immediately with the interactive neural network.
+			 */
+			std::future<PredictionCache::Detections> submit_detections(const std::string & filename, const cv::Mat & mat);
+
+			/// Load the replicas used by @ref inference_pool.  The inference mutex must be held.
+			void start_inference_pool();
+
+			/** The number of images bulk operations should keep in flight with @ref submit_detections(), so every replica
+			 * in @ref inference_pool has a batch running and another one waiting.  The pool is started if necessary, so
+			 * this uses the number of replicas which were actually loaded.  Returns 1 when the pool is disabled.
+			 */
+			size_t images_in_flight();
+
+			/// Open the prediction cache which matches the current neural network and settings.  The inference mutex must be held.
+			void open_prediction_cache();
+
+			/** Set the ONNX Runtime session options used the next time a model is loaded.  The options come from the
+			 * project's configuration, and can be overridden with CLI parameters such as @p onnx_intra_threads=4.
+			 */
+			void apply_onnx_session_settings();
+
+			/// Determine if ONNX models with dynamic dimensions should use rectangular inference, see @ref OnnxHelp::NN::set_rectangular().
+			bool use_rectangular_inference() const;
+
+			/** Apply the current detection threshold (and NMS for ONNX) to the unfiltered candidates stored in
+			 * @ref prediction_cache.  This is cheap, so it can be called every time a threshold changes.
+			 */
+			PredictionCache::Detections filter_detections(const PredictionCache::Detections & candidates, const cv::Size & image_size) const;
+
+			/// Convert detections to prediction marks.
+			VMarks detections_to_marks(const PredictionCache::Detections & detections, const cv::Size & image_size) const;
+
+			/// Similar to @ref get_detections(), but the results are converted to prediction marks.
+			VMarks predict_marks(const std::string & filename, const cv::Mat & mat, std::string & processing_time, cv::Mat & heatmap);
+
+			/// Re-apply the thresholds to the predictions for the current image without running the neural network.
+			DMContent & refilter_predictions();
+
+			/** Candidates are cached down to this probability, so the detection threshold can later be set to any value
+			 * from here to 100% without having to run the neural network again.
+			 */
+			static constexpr float candidate_threshold = 0.01f;
+
+			/** Called on the message thread when @ref prediction_thread has finished with an image.  The predictions are
+			 * ignored if @p generation shows the user has since moved to a different image.  The detections are converted
+			 * to marks here and not on the prediction thread, since @ref start_darknet() may replace the names at any time.
+			 */
+			DMContent & merge_predictions(const size_t generation, const PredictionCache::Detections & detections, const cv::Size & image_size, const std::string & processing_time, const cv::Mat & heatmap);
+
+			/// Sort the marks by position so TAB and SHIFT+TAB move through the marks in a predictable order.
+			DMContent & sort_marks();
+
 			DMContent & save_text();
 
 			DMContent & save_json();
 
 			DMContent & import_text_annotations(const VStr & image_filenames);
 
-			size_t build_id_from_classes(File & f);
-
 			size_t count_marks_in_json(File & f, const bool for_sorting_purposes=false);
 
 			bool load_text();
@@ -127,6 +188,9 @@ namespace dm
 
 			DMContent & review_iou();
 
+			/// Predict every image which doesn't have annotations.  Used by the CLI option @p editor=pre-annotate.  @see @ref DMContentPreAnnotate
+			DMContent & pre_annotate();
+
 			DMContent & zoom_and_review();
 
 			DMContent & rotate_every_image();
@@ -243,6 +307,12 @@ namespace dm
 
 			std::atomic<bool> images_are_loading;
 
+			/// Incremented every time an image is loaded, so predictions for a previous image can be recognized and discarded.
+			std::atomic<size_t> prediction_generation;
+
+			/// Runs the neural network in the background when predictions are shown.  @see @ref load_image()
+			std::unique_ptr<DMContentPredict> prediction_thread;
+
 			cv::Mat original_image;
 			cv::Mat scaled_image;
 			cv::Mat heatmap_image;
@@ -291,6 +361,18 @@ namespace dm
 
 			ProjectInfo project_info;
 
+			/// Cached information from every .json file, used to quickly sort the images.  @see @ref set_sort_order()
+			AnnotationIndex annotation_index;
+
+			/// Decoded images, including the next few images which are decoded in the background.  @see @ref load_image()
+			ImageCache image_cache;
+
+			/// Detections from the neural network, so images don't need to be predicted more than once.  @see @ref get_detections()
+			PredictionCache prediction_cache;
+
+			/// Replicas of the neural network used by bulk operations.  Loaded the first time it is needed.  @see @ref submit_detections()
+			std::shared_ptr<InferencePool> inference_pool;
+
 			BubbleMessageComponent bubble_message;
 
 			VStr images_without_json;
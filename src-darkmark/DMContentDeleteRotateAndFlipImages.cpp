@@ -83,6 +83,7 @@ void dm::DMContentDeleteRotateAndFlipImages::run()
 	std::sort(keep_filenames.begin(), keep_filenames.end());
 
 	content.image_filenames.swap(keep_filenames);
+	content.image_cache.clear();
 	content.load_image(0);
 	content.set_sort_order(ESort::kAlphabetical);
 
@@ -576,6 +576,7 @@ void dm::DMContentFlipImages::run()
 	setStatusMessage("Sorting...");
 	content.scrollfield_width = previous_scrollfield_width;
 	content.show_predictions = previous_predictions;
+	content.image_cache.clear();
 	juce::MessageManager::callAsync([safe_content = juce::Component::SafePointer<dm::DMContent>(&content)]()
 	{
 		if (safe_content != nullptr)
@@ -38,7 +38,16 @@ void dm::DMContentImageFilenameSort::run()
 	// first thing we need to do is sort alphabetically so we can maintain a predictable order between images (issue #38)
 	std::sort(content.image_filenames.begin(), content.image_filenames.end());
 
-	std::map<std::string, float> m;
+	std::map<std::string, double> m;
+
+	/* When sorting by similar marks, each image gets a string with 1 character per class (plus 1 for "empty images")
+	 * set to '1' when that class appears in the image.  Comparing these strings gives the same order as the old bit
+	 * field where class #0 was the most significant bit, but without any limit on the number of classes.
+	 */
+	std::map<std::string, std::string> similar;
+
+	// images where the .json file could not be parsed are reported once the sort has finished
+	VStr parse_errors;
 
 	const std::time_t now = std::time(nullptr);
 
@@ -55,121 +64,110 @@ void dm::DMContentImageFilenameSort::run()
 		setProgress(work_completed / max_work);
 		work_completed ++;
 
-		File file = File(fn).withFileExtension(".json");
-		if (content.sort_order == dm::ESort::kCountMarks)
+		// the index only needs to parse the .json file if it has changed since the last time we looked at it
+		const auto entry = content.annotation_index.get(fn);
+		if (entry.parse_error)
 		{
-			m[fn] = content.count_marks_in_json(file, true);
+			parse_errors.push_back(fn);
 		}
-		else if (content.sort_order == dm::ESort::kSimilarMarks)
-		{
-			m[fn] = content.build_id_from_classes(file);
-		}
-		else
-		{
-			// if we get here, then we need to get something from the .json file
-			json j;
-			if (file.existsAsFile())
-			{
-				j = json::parse(file.loadFileAsString().toStdString());
-			}
 
-			if (content.sort_order == dm::ESort::kMinimumIoU)
-			{
-				float f = 0.0f;
-				if (j.contains("predictions"))
-				{
-					f = j["predictions"]["IoU"]["min"];
-				}
-				m[fn] = f;
-			}
-			else if (content.sort_order == dm::ESort::kAverageIoU)
+		if (content.sort_order == dm::ESort::kCountMarks)
+		{
+			// add 1 when there are marks, that way empty images wont be mixed up with images that have 1 mark
+			double count = entry.number_of_marks;
+			if (count > 0)
 			{
-				float f = 0.0f;
-				if (j.contains("predictions"))
-				{
-					f = j["predictions"]["IoU"]["avg"];
-				}
-				m[fn] = f;
+				count ++;
 			}
-			else if (content.sort_order == dm::ESort::kMaximumIoU)
+			else if (entry.completely_empty)
 			{
-				float f = 0.0f;
-				if (j.contains("predictions"))
-				{
-					f = j["predictions"]["IoU"]["max"];
-				}
-				m[fn] = f;
+				count = 1;
 			}
-			else if (content.sort_order == dm::ESort::kNumberOfPredictions)
+			m[fn] = count;
+		}
+		else if (content.sort_order == dm::ESort::kSimilarMarks)
+		{
+			// assign an ID to each combination of classes so images can be sorted by "similarity" of annotations
+			std::string id(content.empty_image_name_index + 1, '0');
+			for (const auto & [class_idx, count] : entry.histogram)
 			{
-				float f = 0.0f;
-				if (j.contains("predictions"))
+				if (count > 0 and class_idx < id.size())
 				{
-					f = j["predictions"]["count"];
+					id[class_idx] = '1';
 				}
-				m[fn] = f;
 			}
-			else if (content.sort_order == dm::ESort::kNumberOfDifferences)
+
+			if (entry.histogram.empty() and entry.completely_empty)
 			{
-				float f = 0.0f;
-				if (j.contains("predictions"))
-				{
-					f = j["predictions"]["number_of_differences"];
-				}
-				m[fn] = f;
+				// assign a value to completely empty images so they don't mix with non-annotated images
+				id.back() = '1';
 			}
-			else if (content.sort_order == dm::ESort::kPredictionsWithoutAnnotations)
+			similar[fn] = id;
+		}
+		else if (content.sort_order == dm::ESort::kMinimumIoU)
+		{
+			m[fn] = entry.minimum_iou;
+		}
+		else if (content.sort_order == dm::ESort::kAverageIoU)
+		{
+			m[fn] = entry.average_iou;
+		}
+		else if (content.sort_order == dm::ESort::kMaximumIoU)
+		{
+			m[fn] = entry.maximum_iou;
+		}
+		else if (content.sort_order == dm::ESort::kNumberOfPredictions)
+		{
+			m[fn] = entry.number_of_predictions;
+		}
+		else if (content.sort_order == dm::ESort::kNumberOfDifferences)
+		{
+			m[fn] = entry.number_of_differences;
+		}
+		else if (content.sort_order == dm::ESort::kPredictionsWithoutAnnotations)
+		{
+			m[fn] = entry.predictions_without_annotations;
+		}
+		else if (content.sort_order == dm::ESort::kAnnotationsWithoutPredictions)
+		{
+			m[fn] = entry.annotations_without_predictions;
+		}
+		else if (content.sort_order == dm::ESort::kTimestamp)
+		{
+			/* This is what would be most useful:
+				*
+				*		1) unmarked images are sorted first
+				*		2) marked images are then appended with the most recent image appearing at the very end
+				*
+				* This way users can press "END" and move LEFT to iterate over images, or press "HOME" and move RIGHT to see
+				* unmarked images.
+				*
+				* The way we do this is to calculate the age of an image:  NOW - time when an image was last modified.  A picture
+				* with an age of 1 second was just modified, while a picture with an age of 12345 was modified a long time ago.
+				* And to make this work so unmarked images are sorted first, we bias them as being much older than all marked
+				* images.  Simply subtract a constant value from the timestamp of unmarked images.
+				*/
+			size_t timestamp = 0;
+
+			if (entry.timestamp != 0)
 			{
-				float f = 0.0f;
-				if (j.contains("predictions"))
-				{
-					f = j["predictions"]["predictions_without_annotations"];
-				}
-				m[fn] = f;
+				timestamp = now - entry.timestamp;
 			}
-			else if (content.sort_order == dm::ESort::kAnnotationsWithoutPredictions)
+
+			// If we don't have a timestamp, then use the file's modification time instead,
+			// but subtract a known value so we separate the files with tags and those without.
+			if (timestamp == 0)
 			{
-				float f = 0.0f;
-				if (j.contains("predictions"))
-				{
-					f = j["predictions"]["annotations_without_predictions"];
-				}
-				m[fn] = f;
+				timestamp = now - (entry.json_mtime / 1000 - 123456789);
 			}
-			else if (content.sort_order == dm::ESort::kTimestamp)
-			{
-				/* This is what would be most useful:
-					*
-					*		1) unmarked images are sorted first
-					*		2) marked images are then appended with the most recent image appearing at the very end
-					*
-					* This way users can press "END" and move LEFT to iterate over images, or press "HOME" and move RIGHT to see
-					* unmarked images.
-					*
-					* The way we do this is to calculate the age of an image:  NOW - time when an image was last modified.  A picture
-					* with an age of 1 second was just modified, while a picture with an age of 12345 was modified a long time ago.
-					* And to make this work so unmarked images are sorted first, we bias them as being much older than all marked
-					* images.  Simply subtract a constant value from the timestamp of unmarked images.
-					*/
-				size_t timestamp = 0;
-
-				if (j.contains("timestamp"))
-				{
-					timestamp = now - j["timestamp"].get<std::time_t>();
-				}
 
-				// If we don't have a timestamp, then use the file's modification time instead,
-				// but subtract a known value so we separate the files with tags and those without.
-				if (timestamp == 0)
-				{
-					timestamp = now - (file.getLastModificationTime().toMilliseconds() / 1000 - 123456789);
-				}
-
-				m[fn] = timestamp;
-			}
+			m[fn] = timestamp;
 		}
 	}
 
+	// persist anything new we learned while sorting so the next sort (or the next session) is quick
+	content.annotation_index.save();
+
 	if (threadShouldExit() == false)
 	{
 		// now that we've built up the map, we can sort the images (this part is typically very quick)
@@ -188,6 +186,11 @@ void dm::DMContentImageFilenameSort::run()
 						setProgress(work_completed / max_work);
 						work_completed ++;
 
+						if (content.sort_order == dm::ESort::kSimilarMarks)
+						{
+							return similar.at(lhs) < similar.at(rhs);
+						}
+
 						if (content.sort_order != dm::ESort::kTimestamp)
 						{
 							return m.at(lhs) < m.at(rhs);
@@ -207,6 +210,26 @@ void dm::DMContentImageFilenameSort::run()
 #endif
 	}
 
+	if (parse_errors.empty() == false)
+	{
+		// parse the first file again to show the user exactly what is wrong with it
+		std::string msg = "Failed to read or parse the .json file " + File(parse_errors[0]).withFileExtension(".json").getFullPathName().toStdString() + ".";
+		try
+		{
+			json::parse(File(parse_errors[0]).withFileExtension(".json").loadFileAsString().toStdString());
+		}
+		catch (const std::exception & e)
+		{
+			msg += "\n\n" + std::string(e.what());
+		}
+		if (parse_errors.size() > 1)
+		{
+			msg += "\n\nThe .json files for " + std::to_string(parse_errors.size() - 1) + " other image(s) also failed to parse.  See the log file for details.";
+		}
+
+		AlertWindow::showMessageBox(AlertWindow::AlertIconType::WarningIcon, "DarkMark", msg);
+	}
+
 	if (threadShouldExit())
 	{
 		// user hit the "cancel" button, so go back to a normal alphabetical sort order
@@ -0,0 +1,246 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+
+
+dm::DMContentPreAnnotate::DMContentPreAnnotate(dm::DMContent & c) :
+	content(c),
+	save_as_marks(dmapp().cli_options.count("pre_annotate") and dmapp().cli_options.at("pre_annotate") == "marks"),
+	images_decoded(0),
+	images_written(0),
+	marks_written(0)
+{
+	return;
+}
+
+
+dm::DMContentPreAnnotate::~DMContentPreAnnotate()
+{
+	return;
+}
+
+
+void dm::DMContentPreAnnotate::run()
+{
+	if (not dmapp().darkhelp_nn and not dmapp().onnx_nn and not dmapp().opencv_nn)
+	{
+		Log("pre-annotate: a neural network is required but none has been loaded for this project");
+		return;
+	}
+
+	// only the images which have neither a .json nor a .txt file still need to be annotated
+	VStr filenames;
+	for (const auto & fn : content.image_filenames)
+	{
+		const File f(fn);
+		if (f.withFileExtension(".json").existsAsFile() == false and f.withFileExtension(".txt").existsAsFile() == false)
+		{
+			filenames.push_back(fn);
+		}
+	}
+
+	Log("pre-annotate: found " + std::to_string(filenames.size()) + " images without annotations (out of " + std::to_string(content.image_filenames.size()) + "), results will be saved as " + (save_as_marks ? "marks" : "predictions"));
+	if (filenames.empty())
+	{
+		return;
+	}
+
+	const auto start_time = std::chrono::high_resolution_clock::now();
+
+	/* Keep enough predictions in flight for every replica in the inference pool to always have the next batch waiting.
+	 * The futures themselves are small since the inference pool holds on to the images, and the pool blocks when its
+	 * own queue is full.  The decoded images waiting to be submitted are full-size, so only a few of those are kept.
+	 */
+	const size_t images_in_flight = content.images_in_flight();
+
+	const size_t number_of_decoders = std::max(1, cfg().get_int("image_cache_threads"));
+	ScopedWorkerThreads busy_threads(number_of_decoders + 1);
+
+	BoundedQueue<Decoded> decoded(number_of_decoders);
+	BoundedQueue<Predicted> predicted(images_in_flight);
+
+	std::atomic<size_t> next_index(0);
+	std::atomic<size_t> decoders_running(number_of_decoders);
+	VThreads threads;
+	for (size_t idx = 0; idx < number_of_decoders; idx ++)
+	{
+		threads.emplace_back(&DMContentPreAnnotate::decode, this, std::cref(filenames), std::ref(next_index), std::ref(decoders_running), std::ref(decoded));
+	}
+	std::thread writer(&DMContentPreAnnotate::write, this, std::ref(predicted));
+
+	struct Pending
+	{
+		std::string									filename;
+		cv::Size									image_size;
+		std::future<PredictionCache::Detections>	detections;
+	};
+	std::deque<Pending> pending;
+
+	auto finish_oldest = [&]()
+	{
+		Pending oldest = std::move(pending.front());
+		pending.pop_front();
+
+		try
+		{
+			predicted.push({oldest.filename, oldest.image_size, oldest.detections.get()});
+		}
+		catch (const std::exception & e)
+		{
+			Log("pre-annotate: failed to predict " + oldest.filename + ": " + e.what());
+		}
+
+		content.prediction_cache.save_periodically();
+	};
+
+	// this thread feeds the decoded images to the inference pool, and hands the results to the writer in the original order
+	try
+	{
+		Decoded image;
+		while (decoded.pop(image))
+		{
+			pending.push_back({image.filename, image.mat.size(), content.submit_detections(image.filename, image.mat)});
+			image.mat = cv::Mat();
+
+			while (pending.size() > images_in_flight)
+			{
+				finish_oldest();
+			}
+		}
+		while (pending.empty() == false)
+		{
+			finish_oldest();
+		}
+	}
+	catch (...)
+	{
+		// stop the decoders and the writer so the threads can be joined before the exception leaves this function
+		decoded.close();
+		predicted.close();
+		writer.join();
+		for (auto & t : threads)
+		{
+			t.join();
+		}
+		throw;
+	}
+
+	predicted.close();
+	writer.join();
+	for (auto & t : threads)
+	{
+		t.join();
+	}
+
+	// remember the detections so the images don't need to be predicted again when they are opened in the editor
+	content.prediction_cache.save();
+	content.annotation_index.save();
+
+	const auto end_time = std::chrono::high_resolution_clock::now();
+	const double seconds = std::chrono::duration<double>(end_time - start_time).count();
+	Log("pre-annotate: processed " + std::to_string(images_written.load()) + " images in " + std::to_string(seconds) + " seconds (" + std::to_string(images_written.load() / std::max(0.001, seconds)) + " images per second), " + std::to_string(marks_written.load()) + " marks saved");
+
+	return;
+}
+
+
+void dm::DMContentPreAnnotate::decode(const VStr & filenames, std::atomic<size_t> & next_index, std::atomic<size_t> & decoders_running, BoundedQueue<Decoded> & decoded)
+{
+	while (true)
+	{
+		const size_t idx = next_index ++;
+		if (idx >= filenames.size())
+		{
+			break;
+		}
+
+		const auto & fn = filenames[idx];
+		cv::Mat mat;
+		try
+		{
+			mat = cv::imread(fn);
+		}
+		catch (const std::exception & e)
+		{
+			Log("pre-annotate: exception caught while decoding " + fn + ": " + e.what());
+		}
+
+		if (mat.empty())
+		{
+			Log("pre-annotate: failed to load image " + fn);
+			continue;
+		}
+
+		images_decoded ++;
+		if (decoded.push({fn, mat}) == false)
+		{
+			break;
+		}
+	}
+
+	// the last decoder to finish lets the inference thread know there are no more images coming
+	if (-- decoders_running == 0)
+	{
+		decoded.close();
+	}
+
+	return;
+}
+
+
+void dm::DMContentPreAnnotate::write(BoundedQueue<Predicted> & predicted)
+{
+	const size_t total = content.image_filenames.size();
+	auto last_update = std::chrono::high_resolution_clock::now();
+
+	Predicted result;
+	while (predicted.pop(result))
+	{
+		if (save_as_marks and result.detections.empty() == false)
+		{
+			try
+			{
+				save_marks(result);
+			}
+			catch (const std::exception & e)
+			{
+				Log("pre-annotate: failed to save the annotations for " + result.filename + ": " + e.what());
+			}
+		}
+		images_written ++;
+
+		const auto now = std::chrono::high_resolution_clock::now();
+		if (now - last_update >= std::chrono::seconds(5))
+		{
+			last_update = now;
+			Log("pre-annotate: " + std::to_string(images_written.load()) + " images done, " + std::to_string(images_decoded.load()) + " decoded, " + std::to_string(total) + " images in the project");
+		}
+	}
+
+	return;
+}
+
+
+void dm::DMContentPreAnnotate::save_marks(const Predicted & predicted)
+{
+	auto marks = content.detections_to_marks(predicted.detections, predicted.image_size);
+	for (auto & m : marks)
+	{
+		m.is_prediction = false;
+		m.description.clear();
+	}
+
+	const File image_file(predicted.filename);
+	const std::string json_filename = image_file.withFileExtension(".json").getFullPathName().toStdString();
+	const std::string text_filename = image_file.withFileExtension(".txt").getFullPathName().toStdString();
+
+	// these throw if the files cannot be written
+	const std::time_t now = std::time(nullptr);
+	save_json_annotations(json_filename, marks, predicted.image_size, 1.0, false, now);
+	save_text_annotations(text_filename, marks, false);
+
+	content.annotation_index.update(predicted.filename, marks, false, now);
+	marks_written += marks.size();
+
+	return;
+}
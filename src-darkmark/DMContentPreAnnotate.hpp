@@ -0,0 +1,63 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Run the neural network over every image in the project which does not yet have any annotations.  This is started
+	 * with the CLI option @p editor=pre-annotate and does not show any windows, so it can be scheduled to run unattended.
+	 * It does @em not run without a display:  the launcher and editor windows are still created (hidden), so on a server
+	 * an X server such as @p xvfb-run is required.
+	 *
+	 * Images are decoded by several threads, predicted in batches by @ref DMContent::inference_pool, and the results are
+	 * written out by a dedicated thread.  With @p pre_annotate=predictions (the default) the results are only stored in
+	 * the prediction cache, so the images show predictions the moment they are opened in the editor.  With
+	 * @p pre_annotate=marks the results are saved as annotations in new .json and .txt files.
+	 */
+	class DMContentPreAnnotate final
+	{
+		public:
+
+			DMContentPreAnnotate(dm::DMContent & c);
+
+			~DMContentPreAnnotate();
+
+			void run();
+
+			DMContent & content;
+
+			/// Save the results as marks instead of only storing them as predictions.
+			bool save_as_marks;
+
+		private:
+
+			struct Decoded
+			{
+				std::string	filename;
+				cv::Mat		mat;
+			};
+
+			struct Predicted
+			{
+				std::string					filename;
+				cv::Size					image_size;
+				PredictionCache::Detections	detections;
+			};
+
+			/// Decode images on one of several threads until all the images have been handed out.
+			void decode(const VStr & filenames, std::atomic<size_t> & next_index, std::atomic<size_t> & decoders_running, BoundedQueue<Decoded> & decoded);
+
+			/// Save the results on a dedicated thread so writing the files doesn't slow down inference.
+			void write(BoundedQueue<Predicted> & predicted);
+
+			/// Write the .json and .txt annotation files for a single image.
+			void save_marks(const Predicted & predicted);
+
+			std::atomic<size_t> images_decoded;
+			std::atomic<size_t> images_written;
+			std::atomic<size_t> marks_written;
+	};
+}
@@ -0,0 +1,109 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+
+
+dm::DMContentPredict::DMContentPredict(dm::DMContent & c) :
+	Thread("DarkMark predictions"),
+	content(c),
+	request_pending(false),
+	request_generation(0)
+{
+	startThread();
+
+	return;
+}
+
+
+dm::DMContentPredict::~DMContentPredict()
+{
+	signalThreadShouldExit();
+	notify();
+
+	// inference cannot be interrupted, so give the thread enough time to finish the current image
+	stopThread(30000);
+
+	return;
+}
+
+
+dm::DMContentPredict & dm::DMContentPredict::submit(const size_t generation, const std::string & filename, const cv::Mat & mat)
+{
+	{
+		std::lock_guard<std::mutex> lock(request_mutex);
+		request_pending		= true;
+		request_generation	= generation;
+		request_filename	= filename;
+		request_image		= mat;
+	}
+	notify();
+
+	return *this;
+}
+
+
+void dm::DMContentPredict::run()
+{
+	while (threadShouldExit() == false)
+	{
+		size_t generation = 0;
+		std::string filename;
+		cv::Mat mat;
+
+		{
+			std::lock_guard<std::mutex> lock(request_mutex);
+			if (request_pending)
+			{
+				request_pending = false;
+				generation	= request_generation;
+				filename	= request_filename;
+				mat			= request_image;
+				request_image = cv::Mat();
+			}
+		}
+
+		if (mat.empty())
+		{
+			wait(-1);
+			continue;
+		}
+
+		if (generation != content.prediction_generation)
+		{
+			// the user has already moved on to a different image
+			continue;
+		}
+
+		// the detections are converted to marks on the message thread, since the names may change while we're running
+		PredictionCache::Detections detections;
+		const cv::Size image_size = mat.size();
+		std::string processing_time;
+		cv::Mat heatmap;
+		try
+		{
+			detections = content.get_detections(filename, mat, processing_time, &heatmap);
+		}
+		catch (const std::exception & e)
+		{
+			Log("Error getting predictions for " + filename + ": " + e.what());
+			continue;
+		}
+
+		if (generation != content.prediction_generation)
+		{
+			Log("discarding stale predictions for " + filename);
+			continue;
+		}
+
+		juce::MessageManager::callAsync(
+			[safe_content = juce::Component::SafePointer<dm::DMContent>(&content), generation, detections, image_size, processing_time, heatmap]()
+			{
+				if (safe_content != nullptr)
+				{
+					safe_content->merge_predictions(generation, detections, image_size, processing_time, heatmap);
+				}
+			});
+	}
+
+	return;
+}
@@ -0,0 +1,40 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Dedicated inference thread used by @ref DMContent::load_image() so the image and the user's marks can be shown
+	 * immediately, without waiting for the neural network.  When the predictions are ready they are passed back to the
+	 * message thread and merged into the marks with @ref DMContent::merge_predictions().
+	 *
+	 * Only the most recent request is kept.  If the user moves to a different image before the predictions are ready,
+	 * the request is either dropped before inference starts, or the results are discarded once they arrive.
+	 */
+	class DMContentPredict : public Thread
+	{
+		public:
+
+			DMContentPredict(dm::DMContent & c);
+
+			virtual ~DMContentPredict();
+
+			/// Queue an image for inference.  This replaces any previous request which has not yet started.
+			DMContentPredict & submit(const size_t generation, const std::string & filename, const cv::Mat & mat);
+
+			virtual void run();
+
+			DMContent & content;
+
+		private:
+
+			std::mutex request_mutex;
+			bool request_pending;
+			size_t request_generation;
+			std::string request_filename;
+			cv::Mat request_image;
+	};
+}
@@ -484,6 +484,7 @@ void dm::DMContentRotateImages::run()
 	setStatusMessage("Sorting...");
 	content.scrollfield_width = previous_scrollfield_width;
 	content.show_predictions = previous_predictions;
+	content.image_cache.clear();
 	juce::MessageManager::callAsync([safe_content = juce::Component::SafePointer<dm::DMContent>(&content)]()
 	{
 		if (safe_content != nullptr)
@@ -18,7 +18,7 @@ dm::DMWnd::DMWnd(const std::string & prefix) :
 	setResizable			(true, true	);
 	setDropShadowEnabled	(true		);
 
-	if (dmapp().cli_options.count("editor") and dmapp().cli_options.at("editor") == "gen-darknet")
+	if (content.show_window == false)
 	{
 		show_window = false;
 		content.show_window = false;
@@ -141,6 +141,16 @@ void dm::DMWnd::timerCallback()
 		setMinimised(true);
 		content.show_darknet_window();
 	}
+	else if (action == "pre-annotate")
+	{
+		setVisible(false);
+		setBounds(0, 0, 0, 0);
+		setMinimised(true);
+		content.pre_annotate();
+
+		// since our sole purpose was to pre-annotate the images, we can completely exit from DarkMark
+		dmapp().systemRequestedQuit();
+	}
 	else
 	{
 		content.load_image(0);
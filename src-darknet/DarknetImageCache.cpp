@@ -0,0 +1,274 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace
+{
+	/// Increment this every time the way outputs are generated changes, so older outputs are not reused.
+	const int cache_version = 2;
+
+	/// The subdirectories of @p darkmark_image_cache which belong to this cache, and the log file each stage writes.
+	const std::map<std::string, std::string> stage_logs =
+	{
+		{"resize"	, "resized.txt"	},
+		{"tiles"	, "tiles.txt"	},
+		{"zoom"		, "zoom.txt"	},
+	};
+}
+
+
+dm::DarknetImageCache::Entry::Entry() :
+	marks(0),
+	empty_images(0),
+	resized_images(0),
+	dropped(0)
+{
+	return;
+}
+
+
+dm::DarknetImageCache::DarknetImageCache() :
+	dirty(false)
+{
+	return;
+}
+
+
+dm::DarknetImageCache::~DarknetImageCache()
+{
+	return;
+}
+
+
+dm::DarknetImageCache & dm::DarknetImageCache::open(const std::string & project_directory)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	entries.clear();
+	used.clear();
+	dirty = false;
+
+	manifest_file = File(project_directory).getChildFile("darkmark_image_cache").getChildFile("darknet_manifest.json");
+	if (manifest_file.existsAsFile() == false)
+	{
+		Log("darknet image cache manifest does not exist: " + manifest_file.getFullPathName().toStdString());
+		return *this;
+	}
+
+	try
+	{
+		const json root = json::parse(manifest_file.loadFileAsString().toStdString());
+		if (root.value("version", 0) != cache_version)
+		{
+			Log("ignoring incompatible darknet image cache manifest " + manifest_file.getFullPathName().toStdString());
+			return *this;
+		}
+
+		for (const auto & item : root.at("entries").items())
+		{
+			const std::string name	= item.key();
+			const json & j			= item.value();
+
+			Entry entry;
+			entry.key				= j.at("key"		).get<std::string>();
+			entry.outputs			= j.at("outputs"	).get<VStr>();
+			entry.marks				= j.at("marks"		).get<size_t>();
+			entry.empty_images		= j.at("empty"		).get<size_t>();
+			entry.resized_images	= j.at("resized"	).get<size_t>();
+			entry.dropped			= j.at("dropped"	).get<size_t>();
+
+			entries[name] = entry;
+		}
+	}
+	catch (const std::exception & e)
+	{
+		Log("failed to read the darknet image cache manifest " + manifest_file.getFullPathName().toStdString() + ": " + e.what());
+		entries.clear();
+	}
+
+	Log("darknet image cache loaded " + std::to_string(entries.size()) + " entries from " + manifest_file.getFullPathName().toStdString());
+
+	return *this;
+}
+
+
+dm::DarknetImageCache & dm::DarknetImageCache::save()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	if (dirty == false or manifest_file == File())
+	{
+		return *this;
+	}
+
+	json root;
+	root["version"] = cache_version;
+	root["entries"] = json::object();
+	for (const auto & [name, entry] : entries)
+	{
+		auto & j = root["entries"][name];
+		j["key"]		= entry.key;
+		j["outputs"]	= entry.outputs;
+		j["marks"]		= entry.marks;
+		j["empty"]		= entry.empty_images;
+		j["resized"]	= entry.resized_images;
+		j["dropped"]	= entry.dropped;
+	}
+
+	// write to a temporary file first so an interrupted save never leaves behind a corrupt manifest
+	const std::string text = root.dump(1, '\t');
+	manifest_file.getParentDirectory().createDirectory();
+	TemporaryFile tmp(manifest_file);
+	if (tmp.getFile().replaceWithData(text.c_str(), text.size()) and tmp.overwriteTargetFileWithTemporary())
+	{
+		Log("darknet image cache saved " + std::to_string(entries.size()) + " entries to " + manifest_file.getFullPathName().toStdString());
+		dirty = false;
+	}
+	else
+	{
+		Log("failed to save the darknet image cache manifest " + manifest_file.getFullPathName().toStdString());
+	}
+
+	return *this;
+}
+
+
+std::string dm::DarknetImageCache::hash_source(const std::string & source_image)
+{
+	// the image is only identified by size and timestamp since hashing every image would take as long as decoding it
+	const File image_file(source_image);
+	const std::string text =
+		source_image + "|" +
+		std::to_string(image_file.getSize()) + "|" +
+		std::to_string(image_file.getLastModificationTime().toMilliseconds()) + "|" +
+		image_file.withFileExtension(".json").loadFileAsString().toStdString() + "|" +
+		image_file.withFileExtension(".txt").loadFileAsString().toStdString();
+
+	return MD5(text.c_str(), text.size()).toHexString().toStdString();
+}
+
+
+std::string dm::DarknetImageCache::make_key(const std::string & params, const std::string & source_hash)
+{
+	const std::string text = std::to_string(cache_version) + "|" + params + "|" + source_hash;
+
+	return MD5(text.c_str(), text.size()).toHexString().toStdString();
+}
+
+
+bool dm::DarknetImageCache::get(const std::string & stage, const std::string & source_image, const std::string & key, Entry & entry)
+{
+	const std::string name = stage + "|" + source_image;
+
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		auto iter = entries.find(name);
+		if (iter == entries.end() or iter->second.key != key)
+		{
+			return false;
+		}
+		entry = iter->second;
+	}
+
+	// the outputs are checked without holding the lock since this touches the disk
+	for (const auto & fn : entry.outputs)
+	{
+		const File f(fn);
+		if (f.existsAsFile() == false or f.withFileExtension(".txt").existsAsFile() == false)
+		{
+			return false;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	used.insert(name);
+
+	return true;
+}
+
+
+dm::DarknetImageCache & dm::DarknetImageCache::set(const std::string & stage, const std::string & source_image, const Entry & entry)
+{
+	const std::string name = stage + "|" + source_image;
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	entries[name] = entry;
+	used.insert(name);
+	dirty = true;
+
+	return *this;
+}
+
+
+size_t dm::DarknetImageCache::garbage_collect()
+{
+	size_t files_deleted = 0;
+
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+
+		auto iter = entries.begin();
+		while (iter != entries.end())
+		{
+			if (used.count(iter->first))
+			{
+				iter ++;
+				continue;
+			}
+
+			iter = entries.erase(iter);
+			dirty = true;
+		}
+
+		SStr stages_used;
+		SStr files_used;
+		for (const auto & [name, entry] : entries)
+		{
+			stages_used.insert(name.substr(0, name.find('|')));
+			for (const auto & fn : entry.outputs)
+			{
+				files_used.insert(fn);
+				files_used.insert(File(fn).withFileExtension(".txt").getFullPathName().toStdString());
+			}
+		}
+
+		for (const auto & [stage, log_filename] : stage_logs)
+		{
+			File dir = manifest_file.getParentDirectory().getChildFile(stage);
+			if (dir.isDirectory() == false)
+			{
+				continue;
+			}
+
+			if (stages_used.count(stage) == 0)
+			{
+				// this stage was not used at all, so the entire subdirectory can be removed
+				files_deleted += dir.getNumberOfChildFiles(File::TypesOfFileToFind::findFiles);
+				dir.deleteRecursively();
+				continue;
+			}
+
+			for (const auto & f : dir.findChildFiles(File::TypesOfFileToFind::findFiles, false))
+			{
+				if (f.getFileName().toStdString() == log_filename or files_used.count(f.getFullPathName().toStdString()))
+				{
+					continue;
+				}
+				f.deleteFile();
+				files_deleted ++;
+			}
+		}
+
+		Log("darknet image cache kept " + std::to_string(entries.size()) + " entries and deleted " + std::to_string(files_deleted) + " stale files");
+	}
+
+	save();
+
+	return files_deleted;
+}
@@ -0,0 +1,90 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Manifest of the images which were created in @p darkmark_image_cache/resize, @p tiles, and @p zoom when the Darknet
+	 * files were last generated.  Previously all of those images were deleted and re-created every single time, which on
+	 * large projects takes much longer than the few images which have actually been modified since the previous run.
+	 *
+	 * Each source image has one entry per stage.  The entry is identified by a key which combines the generation
+	 * parameters (network size, image format, small annotation limit, ...) with the name, size, and timestamp of the
+	 * source image and the content of its .json and .txt annotations.  When the key has not changed and all the output
+	 * files still exist, the outputs are reused instead of being generated again.  Once all the stages have run,
+	 * @ref garbage_collect() removes the entries and files which were not needed.
+	 *
+	 * This class is thread-safe.
+	 */
+	class DarknetImageCache final
+	{
+		public:
+
+			/// Everything which was created from a single source image in one stage.
+			struct Entry
+			{
+				std::string	key;			///< @see @ref make_key()
+				VStr		outputs;		///< The output images.  Annotations are in the .txt file with the same basename.
+				size_t		marks;			///< Number of annotations across all the outputs, including those dropped for being too small.
+				size_t		empty_images;	///< Number of outputs which are negative samples.
+				size_t		resized_images;	///< Number of outputs which had to be resized (only used by the "resize" stage).
+				size_t		dropped;		///< Number of small annotations removed across all the outputs.
+
+				Entry();
+			};
+
+			DarknetImageCache();
+
+			~DarknetImageCache();
+
+			/// Load the manifest for the given project directory.  If the manifest does not exist then the cache starts out empty.
+			DarknetImageCache & open(const std::string & project_directory);
+
+			/// Write the manifest back to disk, but only if something has changed.
+			DarknetImageCache & save();
+
+			/** Identify the current state of a source image.  The image itself is identified by name, size, and timestamp,
+			 * while the content of the .json and .txt annotations is hashed.
+			 */
+			static std::string hash_source(const std::string & source_image);
+
+			/** Calculate the key for a source image in one stage.  The @p params must describe every setting which changes the
+			 * output of the stage, and @p source_hash comes from @ref hash_source().
+			 */
+			static std::string make_key(const std::string & params, const std::string & source_hash);
+
+			/** Get the entry for the given stage and source image.  Returns @p false if the entry does not exist, if the key
+			 * is different, or if any of the output files have been deleted.  Entries returned by this call are kept when
+			 * @ref garbage_collect() is called.
+			 */
+			bool get(const std::string & stage, const std::string & source_image, const std::string & key, Entry & entry);
+
+			/// Remember the outputs created for a source image.
+			DarknetImageCache & set(const std::string & stage, const std::string & source_image, const Entry & entry);
+
+			/** Forget every entry which was not used since the cache was opened, and delete all the files in the stage
+			 * subdirectories which do not belong to an entry.  The subdirectory of a stage which was not used is deleted.
+			 * The manifest is then saved.
+			 * @returns the number of files which were deleted.
+			 */
+			size_t garbage_collect();
+
+			/// The JSON file where the manifest is stored.
+			File manifest_file;
+
+		private:
+
+			std::mutex cache_mutex;
+
+			/// The key is the stage name and the source image, such as @p "resize|/home/bob/image.jpg".
+			std::map<std::string, Entry> entries;
+
+			/// Entries which were returned by @ref get() or stored by @ref set() since the cache was opened.
+			SStr used;
+
+			bool dirty;
+	};
+}
@@ -15,48 +15,29 @@ namespace
 	 */
 	static int cache_image_format = 0;
 
-	/** Split a vector of filenames (or strings) into several parts.  When pieces is set to 0 (the default) an attempt
-	 * will be made to determine the number of available cores.
-	 * @since 2025-12-08
+
+	/** Describe the settings which change the images created by one of the stages.  When any of these settings change,
+	 * the images in the cache cannot be reused.  @see @ref dm::DarknetImageCache::make_key()
 	 */
-	std::vector<dm::VStr> split(const dm::VStr & vstr, size_t pieces = 0)
+	std::string cache_params(const std::string & stage, const dm::ProjectInfo & info)
 	{
-		if (pieces == 0)
-		{
-			pieces = std::max(2U, std::thread::hardware_concurrency());
-		}
-
-		std::vector<dm::VStr> output;
-
-		dm::Log("splitting a vector of " + std::to_string(vstr.size()) + " strings into " + std::to_string(pieces) + " new vectors...");
-
-		if (pieces < 2)
-		{
-			output.push_back(vstr);
-		}
-		else
-		{
-			output.resize(pieces);
-			for (auto & v : output)
-			{
-				v.reserve((vstr.size() + pieces) / pieces);
-			}
-
-			// round-robin distribute the filenames between all the vectors
-			for (size_t idx = 0; idx < vstr.size(); idx ++)
-			{
-				output[idx % pieces].push_back(vstr[idx]);
-			}
-		}
-
-		return output;
+		return
+			stage +
+			" size=" + std::to_string(info.image_width) + "x" + std::to_string(info.image_height) +
+			" format=" + std::to_string(cache_image_format) +
+			" small=" + (info.remove_small_annotations ? std::to_string(info.annotation_area_size) : "0") +
+			// single tiles are skipped when the images are also resized
+			(stage == "tiles" and info.resize_images ? " skip_single_tile" : "");
 	}
 
 
-	std::atomic<size_t> output_image_index = 0;
-	size_t get_next_output_image_index()
+	/// The images created from a source image are named after the cache key, so the names don't change between runs.
+	std::string cache_basename(const std::string & dir_name, const std::string & key, const size_t idx)
 	{
-		return output_image_index ++;
+		std::stringstream ss;
+		ss << dir_name << "/" << key << "_" << std::setfill('0') << std::setw(3) << idx;
+
+		return ss.str();
 	}
 
 
@@ -127,992 +108,1136 @@ namespace
 	}
 
 
-	void save_image(const std::string & filename, cv::Mat & mat, std::default_random_engine & rng)
+	/// Decide how a new image will be encoded.  JPG images use a random quality, while PNG images are not compressed.
+	std::vector<int> encode_params(const std::string & filename, std::default_random_engine & rng)
 	{
-		if (filename.empty() == false and mat.empty() == false)
+		if (is_jpg(filename))
 		{
-			if (is_jpg(filename))
-			{
-				cv::imwrite(filename, mat, {cv::ImwriteFlags::IMWRITE_JPEG_QUALITY, rnd_jpg_quality(rng)});
-			}
-			else
-			{
-				cv::imwrite(filename, mat, {cv::ImwriteFlags::IMWRITE_PNG_COMPRESSION, 0});
-			}
+			return {cv::ImwriteFlags::IMWRITE_JPEG_QUALITY, rnd_jpg_quality(rng)};
 		}
 
-		return;
+		return {cv::ImwriteFlags::IMWRITE_PNG_COMPRESSION, 0};
 	}
-}
 
 
-void dm::DarknetWnd::find_all_annotated_images(ThreadWithProgressWindow & progress_window, VStr & annotated_images, VStr & skipped_images, size_t & number_of_marks, size_t & number_of_empty_images)
-{
-	output_image_index = 0;
-	double work_done = 0.0;
-	double work_to_do = content.image_filenames.size() + 1.0;
-	progress_window.setProgress(0.0);
-	progress_window.setStatusMessage(getText("Finding all images and annotations..."));
+	/// A single Darknet annotation.  The coordinates are normalized, and X and Y are the centre of the annotation.
+	struct Label
+	{
+		int		class_idx;
+		double	x;
+		double	y;
+		double	w;
+		double	h;
+	};
+	using Labels = std::vector<Label>;
 
-	annotated_images.clear();
-	skipped_images.clear();
 
-	for (const auto & filename : content.image_filenames)
+	/** Everything the resize, tile, and crop & zoom stages need to know about a source image.  This is read and decoded
+	 * only once, and then given to every stage which needs to create new images.
+	 */
+	struct SourceImage
 	{
-		work_done ++;
-		progress_window.setProgress(work_done / work_to_do);
+		std::string	filename;
+		cv::Mat		mat;
+		json		root;	///< The DarkMark .json annotations.
+		Labels		labels;	///< The Darknet .txt annotations.
+	};
+
+
+	struct ImageJob;
+
+
+	/// A new image and its annotations, on the way to being encoded and written to disk.
+	struct OutputFile
+	{
+		std::shared_ptr<ImageJob>	job;			///< The source image from which this file was created.
+		std::string					image_filename;
+		cv::Mat						mat;
+		std::vector<int>			params;			///< @see @ref encode_params()
+		std::vector<uchar>			encoded;
+		std::string					label_filename;
+		std::string					labels;			///< The content of the .txt file.
+	};
+	using OutputFiles = std::vector<OutputFile>;
+
+
+	/// A source image on its way through the pipeline in @ref dm::DarknetWnd::generate_images().
+	struct ImageJob
+	{
+		size_t										idx;				///< Index into the vector of annotated images.
+		std::vector<dm::DarknetImageCache::Entry>	entries;			///< One entry for each stage.
+		std::vector<bool>							reused;				///< Whether the entry for each stage came from the cache.
+		std::vector<std::string>					messages;			///< Details for the log file of each stage.
+		std::vector<uchar>							raw_image;			///< The image file exactly as it was read from disk.
+		std::string									json_text;
+		std::string									txt_text;
+		SourceImage									src;
+		std::atomic<size_t>							outputs_remaining;	///< Number of files which have not yet been written.
+	};
+	using Job = std::shared_ptr<ImageJob>;
+
+
+	/// Settings shared by all of the stages.
+	struct StageSettings
+	{
+		cv::Size	network_size;
+		int			area_limit;			///< Annotations of this size and less are dropped.  Negative when small annotations are kept.
+		bool		skip_single_tile;	///< Images which would result in a single tile are skipped since they are also resized.
+	};
+
+
+	/// Signature of the functions which create new images from a source image.
+	using Transform = void(*)(const SourceImage & src, const std::string & dir_name, const StageSettings & settings, std::default_random_engine & rng, dm::DarknetImageCache::Entry & entry, OutputFiles & files, std::ostream & messages);
+
 
-		File f = File(filename).withFileExtension(".json");
+	/// Parse the content of a Darknet .txt annotation file.
+	Labels read_labels(const std::string & text)
+	{
+		Labels labels;
+
+		std::istringstream ifs(text);
+		ifs.imbue(std::locale("C"));
 
-		// note how count_marks_in_json() lies about negative samples and returns "1" for empty images
-		size_t count = content.count_marks_in_json(f);
-		if (count)
+		Label label;
+		while (ifs >> label.class_idx >> label.x >> label.y >> label.w >> label.h)
 		{
-			annotated_images.push_back(filename);
+			labels.push_back(label);
+		}
 
-			// cheat -- we'd like to know if this is actually a negative samples
-			if (File(f).withFileExtension(".txt").getSize() == 0)
+		return labels;
+	}
+
+
+	/** Add a new image to the files which need to be encoded and written.  Annotations which are too small for the
+	 * network to detect are dropped at the same time, so the .txt files don't need to be read and re-written later.
+	 * @returns the number of annotations which were kept.
+	 */
+	size_t add_output(const std::string & output_base_name, const cv::Mat & mat, const Labels & labels, const StageSettings & settings, std::default_random_engine & rng, dm::DarknetImageCache::Entry & entry, OutputFiles & files)
+	{
+		OutputFile file;
+		file.image_filename	= rnd_image_filename(rng, output_base_name);
+		file.params			= encode_params(file.image_filename, rng);
+		file.mat			= mat;
+		file.label_filename	= output_base_name + ".txt";
+
+		std::stringstream fs;
+		fs.imbue(std::locale("C"));
+		fs << std::fixed << std::setprecision(10);
+
+		size_t written = 0;
+		for (const auto & label : labels)
+		{
+			if (settings.area_limit >= 0)
 			{
-				number_of_empty_images ++;
-				count = 0;
+				const int annotation_width	= std::round(settings.network_size.width	* label.w);
+				const int annotation_height	= std::round(settings.network_size.height	* label.h);
+				const int area = annotation_width * annotation_height;
+
+				if (area <= settings.area_limit)
+				{
+					dm::Log(file.label_filename + ": dropping annotation (too small): class #" + std::to_string(label.class_idx) + " w=" + std::to_string(annotation_width) + " h=" + std::to_string(annotation_height) + " area=" + std::to_string(area) + " limit=" + std::to_string(settings.area_limit));
+					entry.dropped ++;
+					continue;
+				}
 			}
+
+			fs << label.class_idx << " " << label.x << " " << label.y << " " << label.w << " " << label.h << std::endl;
+			written ++;
 		}
-		else
+
+		// marks are counted before the small annotations are dropped
+		entry.marks += labels.size();
+		if (written == 0)
 		{
-			skipped_images.push_back(filename);
+			entry.empty_images ++;
 		}
-		number_of_marks += count;
-	}
 
-	work_done = 0.0;
-	work_to_do = skipped_images.size() + 1.0;
-	progress_window.setProgress(0.0);
-	progress_window.setStatusMessage(getText("Listing skipped images..."));
+		file.labels = fs.str();
+		entry.outputs.push_back(file.image_filename);
+		files.push_back(std::move(file));
 
-	std::shuffle(skipped_images.begin(), skipped_images.end(), get_random_engine());
-	const std::string fn = File(info.project_dir).getChildFile("skipped_images.txt").getFullPathName().toStdString();
-	std::ofstream fs_skipped(fn);
-	for (const auto & image_filename : skipped_images)
-	{
-		work_done ++;
-		progress_window.setProgress(work_done / work_to_do);
-
-		fs_skipped << image_filename << std::endl;
+		return written;
 	}
 
-	if (info.image_type == "JPG")
-	{
-		cache_image_format = 1;
-	}
-	else if (info.image_type == "PNG")
-	{
-		cache_image_format = 2;
-	}
-	else
+
+	/** Convert the DarkMark annotations which intersect with @p roi to Darknet annotations relative to the RoI.  Slices of
+	 * annotations smaller than @p min_size are ignored.
+	 */
+	Labels crop_labels(const json & root, const cv::Rect & roi, const int min_size)
 	{
-		cache_image_format = 0; // both
-	}
+		Labels labels;
 
-	return;
-}
+		for (const auto & j : root["mark"])
+		{
+			int x = j["rect"]["int_x"];
+			int y = j["rect"]["int_y"];
+			int w = j["rect"]["int_w"];
+			int h = j["rect"]["int_h"];
+			const cv::Rect annotation_rect(x, y, w, h);
+			const cv::Rect intersection = annotation_rect & roi;
+			if (intersection.area() == 0)
+			{
+				// this annotation does not appear in our new image
+				continue;
+			}
+
+			if (x < roi.x)
+			{
+				// X is beyond the left border, we need to move it to the right
+				const int delta = roi.x - x;
+				x += delta;
+				w -= delta;
+			}
+			if (y < roi.y)
+			{
+				// Y is beyond the top border, we need to move it down
+				const int delta = roi.y - y;
+				y += delta;
+				h -= delta;
+			}
+			if (x + w > roi.x + roi.width)
+			{
+				// width is beyond the right border
+				w = roi.x + roi.width - x;
+			}
+			if (y + h > roi.y + roi.height)
+			{
+				// height is beyond the bottom border
+				h = roi.y + roi.height - y;
+			}
 
+			if (w < min_size or h < min_size)
+			{
+				// ignore extremely tiny slices of annotations
+				continue;
+			}
 
-void dm::DarknetWnd::resize_images(ThreadWithProgressWindow & progress_window, const VStr & annotated_images, VStr & all_output_images, size_t & number_of_resized_images, size_t & number_of_images_not_resized, size_t & number_of_marks, size_t & number_of_empty_images)
-{
-	std::atomic<size_t> work_done = 0;
-	const size_t work_to_do = annotated_images.size();
+			// bring all the coordinates back down to zero
+			x -= roi.x;
+			y -= roi.y;
+
+			Label label;
+			label.class_idx	= j["class_idx"];
+			label.w			= static_cast<double>(w) / static_cast<double>(roi.width	);
+			label.h			= static_cast<double>(h) / static_cast<double>(roi.height	);
+			label.x			= static_cast<double>(x) / static_cast<double>(roi.width	) + label.w / 2.0;
+			label.y			= static_cast<double>(y) / static_cast<double>(roi.height	) + label.h / 2.0;
+			labels.push_back(label);
+		}
 
-	const String sizing = String(info.image_width) + "x" + String(info.image_height);
-	String text = getText("Resizing images to");
-	#if DARKNET_GEN_SIMPLIFIED
-		text = sizing + " " + text + "...";
-	#else
-		text += " " + sizing + "...";
-	#endif
+		return labels;
+	}
 
-	progress_window.setProgress(0.0);
-	progress_window.setStatusMessage(text);
 
-	File dir = File(info.project_dir).getChildFile("darkmark_image_cache").getChildFile("resize");
-	const std::string dir_name = dir.getFullPathName().toStdString();
-	dir.createDirectory();
-	if (dir.isDirectory() == false)
+	void resize_image(const SourceImage & src, const std::string & dir_name, const StageSettings & settings, std::default_random_engine & rng, dm::DarknetImageCache::Entry & entry, OutputFiles & files, std::ostream & messages)
 	{
-		throw std::runtime_error("Failed to create directory " + dir_name + ".");
-	}
+		cv::Mat dst;
+		if (src.mat.size() != settings.network_size)
+		{
+			cv::resize(src.mat, dst, settings.network_size, 0, 0, rnd_resize_method(rng));
+			entry.resized_images ++;
+		}
+		else
+		{
+			dst = src.mat;
+		}
 
-	auto & rng = get_random_engine();
+		add_output(cache_basename(dir_name, entry.key, 0), dst, src.labels, settings, rng, entry, files);
 
-	const cv::Size desired_image_size(info.image_width, info.image_height);
+		messages
+			<< src.filename
+			<< " [" << src.mat.cols << "x" << src.mat.rows << "] -> "
+			<< entry.outputs.back()
+			<< " [" << dst.cols << "x" << dst.rows << "]"
+			<< std::endl;
 
-	std::ofstream resized_txt(dir_name + "/resized.txt");
-	resized_txt << "WARNING: multiple threads write to this file at the same time." << std::endl;
+		return;
+	}
 
-	// need to protect "all_output_images" and several other items from being modified across multiple threads at the same time
-	std::mutex resize_images_mutex;
-	const auto & split_image_filenames = split(annotated_images);
-	std::string error_detected;
 
-	const auto resize_worker_lambda = [&, this](const size_t thread_idx)
+	void tile_image(const SourceImage & src, const std::string & dir_name, const StageSettings & settings, std::default_random_engine & rng, dm::DarknetImageCache::Entry & entry, OutputFiles & files, std::ostream & messages)
 	{
-		std::string last_image_filename = "?";
+		const cv::Mat & mat = src.mat;
+		const cv::Size & desired_tile_size = settings.network_size;
+
+		const double horizontal_factor		= static_cast<double>(mat.cols) / static_cast<double>(desired_tile_size.width);
+		const double vertical_factor		= static_cast<double>(mat.rows) / static_cast<double>(desired_tile_size.height);
+		const size_t horizontal_tiles_count	= std::round(std::max(1.0, horizontal_factor	));
+		const size_t vertical_tiles_count	= std::round(std::max(1.0, vertical_factor		));
+		const double cell_width				= static_cast<double>(mat.cols) / static_cast<double>(horizontal_tiles_count);
+		const double cell_height			= static_cast<double>(mat.rows) / static_cast<double>(vertical_tiles_count);
+
+		messages
+			<< src.filename << " [" << mat.cols << "x" << mat.rows << "]"
+			<< " -> [" << horizontal_tiles_count << "x" << vertical_tiles_count << "]"
+			<< " -> [" << cell_width << "x" << cell_height << "]"
+			<< std::endl;
+
+		if (settings.skip_single_tile and horizontal_tiles_count == 1 and vertical_tiles_count == 1)
+		{
+			// this image only has 1 tile, and we already have it since "resize" is enabled
+			messages << src.filename << " -> skipped (single tile)" << std::endl;
+			return;
+		}
 
-		try
+		for (size_t y_idx = 0; y_idx < vertical_tiles_count; y_idx ++)
 		{
-			for (const auto & original_image : split_image_filenames[thread_idx])
+			for (size_t x_idx = 0; x_idx < horizontal_tiles_count; x_idx ++)
 			{
-				if (not error_detected.empty())
+				int tile_x = std::round(cell_width	* static_cast<double>(x_idx));
+				int tile_y = std::round(cell_height	* static_cast<double>(y_idx));
+				int tile_w = std::round(cell_width);
+				int tile_h = std::round(cell_height);
+
+				// if a cell is smaller than our desired tile, then we can grab a few more pixels to fill out the tile and get it closer to the desired network size
+				int delta = desired_tile_size.width - tile_w;
+				tile_x -= delta / 2;
+				tile_w += delta;
+
+				// if we moved beyond the right border then move the X coordinate back
+				if (tile_x + tile_w >= mat.cols)
 				{
-					break;
+					tile_x = mat.cols - tile_w;
 				}
 
-				work_done ++;
-
-				last_image_filename = original_image;
-
-				std::stringstream ss;
-				ss << dir_name << "/" << std::setfill('0') << std::setw(8) << get_next_output_image_index();
-				const std::string output_base_name = ss.str();
-				const std::string output_image = rnd_image_filename(rng, output_base_name);
-				const std::string output_label = output_base_name + ".txt";
-
-				// first we create the resized image file
-				cv::Mat mat = cv::imread(original_image);
-				if (mat.empty())
+				// if we moved beyond the *left* border, then reset to zero
+				if (tile_x < 0)
 				{
-					// something has gone *very* wrong if we cannot read the image
-					Log(original_image + " (" + std::to_string(mat.cols) + "x" + std::to_string(mat.rows) + ")");
-					throw std::runtime_error("failed to open or read the image " + original_image);
+					tile_x = 0;
 				}
 
-				cv::Mat dst;
-				if (mat.cols != desired_image_size.width or mat.rows != desired_image_size.height)
+				// make sure the cell width doesn't extend beyond the right border
+				if (tile_x + tile_w >= mat.cols)
 				{
-					cv::resize(mat, dst, desired_image_size, 0, 0, rnd_resize_method(rng));
-					number_of_resized_images ++;
-				}
-				else
-				{
-					dst = mat;
-					number_of_images_not_resized ++;
+					tile_w = (mat.cols - tile_x);
 				}
 
-				save_image(output_image, dst, rng);
+				delta = desired_tile_size.height - tile_h;
+				tile_y -= delta / 2;
+				tile_h += delta;
 
-				// next we copy the annoations in the .txt file
-				File txt = File(original_image).withFileExtension(".txt");
-				const bool success = txt.copyFileTo(File(output_label));
-				if (not success)
+				// if we moved beyond the bottom border then move the Y coordinate back
+				if (tile_y + tile_h >= mat.rows)
 				{
-					throw std::runtime_error("Failed to copy " + txt.getFullPathName().toStdString() + ".");
+					tile_y = mat.rows - tile_h;
 				}
 
-				// beyond this point we update the things that must be protected by the mutex lock
-
-				std::lock_guard lock(resize_images_mutex);
-				all_output_images.push_back(output_image);
-				resized_txt
-					<< "#" << thread_idx << ": "
-					<< original_image
-					<< " [" << mat.cols << "x" << mat.rows << "] -> "
-					<< output_image
-					<< " [" << dst.cols << "x" << dst.rows << "]"
-					<< std::endl;
-
-				if (txt.getSize() == 0)
+				// if we moved beyond the *top* border, then reset to zero
+				if (tile_y < 0)
 				{
-					number_of_empty_images ++;
+					tile_y = 0;
 				}
-				else
+
+				// make sure the cell width doesn't extend beyond the bottom border
+				if (tile_y + tile_h >= mat.rows)
 				{
-					json root = json::parse(txt.withFileExtension(".json").loadFileAsString().toStdString());
-					number_of_marks += root["mark"].size();
+					tile_h = (mat.rows - tile_y);
 				}
-			}
-		}
-		catch (const std::exception & e)
-		{
-			std::string msg = "error in resize thread #" + std::to_string(thread_idx) + " while processing \"" + last_image_filename + "\": " + e.what();
-			Log(msg);
-			if (error_detected.empty())
-			{
-				error_detected.swap(msg);
-			}
-		}
-	};
 
-	// start multiple threads running the resize worker lambda, then we wait for all of them to be done
+				const cv::Rect tile_rect(tile_x, tile_y, tile_w, tile_h);
+				cv::Mat tile = mat(tile_rect);
 
-	VThreads vthreads;
-	for (size_t idx = 0; idx < split_image_filenames.size(); idx ++)
-	{
-		Log("creating image resize thread #" + std::to_string(idx) + " to handle " + std::to_string(split_image_filenames[idx].size()) + " images...");
-		vthreads.emplace_back(resize_worker_lambda, idx);
-	}
+				// we know our tile is from (tile_x, tile_y, tile_w, tile_h), so include any annotations within those bounds
+				const std::string output_base_name = cache_basename(dir_name, entry.key, y_idx * horizontal_tiles_count + x_idx);
+				const size_t number_of_annotations = add_output(output_base_name, tile, crop_labels(src.root, tile_rect, 10), settings, rng, entry, files);
 
-	while (work_done < work_to_do and error_detected.empty())
-	{
-		progress_window.setProgress(work_done / static_cast<double>(work_to_do));
-		std::this_thread::sleep_for(std::chrono::milliseconds(750));
-	}
-
-	for (auto & t : vthreads)
-	{
-		t.join();
-	}
+				messages
+					<< entry.outputs.back()
+					<< " [" << tile.cols << "x" << tile.rows << "]"
+					<< " [" << number_of_annotations << "/" << src.root["mark"].size() << "]"
+					<< std::endl;
+			}
+		}
 
-	if (not error_detected.empty())
-	{
-		throw std::runtime_error(error_detected);
+		return;
 	}
 
-	return;
-}
-
-
-void dm::DarknetWnd::tile_images(ThreadWithProgressWindow & progress_window, const VStr & annotated_images, VStr & all_output_images, size_t & number_of_marks, size_t & number_of_tiles_created, size_t & number_of_empty_images)
-{
-	std::atomic<size_t> work_done = 0;
-	const size_t work_to_do = annotated_images.size();
-
-	const String sizing = String(info.image_width) + "x" + String(info.image_height);
-	String text = getText("Tiling images to");
-	#if DARKNET_GEN_SIMPLIFIED
-		text = sizing + " " + text + "...";
-	#else
-		text += " " + sizing + "...";
-	#endif
-
-	progress_window.setProgress(0.0);
-	progress_window.setStatusMessage(text);
 
-	File dir = File(info.project_dir).getChildFile("darkmark_image_cache").getChildFile("tiles");
-	const std::string dir_name = dir.getFullPathName().toStdString();
-	dir.createDirectory();
-	if (dir.isDirectory() == false)
+	void zoom_image(const SourceImage & src, const std::string & dir_name, const StageSettings & settings, std::default_random_engine & rng, dm::DarknetImageCache::Entry & entry, OutputFiles & files, std::ostream & messages)
 	{
-		throw std::runtime_error("Failed to create directory " + dir_name + ".");
-	}
+		const cv::Mat & original_mat = src.mat;
+		const cv::Size & desired_size = settings.network_size;
 
-	auto & rng = get_random_engine();
+		/* Images must be larger than the final desired size for us to "zoom in".
+		 * This variable describes the minimum size we need for us to work with the image.
+		 */
+		const cv::Size large_size(
+				std::round(1.25f * desired_size.width),
+				std::round(1.25f * desired_size.height));
 
-	const cv::Size desired_tile_size(info.image_width, info.image_height);
+		if (original_mat.cols < large_size.width or original_mat.rows < large_size.height)
+		{
+			messages
+				<< src.filename
+				<< " [" << original_mat.cols << "x" << original_mat.rows << "]"
+				<< " -> skipped (image too small)" << std::endl;
+			return;
+		}
 
-	std::ofstream tiles_txt(dir_name + "/tiles.txt");
-	tiles_txt << "WARNING: multiple threads write to this file at the same time." << std::endl;
+		const cv::Rect original_rect(0, 0, original_mat.cols, original_mat.rows);
+		std::vector<cv::Point> points_of_interest;
+		for (const auto & j : src.root["mark"])
+		{
+			const int x = j["rect"]["int_x"];
+			const int y = j["rect"]["int_y"];
+			const int w = j["rect"]["int_w"];
+			const int h = j["rect"]["int_h"];
 
-	std::mutex tile_images_mutex;
-	const auto & split_image_filenames = split(annotated_images);
-	std::string error_detected;
+			for (const cv::Point & p :
+				{
+					cv::Point(x + 0, y + 0),	// TL
+					cv::Point(x + w, y + 0),	// TR
+					cv::Point(x + w, y + h),	// BR
+					cv::Point(x + 0, y + h),	// BL
+					cv::Point(x + w/2, y + h/2)	// middle
+				})
+			{
+				if (original_rect.contains(p))
+				{
+					points_of_interest.push_back(p);
+				}
+			}
+		}
 
-	const auto tile_worker_lambda = [&, this](const size_t thread_idx)
-	{
-		std::string last_image_filename = "?";
+		// keep creating cropped/zoomed images as long as we're finding new parts of the image that we didn't previously cover
+		std::vector<cv::Rect> all_previous_rectangles;
+		size_t failed_consecutive_attempts = 0;
 
-		try
+		while (failed_consecutive_attempts < 5)
 		{
-			for (const auto & original_image : split_image_filenames[thread_idx])
+			/* The amount we're going to "zoom in" depends on exactly how big the image is compared to the final size.
+			 * This value is the "factor" by which we multiply the desired image size.  We need to make sure that both
+			 * the horizontal and vertical values can be satisfied.
+			 */
+			const float horizontal_factor	= static_cast<float>(original_mat.cols) / static_cast<float>(desired_size.width);
+			const float vertical_factor		= static_cast<float>(original_mat.rows) / static_cast<float>(desired_size.height);
+			const float min_factor			= std::min(horizontal_factor, vertical_factor);
+
+			std::uniform_real_distribution<float> uni_f(0.8f, min_factor);
+			const float factor = uni_f(rng);
+
+			// This describes the size of the RoI we're going to carve out of the original image mat.
+			const cv::Size size(
+					std::round(factor * desired_size.width),
+					std::round(factor * desired_size.height));
+
+			// Now that we know the size, we can create the rectangle which is used to carve out the RoI.
+			cv::Rect roi(cv::Point(0, 0), size);
+
+			// Now figure out how much room remains outside of the RoI, and randomly choose some spacing to assign.
+			const int delta_h = original_mat.cols - roi.width;
+			const int delta_v = original_mat.rows - roi.height;
+			std::uniform_int_distribution<int> uni_h(0, delta_h);
+			std::uniform_int_distribution<int> uni_v(0, delta_v);
+			roi.x = uni_h(rng);
+			roi.y = uni_v(rng);
+
+			// See if the middle point of this RoI was already covered by a previous rectangle.
+			bool continue_crop_and_zoom = true;
+			const cv::Point middle_point(roi.x + roi.width/2, roi.y + roi.height/2);
+			for (const auto & r : all_previous_rectangles)
 			{
-				if (not error_detected.empty())
+				if (r.contains(middle_point))
 				{
+					// we've already covered this point
+					continue_crop_and_zoom = false;
 					break;
 				}
+			}
 
-				work_done ++;
-
-				last_image_filename = original_image;
-
-				// first thing we'll do is read the annotations for this image
-				json root = json::parse(File(original_image).withFileExtension(".json").loadFileAsString().toStdString());
-
-				cv::Mat mat = cv::imread(original_image);
-				if (mat.empty())
+			if (continue_crop_and_zoom == false)
+			{
+				// before we give up on this RoI, see if it covers one of the remaining points of interest
+				for (const auto & p : points_of_interest)
 				{
-					// something has gone *very* wrong if we cannot read the image
-					Log(original_image + " (" + std::to_string(mat.cols) + "x" + std::to_string(mat.rows) + ")");
-					throw std::runtime_error("failed to open or read the image " + original_image);
+					if (roi.contains(p))
+					{
+						messages << src.filename << "-> adding RoI because it includes point-of-interest x=" << p.x << " y=" << p.y << std::endl;
+						continue_crop_and_zoom = true;
+						break;
+					}
 				}
+			}
 
-				const double horizontal_factor		= static_cast<double>(mat.cols) / static_cast<double>(desired_tile_size.width);
-				const double vertical_factor		= static_cast<double>(mat.rows) / static_cast<double>(desired_tile_size.height);
-				const size_t horizontal_tiles_count	= std::round(std::max(1.0, horizontal_factor	));
-				const size_t vertical_tiles_count	= std::round(std::max(1.0, vertical_factor		));
-				const double cell_width				= static_cast<double>(mat.cols) / static_cast<double>(horizontal_tiles_count);
-				const double cell_height			= static_cast<double>(mat.rows) / static_cast<double>(vertical_tiles_count);
-
-				std::stringstream messages;
+			if (continue_crop_and_zoom == false)
+			{
 				messages
-					<< "#" << thread_idx << ": "
-					<< original_image << " [" << mat.cols << "x" << mat.rows << "]"
-					<< " -> [" << horizontal_tiles_count << "x" << vertical_tiles_count << "]"
-					<< " -> [" << cell_width << "x" << cell_height << "]"
-					<< std::endl;
+					<< src.filename
+					<< " -> skipped RoI [x=" << roi.x << " y=" << roi.y << " w=" << roi.width << " h=" << roi.height << "] due to overlap" << std::endl;
+				failed_consecutive_attempts ++;
+				continue;
+			}
 
-				if (info.resize_images and horizontal_tiles_count == 1 and vertical_tiles_count == 1)
+			// ...otherise, if we get here then we seem to be covering a new part of the image
+			failed_consecutive_attempts = 0;
+			all_previous_rectangles.push_back(roi);
+
+			// remove from "points-of-interest" any points located within the RoI we've just created
+			auto iter = points_of_interest.begin();
+			while (iter != points_of_interest.end())
+			{
+				const auto & p = *iter;
+				if (roi.contains(p))
 				{
-					// this image only has 1 tile, and we already have it since "resize" is enabled, so skip to the next image
-					std::lock_guard lock(tile_images_mutex);
-					tiles_txt
-						<< messages.str()
-						<< "#" << thread_idx << ": "
-						<< "skipped (single tile)" << std::endl;
-					continue;
+					iter = points_of_interest.erase(iter);
 				}
-
-//				Log(original_image + " (" + std::to_string(mat.cols) + "x" + std::to_string(mat.rows) + ") needs to be tiled as " + std::to_string(horizontal_tiles_count) + "x" + std::to_string(vertical_tiles_count) + " tiles each measuring " + std::to_string(desired_tile_size.width) + "x" + std::to_string(desired_tile_size.height));
-
-				for (size_t y_idx = 0; y_idx < vertical_tiles_count; y_idx ++)
+				else
 				{
-					for (size_t x_idx = 0; x_idx < horizontal_tiles_count; x_idx ++)
-					{
-						int tile_x = std::round(cell_width	* static_cast<double>(x_idx));
-						int tile_y = std::round(cell_height	* static_cast<double>(y_idx));
-						int tile_w = std::round(cell_width);
-						int tile_h = std::round(cell_height);
-//						Log("-> old tile: x=" + std::to_string(tile_x) + " y=" + std::to_string(tile_y) + " w=" + std::to_string(tile_w) + " h=" + std::to_string(tile_h));
-
-						// if a cell is smaller than our desired tile, then we can grab a few more pixels to fill out the tile and get it closer to the desired network size
-						int delta = desired_tile_size.width - tile_w;
-						tile_x -= delta / 2;
-						tile_w += delta;
-
-						// if we moved beyond the right border then move the X coordinate back
-						if (tile_x + tile_w >= mat.cols)
-						{
-							tile_x = mat.cols - tile_w;
-						}
-
-						// if we moved beyond the *left* border, then reset to zero
-						if (tile_x < 0)
-						{
-							tile_x = 0;
-						}
-
-						// make sure the cell width doesn't extend beyond the right border
-						if (tile_x + tile_w >= mat.cols)
-						{
-							tile_w = (mat.cols - tile_x);
-						}
-
-						delta = desired_tile_size.height - tile_h;
-						tile_y -= delta / 2;
-						tile_h += delta;
-
-						// if we moved beyond the bottom border then move the Y coordinate back
-						if (tile_y + tile_h >= mat.rows)
-						{
-							tile_y = mat.rows - tile_h;
-						}
-
-						// if we moved beyond the *top* border, then reset to zero
-						if (tile_y < 0)
-						{
-							tile_y = 0;
-						}
-
-						// make sure the cell width doesn't extend beyond the bottom border
-						if (tile_y + tile_h >= mat.rows)
-						{
-							tile_h = (mat.rows - tile_y);
-						}
-//						Log("-> new tile: x=" + std::to_string(tile_x) + " y=" + std::to_string(tile_y) + " w=" + std::to_string(tile_w) + " h=" + std::to_string(tile_h));
-
-						const cv::Rect tile_rect(tile_x, tile_y, tile_w, tile_h);
-						cv::Mat tile = mat(tile_rect);
-
-						std::stringstream ss;
-						ss << dir_name << "/" << std::setfill('0') << std::setw(8) << get_next_output_image_index();
-						const std::string output_base_name = ss.str();
-						const std::string output_image = rnd_image_filename(rng, output_base_name);
-						const std::string output_label = output_base_name + ".txt";
-
-						save_image(output_image, tile, rng);
-
-						// now re-create the .txt file with the appropriate annotations for this new tile
-						//
-						// we know our tile is from (tile_x, tile_y, tile_w, tile_h), so include any annotations within those bounds
-						std::ofstream fs_txt(output_label);
-						fs_txt.imbue(std::locale("C"));
-						fs_txt << std::fixed << std::setprecision(10);
-
-						size_t number_of_annotations = 0;
-						for (auto j : root["mark"])
-						{
-							const cv::Rect annotation_rect(j["rect"]["int_x"], j["rect"]["int_y"], j["rect"]["int_w"], j["rect"]["int_h"]);
-							const cv::Rect intersection = annotation_rect & tile_rect;
-							if (intersection.area() > 0)
-							{
-								const int class_idx = j["class_idx"];
-								int x = j["rect"]["int_x"];
-								int y = j["rect"]["int_y"];
-								int w = j["rect"]["int_w"];
-								int h = j["rect"]["int_h"];
-
-								if (x < tile_rect.x)
-								{
-									// X is beyond the left border, we need to move it to the right
-									const int delta_x = tile_rect.x - x;
-									x += delta_x;
-									w -= delta_x;
-								}
-								if (y < tile_rect.y)
-								{
-									const int delta_y = tile_rect.y - y;
-									y += delta_y;
-									h -= delta_y;
-								}
-								if (x + w > tile_rect.x + tile_rect.width)
-								{
-									w = tile_rect.x + tile_rect.width - x;
-								}
-								if (y + h > tile_rect.y + tile_rect.height)
-								{
-									h = tile_rect.y + tile_rect.height - y;
-								}
-
-								// ignore extremely tiny slices
-								if (w >= 10 and h >= 10)
-								{
-									// bring all the coordinates back down to zero
-									x -= tile_rect.x;
-									y -= tile_rect.y;
-
-									const double normalized_w = static_cast<double>(w) / static_cast<double>(tile.cols);
-									const double normalized_h = static_cast<double>(h) / static_cast<double>(tile.rows);
-									const double normalized_x = static_cast<double>(x) / static_cast<double>(tile.cols) + normalized_w / 2.0;
-									const double normalized_y = static_cast<double>(y) / static_cast<double>(tile.rows) + normalized_h / 2.0;
-									fs_txt << class_idx << " " << normalized_x <<  " " << normalized_y << " " << normalized_w << " " << normalized_h << std::endl;
-									number_of_annotations ++;
-								}
-							}
-						}
-
-						std::lock_guard lock(tile_images_mutex);
-						all_output_images.push_back(output_image);
-
-						if (number_of_annotations == 0)
-						{
-							number_of_empty_images ++;
-						}
-						number_of_marks += number_of_annotations;
-						number_of_tiles_created ++;
-
-						tiles_txt
-							<< messages.str()
-							<< "#" << thread_idx << ": "
-							<< output_image
-							<< " [" << tile.cols << "x" << tile.rows << "]"
-							<< " [" << number_of_annotations << "/" << root["mark"].size() << "]"
-							<< std::endl;
-					}
+					iter ++;
 				}
 			}
+
+			// Crop the original image, and at the same time resize it to be the exact dimensions we need.
+			cv::Mat output_mat;
+			cv::resize(original_mat(roi), output_mat, desired_size, 0.0, 0.0, rnd_resize_method(rng));
+
+			// crop the annotations to match the image, and re-calculate the values for the .txt file
+			const std::string output_base_name = cache_basename(dir_name, entry.key, entry.outputs.size());
+			const size_t number_of_annotations = add_output(output_base_name, output_mat, crop_labels(src.root, roi, 5), settings, rng, entry, files);
+
+			messages
+				<< src.filename
+				<< " [" << original_mat.cols << "x" << original_mat.rows << "]"
+				<< " -> " << entry.outputs.back()
+				<< " [f=" << factor
+				<< " x=" << roi.x
+				<< " y=" << roi.y
+				<< " w=" << roi.width
+				<< " h=" << roi.height
+				<< "]"
+				<< " -> [" << output_mat.cols << "x" << output_mat.rows << "]"
+				<< " [" << number_of_annotations << "/" << src.root["mark"].size() << "]"
+				<< std::endl;
 		}
-		catch (const std::exception & e)
+
+		if (points_of_interest.empty() == false)
 		{
-			std::string msg = "error in tile thread #" + std::to_string(thread_idx) + " while processing \"" + last_image_filename + "\": " + e.what();
-			Log(msg);
-			if (error_detected.empty())
+			messages << src.filename << " -> still had " << points_of_interest.size() << " items remaining in the points-of-interest" << std::endl;
+		}
+
+		return;
+	}
+}
+
+
+void dm::DarknetWnd::find_all_annotated_images(ThreadWithProgressWindow & progress_window, VStr & annotated_images, VStr & skipped_images, size_t & number_of_marks, size_t & number_of_empty_images)
+{
+	progress_window.setProgress(0.0);
+	progress_window.setStatusMessage(getText("Finding all images and annotations..."));
+
+	annotated_images.clear();
+	skipped_images.clear();
+
+	// the .json files are parsed in parallel, and the results are then combined in the original order
+	const size_t number_of_images = content.image_filenames.size();
+	VSizet counts(number_of_images, 0);
+	std::vector<char> negative_samples(number_of_images, 0);
+
+	TaskPool().run(number_of_images,
+		[&](const size_t idx)
+		{
+			File f = File(content.image_filenames[idx]).withFileExtension(".json");
+
+			// note how count_marks_in_json() lies about negative samples and returns "1" for empty images
+			counts[idx] = content.count_marks_in_json(f);
+
+			// cheat -- we'd like to know if this is actually a negative samples
+			if (counts[idx] and f.withFileExtension(".txt").getSize() == 0)
 			{
-				error_detected.swap(msg);
+				negative_samples[idx] = 1;
 			}
+		},
+		[&](const size_t tasks_done, const size_t number_of_tasks)
+		{
+			progress_window.setProgress(tasks_done / (number_of_tasks + 1.0));
+		});
+
+	for (size_t idx = 0; idx < number_of_images; idx ++)
+	{
+		const auto & filename = content.image_filenames[idx];
+		if (counts[idx] == 0)
+		{
+			skipped_images.push_back(filename);
 		}
-	};
+		else if (negative_samples[idx])
+		{
+			annotated_images.push_back(filename);
+			number_of_empty_images ++;
+		}
+		else
+		{
+			annotated_images.push_back(filename);
+			number_of_marks += counts[idx];
+		}
+	}
 
-	// start multiple threads running the tile lambda, then we wait for all of them to be done
+	double work_done = 0.0;
+	double work_to_do = skipped_images.size() + 1.0;
+	progress_window.setProgress(0.0);
+	progress_window.setStatusMessage(getText("Listing skipped images..."));
 
-	VThreads vthreads;
-	for (size_t idx = 0; idx < split_image_filenames.size(); idx ++)
+	std::shuffle(skipped_images.begin(), skipped_images.end(), get_random_engine());
+	const std::string fn = File(info.project_dir).getChildFile("skipped_images.txt").getFullPathName().toStdString();
+	std::ofstream fs_skipped(fn);
+	for (const auto & image_filename : skipped_images)
 	{
-		Log("creating tile thread #" + std::to_string(idx) + " to handle " + std::to_string(split_image_filenames[idx].size()) + " images...");
-		vthreads.emplace_back(tile_worker_lambda, idx);
+		work_done ++;
+		progress_window.setProgress(work_done / work_to_do);
+
+		fs_skipped << image_filename << std::endl;
 	}
 
-	while (work_done < work_to_do and error_detected.empty())
+	if (info.image_type == "JPG")
 	{
-		progress_window.setProgress(work_done / static_cast<double>(work_to_do));
-		std::this_thread::sleep_for(std::chrono::milliseconds(750));
+		cache_image_format = 1;
 	}
-
-	for (auto & t : vthreads)
+	else if (info.image_type == "PNG")
 	{
-		t.join();
+		cache_image_format = 2;
 	}
-
-	if (not error_detected.empty())
+	else
 	{
-		throw std::runtime_error(error_detected);
+		cache_image_format = 0; // both
 	}
 
 	return;
 }
 
 
-void dm::DarknetWnd::random_zoom_images(ThreadWithProgressWindow & progress_window, const VStr & annotated_images, VStr & all_output_images, size_t & number_of_marks, size_t & number_of_zooms_created, size_t & number_of_empty_images)
+void dm::DarknetWnd::generate_images(ThreadWithProgressWindow & progress_window, const VStr & annotated_images, VStr & all_output_images, size_t & number_of_marks, size_t & number_of_empty_images, size_t & number_of_resized_images, size_t & number_of_images_not_resized, size_t & number_of_tiles_created, size_t & number_of_zooms_created, size_t & number_of_dropped_annotations)
 {
-	std::atomic<size_t> work_done = 0;
-	const size_t work_to_do = annotated_images.size();
+	// all the stages run at the same time, so show the status message of the first one which is enabled
+	String text = getText("Random image crop and zoom...");
+	if (info.resize_images or info.tile_images)
+	{
+		const String sizing = String(info.image_width) + "x" + String(info.image_height);
+		text = getText(info.resize_images ? "Resizing images to" : "Tiling images to");
+		#if DARKNET_GEN_SIMPLIFIED
+			text = sizing + " " + text + "...";
+		#else
+			text += " " + sizing + "...";
+		#endif
+	}
+
 	progress_window.setProgress(0.0);
-	progress_window.setStatusMessage(getText("Random image crop and zoom..."));
+	progress_window.setStatusMessage(text);
 
-	File dir = File(info.project_dir).getChildFile("darkmark_image_cache").getChildFile("zoom");
-	const std::string dir_name = dir.getFullPathName().toStdString();
-	dir.createDirectory();
-	if (dir.isDirectory() == false)
+	struct Stage
 	{
-		throw std::runtime_error("Failed to create directory " + dir_name + ".");
-	}
+		std::string		name;
+		Transform		transform;
+		std::string		params;
+		std::string		dir_name;
+		std::ofstream	log;
+		size_t			images_reused;
+	};
 
-	std::ofstream zoom_txt(dir_name + "/zoom.txt");
-	zoom_txt << "WARNING: multiple threads write to this file at the same time." << std::endl;
+	const std::vector<std::tuple<std::string, std::string, Transform, bool>> all_stages =
+	{
+		{"resize"	, "resized.txt"	, resize_image	, info.resize_images	},
+		{"tiles"	, "tiles.txt"	, tile_image	, info.tile_images		},
+		{"zoom"		, "zoom.txt"	, zoom_image	, info.zoom_images		},
+	};
 
-	const cv::Size desired_size(info.image_width, info.image_height);
+	std::vector<Stage> stages;
+	stages.reserve(all_stages.size());
+	for (const auto & [name, log_filename, transform, enabled] : all_stages)
+	{
+		if (not enabled)
+		{
+			continue;
+		}
 
-	/* Images must be larger than the final desired size for us to "zoom in".
-	 * This variable describes the minimum size we need for us to work with the image.
-	 */
-	const cv::Size large_size(
-			std::round(1.25f * desired_size.width),
-			std::round(1.25f * desired_size.height));
+		File dir = File(info.project_dir).getChildFile("darkmark_image_cache").getChildFile(name);
+		const std::string dir_name = dir.getFullPathName().toStdString();
+		dir.createDirectory();
+		if (dir.isDirectory() == false)
+		{
+			throw std::runtime_error("Failed to create directory " + dir_name + ".");
+		}
 
-	auto & rng = get_random_engine();
+		Stage stage;
+		stage.name			= name;
+		stage.transform		= transform;
+		stage.params		= cache_params(name, info);
+		stage.dir_name		= dir_name;
+		stage.images_reused	= 0;
+		stage.log.open(dir_name + "/" + log_filename);
+		stage.log << "WARNING: multiple threads write to this file at the same time." << std::endl;
+		stages.push_back(std::move(stage));
+	}
 
-	std::mutex random_zoom_mutex;
-	const auto & split_image_filenames = split(annotated_images);
-	std::string error_detected;
+	StageSettings settings;
+	settings.network_size		= cv::Size(info.image_width, info.image_height);
+	settings.area_limit			= info.remove_small_annotations ? info.annotation_area_size : -1;
+	settings.skip_single_tile	= info.resize_images;
 
-	const auto random_zoom_worker_lambda = [&, this](const size_t thread_idx)
+	// Reading and writing mostly wait on the disk, so 0 means one thread per core for those stages.  Decoding, transforming,
+	// and encoding all need the CPU, so instead of giving each of them every core, 0 means the cores are split between the
+	// CPU-bound stages which don't have an explicit number of threads.  Every stage needs at least 1 thread.
+	const size_t cores = std::max(1U, std::thread::hardware_concurrency());
+	const auto configured_threads = [](const std::string & key)
+	{
+		return static_cast<size_t>(std::max(0, cfg().get_int(key)));
+	};
+	const size_t read_threads	= configured_threads("darknet_read_threads"		) ? configured_threads("darknet_read_threads"	) : cores;
+	const size_t write_threads	= configured_threads("darknet_write_threads"	) ? configured_threads("darknet_write_threads"	) : cores;
+	size_t decode_threads		= configured_threads("darknet_decode_threads"		);
+	size_t transform_threads	= configured_threads("darknet_transform_threads"	);
+	size_t encode_threads		= configured_threads("darknet_encode_threads"		);
+
+	std::vector<size_t*> automatic_stages;
+	size_t cores_left = cores;
+	for (size_t * count : {&decode_threads, &transform_threads, &encode_threads})
+	{
+		if (*count == 0)
+		{
+			automatic_stages.push_back(count);
+		}
+		else
+		{
+			cores_left -= std::min(cores_left, *count);
+		}
+	}
+	for (size_t idx = 0; idx < automatic_stages.size(); idx ++)
 	{
-		std::string last_image_filename = "?";
+		// the remainder goes to the first stages, since decoding is usually the slowest
+		const size_t share = cores_left / automatic_stages.size() + (idx < cores_left % automatic_stages.size() ? 1 : 0);
+		*automatic_stages[idx] = std::max(size_t(1), share);
+	}
 
-		try
+	Log("darknet image pipeline threads:"
+		" read="		+ std::to_string(read_threads		) +
+		" decode="		+ std::to_string(decode_threads		) +
+		" transform="	+ std::to_string(transform_threads	) +
+		" encode="		+ std::to_string(encode_threads		) +
+		" write="		+ std::to_string(write_threads		));
+
+	// The images flow through 5 stages, each one with its own threads:
+	//
+	//		read -> decode -> transform -> encode -> write
+	//
+	// The queues between the stages are bounded, so a fast stage blocks instead of filling up memory with images.
+	BoundedQueue<Job>			read_queue		(2 * decode_threads		);	// raw files waiting to be decoded
+	BoundedQueue<Job>			decode_queue	(transform_threads		);	// decoded images waiting to be transformed
+	BoundedQueue<OutputFile>	transform_queue	(4 * encode_threads		);	// new images waiting to be encoded
+	BoundedQueue<OutputFile>	encode_queue	(4 * write_threads		);	// encoded images waiting to be written
+
+	std::atomic<size_t> next_image			(0);
+	std::atomic<size_t> images_read			(0);
+	std::atomic<size_t> images_decoded		(0);
+	std::atomic<size_t> images_transformed	(0);
+	std::atomic<size_t> files_encoded		(0);
+	std::atomic<size_t> files_written		(0);
+	std::atomic<size_t> images_done			(0);
+
+	// the first error stops the entire pipeline
+	std::mutex error_mutex;
+	std::string error_message;
+	std::atomic<bool> failed(false);
+	const auto fail = [&](const std::string & msg)
+	{
+		Log(msg);
+		if (true)
 		{
-			for (const auto & original_image : split_image_filenames[thread_idx])
+			std::lock_guard lock(error_mutex);
+			if (error_message.empty())
 			{
-				if (not error_detected.empty())
-				{
-					break;
-				}
+				error_message = msg;
+			}
+		}
+		failed = true;
+		read_queue		.close();
+		decode_queue	.close();
+		transform_queue	.close();
+		encode_queue	.close();
+	};
 
-				work_done ++;
+	// need to protect the counters and log files from being modified across multiple threads at the same time
+	std::mutex generate_images_mutex;
+	std::vector<VStr> outputs_per_image(annotated_images.size());
 
-				last_image_filename = original_image;
+	// called once all the files for an image have been written, or if all the stages were reused from the cache
+	const auto finish = [&, this](const Job & job)
+	{
+		const std::string & original_image = annotated_images[job->idx];
 
-				cv::Mat original_mat = cv::imread(original_image);
-				if (original_mat.empty())
-				{
-					// something has gone *very* wrong if we cannot read the image
-					Log(original_image + " (" + std::to_string(original_mat.cols) + "x" + std::to_string(original_mat.rows) + ")");
-					throw std::runtime_error("failed to open or read the image " + original_image);
-				}
+		for (size_t idx = 0; idx < stages.size(); idx ++)
+		{
+			if (not job->reused[idx])
+			{
+				image_cache.set(stages[idx].name, original_image, job->entries[idx]);
+			}
+		}
 
-				if (original_mat.cols < large_size.width or original_mat.rows < large_size.height)
-				{
-					std::lock_guard lock(random_zoom_mutex);
-					zoom_txt
-						<< "#" << thread_idx << ": "
-						<< original_image
-						<< " [" << original_mat.cols << "x" << original_mat.rows << "]"
-						<< " -> skipped (image too small)" << std::endl;
-					continue;
-				}
+		// beyond this point we update the things that must be protected by the mutex lock
 
-				const cv::Rect original_rect(0, 0, original_mat.cols, original_mat.rows);
-				json root = json::parse(File(original_image).withFileExtension(".json").loadFileAsString().toStdString());
-				std::vector<cv::Point> points_of_interest;
-				for (auto j : root["mark"])
-				{
-					const int x = j["rect"]["int_x"];
-					const int y = j["rect"]["int_y"];
-					const int w = j["rect"]["int_w"];
-					const int h = j["rect"]["int_h"];
-
-					for (const cv::Point & p :
-						{
-							cv::Point(x + 0, y + 0),	// TL
-							cv::Point(x + w, y + 0),	// TR
-							cv::Point(x + w, y + h),	// BR
-							cv::Point(x + 0, y + h),	// BL
-							cv::Point(x + w/2, y + h/2)	// middle
-						})
-					{
-						if (original_rect.contains(p))
-						{
-							points_of_interest.push_back(p);
-						}
-					}
-				}
+		std::lock_guard lock(generate_images_mutex);
+		for (size_t idx = 0; idx < stages.size(); idx ++)
+		{
+			auto & stage = stages[idx];
+			const auto & entry = job->entries[idx];
 
-				// keep creating cropped/zoomed images as long as we're finding new parts of the image that we didn't previously cover
-				std::vector<cv::Rect> all_previous_rectangles;
-				size_t failed_consecutive_attempts = 0;
-				std::stringstream messages;
+			outputs_per_image[job->idx].insert(outputs_per_image[job->idx].end(), entry.outputs.begin(), entry.outputs.end());
+			number_of_marks					+= entry.marks;
+			number_of_empty_images			+= entry.empty_images;
+			number_of_dropped_annotations	+= entry.dropped;
 
-				while (failed_consecutive_attempts < 5)
-				{
-					/* The amount we're going to "zoom in" depends on exactly how big the image is compared to the final size.
-					 * This value is the "factor" by which we multiply the desired image size.  We need to make sure that both
-					 * the horizontal and vertical values can be satisfied.
-					 */
-					const float horizontal_factor	= static_cast<float>(original_mat.cols) / static_cast<float>(desired_size.width);
-					const float vertical_factor		= static_cast<float>(original_mat.rows) / static_cast<float>(desired_size.height);
-					const float min_factor			= std::min(horizontal_factor, vertical_factor);
-
-					std::uniform_real_distribution<float> uni_f(0.8f, min_factor);
-					const float factor = uni_f(rng);
-
-					// This describes the size of the RoI we're going to carve out of the original image mat.
-					const cv::Size size(
-							std::round(factor * desired_size.width),
-							std::round(factor * desired_size.height));
-
-					// Now that we know the size, we can create the rectangle which is used to carve out the RoI.
-					cv::Rect roi(cv::Point(0, 0), size);
-
-					// Now figure out how much room remains outside of the RoI, and randomly choose some spacing to assign.
-					const int delta_h = original_mat.cols - roi.width;
-					const int delta_v = original_mat.rows - roi.height;
-					std::uniform_int_distribution<int> uni_h(0, delta_h);
-					std::uniform_int_distribution<int> uni_v(0, delta_v);
-					roi.x = uni_h(rng);
-					roi.y = uni_v(rng);
-
-					// See if the middle point of this RoI was already covered by a previous rectangle.
-					bool continue_crop_and_zoom = true;
-					const cv::Point middle_point(roi.x + roi.width/2, roi.y + roi.height/2);
-					for (const auto & r : all_previous_rectangles)
-					{
-						if (r.contains(middle_point))
-						{
-							// we've already covered this point
-							continue_crop_and_zoom = false;
-							break;
-						}
-					}
+			if (stage.name == "resize")
+			{
+				number_of_resized_images		+= entry.resized_images;
+				number_of_images_not_resized	+= entry.outputs.size() - entry.resized_images;
+			}
+			else if (stage.name == "tiles")
+			{
+				number_of_tiles_created += entry.outputs.size();
+			}
+			else
+			{
+				number_of_zooms_created += entry.outputs.size();
+			}
 
-					if (continue_crop_and_zoom == false)
-					{
-						// before we give up on this RoI, see if it covers one of the remaining points of interest
-						for (const auto & p : points_of_interest)
-						{
-							if (roi.contains(p))
-							{
-								messages << "#" << thread_idx << ": " << original_image << "-> adding RoI because it includes point-of-interest x=" << p.x << " y=" << p.y << std::endl;
-								continue_crop_and_zoom = true;
-								break;
-							}
-						}
-					}
+			if (job->reused[idx])
+			{
+				stage.images_reused ++;
+				stage.log << original_image << " -> " << entry.outputs.size() << " images (reused)" << std::endl;
+			}
+			else
+			{
+				stage.log << job->messages[idx];
+			}
+		}
+		images_done ++;
+	};
 
-					if (continue_crop_and_zoom == false)
-					{
-						messages
-							<< "#" << thread_idx << ": "
-							<< original_image
-							<< " -> skipped RoI [x=" << roi.x << " y=" << roi.y << " w=" << roi.width << " h=" << roi.height << "] due to overlap" << std::endl;
-						failed_consecutive_attempts ++;
-						continue;
-					}
+	// read:  check the cache, and load the image and annotations from disk so the decoders never wait on the disk
+	const auto read_work = [&, this]()
+	{
+		while (not failed)
+		{
+			const size_t image_idx = next_image ++;
+			if (image_idx >= annotated_images.size())
+			{
+				break;
+			}
+			const std::string & original_image = annotated_images[image_idx];
 
-					// ...otherise, if we get here then we seem to be covering a new part of the image
-					failed_consecutive_attempts = 0;
-					all_previous_rectangles.push_back(roi);
-					messages
-						<< "#" << thread_idx << ": "
-						<< original_image
-						<< " -> creating RoI from [x=" << roi.x << " y=" << roi.y << " w=" << roi.width << " h=" << roi.height << "]" << std::endl;
-
-					// remove from "points-of-interest" any points located within the RoI we've just created
-					auto iter = points_of_interest.begin();
-					while (iter != points_of_interest.end())
+			try
+			{
+				auto job = std::make_shared<ImageJob>();
+				job->idx				= image_idx;
+				job->entries			.resize(stages.size());
+				job->reused				.resize(stages.size(), false);
+				job->messages			.resize(stages.size());
+				job->outputs_remaining	= 0;
+
+				// first see which stages can reuse the images created the last time
+				const std::string source_hash = DarknetImageCache::hash_source(original_image);
+				bool all_reused = true;
+				for (size_t idx = 0; idx < stages.size(); idx ++)
+				{
+					const std::string key = DarknetImageCache::make_key(stages[idx].params, source_hash);
+					job->reused[idx] = image_cache.get(stages[idx].name, original_image, key, job->entries[idx]);
+					if (not job->reused[idx])
 					{
-						const auto & p = *iter;
-						if (roi.contains(p))
-						{
-							iter = points_of_interest.erase(iter);
-						}
-						else
-						{
-							iter ++;
-						}
+						job->entries[idx] = DarknetImageCache::Entry();
+						job->entries[idx].key = key;
+						all_reused = false;
 					}
+				}
 
-					// Crop the original image, and at the same time resize it to be the exact dimensions we need.
-					cv::Mat output_mat;
-					cv::resize(original_mat(roi), output_mat, desired_size, 0.0, 0.0, rnd_resize_method(rng));
-
-					std::stringstream ss;
-					ss << dir_name << "/" << std::setfill('0') << std::setw(8) << get_next_output_image_index();
-					const std::string output_base_name = ss.str();
-					const std::string output_image = rnd_image_filename(rng, output_base_name);
-					const std::string output_label = output_base_name + ".txt";
-
-					save_image(output_image, output_mat, rng);
-
-					// crop the annotations to match the image, and re-calculate the values for the .txt file.
+				if (all_reused)
+				{
+					finish(job);
+					continue;
+				}
 
-					std::ofstream fs_txt(output_label);
-					fs_txt.imbue(std::locale("C"));
-					fs_txt << std::fixed << std::setprecision(10);
-					size_t number_of_annotations = 0;
-					for (auto j : root["mark"])
-					{
-						int x = j["rect"]["int_x"];
-						int y = j["rect"]["int_y"];
-						int w = j["rect"]["int_w"];
-						int h = j["rect"]["int_h"];
-						const cv::Rect annotation_rect(x, y, w, h);
-						const cv::Rect intersection = annotation_rect & roi;
-						if (intersection.area() == 0)
-						{
-							// this annotation does not appear in our new image
-							continue;
-						}
-
-						const int class_idx = j["class_idx"];
-
-						if (x < roi.x)
-						{
-							// X is beyond the left border, we need to move it to the right
-							int delta = roi.x - x;
-							x += delta;
-							w -= delta;
-						}
-						if (y < roi.y)
-						{
-							// Y is beyond the top border, we need to move it down
-							int delta = roi.y - y;
-							y += delta;
-							h -= delta;
-						}
-						if (x + w > roi.x + roi.width)
-						{
-							// width is beyond the right border
-							w = roi.x + roi.width - x;
-						}
-						if (y + h > roi.y + roi.height)
-						{
-							// height is beyond the bottom border
-							h = roi.y + roi.height - y;
-						}
-
-						if (w < 5 or h < 5)
-						{
-							// ignore extremely tiny slices of annotations
-							continue;
-						}
-
-						// bring all the coordinates back down to zero
-						x -= roi.x;
-						y -= roi.y;
-
-						const double normalized_w = static_cast<double>(w) / static_cast<double>(roi.width	);
-						const double normalized_h = static_cast<double>(h) / static_cast<double>(roi.height	);
-						const double normalized_x = static_cast<double>(x) / static_cast<double>(roi.width	) + normalized_w / 2.0;
-						const double normalized_y = static_cast<double>(y) / static_cast<double>(roi.height	) + normalized_h / 2.0;
-
-						fs_txt << class_idx << " " << normalized_x <<  " " << normalized_y << " " << normalized_w << " " << normalized_h << std::endl;
-						number_of_annotations ++;
-					}
+				const File file(original_image);
+				job->json_text	= file.withFileExtension(".json").loadFileAsString().toStdString();
+				job->txt_text	= file.withFileExtension(".txt").loadFileAsString().toStdString();
 
-					// beyond this point we update the things that must be protected by the mutex lock
-
-					std::lock_guard lock(random_zoom_mutex);
-					all_output_images.push_back(output_image);
-
-					zoom_txt
-						<< messages.str()
-						<< "#" << thread_idx << ": "
-						<< original_image
-						<< " [" << original_mat.cols << "x" << original_mat.rows << "]"
-						<< " -> " << output_image
-						<< " [f=" << factor
-						<< " x=" << roi.x
-						<< " y=" << roi.y
-						<< " w=" << roi.width
-						<< " h=" << roi.height
-						<< "]"
-						<< " -> [" << output_mat.cols << "x" << output_mat.rows << "]"
-						<< " [" << number_of_annotations << "/" << root["mark"].size() << "]"
-						<< std::endl;
-
-					if (number_of_annotations == 0)
-					{
-						number_of_empty_images ++;
-					}
-					number_of_marks += number_of_annotations;
-					number_of_zooms_created ++;
+				std::ifstream ifs(original_image, std::ios::binary);
+				job->raw_image.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+				if (job->raw_image.empty())
+				{
+					throw std::runtime_error("failed to read the image " + original_image);
 				}
 
-				if (points_of_interest.empty() == false)
+				images_read ++;
+				if (not read_queue.push(job))
 				{
-					std::lock_guard lock(random_zoom_mutex);
-					zoom_txt << "#" << thread_idx << ": " << original_image << " -> still had " << points_of_interest.size() << " items remaining in the points-of-interest" << std::endl;
+					break;
 				}
 			}
-		}
-		catch (const std::exception & e)
-		{
-			std::string msg = "error in crop & zoom thread #" + std::to_string(thread_idx) + " while processing \"" + last_image_filename + "\": " + e.what();
-			Log(msg);
-			if (error_detected.empty())
+			catch (const std::exception & e)
 			{
-				error_detected.swap(msg);
+				fail("error while reading \"" + original_image + "\": " + e.what());
 			}
 		}
 	};
 
-	// start multiple threads running the crop and zoom worker lambda, then we wait for all of them to be done
-
-	VThreads vthreads;
-	for (size_t idx = 0; idx < split_image_filenames.size(); idx ++)
+	// decode:  the image is decoded and the annotations are parsed once, and then handed to every stage which needs them
+	const auto decode_work = [&]()
 	{
-		Log("creating random zoom thread #" + std::to_string(idx) + " to handle " + std::to_string(split_image_filenames[idx].size()) + " images...");
-		vthreads.emplace_back(random_zoom_worker_lambda, idx);
-	}
+		Job job;
+		while (read_queue.pop(job))
+		{
+			if (failed)
+			{
+				// keep emptying the queue so the readers are not left blocked
+				continue;
+			}
 
-	while (work_done < work_to_do and error_detected.empty())
-	{
-		progress_window.setProgress(work_done / static_cast<double>(work_to_do));
-		std::this_thread::sleep_for(std::chrono::milliseconds(750));
-	}
+			const std::string & original_image = annotated_images[job->idx];
 
-	for (auto & t : vthreads)
-	{
-		t.join();
-	}
+			try
+			{
+				SourceImage & src = job->src;
+				src.filename	= original_image;
+				src.mat			= cv::imdecode(job->raw_image, cv::IMREAD_COLOR);
+				if (src.mat.empty())
+				{
+					// something has gone *very* wrong if we cannot decode the image
+					Log(original_image + " (" + std::to_string(job->raw_image.size()) + " bytes)");
+					throw std::runtime_error("failed to decode the image " + original_image);
+				}
+				src.root		= json::parse(job->json_text);
+				src.labels		= read_labels(job->txt_text);
+				if (src.root.contains("mark") == false)
+				{
+					// negative samples have no marks
+					src.root["mark"] = json::array();
+				}
+
+				// the raw file is no longer needed, so don't hold on to the memory while the image waits in the next queue
+				std::vector<uchar>().swap(job->raw_image);
+				std::string().swap(job->json_text);
+				std::string().swap(job->txt_text);
 
-	if (not error_detected.empty())
+				images_decoded ++;
+				if (not decode_queue.push(job))
+				{
+					break;
+				}
+			}
+			catch (const std::exception & e)
+			{
+				fail("error while decoding \"" + original_image + "\": " + e.what());
+			}
+		}
+	};
+
+	// transform:  resize, tile, and zoom the image, but leave the encoding to the next stage
+	const auto transform_work = [&]()
 	{
-		throw std::runtime_error(error_detected);
-	}
+		Job job;
+		while (decode_queue.pop(job))
+		{
+			if (failed)
+			{
+				continue;
+			}
 
-	return;
-}
+			const std::string & original_image = annotated_images[job->idx];
 
+			try
+			{
+				// each image gets its own random engine so the results don't depend on the number of threads
+				auto rng = TaskPool::random_engine(job->idx);
 
-void dm::DarknetWnd::drop_small_annotations(ThreadWithProgressWindow & progress_window, const VStr & all_output_images, size_t & number_of_annotations_dropped)
-{
-	std::atomic<size_t> work_done = 0;
-	const size_t work_to_do = all_output_images.size();
+				OutputFiles files;
+				for (size_t idx = 0; idx < stages.size(); idx ++)
+				{
+					if (not job->reused[idx])
+					{
+						std::stringstream messages;
+						stages[idx].transform(job->src, stages[idx].dir_name, settings, rng, job->entries[idx], files, messages);
+						job->messages[idx] = messages.str();
+					}
+				}
 
-	progress_window.setProgress(0.0);
-	progress_window.setStatusMessage("Looking for annotations too small to detect...");
+				// tiles still reference the pixels of the source image, but the rest can be released now
+				job->src = SourceImage();
 
-	const double image_width	= info.image_width;
-	const double image_height	= info.image_height;
+				images_transformed ++;
+				if (files.empty())
+				{
+					finish(job);
+					continue;
+				}
 
-	std::atomic<size_t> total_annotations_dropped = 0;
-	const auto & split_image_filenames = split(all_output_images);
-	std::string error_detected;
+				job->outputs_remaining = files.size();
+				for (auto & file : files)
+				{
+					file.job = job;
+					if (not transform_queue.push(std::move(file)))
+					{
+						break;
+					}
+				}
+			}
+			catch (const std::exception & e)
+			{
+				fail("error while processing \"" + original_image + "\": " + e.what());
+			}
+		}
+	};
 
-	const auto drop_small_annotations_worker_lambda = [&, this](const size_t thread_idx)
+	// encode:  compress the new images as JPG or PNG
+	const auto encode_work = [&]()
 	{
-		std::string last_image_filename = "?";
-
-		try
+		OutputFile file;
+		while (transform_queue.pop(file))
 		{
-			for (const auto & fn : split_image_filenames[thread_idx])
+			if (failed)
 			{
-				if (not error_detected.empty())
+				continue;
+			}
+
+			try
+			{
+				const std::string extension = is_jpg(file.image_filename) ? ".jpg" : ".png";
+				if (cv::imencode(extension, file.mat, file.encoded, file.params) == false)
 				{
-					break;
+					throw std::runtime_error("failed to encode the image " + file.image_filename);
 				}
+				file.mat.release();
 
-				work_done ++;
-
-				last_image_filename = fn;
-
-				const auto txt = std::filesystem::path(fn).replace_extension(".txt");
-				if (std::filesystem::file_size(txt) == 0)
+				files_encoded ++;
+				if (not encode_queue.push(std::move(file)))
 				{
-					continue;
+					break;
 				}
+			}
+			catch (const std::exception & e)
+			{
+				fail("error while encoding \"" + file.image_filename + "\": " + e.what());
+			}
+		}
+	};
 
-				std::stringstream ss;
-				ss.imbue(std::locale("C"));
-				ss << std::fixed << std::setprecision(10);
+	// write:  save the encoded images and the annotations to disk
+	const auto write_work = [&]()
+	{
+		OutputFile file;
+		while (encode_queue.pop(file))
+		{
+			if (failed)
+			{
+				continue;
+			}
 
-				std::ifstream ifs(txt.string());
-				ifs.imbue(std::locale("C"));
+			try
+			{
+				std::ofstream image_fs(file.image_filename, std::ios::binary);
+				image_fs.write(reinterpret_cast<const char *>(file.encoded.data()), file.encoded.size());
+				image_fs.close();
 
-				size_t lines_dropped_in_this_file	= 0;
-				size_t lines_kept_in_this_file		= 0;
-				int class_id						= -1;
-				double cx							= -1.0;
-				double cy							= -1.0;
-				double w							= -1.0;
-				double h							= -1.0;
+				std::ofstream label_fs(file.label_filename);
+				label_fs << file.labels;
+				label_fs.close();
 
-				while (ifs.good())
+				if (image_fs.fail() or label_fs.fail())
 				{
-					ifs >> class_id >> cx >> cy >> w >> h;
-					if (class_id >= 0 and cx > 0.0 and cy > 0.0 and w > 0.0 and h > 0.0)
-					{
-						const int annotation_width	= std::round(image_width * w);
-						const int annotation_height	= std::round(image_height * h);
-						const int area = annotation_width * annotation_height;
-
-						if (area <= info.annotation_area_size)
-						{
-							// this annotation is too small, so don't bother remembering it (we'll re-write the .txt file without this line)
-							Log(txt.string() + ": dropping annotation (too small): class #" + std::to_string(class_id) + " w=" + std::to_string(annotation_width) + " h=" + std::to_string(annotation_height) + " area=" + std::to_string(area) + " limit=" + std::to_string(info.annotation_area_size));
-							total_annotations_dropped ++;
-							lines_dropped_in_this_file ++;
-							continue;
-						}
-
-						// otherwise, remember this annotation
-						lines_kept_in_this_file ++;
-						ss << class_id << " " << cx << " " << cy << " " << w << " " << h << std::endl;
-					}
+					throw std::runtime_error("failed to write " + file.image_filename);
 				}
-				ifs.close();
 
-				if (lines_dropped_in_this_file > 0)
+				files_written ++;
+				if (-- file.job->outputs_remaining == 0)
 				{
-					// we must have decided to drop an annotation, so re-write the .txt file
-					std::ofstream ofs(txt.string());
-					ofs << ss.str();
+					finish(file.job);
 				}
+
+				// don't hold on to the encoded image (or the job) while waiting for the next file
+				file = OutputFile();
 			}
-		}
-		catch (const std::exception & e)
-		{
-			std::string msg = "error in \"too-small\" thread #" + std::to_string(thread_idx) + " while processing \"" + last_image_filename + "\": " + e.what();
-			Log(msg);
-			if (error_detected.empty())
+			catch (const std::exception & e)
 			{
-				error_detected.swap(msg);
+				fail("error while writing \"" + file.image_filename + "\": " + e.what());
 			}
 		}
 	};
 
-	// start multiple threads running the "too-small" worker lambda, then we wait for all of them to be done
+	// the last thread of each stage to exit closes the queue to the next stage, which lets those threads exit in turn
+	VThreads threads;
+	std::atomic<size_t> threads_running(0);
+	const auto start_stage = [&](const size_t count, std::function<void()> work, std::function<void()> done)
+	{
+		auto stage_running = std::make_shared<std::atomic<size_t>>(count);
+		threads_running += count;
+		for (size_t idx = 0; idx < count; idx ++)
+		{
+			threads.emplace_back(
+				[work, done, stage_running, &threads_running]()
+				{
+					work();
+					if (-- *stage_running == 0)
+					{
+						done();
+					}
+					threads_running --;
+				});
+		}
+	};
+
+	const auto start_time = std::chrono::high_resolution_clock::now();
+	ScopedWorkerThreads busy_threads(read_threads + decode_threads + transform_threads + encode_threads + write_threads);
+	start_stage(read_threads		, read_work			, [&]() { read_queue		.close(); });
+	start_stage(decode_threads		, decode_work		, [&]() { decode_queue		.close(); });
+	start_stage(transform_threads	, transform_work	, [&]() { transform_queue	.close(); });
+	start_stage(encode_threads		, encode_work		, [&]() { encode_queue		.close(); });
+	start_stage(write_threads		, write_work		, []() {});
 
-	VThreads vthreads;
-	for (size_t idx = 0; idx < split_image_filenames.size(); idx ++)
+	// show the throughput of each stage so it is obvious which one is the bottleneck and needs more threads
+	const auto throughput = [&]()
 	{
-		Log("creating \"too-small\" thread #" + std::to_string(idx) + " to handle " + std::to_string(split_image_filenames[idx].size()) + " images...");
-		vthreads.emplace_back(drop_small_annotations_worker_lambda, idx);
-	}
+		const double seconds = std::max(0.001, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count());
+		std::stringstream ss;
+		ss	<< std::fixed << std::setprecision(1)
+			<< "read "		<< images_read			/ seconds << "/s, "
+			<< "decode "	<< images_decoded		/ seconds << "/s, "
+			<< "transform "	<< images_transformed	/ seconds << "/s, "
+			<< "encode "	<< files_encoded		/ seconds << "/s, "
+			<< "write "		<< files_written		/ seconds << "/s";
+		return ss.str();
+	};
 
-	while (work_done < work_to_do and error_detected.empty())
+	while (threads_running > 0)
 	{
-		progress_window.setProgress(work_done / static_cast<double>(work_to_do));
-		std::this_thread::sleep_for(std::chrono::milliseconds(750));
+		progress_window.setProgress(images_done / static_cast<double>(annotated_images.size()));
+		progress_window.setStatusMessage(text + "\n" + throughput());
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
 	}
 
-	for (auto & t : vthreads)
+	for (auto & t : threads)
 	{
 		t.join();
 	}
 
-	number_of_annotations_dropped += total_annotations_dropped;
+	Log("darknet image pipeline:"
+		" images read="		+ std::to_string(images_read		) +
+		" decoded="			+ std::to_string(images_decoded		) +
+		" transformed="		+ std::to_string(images_transformed	) +
+		" files encoded="	+ std::to_string(files_encoded		) +
+		" written="			+ std::to_string(files_written		) +
+		" (" + throughput() + ")");
+
+	if (failed)
+	{
+		throw std::runtime_error(error_message);
+	}
+
+	progress_window.setProgress(1.0);
+
+	// the output images are combined in the original order so the results don't depend on which thread finished first
+	for (const auto & outputs : outputs_per_image)
+	{
+		all_output_images.insert(all_output_images.end(), outputs.begin(), outputs.end());
+	}
 
-	if (not error_detected.empty())
+	for (const auto & stage : stages)
 	{
-		throw std::runtime_error(error_detected);
+		Log(stage.name + " images reused from the cache: " + std::to_string(stage.images_reused) + "/" + std::to_string(annotated_images.size()));
 	}
 
 	return;
@@ -1100,35 +1100,31 @@ void dm::DarknetWnd::create_Darknet_configuration_file(ThreadWithProgressWindow
 		progress_window.setProgress(0.0);
 
 		/* Make many attempts at figuring out the best anchors.  In tests, I've seen the best anchors found as high
-		 * as the 98th attempt!  Also keep track of the time in case it is taking too long and we want to abort.
+		 * as the 98th attempt!  The annotations are only read once, and the attempts run in parallel.  Attempts which
+		 * have not started after 60 seconds are skipped in case it is taking too long.
 		 */
-		std::time_t now = std::time(nullptr);
-		const std::time_t end_time = now + 60;
-		const size_t max_attempts = 100;
-		float best_avg_iou = 0.0f;
+		const AnchorBoxes boxes = load_anchor_boxes(info.train_filename, info.image_width, info.image_height, number_of_classes);
+		std::string counters_per_class;
+		std::string anchors;
+		float avg_iou = 0.0f;
 
-		for (size_t attempt = 0; attempt < max_attempts and std::time(nullptr) < end_time; attempt ++)
+		calc_anchors(boxes, anchor_clusters, 100, 60.0, anchors, counters_per_class, avg_iou,
+			[&](const size_t attempts_done, const size_t attempts)
+			{
+				progress_window.setProgress(double(attempts_done) / double(attempts));
+			});
+
+		if (avg_iou > 0.0f)
 		{
-			progress_window.setProgress(double(attempt) / double(max_attempts));
+			dm::Log("avg IoU ........ " + std::to_string(avg_iou));
+			dm::Log("new anchors .... " + anchors);
+			dm::Log("new counters ... " + counters_per_class);
 
-			std::string counters_per_class;
-			std::string anchors;
-			float avg_iou = 0.0f;
+			m["anchors"] = anchors;
 
-			calc_anchors(info.train_filename, anchor_clusters, info.image_width, info.image_height, number_of_classes, anchors, counters_per_class, avg_iou);
-			if (avg_iou > best_avg_iou)
+			if (class_imbalance)
 			{
-				dm::Log("attempt #" + std::to_string(attempt) + ": avg IoU ........ " + std::to_string(avg_iou));
-				dm::Log("attempt #" + std::to_string(attempt) + ": new anchors .... " + anchors);
-				dm::Log("attempt #" + std::to_string(attempt) + ": new counters ... " + counters_per_class);
-
-				best_avg_iou = avg_iou;
-				m["anchors"] = anchors;
-
-				if (class_imbalance)
-				{
-					m["counters_per_class"] = counters_per_class;
-				}
+				m["counters_per_class"] = counters_per_class;
 			}
 		}
 
@@ -1202,15 +1198,8 @@ void dm::DarknetWnd::create_Darknet_training_and_validation_files(
 	number_of_zooms_created			= 0;
 	number_of_dropped_annotations	= 0;
 
-	File dir = File(info.project_dir).getChildFile("darkmark_image_cache");
-	if (dir.exists())
-	{
-		for (const auto & name : {"resize", "tiles", "zoom"})
-		{
-			File subdir = dir.getChildFile(name);
-			subdir.deleteRecursively();
-		}
-	}
+	// images which haven't changed since the last time are reused, and everything else is deleted once we're done
+	image_cache.open(info.project_dir);
 
 	// these vectors will have the full path of the images we need to use (or which have been skipped)
 	VStr negative_samples;
@@ -1238,24 +1227,15 @@ void dm::DarknetWnd::create_Darknet_training_and_validation_files(
 		number_of_empty_images = 0;
 	}
 
-	if (info.resize_images)
+	if (info.resize_images or info.tile_images or info.zoom_images)
 	{
-		Log("resizing all images");
-		resize_images(progress_window, annotated_images, all_output_images, number_of_resized_images, number_of_images_not_resized, number_of_marks, number_of_empty_images);
+		Log(std::string("generating images:") + (info.resize_images ? " resize" : "") + (info.tile_images ? " tile" : "") + (info.zoom_images ? " crop+zoom" : ""));
+		generate_images(progress_window, annotated_images, all_output_images, number_of_marks, number_of_empty_images, number_of_resized_images, number_of_images_not_resized, number_of_tiles_created, number_of_zooms_created, number_of_dropped_annotations);
 		Log("number of images resized ................. " + std::to_string(number_of_resized_images		));
 		Log("number of images not resized ............. " + std::to_string(number_of_images_not_resized	));
-	}
-	if (info.tile_images)
-	{
-		Log("tiling all images");
-		tile_images(progress_window, annotated_images, all_output_images, number_of_marks, number_of_tiles_created, number_of_empty_images);
-		Log("number of tiles created .................. " + std::to_string(number_of_tiles_created));
-	}
-	if (info.zoom_images)
-	{
-		Log("crop+zoom all images");
-		random_zoom_images(progress_window, annotated_images, all_output_images, number_of_marks, number_of_zooms_created, number_of_empty_images);
-		Log("number of crop+zoom images created ....... " + std::to_string(number_of_zooms_created));
+		Log("number of tiles created .................. " + std::to_string(number_of_tiles_created		));
+		Log("number of crop+zoom images created ....... " + std::to_string(number_of_zooms_created		));
+		Log("number of small annotations dropped ...... " + std::to_string(number_of_dropped_annotations	));
 	}
 
 	std::shuffle(all_output_images.begin(), all_output_images.end(), get_random_engine());
@@ -1301,13 +1281,7 @@ void dm::DarknetWnd::create_Darknet_training_and_validation_files(
 		}
 	}
 
-	if (info.do_not_resize_images == false and info.remove_small_annotations)
-	{
-		// go through all of the annotations and see if anything needs to be dropped
-
-		Log("drop small annotations");
-		drop_small_annotations(progress_window, all_output_images, number_of_dropped_annotations);
-	}
+	image_cache.garbage_collect();
 
 	// now that we know the exact set of images (including resized and tiled images)
 	// we can create the training and validation .txt files
@@ -43,19 +43,19 @@ namespace dm
 
 			void find_all_annotated_images(ThreadWithProgressWindow & progress_window, VStr & annotated_images, VStr & skipped_images, size_t & number_of_marks, size_t & number_of_empty_images);
 
-			void resize_images(ThreadWithProgressWindow & progress_window, const VStr & annotated_images, VStr & all_output_images, size_t & number_of_resized_images, size_t & number_of_images_not_resized, size_t & number_of_marks, size_t & number_of_empty_images);
-
-			void tile_images(ThreadWithProgressWindow & progress_window, const VStr & annotated_images, VStr & all_output_images, size_t & number_of_marks, size_t & number_of_tiles_created, size_t & number_of_empty_images);
-
-			void random_zoom_images(ThreadWithProgressWindow & progress_window, const VStr & annotated_images, VStr & all_output_images, size_t & number_of_marks, size_t & number_of_zooms_created, size_t & number_of_empty_images);
-
-			void drop_small_annotations(ThreadWithProgressWindow & progress_window, const VStr & all_output_images, size_t & number_of_annotations_dropped);
+			/** Create the resized, tiled, and crop & zoom images.  Each source image is decoded once and given to all of the
+			 * enabled stages, and small annotations are dropped as the new .txt files are written.
+			 */
+			void generate_images(ThreadWithProgressWindow & progress_window, const VStr & annotated_images, VStr & all_output_images, size_t & number_of_marks, size_t & number_of_empty_images, size_t & number_of_resized_images, size_t & number_of_images_not_resized, size_t & number_of_tiles_created, size_t & number_of_zooms_created, size_t & number_of_dropped_annotations);
 
 			void create_Darknet_configuration_file(ThreadWithProgressWindow & progress_window);
 			void create_Darknet_shell_scripts();
 
 			CfgHandler cfg_handler;
 
+			/// Remembers the resized, tiled, and zoomed images so they don't have to be re-created every time.
+			DarknetImageCache image_cache;
+
 			Value v_cfg_template;
 			Value v_extra_flags;
 			Value v_train_with_all_images;
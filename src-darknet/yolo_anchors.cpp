@@ -1,7 +1,9 @@
 // DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <functional>
 #include <limits>
 #include <random>
 #include <string>
@@ -27,208 +29,189 @@ struct box_label
 typedef std::vector<box_label> Boxes;
 
 
-struct matrix
+/// The result of a single k-means attempt.
+struct model
 {
-	size_t rows;
-	size_t cols;
-	VFloat vals;
+	VFloat center_widths;
+	VFloat center_heights;
+	float avg_iou;
+};
 
-	matrix(const size_t r, const size_t c)
-	{
-		rows = r;
-		cols = c;
-		vals = VFloat(std::max<size_t>(1lu, r * c), 0.0f);
-		return;
-	}
 
-	matrix() : matrix(0, 0)
-	{
-		return;
-	}
+/** Find the closest center for every box.  Boxes and anchors are compared as if they were centered on the same point,
+ * and the distance is 1 - IoU, so the closest center is the one with the highest IoU.  The loop over the boxes has no
+ * branches and reads from contiguous arrays, which lets the compiler vectorize it.
+ */
+void closest_centers(const AnchorBoxes & boxes, const VFloat & center_widths, const VFloat & center_heights, VInt & assignments, VFloat & best_ious)
+{
+	const size_t number_of_boxes	= boxes.widths.size();
+	const float * const w			= boxes.widths.data();
+	const float * const h			= boxes.heights.data();
+	int * const assigned			= assignments.data();
+	float * const best				= best_ious.data();
+
+	std::fill(best_ious.begin(), best_ious.end(), -1.0f);
 
-	float & row_and_col(const size_t r, const size_t c)
+	for (size_t j = 0; j < center_widths.size(); ++j)
 	{
-		if (rows == 0 or cols == 0)
-		{
-			throw std::invalid_argument("cannot get cell r=" + std::to_string(r) + " c=" + std::to_string(c) + " when rows=" + std::to_string(rows) + " and cols=" + std::to_string(cols));
-		}
-		if (r >= rows or c >= cols)
+		const float anchor_w	= center_widths[j];
+		const float anchor_h	= center_heights[j];
+		const float anchor_area	= anchor_w * anchor_h;
+		const int center_idx	= static_cast<int>(j);
+
+		for (size_t i = 0; i < number_of_boxes; ++i)
 		{
-			throw std::invalid_argument("invalid cell r=" + std::to_string(r) + " c=" + std::to_string(c) + " when rows=" + std::to_string(rows) + " and cols=" + std::to_string(cols));
-		}
+			const float min_w			= std::min(w[i], anchor_w);
+			const float min_h			= std::min(h[i], anchor_h);
+			const float box_intersect	= min_w * min_h;
+			const float box_union		= w[i] * h[i] + anchor_area - box_intersect;
+			const float iou				= box_intersect / box_union;
 
-		return vals.at(r * cols + c);
+			// use a bit mask instead of a conditional so the compiler can vectorize the update of the assignment
+			const int closer_mask		= -static_cast<int>(iou > best[i]);
+			best[i]						= std::max(best[i], iou);
+			assigned[i]					= (center_idx & closer_mask) | (assigned[i] & ~closer_mask);
+		}
 	}
 
-	float * row(const size_t r)
-	{
-		return & row_and_col(r, 0);
-	}
-};
+	return;
+}
 
 
-struct model
+/** Choose the initial centers with k-means++.  The first center is a random box, and each of the following centers is
+ * a random box chosen with a probability proportional to the square of its distance from the nearest center.  This
+ * spreads out the initial centers, which means fewer iterations and far fewer attempts stuck in a poor solution.
+ */
+void kmeans_plus_plus(const AnchorBoxes & boxes, const size_t number_of_clusters, std::default_random_engine & rng, VFloat & center_widths, VFloat & center_heights)
 {
-	VInt assignments;
-	matrix centers;
-};
+	const size_t number_of_boxes	= boxes.widths.size();
+	const float * const w			= boxes.widths.data();
+	const float * const h			= boxes.heights.data();
 
+	std::uniform_int_distribution<size_t> uni(0, number_of_boxes - 1);
+	const size_t first = uni(rng);
+	center_widths	.assign(1, w[first]);
+	center_heights	.assign(1, h[first]);
 
-float dist(float *x, float *y, int n)
-{
-	float mw = (x[0] < y[0]) ? x[0] : y[0];
-	float mh = (x[1] < y[1]) ? x[1] : y[1];
-	float inter = mw * mh;
-	float sum = x[0] * x[1] + y[0] * y[1];
-	float un = sum - inter;
-	float iou = inter / un;
-
-	return 1.0f - iou;
-}
-
+	// squared distance between each box and the nearest center chosen so far
+	VFloat min_dist(number_of_boxes, std::numeric_limits<float>::max());
+	float * const d = min_dist.data();
 
-VInt random_samples(const size_t maximum_number_of_samples)
-{
-	VInt v;
-	v.reserve(maximum_number_of_samples);
-	while (v.size() < maximum_number_of_samples)
+	while (center_widths.size() < number_of_clusters)
 	{
-		v.push_back(v.size());
-	}
-
-	#if 0
-	//
-	// If using a stand-alone version of yolo anchors, you'll have to use this
-	// (or something similar) as your random number generator.
-	//
-	std::random_device rd;
-	std::mt19937 rng(rd());
-	#else
-	auto & rng = dm::get_random_engine();
-	#endif
+		const float anchor_w	= center_widths.back();
+		const float anchor_h	= center_heights.back();
+		const float anchor_area	= anchor_w * anchor_h;
 
-	std::shuffle(v.begin(), v.end(), rng);
-
-	return v;
-}
+		for (size_t i = 0; i < number_of_boxes; ++i)
+		{
+			const float min_w			= (w[i] < anchor_w) ? w[i] : anchor_w;
+			const float min_h			= (h[i] < anchor_h) ? h[i] : anchor_h;
+			const float box_intersect	= min_w * min_h;
+			const float box_union		= w[i] * h[i] + anchor_area - box_intersect;
+			const float distance		= 1.0f - box_intersect / box_union;
+			const float distance_sq		= distance * distance;
+			d[i]						= (distance_sq < d[i]) ? distance_sq : d[i];
+		}
 
+		double total = 0.0;
+		for (size_t i = 0; i < number_of_boxes; ++i)
+		{
+			total += d[i];
+		}
 
-void random_centers(matrix & data, matrix & centers)
-{
-	const VInt s = random_samples(data.rows);
-	for (size_t row = 0; row < centers.rows; row ++)
-	{
-		for (size_t col = 0; col < data.cols; col ++)
+		size_t idx = 0;
+		if (total > 0.0)
+		{
+			std::uniform_real_distribution<double> uni_d(0.0, total);
+			double target = uni_d(rng);
+			while (idx + 1 < number_of_boxes)
+			{
+				target -= d[idx];
+				if (target < 0.0)
+				{
+					break;
+				}
+				idx ++;
+			}
+		}
+		else
 		{
-			centers.row_and_col(row, col) = data.row_and_col(s[row], col);
+			// every box is identical to one of the centers, so any box will do
+			idx = uni(rng);
 		}
+
+		center_widths	.push_back(w[idx]);
+		center_heights	.push_back(h[idx]);
 	}
 
 	return;
 }
 
 
-int closest_center(float *datum, matrix & centers)
+/// Move each center to the average size of the boxes assigned to it.  A center without any boxes keeps its previous size.
+void update_centers(const AnchorBoxes & boxes, const VInt & assignments, VFloat & center_widths, VFloat & center_heights)
 {
-	int best = 0;
-	float best_dist = dist(datum, centers.row(best), centers.cols);
-	for (size_t j = 0; j < centers.rows; ++j)
+	const size_t number_of_clusters = center_widths.size();
+	std::vector<double> sum_w(number_of_clusters, 0.0);
+	std::vector<double> sum_h(number_of_clusters, 0.0);
+	VInt counts(number_of_clusters, 0);
+
+	for (size_t i = 0; i < assignments.size(); ++i)
 	{
-		float new_dist = dist(datum, centers.row(j), centers.cols);
-		if (new_dist < best_dist)
-		{
-			best_dist = new_dist;
-			best = j;
-		}
+		const int center_idx = assignments[i];
+		sum_w[center_idx] += boxes.widths[i];
+		sum_h[center_idx] += boxes.heights[i];
+		counts[center_idx] ++;
 	}
 
-	return best;
-}
-
-
-int kmeans_expectation(matrix & data, VInt & assignments, matrix & centers)
-{
-	int converged = 1;
-	for (size_t i = 0; i < data.rows; ++i)
+	for (size_t j = 0; j < number_of_clusters; ++j)
 	{
-		int closest = closest_center(data.row(i), centers);
-		if (closest != assignments[i])
+		if (counts[j])
 		{
-			converged = 0;
+			center_widths[j]	= static_cast<float>(sum_w[j] / counts[j]);
+			center_heights[j]	= static_cast<float>(sum_h[j] / counts[j]);
 		}
-		assignments[i] = closest;
 	}
 
-	return converged;
+	return;
 }
 
 
-void kmeans_maximization(matrix & data, VInt & assignments, matrix & centers)
+model do_kmeans(const AnchorBoxes & boxes, const size_t number_of_clusters, std::default_random_engine & rng)
 {
-	matrix old_centers(centers.rows, centers.cols);
+	const size_t number_of_boxes = boxes.widths.size();
 
-	VInt counts(centers.rows, 0);
+	model m;
+	kmeans_plus_plus(boxes, number_of_clusters, rng, m.center_widths, m.center_heights);
 
-	for (size_t i = 0; i < centers.rows; ++i)
-	{
-		for (size_t j = 0; j < centers.cols; ++j)
-		{
-			old_centers.row_and_col(i, j) = centers.row_and_col(i, j);
-			centers.row_and_col(i, j) = 0;
-		}
-	}
+	VInt assignments(number_of_boxes, 0);
+	VInt previous_assignments;
+	VFloat best_ious(number_of_boxes, 0.0f);
 
-	for (size_t i = 0; i < data.rows; ++i)
+	for (int i = 0; i < 1000; ++i)
 	{
-		++counts[assignments[i]];
-		for (size_t j = 0; j < data.cols; ++j)
+		previous_assignments = assignments;
+		closest_centers(boxes, m.center_widths, m.center_heights, assignments, best_ious);
+		if (i > 0 and assignments == previous_assignments)
 		{
-			centers.row_and_col(assignments[i], j) += data.row_and_col(i, j);
+			break;
 		}
+		update_centers(boxes, assignments, m.center_widths, m.center_heights);
 	}
 
-	for (size_t i = 0; i < centers.rows; ++i)
-	{
-		if (counts[i])
-		{
-			for (size_t j = 0; j < centers.cols; ++j)
-			{
-				centers.row_and_col(i, j) /= counts[i];
-			}
-		}
-	}
+	// the centers may have moved after the last assignment, so get the final IoU of every box with its closest anchor
+	closest_centers(boxes, m.center_widths, m.center_heights, assignments, best_ious);
 
-	for (size_t i = 0; i < centers.rows; ++i)
+	double avg_iou = 0.0;
+	for (const float iou : best_ious)
 	{
-		for (size_t j = 0; j < centers.cols; ++j)
+		if (iou > 0.0f and iou < 1.0f)
 		{
-			if(centers.row_and_col(i, j) == 0)
-			{
-				centers.row_and_col(i, j) = old_centers.row_and_col(i, j);
-			}
+			avg_iou += iou;
 		}
 	}
-
-	return;
-}
-
-
-model do_kmeans(matrix & data, const size_t number_of_clusters)
-{
-	matrix centers(number_of_clusters, data.cols);
-
-	VInt assignments(data.rows, 0);
-
-	random_centers(data, centers);
-
-	for (int i = 0; i < 1000 and not kmeans_expectation(data, assignments, centers); ++i)
-	{
-		kmeans_maximization(data, assignments, centers);
-	}
-
-	model m;
-	m.assignments = assignments;
-	m.centers = centers;
+	m.avg_iou = static_cast<float>(100.0 * avg_iou / static_cast<double>(number_of_boxes));
 
 	return m;
 }
@@ -258,25 +241,18 @@ Boxes read_boxes(const std::string & filename)
 }
 
 
-void calc_anchors(const std::string & train_images_filename, const size_t number_of_clusters, const size_t width, const size_t height, const size_t number_of_classes, std::string & new_anchors, std::string & new_counters_per_class, float & new_avg_iou)
+AnchorBoxes load_anchor_boxes(const std::string & train_images_filename, const size_t width, const size_t height, const size_t number_of_classes)
 {
-	new_anchors				= "";
-	new_counters_per_class	= "";
-	new_avg_iou				= 0.0f;
-
 	if (width	< 32 or
 		width	% 32 or
 		height	< 32 or
 		height	% 32 or
-		number_of_clusters <= 1 or
 		train_images_filename.empty())
 	{
-		throw std::invalid_argument("width and height must both be multiples of 32, and number_of_clusters must be greater than 1");
+		throw std::invalid_argument("width and height must both be multiples of 32");
 	}
 
-	VFloat rel_width_height_array;
-	VInt counter_per_class(number_of_classes, 0);
-	size_t number_of_boxes = 0;
+	std::vector<std::string> label_filenames;
 	std::string path;
 	std::ifstream ifs(train_images_filename);
 	while (std::getline(ifs, path))
@@ -294,25 +270,103 @@ void calc_anchors(const std::string & train_images_filename, const size_t number
 			labelpath.erase(pos);
 		}
 		labelpath += ".txt";
+		label_filenames.push_back(labelpath);
+	}
+
+	// the label files are read in parallel, but the boxes are combined in the original order
+	std::vector<Boxes> boxes_per_file(label_filenames.size());
+	dm::TaskPool().run(label_filenames.size(),
+		[&](const size_t idx)
+		{
+			boxes_per_file[idx] = read_boxes(label_filenames[idx]);
+		});
 
-		for (const auto & box : read_boxes(labelpath))
+	AnchorBoxes boxes;
+	boxes.counter_per_class.assign(number_of_classes, 0);
+	for (const auto & v : boxes_per_file)
+	{
+		for (const auto & box : v)
 		{
-			number_of_boxes ++;
-			counter_per_class[box.class_idx] ++;
-			rel_width_height_array.push_back(box.w * static_cast<float>(width));
-			rel_width_height_array.push_back(box.h * static_cast<float>(height));
+			if (box.class_idx >= 0 and static_cast<size_t>(box.class_idx) < number_of_classes)
+			{
+				boxes.counter_per_class[box.class_idx] ++;
+			}
+
+			// annotations without a size cannot be compared with anchors
+			const float w = box.w * static_cast<float>(width);
+			const float h = box.h * static_cast<float>(height);
+			if (w > 0.0f and h > 0.0f)
+			{
+				boxes.widths	.push_back(w);
+				boxes.heights	.push_back(h);
+			}
 		}
 	}
 
-	matrix boxes_data(number_of_boxes, 2);
-	for (size_t i = 0; i < number_of_boxes; ++i)
+	dm::Log("anchors: loaded " + std::to_string(boxes.widths.size()) + " boxes from " + std::to_string(label_filenames.size()) + " label files");
+
+	return boxes;
+}
+
+
+void calc_anchors(const AnchorBoxes & boxes, const size_t number_of_clusters, const size_t attempts, const double max_seconds, std::string & new_anchors, std::string & new_counters_per_class, float & new_avg_iou, std::function<void(const size_t attempts_done, const size_t attempts)> progress)
+{
+	new_anchors				= "";
+	new_counters_per_class	= "";
+	new_avg_iou				= 0.0f;
+
+	if (number_of_clusters <= 1)
 	{
-		boxes_data.row_and_col(i, 0) = rel_width_height_array[i * 2 + 0];
-		boxes_data.row_and_col(i, 1) = rel_width_height_array[i * 2 + 1];
+		throw std::invalid_argument("number_of_clusters must be greater than 1");
 	}
+	if (boxes.widths.size() < number_of_clusters)
+	{
+		throw std::invalid_argument("cannot calculate " + std::to_string(number_of_clusters) + " anchors from " + std::to_string(boxes.widths.size()) + " annotations");
+	}
+
+	/* Each attempt has its own random engine so the attempts can run in any order on any thread.  The seed for this call
+	 * still comes from the shared random engine, so calling this again gives a different set of attempts.
+	 */
+	const uint32_t seed = dm::get_random_engine()();
+
+	const auto start_time = std::chrono::high_resolution_clock::now();
+	std::vector<model> models(std::max<size_t>(1, attempts));
+	std::vector<char> completed(models.size(), false);
 
-	// K-means
-	model anchors_data = do_kmeans(boxes_data, number_of_clusters);
+	dm::TaskPool().run(models.size(),
+		[&](const size_t attempt)
+		{
+			const double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+			if (attempt > 0 and elapsed >= max_seconds)
+			{
+				// out of time, so skip the attempts which have not yet started
+				return;
+			}
+
+			std::seed_seq seq{seed, static_cast<uint32_t>(attempt)};
+			std::default_random_engine rng(seq);
+			models[attempt]		= do_kmeans(boxes, number_of_clusters, rng);
+			completed[attempt]	= true;
+		},
+		progress);
+
+	// on a tie the lowest attempt wins, so the result does not depend on which thread finished first
+	size_t best_attempt		= 0;
+	size_t attempts_done	= 0;
+	for (size_t attempt = 0; attempt < models.size(); attempt ++)
+	{
+		if (completed[attempt])
+		{
+			attempts_done ++;
+			if (models[attempt].avg_iou > models[best_attempt].avg_iou)
+			{
+				best_attempt = attempt;
+			}
+		}
+	}
+	const model & anchors_data = models[best_attempt];
+
+	dm::Log("anchors: completed " + std::to_string(attempts_done) + "/" + std::to_string(models.size()) + " attempts, best was #" + std::to_string(best_attempt));
 
 	// Store all the sizes in a multimap.  The key is the total area, and the value is the width+height stored as strings.
 	// This way the multimap will automatically sort all the values for us from smallest to largest, and all that we need
@@ -320,8 +374,8 @@ void calc_anchors(const std::string & train_images_filename, const size_t number
 	std::multimap<float, std::string> mm;
 	for (size_t row = 0; row < number_of_clusters; row ++)
 	{
-		const float w				= anchors_data.centers.row_and_col(row, 0);
-		const float h				= anchors_data.centers.row_and_col(row, 1);
+		const float w				= anchors_data.center_widths[row];
+		const float h				= anchors_data.center_heights[row];
 		const float area			= w * h;
 		const size_t round_width	= std::round(w);
 		const size_t round_height	= std::round(h);
@@ -341,46 +395,16 @@ void calc_anchors(const std::string & train_images_filename, const size_t number
 
 	// now we figure out the values for counters_per_class
 
-	float avg_iou = 0.0f;
-	for (size_t i = 0; i < number_of_boxes; ++i)
-	{
-		float box_w		= rel_width_height_array[i * 2 + 0];
-		float box_h		= rel_width_height_array[i * 2 + 1];
-		float min_dist	= std::numeric_limits<float>::max();
-		float best_iou	= 0.0f;
-		for (size_t j = 0; j < number_of_clusters; ++j)
-		{
-			const float anchor_w		= anchors_data.centers.row_and_col(j, 0);
-			const float anchor_h		= anchors_data.centers.row_and_col(j, 1);
-			const float min_w			= (box_w < anchor_w) ? box_w : anchor_w;
-			const float min_h			= (box_h < anchor_h) ? box_h : anchor_h;
-			const float box_intersect	= min_w * min_h;
-			const float box_union		= box_w * box_h + anchor_w * anchor_h - box_intersect;
-			const float iou				= box_intersect / box_union;
-			const float distance		= 1 - iou;
-			if (distance < min_dist)
-			{
-				min_dist = distance;
-				best_iou = iou;
-			}
-		}
-
-		if (best_iou > 0.0f and best_iou < 1.0f)
-		{
-			avg_iou += best_iou;
-		}
-	}
-
-	for (size_t i = 0; i < number_of_classes; i++)
+	for (size_t i = 0; i < boxes.counter_per_class.size(); i++)
 	{
 		if (i > 0)
 		{
 			new_counters_per_class += ", ";
 		}
-		new_counters_per_class += std::to_string(counter_per_class[i]);
+		new_counters_per_class += std::to_string(boxes.counter_per_class[i]);
 	}
 
-	new_avg_iou = 100.0f * avg_iou / static_cast<float>(number_of_boxes);
+	new_avg_iou = anchors_data.avg_iou;
 
 	return;
 }
@@ -391,9 +415,10 @@ int main(int argc, char * argv[])
 {
 	std::string new_anchors;
 	std::string counters_per_class;
-	std::string avg_iou;
+	float avg_iou;
 
-	calc_anchors("/home/stephane/nn/vz_pharmacy/vz_pharmacy_train.txt", 9, 800, 608, 8, new_anchors, counters_per_class, avg_iou);
+	const AnchorBoxes boxes = load_anchor_boxes("/home/stephane/nn/vz_pharmacy/vz_pharmacy_train.txt", 800, 608, 8);
+	calc_anchors(boxes, 9, 100, 60.0, new_anchors, counters_per_class, avg_iou);
 
 	std::cout	<< "counters_per_class=" << counters_per_class << std::endl
 				<< "anchors=" << new_anchors << std::endl
@@ -2,8 +2,31 @@
 
 #pragma once
 
+/** The size of every annotation in the training images, in pixels at the network dimensions.  Reading all the .txt
+ * files is by far the slowest part of calculating anchors on large datasets, so this is done once by
+ * @ref load_anchor_boxes() and then reused by every call to @ref calc_anchors().
+ */
+struct AnchorBoxes
+{
+	/// Widths and heights are kept in separate contiguous arrays so the k-means distance loops can be vectorized.
+	std::vector<float>	widths;
+	std::vector<float>	heights;
+
+	/// Number of annotations for each class.
+	std::vector<int>	counter_per_class;
+};
+
+
+/// Read the annotations for every image listed in @p train_images_filename.
+AnchorBoxes load_anchor_boxes(const std::string & train_images_filename, const size_t width, const size_t height, const size_t number_of_classes);
+
+
 /** The original @p calc_anchors() code from Darknet was taken from src/detector.c.  The code was then heavily modified
  * to bring it up to C++, remove memory leaks, cut out unneeded functionality, and remove all console output.  This new
  * function returns 3 values:  @p new_anchors, @p new_counters_per_class, and @p new_avg_iou.
+ *
+ * Up to @p attempts independent k-means runs -- each one seeded with k-means++ -- are spread across all the cores, and
+ * the anchors with the best average IoU are returned.  Attempts which have not started once @p max_seconds have elapsed
+ * are skipped.  The @p progress callback (if set) is regularly called from the calling thread.
  */
-void calc_anchors(const std::string & train_images_filename, const size_t number_of_clusters, const size_t width, const size_t height, const size_t number_of_classes, std::string & new_anchors, std::string & new_counters_per_class, float & new_avg_iou);
+void calc_anchors(const AnchorBoxes & boxes, const size_t number_of_clusters, const size_t attempts, const double max_seconds, std::string & new_anchors, std::string & new_counters_per_class, float & new_avg_iou, std::function<void(const size_t attempts_done, const size_t attempts)> progress = nullptr);
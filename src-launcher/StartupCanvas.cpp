@@ -303,7 +303,7 @@ void dm::StartupCanvas::initialize_on_thread()
 
 	if (not done and initialize_everything and image_filenames.empty() == false)
 	{
-		auto image = ImageCache::getFromFile(File(image_filenames[std::rand() % image_filenames.size()]));
+		auto image = juce::ImageCache::getFromFile(File(image_filenames[std::rand() % image_filenames.size()]));
 		thumbnail.setImage(image, RectanglePlacement::xLeft);
 	}
 
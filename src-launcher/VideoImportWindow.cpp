@@ -5,6 +5,31 @@
 #include <magic.h>
 
 
+namespace
+{
+	/// Convert the pixel coordinates returned by OnnxHelp to the normalized detections used by the inference pool.
+	dm::PredictionCache::Detections to_detections(const OnnxHelp::PredictionResults & results, const cv::Size & image_size)
+	{
+		dm::PredictionCache::Detections detections;
+		detections.reserve(results.size());
+		for (const auto & result : results)
+		{
+			dm::PredictionCache::Detection d;
+			d.rect.x		= static_cast<float>(result.rect.x)		/ image_size.width;
+			d.rect.y		= static_cast<float>(result.rect.y)		/ image_size.height;
+			d.rect.width	= static_cast<float>(result.rect.width)	/ image_size.width;
+			d.rect.height	= static_cast<float>(result.rect.height)	/ image_size.height;
+			d.class_idx		= result.class_idx;
+			d.probability	= result.probability;
+			d.all_probabilities[result.class_idx] = result.probability;
+			detections.push_back(d);
+		}
+
+		return detections;
+	}
+}
+
+
 dm::UnifiedPredictionResult::UnifiedPredictionResult(const DarkHelp::PredictionResult& dh_result, const VStr& names)
 	: rect(dh_result.rect)
 	, probability(dh_result.best_probability)
@@ -21,6 +46,18 @@ dm::UnifiedPredictionResult::UnifiedPredictionResult(const OnnxHelp::PredictionR
 {
 }
 
+dm::UnifiedPredictionResult::UnifiedPredictionResult(const PredictionCache::Detection& detection, const cv::Size& image_size, const VStr& names)
+	: rect(
+		std::round(detection.rect.x			* image_size.width),
+		std::round(detection.rect.y			* image_size.height),
+		std::round(detection.rect.width		* image_size.width),
+		std::round(detection.rect.height	* image_size.height))
+	, probability(detection.probability)
+	, class_idx(detection.class_idx)
+	, name(static_cast<size_t>(detection.class_idx) < names.size() ? names.at(detection.class_idx) : "class_" + std::to_string(detection.class_idx))
+{
+}
+
 
 dm::VideoImportWindow::VideoImportWindow(const std::string & dir, const VStr & v) :
 	DocumentWindow("DarkMark - Import Video Frames", Colours::darkgrey, TitleBarButtons::closeButton),
@@ -56,10 +93,12 @@ dm::VideoImportWindow::VideoImportWindow(const std::string & dir, const VStr & v
 	btn_select_darknet_weights("Select .weights file"),
 	btn_select_darknet_cfg("Select .cfg file"),
 	btn_select_darknet_names("Select .names file"),
+	tb_darknet_use_opencv("Use OpenCV DNN instead of libdarknet (faster on CPU-only machines)"),
 	btn_select_onnx_model("Select .onnx file"),
 	btn_select_onnx_names("Select .names file"),
 	txt_onnx_input_size("", "ONNX input size:"),
 	txt_onnx_x("", "x"),
+	tb_onnx_rectangular("Rectangular inference (less padding on wide frames)"),
 	tb_import_with_detections("Import only frames with detections"),
 	tb_import_without_detections("Import only frames without detections"),
 	tb_import_all_frames("Import all frames regardless of detections"),
@@ -114,6 +153,7 @@ dm::VideoImportWindow::VideoImportWindow(const std::string & dir, const VStr & v
 	canvas.addAndMakeVisible(lbl_darknet_weights);
 	canvas.addAndMakeVisible(lbl_darknet_cfg);
 	canvas.addAndMakeVisible(lbl_darknet_names);
+	canvas.addAndMakeVisible(tb_darknet_use_opencv);
 	canvas.addAndMakeVisible(btn_select_onnx_model);
 	canvas.addAndMakeVisible(btn_select_onnx_names);
 	canvas.addAndMakeVisible(lbl_onnx_model);
@@ -122,6 +162,7 @@ dm::VideoImportWindow::VideoImportWindow(const std::string & dir, const VStr & v
 	canvas.addAndMakeVisible(ef_onnx_width);
 	canvas.addAndMakeVisible(txt_onnx_x);
 	canvas.addAndMakeVisible(ef_onnx_height);
+	canvas.addAndMakeVisible(tb_onnx_rectangular);
 	canvas.addAndMakeVisible(tb_import_with_detections);
 	canvas.addAndMakeVisible(tb_import_without_detections);
 	canvas.addAndMakeVisible(tb_import_all_frames);
@@ -181,6 +222,8 @@ dm::VideoImportWindow::VideoImportWindow(const std::string & dir, const VStr & v
 	tb_import_without_detections.addListener(this);
 	tb_import_all_frames.addListener(this);
 	tb_enable_tiling.addListener(this);
+	tb_darknet_use_opencv.addListener(this);
+	tb_onnx_rectangular.addListener(this);
 
 	tb_extract_sequences	.setToggleState(true, NotificationType::sendNotification);
 	tb_do_not_resize		.setToggleState(true, NotificationType::sendNotification);
@@ -188,6 +231,8 @@ dm::VideoImportWindow::VideoImportWindow(const std::string & dir, const VStr & v
 	tb_save_as_jpeg			.setToggleState(true, NotificationType::sendNotification);
 	tb_model_type_darknet	.setToggleState(true, NotificationType::sendNotification);
 	tb_import_all_frames	.setToggleState(true, NotificationType::sendNotification);
+	tb_darknet_use_opencv	.setToggleState(cfg().get_bool("video_import_darknet_opencv", false), NotificationType::dontSendNotification);
+	tb_onnx_rectangular		.setToggleState(cfg().get_bool("video_import_onnx_rectangular", false), NotificationType::dontSendNotification);
 
 	sl_sequences			.setRange(1.0, 999.0, 1.0);
 	sl_sequences			.setNumDecimalPlacesToDisplay(0);
@@ -483,6 +528,7 @@ void dm::VideoImportWindow::resized()
 	fb_darknet_names.items.add(FlexItem(btn_select_darknet_names).withHeight(height).withWidth(150.0f));
 	fb_darknet_names.items.add(FlexItem(lbl_darknet_names).withHeight(height).withFlex(1.0f));
 	fb_rows.items.add(FlexItem(fb_darknet_names).withHeight(height).withMargin(left_indent));
+	fb_rows.items.add(FlexItem(tb_darknet_use_opencv).withHeight(height).withMargin(left_indent));
 
 	FlexBox fb_onnx_model;
 	fb_onnx_model.flexDirection = FlexBox::Direction::row;
@@ -506,6 +552,7 @@ void dm::VideoImportWindow::resized()
 	fb_onnx_size.items.add(FlexItem(txt_onnx_x).withHeight(height).withWidth(20.0f));
 	fb_onnx_size.items.add(FlexItem(ef_onnx_height).withHeight(height).withWidth(60.0f));
 	fb_rows.items.add(FlexItem(fb_onnx_size).withHeight(height).withMargin(left_indent));
+	fb_rows.items.add(FlexItem(tb_onnx_rectangular).withHeight(height).withMargin(left_indent));
 
 	FlexBox fb_confidence;
 	fb_confidence.flexDirection = FlexBox::Direction::row;
@@ -664,6 +711,9 @@ void dm::VideoImportWindow::buttonClicked(Button * button)
 	{
 		onnx_input_width = ef_onnx_width.getText().getIntValue();
 		onnx_input_height = ef_onnx_height.getText().getIntValue();
+		enable_tiling = tb_enable_tiling.getToggleState();
+		cfg().setValue("video_import_darknet_opencv", tb_darknet_use_opencv.getToggleState());
+		cfg().setValue("video_import_onnx_rectangular", tb_onnx_rectangular.getToggleState());
 
 		cfg().setValue("video_import_onnx_width", onnx_input_width);
 		cfg().setValue("video_import_onnx_height", onnx_input_height);
@@ -693,6 +743,8 @@ void dm::VideoImportWindow::update_model_type_ui()
 	lbl_darknet_weights.setVisible(auto_annotation_enabled && darknet_selected);
 	lbl_darknet_cfg.setVisible(auto_annotation_enabled && darknet_selected);
 	lbl_darknet_names.setVisible(auto_annotation_enabled && darknet_selected);
+	tb_darknet_use_opencv.setVisible(auto_annotation_enabled && darknet_selected);
+	const bool opencv_selected = darknet_selected && tb_darknet_use_opencv.getToggleState();
 
 	btn_select_onnx_model.setVisible(auto_annotation_enabled && onnx_selected);
 	btn_select_onnx_names.setVisible(auto_annotation_enabled && onnx_selected);
@@ -702,6 +754,7 @@ void dm::VideoImportWindow::update_model_type_ui()
 	ef_onnx_width.setVisible(auto_annotation_enabled && onnx_selected);
 	txt_onnx_x.setVisible(auto_annotation_enabled && onnx_selected);
 	ef_onnx_height.setVisible(auto_annotation_enabled && onnx_selected);
+	tb_onnx_rectangular.setVisible(auto_annotation_enabled && onnx_selected);
 
 	tb_import_with_detections.setVisible(auto_annotation_enabled);
 	tb_import_without_detections.setVisible(auto_annotation_enabled);
@@ -712,9 +765,10 @@ void dm::VideoImportWindow::update_model_type_ui()
 	txt_nms_threshold.setVisible(auto_annotation_enabled);
 	sl_nms_threshold.setVisible(auto_annotation_enabled);
 
-	tb_enable_tiling.setVisible(auto_annotation_enabled && darknet_selected);
-	txt_hierarchy_threshold.setVisible(auto_annotation_enabled && darknet_selected);
-	sl_hierarchy_threshold.setVisible(auto_annotation_enabled && darknet_selected);
+	// OpenCV DNN does not support tiling nor the hierarchy threshold
+	tb_enable_tiling.setVisible(auto_annotation_enabled && !opencv_selected);
+	txt_hierarchy_threshold.setVisible(auto_annotation_enabled && darknet_selected && !opencv_selected);
+	sl_hierarchy_threshold.setVisible(auto_annotation_enabled && darknet_selected && !opencv_selected);
 
 	ok.setEnabled(validate_model_files());
 }
@@ -749,6 +803,7 @@ void dm::VideoImportWindow::run()
 	if (tb_enable_auto_annotation.getToggleState()) {
 		try {
 			load_selected_model();
+			start_inference_pool();
 		}
 		catch (const std::exception& e) {
 			AlertWindow::showMessageBox(AlertWindow::AlertIconType::WarningIcon,
@@ -777,6 +832,86 @@ void dm::VideoImportWindow::run()
 		const bool save_as_jpg				= tb_save_as_jpeg		.getToggleState();
 		const int jpg_quality				= sl_jpeg_quality		.getValue();
 
+		const size_t inference_batch_size	= (selected_model_type == ModelType::ONNX and temp_onnx_nn) ? temp_onnx_nn->get_max_batch_size() : 1;
+		std::vector<cv::Mat> pending_frames;
+		VStr pending_filenames;
+
+		// with the inference pool, every replica has a batch running and another one waiting
+		const size_t frames_in_flight = (inference_pool ? 2 * inference_batch_size * inference_pool->size() : inference_batch_size);
+		std::deque<std::future<PredictionCache::Detections>> pending_detections;
+
+		auto save_frame = [&](const cv::Mat & mat, const std::string & fn, const std::vector<UnifiedPredictionResult> & predictions)
+		{
+			bool has_detections = !predictions.empty();
+			bool should_import = true;
+
+			if (tb_import_with_detections.getToggleState() && !has_detections)
+			{
+				should_import = false;
+			}
+			else if (tb_import_without_detections.getToggleState() && has_detections)
+			{
+				should_import = false;
+			}
+
+			if (should_import)
+			{
+				if (save_as_png)
+				{
+					cv::imwrite(fn + ".png", mat, { CV_IMWRITE_PNG_COMPRESSION, 1 });
+				}
+				else if (save_as_jpg)
+				{
+					cv::imwrite(fn + ".jpg", mat, { CV_IMWRITE_JPEG_QUALITY, jpg_quality });
+				}
+
+				if (has_detections)
+				{
+					generate_annotation_file(fn, predictions, mat.size());
+				}
+			}
+		};
+
+		// When finished is false, only the frames beyond the number allowed in flight are annotated.  Otherwise wait for
+		// all the frames, such as at the end of each video.
+		auto annotate_pending_frames = [&](const bool finished)
+		{
+			if (inference_pool)
+			{
+				// the frames were submitted to the pool as they were read, so only wait for the oldest ones
+				while (pending_frames.empty() == false and (finished or pending_frames.size() >= frames_in_flight))
+				{
+					const auto detections = pending_detections.front().get();
+					std::vector<UnifiedPredictionResult> predictions;
+					for (const auto & d : detections)
+					{
+						predictions.emplace_back(d, pending_frames.front().size(), class_names);
+					}
+					save_frame(pending_frames.front(), pending_filenames.front(), predictions);
+
+					pending_detections.pop_front();
+					pending_frames.erase(pending_frames.begin());
+					pending_filenames.erase(pending_filenames.begin());
+				}
+				return;
+			}
+
+			if (pending_frames.empty() or (finished == false and pending_frames.size() < frames_in_flight))
+			{
+				return;
+			}
+
+			const auto all_predictions = run_inference_batch(pending_frames);
+
+			for (size_t idx = 0; idx < pending_frames.size(); idx ++)
+			{
+				save_frame(pending_frames[idx], pending_filenames[idx], all_predictions.at(idx));
+			}
+
+			pending_frames.clear();
+			pending_filenames.clear();
+		};
+
 		setStatusMessage("Determining the amount of frames to extract...");
 
 		for (auto && filename : filenames)
@@ -1018,38 +1153,17 @@ void dm::VideoImportWindow::run()
 				std::stringstream ss;
 				ss << partial_output_filename << "_frame_" << std::setfill('0') << std::setw(6) << frame_number;
 
-				if (tb_enable_auto_annotation.getToggleState() && (temp_darknet_nn || temp_onnx_nn))
+				if (tb_enable_auto_annotation.getToggleState() && (temp_darknet_nn || temp_onnx_nn || temp_opencv_nn))
 				{
-					auto predictions = run_inference(mat);
-
-					bool has_detections = !predictions.empty();
-					bool should_import = true;
-
-					if (tb_import_with_detections.getToggleState() && !has_detections)
-					{
-						should_import = false;
-					}
-					else if (tb_import_without_detections.getToggleState() && has_detections)
+					// frames are accumulated so the neural network can process several of them in a single call
+					pending_frames.push_back(mat);
+					pending_filenames.push_back(ss.str());
+					if (inference_pool)
 					{
-						should_import = false;
-					}
-
-					if (should_import)
-					{
-						if (save_as_png)
-						{
-							cv::imwrite(ss.str() + ".png", mat, { CV_IMWRITE_PNG_COMPRESSION, 1 });
-						}
-						else if (save_as_jpg)
-						{
-							cv::imwrite(ss.str() + ".jpg", mat, { CV_IMWRITE_JPEG_QUALITY, jpg_quality });
-						}
-
-						if (has_detections)
-						{
-							generate_annotation_file(ss.str(), predictions, mat.size());
-						}
+						// this blocks when the replicas cannot keep up with the video decoding
+						pending_detections.push_back(inference_pool->submit(mat));
 					}
+					annotate_pending_frames(false);
 				}
 				else
 				{
@@ -1068,6 +1182,9 @@ void dm::VideoImportWindow::run()
 				work_completed += 1.0;
 				setProgress(work_completed / work_to_be_done);
 			}
+
+			// deal with the last few frames which didn't fill up an entire batch
+			annotate_pending_frames(true);
 		}
 	}
 	catch (const std::exception & e)
@@ -1105,6 +1222,12 @@ void dm::VideoImportWindow::run()
 
 void dm::VideoImportWindow::load_darknet_model()
 {
+	if (tb_darknet_use_opencv.getToggleState())
+	{
+		load_opencv_model();
+		return;
+	}
+
 	try {
 		temp_darknet_nn.reset(new DarkHelp::NN(darknet_cfg_path, darknet_weights_path, darknet_names_path));
 
@@ -1125,6 +1248,32 @@ void dm::VideoImportWindow::load_darknet_model()
 }
 
 
+void dm::VideoImportWindow::load_opencv_model()
+{
+	try {
+		std::vector<std::string> names;
+		std::ifstream ifs(darknet_names_path);
+		std::string line;
+		while (std::getline(ifs, line)) {
+			line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+			line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
+			if (!line.empty()) names.push_back(line);
+		}
+
+		// OpenVINO is used when OpenCV was built with it, since it is the fastest way to run on the CPU
+		temp_opencv_nn.reset(new OnnxHelp::OpenCVNN(darknet_cfg_path, darknet_weights_path, names, true));
+		class_names = names;
+
+		Log("Darknet model loaded with OpenCV DNN");
+	}
+	catch (const std::exception& e) {
+		temp_opencv_nn.reset(nullptr);
+		Log("Failed to load Darknet model with OpenCV DNN: " + std::string(e.what()));
+		throw;
+	}
+}
+
+
 void dm::VideoImportWindow::load_onnx_model()
 {
 	try {
@@ -1164,6 +1313,11 @@ void dm::VideoImportWindow::load_onnx_model()
 			Log("Using YOLOX-style preprocessing (letterbox)");
 		}
 
+		temp_onnx_nn->set_tiling(enable_tiling, cfg().get_int("onnx_tile_overlap") / 100.0f);
+		temp_onnx_nn->set_tile_nms_threshold(cfg().get_int("onnx_nms_threshold") / 100.0f);
+		temp_onnx_nn->set_max_batch_size(cfg().get_int("onnx_batch_size"));
+		temp_onnx_nn->set_rectangular(tb_onnx_rectangular.getToggleState());
+
 		Log("ONNX model loaded successfully");
 	}
 	catch (const std::exception& e) {
@@ -1191,8 +1345,93 @@ void dm::VideoImportWindow::load_selected_model()
 
 void dm::VideoImportWindow::clear_model()
 {
+	inference_pool.reset();
 	temp_darknet_nn.reset(nullptr);
 	temp_onnx_nn.reset(nullptr);
+	temp_opencv_nn.reset(nullptr);
+}
+
+
+void dm::VideoImportWindow::start_inference_pool()
+{
+	// Same as the inference pool used by the editor for bulk operations.  Darknet models loaded by DarkHelp are still
+	// run one frame at a time, since it has not been established that several copies of libdarknet can run concurrently.
+	inference_pool.reset();
+
+	int number_of_replicas = cfg().get_int("inference_replicas");
+	if (dmapp().cli_options.count("inference_replicas"))
+	{
+		number_of_replicas = toInt(dmapp().cli_options.at("inference_replicas"));
+	}
+	if (number_of_replicas <= 0 or (not temp_onnx_nn and not temp_opencv_nn))
+	{
+		return;
+	}
+
+	const float conf_threshold	= sl_confidence_threshold.getValue() / 100.0;
+	const float nms_threshold	= sl_nms_threshold.getValue() / 100.0;
+	size_t batch_size = 1;
+
+	std::vector<InferencePool::Replica> replicas;
+	try
+	{
+		for (int idx = 0; idx < number_of_replicas; idx ++)
+		{
+			if (temp_onnx_nn)
+			{
+				// the replicas share the ONNX Runtime session which was loaded for temp_onnx_nn
+				std::shared_ptr<OnnxHelp::NN> nn(new OnnxHelp::NN(onnx_model_path, class_names));
+				if (nn->is_dynamic())
+				{
+					nn->set_input_size(temp_onnx_nn->get_input_size());
+				}
+				nn->set_preprocess_config(temp_onnx_nn->get_preprocess_config());
+				nn->set_max_batch_size(temp_onnx_nn->get_max_batch_size());
+				nn->set_tiling(temp_onnx_nn->get_tiling(), temp_onnx_nn->get_tile_overlap());
+				nn->set_tile_nms_threshold(temp_onnx_nn->get_tile_nms_threshold());
+				nn->set_rectangular(temp_onnx_nn->get_rectangular());
+				batch_size = nn->get_max_batch_size();
+
+				replicas.push_back([nn, conf_threshold, nms_threshold](const std::vector<cv::Mat> & mats)
+					{
+						std::vector<PredictionCache::Detections> all_detections;
+						const auto all_results = nn->predict_batch(mats, conf_threshold, nms_threshold);
+						for (size_t i = 0; i < mats.size(); i ++)
+						{
+							all_detections.push_back(to_detections(all_results.at(i), mats[i].size()));
+						}
+						return all_detections;
+					});
+			}
+			else
+			{
+				std::shared_ptr<OnnxHelp::OpenCVNN> nn(new OnnxHelp::OpenCVNN(darknet_cfg_path, darknet_weights_path, class_names, temp_opencv_nn->is_using_openvino()));
+
+				replicas.push_back([nn, conf_threshold, nms_threshold](const std::vector<cv::Mat> & mats)
+					{
+						std::vector<PredictionCache::Detections> all_detections;
+						const auto all_results = nn->predict_batch(mats, conf_threshold, nms_threshold);
+						for (size_t i = 0; i < mats.size(); i ++)
+						{
+							all_detections.push_back(to_detections(all_results.at(i), mats[i].size()));
+						}
+						return all_detections;
+					});
+			}
+		}
+	}
+	catch (const std::exception & e)
+	{
+		// run with however many replicas we managed to load
+		Log("video import: failed to load replica #" + std::to_string(replicas.size() + 1) + " of the neural network: " + e.what());
+	}
+
+	if (replicas.empty() == false)
+	{
+		inference_pool.reset(new InferencePool(replicas, batch_size, 2 * replicas.size() * batch_size));
+	}
+
+	return;
 }
 
 
@@ -1208,6 +1447,14 @@ std::vector<dm::UnifiedPredictionResult> dm::VideoImportWindow::run_inference(co
 			results.emplace_back(pred, class_names);
 		}
 	}
+	else if (selected_model_type == ModelType::Darknet && temp_opencv_nn)
+	{
+		const auto opencv_results = temp_opencv_nn->predict(frame, sl_confidence_threshold.getValue() / 100.0, sl_nms_threshold.getValue() / 100.0);
+		for (const auto& pred : opencv_results)
+		{
+			results.emplace_back(pred);
+		}
+	}
 	else if (selected_model_type == ModelType::ONNX && temp_onnx_nn)
 	{
 		auto onnx_results = temp_onnx_nn->predict(frame, sl_confidence_threshold.getValue() / 100.0, sl_nms_threshold.getValue() / 100.0);
@@ -1221,6 +1468,35 @@ std::vector<dm::UnifiedPredictionResult> dm::VideoImportWindow::run_inference(co
 }
 
 
+std::vector<std::vector<dm::UnifiedPredictionResult>> dm::VideoImportWindow::run_inference_batch(const std::vector<cv::Mat>& frames)
+{
+	std::vector<std::vector<UnifiedPredictionResult>> results;
+
+	if (selected_model_type == ModelType::ONNX && temp_onnx_nn)
+	{
+		const auto onnx_results = temp_onnx_nn->predict_batch(frames, sl_confidence_threshold.getValue() / 100.0, sl_nms_threshold.getValue() / 100.0);
+		for (const auto& image_results : onnx_results)
+		{
+			results.emplace_back();
+			for (const auto& pred : image_results)
+			{
+				results.back().emplace_back(pred);
+			}
+		}
+	}
+	else
+	{
+		// Darknet models are called one frame at a time
+		for (const auto& frame : frames)
+		{
+			results.push_back(run_inference(frame));
+		}
+	}
+
+	return results;
+}
+
+
 void dm::VideoImportWindow::generate_annotation_file(const std::string& base_path, const std::vector<UnifiedPredictionResult>& predictions, const cv::Size& image_size)
 {
 	std::ofstream annotation_file(base_path + ".txt");
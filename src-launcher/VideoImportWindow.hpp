@@ -4,6 +4,7 @@
 
 #include "DarkMark.hpp"
 #include <OnnxHelp.hpp>
+#include <OpenCVNN.hpp>
 
 
 namespace dm
@@ -36,8 +37,12 @@ namespace dm
 
 			std::unique_ptr<DarkHelp::NN> temp_darknet_nn;
 			std::unique_ptr<OnnxHelp::NN> temp_onnx_nn;
+			std::unique_ptr<OnnxHelp::OpenCVNN> temp_opencv_nn;
 			VStr class_names;
 
+			/// Replicas of the ONNX or OpenCV model used to annotate several frames at once.  Empty when disabled.
+			std::shared_ptr<InferencePool> inference_pool;
+
 			float confidence_threshold;
 			float nms_threshold;
 			float hierarchy_threshold;
@@ -48,11 +53,14 @@ namespace dm
 			void update_model_type_ui();
 			void load_selected_model();
 			void clear_model();
+			void start_inference_pool();
 			bool validate_model_files();
 			std::vector<UnifiedPredictionResult> run_inference(const cv::Mat& frame);
+			std::vector<std::vector<UnifiedPredictionResult>> run_inference_batch(const std::vector<cv::Mat>& frames);
 			void generate_annotation_file(const std::string& base_path, const std::vector<UnifiedPredictionResult>& predictions, const cv::Size& image_size);
 			void load_darknet_model();
 			void load_onnx_model();
+			void load_opencv_model();
 
 			const std::string base_directory;
 			const VStr		filenames;
@@ -96,6 +104,7 @@ namespace dm
 			Label           lbl_darknet_weights;
 			Label           lbl_darknet_cfg;
 			Label           lbl_darknet_names;
+			ToggleButton    tb_darknet_use_opencv;
 
 			TextButton      btn_select_onnx_model;
 			TextButton      btn_select_onnx_names;
@@ -105,6 +114,7 @@ namespace dm
 			TextEditor      ef_onnx_width;
 			Label           txt_onnx_x;
 			TextEditor      ef_onnx_height;
+			ToggleButton    tb_onnx_rectangular;
 
 			ToggleButton    tb_import_with_detections;
 			ToggleButton    tb_import_without_detections;
@@ -131,5 +141,6 @@ namespace dm
 
 		UnifiedPredictionResult(const DarkHelp::PredictionResult& dh_result, const VStr& names);
 		UnifiedPredictionResult(const OnnxHelp::PredictionResult& onnx_result);
+		UnifiedPredictionResult(const PredictionCache::Detection& detection, const cv::Size& image_size, const VStr& names);
 	};
 }
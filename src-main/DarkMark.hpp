@@ -6,6 +6,11 @@
 #include <fstream>
 #include <regex>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <deque>
 #include <chrono>
 #include <random>
 #include <algorithm>
@@ -54,6 +59,7 @@ namespace dm
 	class AboutWnd;
 	class CfgHandler;
 	class DarknetWnd;
+	class DarknetImageCache;
 	class ClassIdWnd;
 	class WndCfgTemplates;
 	class StartupWnd;
@@ -64,8 +70,15 @@ namespace dm
 	class FilterWnd;
 	class KeybindEditorWnd;
 	class ProjectInfo;
+	class AnnotationIndex;
+	class ImageCache;
+	class PredictionCache;
+	class InferencePool;
+	class TaskPool;
 	class DMContentReview;
 	class DMContentReviewIoU;
+	class DMContentPreAnnotate;
+	class DMContentPredict;
 	class DMReviewIoUWnd;
 	class DMReviewWnd;
 	class DMReviewCanvas;
@@ -90,6 +103,7 @@ namespace dm
 	using MIdxStr	= std::map<size_t, std::string>;
 	using MStr		= std::map<std::string, std::string>;
 	using MStrSize	= std::map<std::string, size_t>;
+	using MIdxSize	= std::map<size_t, size_t>;
 }
 
 #include "Text.hpp"
@@ -99,8 +113,14 @@ namespace dm
 #include "Bitmaps.hpp"
 #include "Mark.hpp"
 #include "Tools.hpp"
+#include "BoundedQueue.hpp"
 #include "CrosshairComponent.hpp"
 #include "ProjectInfo.hpp"
+#include "AnnotationIndex.hpp"
+#include "ImageCache.hpp"
+#include "PredictionCache.hpp"
+#include "InferencePool.hpp"
+#include "TaskPool.hpp"
 #include "Notebook.hpp"
 #include "DMJumpWnd.hpp"
 #include "ScrollField.hpp"
@@ -112,6 +132,7 @@ namespace dm
 #include "DMReviewCanvas.hpp"
 #include "DMReviewIoUWnd.hpp"
 #include "CfgHandler.hpp"
+#include "DarknetImageCache.hpp"
 #include "DarknetWnd.hpp"
 #include "WndCfgTemplates.hpp"
 #include "PdfImportWindow.hpp"
@@ -133,6 +154,8 @@ namespace dm
 #include "DMContentReview.hpp"
 #include "DMContentResizeTLTR.hpp"
 #include "DMContentReviewIoU.hpp"
+#include "DMContentPreAnnotate.hpp"
+#include "DMContentPredict.hpp"
 #include "DMWnd.hpp"
 #include "DMAppMenuModel.hpp"
 #include "DarkMarkApp.hpp"
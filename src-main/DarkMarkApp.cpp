@@ -308,6 +308,12 @@ void dm::DarkMarkApplication::initialise(const String & commandLine)
 	{
 		cfg.reset(new Cfg);
 		keybind_manager.reset(new KeybindManager);
+
+		// ONNX models are saved once ONNX Runtime has optimized them, so the next time they load much faster
+		if (cfg->get_bool("onnx_save_optimized_models"))
+		{
+			OnnxHelp::NN::set_optimized_model_directory(cfg->getFile().getSiblingFile("onnx_optimized_models").getFullPathName().toStdString());
+		}
 	}
 	catch (const std::exception & e)
 	{
@@ -351,9 +357,12 @@ void dm::DarkMarkApplication::initialise(const String & commandLine)
 			dm::Log("DarkMark v" DARKMARK_VERSION);
 			systemRequestedQuit();
 		}
-		else if (key == "editor" and val == "gen-darknet")
+		else if (key == "editor" and (val == "gen-darknet" or val == "pre-annotate"))
+		{
+			// if "editor" is specified, the only actions currently supported are "gen-darknet" and "pre-annotate"
+		}
+		else if (key == "pre_annotate" and (val == "predictions" or val == "marks"))
 		{
-			// if "editor" is specified, the only action currently supported is "gen-darknet"
 		}
 		else if (key == "darknet" and val == "run")
 		{
@@ -491,10 +500,26 @@ void dm::DarkMarkApplication::initialise(const String & commandLine)
 				key == "max_batches"			or
 				key == "batch_size"				or
 				key == "subdivisions"			or
+				key == "inference_replicas"		or
 				key == "annotation_area_size"	))
 		{
 			// no further validation performed here
 		}
+		else if (
+			key == "darknet_backend" and (
+				val == "darkhelp"				or
+				val == "opencv"					or
+				val == "openvino"				))
+		{
+			// no further validation performed here
+		}
+		else if (
+			(validPositiveInt(val) or val == "auto") and (
+				key == "onnx_intra_threads"		or
+				key == "onnx_inter_threads"		))
+		{
+			// no further validation performed here
+		}
 		else if (
 			validBool(val) and (
 				key == "do_not_resize_images"		or
@@ -510,7 +535,11 @@ void dm::DarkMarkApplication::initialise(const String & commandLine)
 				key == "mixup"						or
 				key == "flip"						or
 				key == "restart_training"			or
-				key == "remove_small_annotations"	))
+				key == "remove_small_annotations"	or
+				key == "onnx_parallel_execution"	or
+				key == "onnx_memory_pattern"		or
+				key == "onnx_cpu_arena"				or
+				key == "onnx_rectangular"			))
 		{
 			// no further validation performed here
 		}
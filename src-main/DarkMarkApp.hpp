@@ -4,6 +4,7 @@
 
 #include "DarkMark.hpp"
 #include "OnnxHelp.hpp"
+#include "OpenCVNN.hpp"
 
 
 namespace dm
@@ -37,6 +38,11 @@ namespace dm
 			std::unique_ptr<OnnxHelp::NN>		onnx_nn;
 			std::unique_ptr<DMWnd>				wnd;
 			std::unique_ptr<DarkHelp::NN>		darkhelp_nn;
+			std::unique_ptr<OnnxHelp::OpenCVNN>	opencv_nn;
+
+			/// Must be locked when using or replacing @ref darkhelp_nn, @ref onnx_nn, or @ref opencv_nn, since inference may run on several threads.
+			std::mutex							inference_mutex;
+
 			std::unique_ptr<DMStatsWnd>			stats_wnd;
 			std::unique_ptr<AboutWnd>			about_wnd;
 			std::unique_ptr<DMJumpWnd>			jump_wnd;
@@ -97,4 +103,10 @@ namespace dm
 	{
 		return *dmapp().onnx_nn;
 	}
+
+	/// Quick and easy access to Darknet models loaded through OpenCV DNN.  Will throw if the application does not exist.
+	inline OnnxHelp::OpenCVNN & opencv_nn()
+	{
+		return *dmapp().opencv_nn;
+	}
 }
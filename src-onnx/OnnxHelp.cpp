@@ -8,24 +8,91 @@
 
 namespace OnnxHelp
 {
-Ort::SessionOptions NN::GetSessionOptions()
+namespace
 {
-	Ort::SessionOptions session_options;
-	session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+	// A session which was recently loaded.  The key only contains the settings as configured, where "auto" thread counts
+	// are zero.  The thread counts those were resolved to when the session was created are kept separately.
+	struct CachedSession
+	{
+		std::string key;
+		std::string threads;
+		std::shared_ptr<Ort::Session> session;
+	};
+
+	// The process-wide environment, and the sessions which were recently loaded (most recently used first).
+	// The environment is declared first so it is destroyed last, since sessions cannot outlive their environment.
+	struct SessionCache
+	{
+		Ort::Env env;
+		std::mutex mutex;
+		std::deque<CachedSession> sessions;
+		std::string optimized_model_directory;
+		SessionSettings settings;
 
-	// Try to use CUDA execution provider if available
-	auto available_providers = Ort::GetAvailableProviders();
-	bool cuda_available = false;
-	for (const auto& p : available_providers)
+		// the global thread pools are shared by every session which calls DisablePerSessionThreads()
+		SessionCache() : env(Ort::ThreadingOptions(), ORT_LOGGING_LEVEL_WARNING, "ONNX-DarkMark") {}
+	};
+
+	// Number of sessions kept alive by the cache after the last NN using them has been destroyed
+	const size_t max_cached_sessions = 3;
+
+	SessionCache& session_cache()
+	{
+		static SessionCache cache;
+		return cache;
+	}
+
+	bool is_cuda_available()
 	{
-		if (p == "CUDAExecutionProvider")
+		for (const auto& p : Ort::GetAvailableProviders())
 		{
-			cuda_available = true;
-			break;
+			if (p == "CUDAExecutionProvider")
+			{
+				return true;
+			}
 		}
+		return false;
+	}
+}
+
+Ort::SessionOptions NN::GetSessionOptions(const SessionSettings& settings, bool use_global_thread_pool)
+{
+	Ort::SessionOptions session_options;
+	session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+
+	if (use_global_thread_pool)
+	{
+		// use the thread pools owned by the environment instead of creating new threads for every session
+		session_options.DisablePerSessionThreads();
+	}
+	else
+	{
+		session_options.SetIntraOpNumThreads(settings.intra_op_threads);
+		session_options.SetInterOpNumThreads(settings.inter_op_threads);
+	}
+
+	session_options.SetExecutionMode(settings.parallel_execution ? ExecutionMode::ORT_PARALLEL : ExecutionMode::ORT_SEQUENTIAL);
+
+	if (settings.memory_pattern)
+	{
+		session_options.EnableMemPattern();
+	}
+	else
+	{
+		session_options.DisableMemPattern();
+	}
+
+	if (settings.cpu_arena)
+	{
+		session_options.EnableCpuMemArena();
+	}
+	else
+	{
+		session_options.DisableCpuMemArena();
 	}
 
-	if (cuda_available)
+	// Try to use CUDA execution provider if available
+	if (is_cuda_available())
 	{
 		dm::Log("ONNX Runtime: Using CUDA execution provider.");
 		OrtCUDAProviderOptions cuda_options{};
@@ -39,7 +106,158 @@ Ort::SessionOptions NN::GetSessionOptions()
 	return session_options;
 }
 
-cv::Size NN::GetModelInputSize(Ort::Session& session, bool& is_dynamic)
+Ort::Env& NN::GetEnvironment()
+{
+	return session_cache().env;
+}
+
+std::shared_ptr<Ort::Session> NN::GetSession(const std::string& onnx_filename)
+{
+	Ort::Env& env = GetEnvironment();
+	SessionCache& cache = session_cache();
+
+	// the lock is held while the session is created so 2 windows loading the same model only load it once
+	std::lock_guard<std::mutex> lock(cache.mutex);
+
+	// Resolve the "auto" thread counts.  The global thread pool is sized for the entire machine, so it is only used
+	// when DarkMark isn't already keeping some of the cores busy with its own worker threads.
+	SessionSettings settings = cache.settings;
+	const int hardware_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	const int busy_threads = static_cast<int>(dm::worker_threads_in_use());
+	const bool use_global_thread_pool = (settings.intra_op_threads <= 0 && settings.inter_op_threads <= 0 && busy_threads == 0);
+	if (!use_global_thread_pool)
+	{
+		const int available_threads = std::max(1, hardware_threads - busy_threads);
+		if (settings.intra_op_threads <= 0)
+		{
+			settings.intra_op_threads = available_threads;
+		}
+		if (settings.inter_op_threads <= 0)
+		{
+			settings.inter_op_threads = settings.parallel_execution ? std::max(1, available_threads / 4) : 1;
+		}
+	}
+
+	// The resolved thread counts depend on how busy DarkMark is right now, so they are not part of the key.  Otherwise a
+	// session created while a bulk job was running would keep being reused with fewer threads once the job is done.
+	const std::string threads = (use_global_thread_pool ? std::string("global") : std::to_string(settings.intra_op_threads) + "/" + std::to_string(settings.inter_op_threads));
+	std::stringstream settings_key;
+	settings_key
+		<< "threads=" << cache.settings.intra_op_threads << "/" << cache.settings.inter_op_threads
+		<< " parallel=" << settings.parallel_execution
+		<< " mempattern=" << settings.memory_pattern
+		<< " arena=" << settings.cpu_arena;
+
+	// a model which was modified on disk gets a new key, so the old session is never used for the new model
+	const File file(onnx_filename);
+	const std::string model_key =
+		file.getFullPathName().toStdString() +
+		"|" + std::to_string(file.getLastModificationTime().toMilliseconds()) +
+		"|" + std::to_string(file.getSize());
+	const std::string key = model_key + "|" + settings_key.str();
+
+	for (auto iter = cache.sessions.begin(); iter != cache.sessions.end(); iter++)
+	{
+		if (iter->key == key)
+		{
+			auto cached = *iter;
+			cache.sessions.erase(iter);
+			if (cached.threads != threads)
+			{
+				// the "auto" thread counts resolve differently now, so the session needs to be created again
+				dm::Log("ONNX Runtime: replacing the session for " + onnx_filename + " (threads=" + cached.threads + " -> " + threads + ")");
+				break;
+			}
+			cache.sessions.push_front(cached);
+			dm::Log("ONNX Runtime: reusing the session for " + onnx_filename);
+			return cached.session;
+		}
+	}
+
+	const auto start_time = std::chrono::high_resolution_clock::now();
+
+	std::shared_ptr<Ort::Session> session;
+	if (!cache.optimized_model_directory.empty())
+	{
+		// The optimized graph depends on the execution provider and the version of ONNX Runtime, not only on the model.
+		const std::string optimized_key = model_key + "|" + Ort::GetVersionString() + "|" + (is_cuda_available() ? "cuda" : "cpu");
+		std::stringstream ss;
+		ss << std::hex << std::hash<std::string>()(optimized_key);
+		const File optimized = File(cache.optimized_model_directory).getChildFile(file.getFileNameWithoutExtension() + "_" + ss.str() + ".onnx");
+		const std::string optimized_filename = optimized.getFullPathName().toStdString();
+
+		try
+		{
+			Ort::SessionOptions options = GetSessionOptions(settings, use_global_thread_pool);
+			if (optimized.existsAsFile())
+			{
+				dm::Log("ONNX Runtime: loading the optimized model " + optimized_filename);
+				options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+				session = std::make_shared<Ort::Session>(env, optimized_filename.c_str(), options);
+			}
+			else
+			{
+				dm::Log("ONNX Runtime: saving the optimized model to " + optimized_filename);
+				optimized.getParentDirectory().createDirectory();
+				options.SetOptimizedModelFilePath(optimized_filename.c_str());
+				session = std::make_shared<Ort::Session>(env, onnx_filename.c_str(), options);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			// a corrupt or incompatible optimized model is not fatal, the original model is loaded instead
+			dm::Log("ONNX Runtime: failed to use the optimized model " + optimized_filename + ": " + e.what());
+			optimized.deleteFile();
+			session.reset();
+		}
+	}
+
+	if (!session)
+	{
+		session = std::make_shared<Ort::Session>(env, onnx_filename.c_str(), GetSessionOptions(settings, use_global_thread_pool));
+	}
+
+	const auto end_time = std::chrono::high_resolution_clock::now();
+	dm::Log("ONNX Runtime: created the session for " + onnx_filename + " (" + settings_key.str() + " resolved=" + threads + ") in " + std::to_string(std::chrono::duration<double, std::milli>(end_time - start_time).count()) + " ms");
+
+	cache.sessions.push_front({key, threads, session});
+	while (cache.sessions.size() > max_cached_sessions)
+	{
+		cache.sessions.pop_back();
+	}
+
+	return session;
+}
+
+void NN::set_optimized_model_directory(const std::string& directory)
+{
+	SessionCache& cache = session_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.optimized_model_directory = directory;
+}
+
+void NN::clear_session_cache()
+{
+	SessionCache& cache = session_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.sessions.clear();
+}
+
+void NN::set_session_settings(const SessionSettings& settings)
+{
+	SessionCache& cache = session_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.settings = settings;
+}
+
+SessionSettings NN::get_session_settings()
+{
+	SessionCache& cache = session_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	return cache.settings;
+}
+
+cv::Size NN::GetModelInputSize(Ort::Session& session, bool& is_dynamic, bool& is_dynamic_batch)
 {
 	// Get the first input's shape to determine the expected input size
 	size_t num_input_nodes = session.GetInputCount();
@@ -66,10 +284,11 @@ cv::Size NN::GetModelInputSize(Ort::Session& session, bool& is_dynamic)
 		is_dynamic = true;
 	}
 	
-	// Log if only batch size is dynamic (for informational purposes)
-	if (!is_dynamic && input_shape[0] == -1)
+	// A dynamic batch size is independent of the resolution; it means several images can be processed with a single call
+	is_dynamic_batch = (input_shape[0] == -1);
+	if (is_dynamic_batch)
 	{
-		dm::Log("ONNX model has dynamic batch size only - resolution cannot be customized");
+		dm::Log("ONNX model has dynamic batch size - images can be processed in batches");
 	}
 
 	if (is_dynamic)
@@ -94,7 +313,7 @@ cv::Size NN::GetModelInputSize(Ort::Session& session, bool& is_dynamic)
 		dm::Log("ONNX model has static height/width dimensions - resolution is fixed");
 		
 		// Validate that we have the expected batch size and channels
-		if (input_shape[0] != 1)
+		if (input_shape[0] != 1 && input_shape[0] != -1)
 		{
 			dm::Log("Warning: ONNX model batch size is " + std::to_string(input_shape[0]) + ", expected 1");
 		}
@@ -156,26 +375,32 @@ void NN::ValidateOutputFormat(Ort::Session& session)
 }
 
 NN::NN(const std::string & onnx_filename, const std::vector<std::string>& class_names) :
-	env(ORT_LOGGING_LEVEL_WARNING, "ONNX-DarkMark"),
-	session(env, onnx_filename.c_str(), GetSessionOptions()),
+	session(GetSession(onnx_filename)),
 	memory_info(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
+	is_dynamic_batch(false),
+	max_batch_size(8),
+	enable_tiles(false),
+	tile_overlap(0.2f),
+	tile_nms_threshold(0.45f),
+	enable_rectangular(false),
+	rectangular_stride(32),
 	class_names(class_names)
 {
 	// Automatically detect input size from the model
-	input_size = GetModelInputSize(session, is_dynamic_input);
+	input_size = GetModelInputSize(*session, is_dynamic_input, is_dynamic_batch);
 	
 	// Initialize cached vectors
 	input_tensor_values.resize(1 * 3 * input_size.height * input_size.width);
 	input_shape = {1, 3, input_size.height, input_size.width};
 	
-	size_t num_input_nodes = session.GetInputCount();
+	size_t num_input_nodes = session->GetInputCount();
 	for (size_t i = 0; i < num_input_nodes; i++) {
-		input_node_names_char.push_back(session.GetInputNameAllocated(i, allocator));
+		input_node_names_char.push_back(session->GetInputNameAllocated(i, allocator));
 	}
 
-	size_t num_output_nodes = session.GetOutputCount();
+	size_t num_output_nodes = session->GetOutputCount();
 	for (size_t i = 0; i < num_output_nodes; i++) {
-		output_node_names_char.push_back(session.GetOutputNameAllocated(i, allocator));
+		output_node_names_char.push_back(session->GetOutputNameAllocated(i, allocator));
 	}
 	
 	// Pre-populate name vectors
@@ -185,7 +410,7 @@ NN::NN(const std::string & onnx_filename, const std::vector<std::string>& class_
 	for (auto& ptr : output_node_names_char) output_names.push_back(ptr.get());
 	
 	// Validate output format
-	ValidateOutputFormat(session);
+	ValidateOutputFormat(*session);
 }
 
 NN::~NN()
@@ -193,37 +418,6 @@ NN::~NN()
     // No need to manually free, Ort::AllocatedStringPtr handles memory automatically
 }
 
-void NN::preprocess_image(const cv::Mat& mat, cv::Mat& mat_rs, float& scale_x, float& scale_y) const
-{
-	if (mat.empty()) return;
-	int img_height = mat.rows;
-	int img_width = mat.cols;
-
-	if (preprocess_config.maintain_aspect_ratio)
-	{
-		// Letterbox mode (YOLOX-style): maintain aspect ratio with padding
-		mat_rs = cv::Mat(input_size.height, input_size.width, CV_8UC3, cv::Scalar(114, 114, 114));
-
-		float ratio = std::min((float)input_size.width / (float)img_width, (float)input_size.height / (float)img_height);
-		scale_x = ratio;
-		scale_y = ratio;
-
-		int new_unpad_w = static_cast<int>((float)img_width * ratio);
-		int new_unpad_h = static_cast<int>((float)img_height * ratio);
-
-		cv::Mat new_unpad_mat;
-		cv::resize(mat, new_unpad_mat, cv::Size(new_unpad_w, new_unpad_h));
-		new_unpad_mat.copyTo(mat_rs(cv::Rect(0, 0, new_unpad_w, new_unpad_h)));
-	}
-	else
-	{
-		// Direct resize mode (D-FINE/RT-DETR-style): resize to exact input size, ignore aspect ratio
-		cv::resize(mat, mat_rs, cv::Size(input_size.width, input_size.height));
-		scale_x = (float)input_size.width / (float)img_width;
-		scale_y = (float)input_size.height / (float)img_height;
-	}
-}
-
 void NN::set_preprocess_config(const PreprocessConfig& config)
 {
 	preprocess_config = config;
@@ -234,9 +428,11 @@ void NN::set_preprocess_config(const PreprocessConfig& config)
 
 PredictionResults NN::predict(const cv::Mat& image, float conf_threshold, float nms_threshold) const
 {
-	PredictionResults results;
-	if (image.empty()) return results;
+	return predict_batch({image}, conf_threshold, nms_threshold).at(0);
+}
 
+std::vector<PredictionResults> NN::predict_batch(const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold) const
+{
 	// Validate thresholds
 	if (conf_threshold < 0.0f || conf_threshold > 1.0f)
 	{
@@ -249,37 +445,258 @@ PredictionResults NN::predict(const cv::Mat& image, float conf_threshold, float
 		nms_threshold = 0.45f;
 	}
 
-	float scale_x, scale_y;
-	cv::Mat preprocessed_image;
-	preprocess_image(image, preprocessed_image, scale_x, scale_y);
+	std::vector<PredictionResults> all_results = predict_candidates_batch(images, conf_threshold);
+	for (auto& results : all_results)
+	{
+		results = filter(results, conf_threshold, nms_threshold);
+		set_names(results);
+	}
 
-	// HWC to CHW conversion with optional BGR to RGB and pixel scaling
-	const float pixel_scale = preprocess_config.scale_factor;
-	const bool swap_rb = preprocess_config.bgr_to_rgb;
-	
-	for (int i = 0; i < input_size.height; i++) {
-		for (int j = 0; j < input_size.width; j++) {
-			const cv::Vec3b& pixel = preprocessed_image.at<cv::Vec3b>(i, j);
-			if (swap_rb)
-			{
-				// BGR to RGB: swap channels 0 and 2
-				input_tensor_values[0 * (input_size.height * input_size.width) + i * input_size.width + j] = pixel[2] * pixel_scale;
-				input_tensor_values[1 * (input_size.height * input_size.width) + i * input_size.width + j] = pixel[1] * pixel_scale;
-				input_tensor_values[2 * (input_size.height * input_size.width) + i * input_size.width + j] = pixel[0] * pixel_scale;
-			}
-			else
-			{
-				// Keep BGR order
-				input_tensor_values[0 * (input_size.height * input_size.width) + i * input_size.width + j] = pixel[0] * pixel_scale;
-				input_tensor_values[1 * (input_size.height * input_size.width) + i * input_size.width + j] = pixel[1] * pixel_scale;
-				input_tensor_values[2 * (input_size.height * input_size.width) + i * input_size.width + j] = pixel[2] * pixel_scale;
-			}
+	return all_results;
+}
+
+void NN::set_names(PredictionResults& results) const
+{
+	for (auto& res : results)
+	{
+		// Format name with confidence percentage like Darknet does
+		int confidence_percentage = static_cast<int>(std::round(res.probability * 100.0f));
+		if (static_cast<size_t>(res.class_idx) < class_names.size())
+		{
+			res.name = class_names[res.class_idx] + " " + std::to_string(confidence_percentage) + "%";
+		}
+		else
+		{
+			res.name = "class_" + std::to_string(res.class_idx) + " " + std::to_string(confidence_percentage) + "%";
+		}
+	}
+}
+
+PredictionResults NN::predict_candidates(const cv::Mat& image, float min_threshold) const
+{
+	return predict_candidates_batch({image}, min_threshold).at(0);
+}
+
+std::vector<PredictionResults> NN::predict_candidates_batch(const std::vector<cv::Mat>& images, float min_threshold) const
+{
+	if (!enable_tiles)
+	{
+		return run_all(images, min_threshold);
+	}
+
+	// Each image is replaced by its tiles (which are only ROI headers, not copies) plus the entire image so large
+	// objects which don't fit in a single tile can still be detected.  All of the pieces are then run as one batch.
+	std::vector<cv::Mat> pieces;
+	std::vector<size_t> owners;
+	std::vector<cv::Point> offsets;
+	for (size_t idx = 0; idx < images.size(); idx++)
+	{
+		if (images[idx].empty())
+		{
+			continue;
+		}
+
+		const auto tiles = get_tiles(images[idx].size());
+		for (const auto& tile : tiles)
+		{
+			pieces.push_back(images[idx](tile));
+			owners.push_back(idx);
+			offsets.push_back(tile.tl());
+		}
+
+		if (tiles.size() > 1)
+		{
+			pieces.push_back(images[idx]);
+			owners.push_back(idx);
+			offsets.push_back(cv::Point(0, 0));
+		}
+	}
+
+	const auto piece_candidates = run_all(pieces, min_threshold);
+
+	std::vector<PredictionResults> all_candidates(images.size());
+	std::vector<size_t> number_of_pieces(images.size(), 0);
+	for (size_t piece = 0; piece < pieces.size(); piece++)
+	{
+		auto& candidates = all_candidates[owners[piece]];
+		for (auto res : piece_candidates[piece])
+		{
+			res.rect += offsets[piece];
+			candidates.push_back(res);
+		}
+		number_of_pieces[owners[piece]]++;
+	}
+
+	// Objects along the seams are seen by more than one tile (and by the entire image).  Only boxes of the same class
+	// are merged so the candidates remain valid input for filter(), which applies the user's thresholds later.  There is
+	// no limit on the number of candidates here since they are cached, and top_k is applied when they are filtered.
+	for (size_t idx = 0; idx < images.size(); idx++)
+	{
+		if (number_of_pieces[idx] > 1)
+		{
+			all_candidates[idx] = filter(all_candidates[idx], min_threshold, tile_nms_threshold, 0);
+		}
+	}
+
+	return all_candidates;
+}
+
+std::vector<PredictionResults> NN::run_all(const std::vector<cv::Mat>& images, float min_threshold) const
+{
+	std::vector<PredictionResults> all_candidates(images.size());
+
+	// empty images are skipped, but still get an (empty) entry in the results so the indexes line up with the images
+	std::vector<size_t> indexes;
+	indexes.reserve(images.size());
+	for (size_t idx = 0; idx < images.size(); idx++)
+	{
+		if (!images[idx].empty())
+		{
+			indexes.push_back(idx);
+		}
+	}
+
+	// every image in a tensor must have the same shape, which is only a concern with rectangular inference
+	std::map<std::pair<int, int>, std::vector<size_t>> groups;
+	for (const size_t idx : indexes)
+	{
+		const cv::Size shape = get_inference_size(images[idx].size());
+		groups[{shape.width, shape.height}].push_back(idx);
+	}
+
+	// models with a fixed batch size of 1 are given the images one at a time
+	const size_t batch_size = is_dynamic_batch ? std::max(size_t(1), max_batch_size) : 1;
+
+	for (const auto& [dimensions, group] : groups)
+	{
+		const cv::Size shape(dimensions.first, dimensions.second);
+		for (size_t first = 0; first < group.size(); first += batch_size)
+		{
+			const size_t count = std::min(batch_size, group.size() - first);
+			run_batch(images, std::vector<size_t>(group.begin() + first, group.begin() + first + count), shape, min_threshold, all_candidates);
+		}
+	}
+
+	return all_candidates;
+}
+
+std::vector<cv::Rect> NN::get_tiles(const cv::Size& image_size) const
+{
+	if (!enable_tiles || (image_size.width <= input_size.width && image_size.height <= input_size.height))
+	{
+		return {cv::Rect(cv::Point(0, 0), image_size)};
+	}
+
+	// Find where the tiles start along one axis.  The tiles are spread evenly so the first one starts at zero, the last
+	// one ends exactly at the edge of the image, and adjacent tiles overlap by at least the requested amount.
+	auto tile_positions = [this](int image_length, int tile_length)
+	{
+		std::vector<int> positions;
+		if (image_length <= tile_length)
+		{
+			positions.push_back(0);
+			return positions;
+		}
+
+		const int minimum_overlap = static_cast<int>(std::round(tile_length * tile_overlap));
+		const int step = std::max(1, tile_length - minimum_overlap);
+		const int number_of_tiles = 1 + static_cast<int>(std::ceil(static_cast<double>(image_length - tile_length) / step));
+		for (int i = 0; i < number_of_tiles; i++)
+		{
+			positions.push_back(static_cast<int>(std::round(static_cast<double>(image_length - tile_length) * i / (number_of_tiles - 1))));
+		}
+
+		return positions;
+	};
+
+	const int tile_width = std::min(image_size.width, input_size.width);
+	const int tile_height = std::min(image_size.height, input_size.height);
+
+	std::vector<cv::Rect> tiles;
+	for (const int y : tile_positions(image_size.height, tile_height))
+	{
+		for (const int x : tile_positions(image_size.width, tile_width))
+		{
+			tiles.push_back(cv::Rect(x, y, tile_width, tile_height));
 		}
 	}
 
-	auto input_tensor = Ort::Value::CreateTensor<float>(memory_info, input_tensor_values.data(), input_tensor_values.size(), input_shape.data(), input_shape.size());
+	return tiles;
+}
+
+void NN::set_tiling(bool enable, float overlap)
+{
+	enable_tiles = enable;
+	tile_overlap = std::max(0.0f, std::min(overlap, 0.9f));
+	dm::Log("ONNX tiling: " + std::string(enable_tiles ? "enabled" : "disabled") + " overlap=" + std::to_string(tile_overlap));
+}
+
+void NN::set_tile_nms_threshold(float nms_threshold)
+{
+	tile_nms_threshold = std::max(0.0f, std::min(nms_threshold, 1.0f));
+}
+
+cv::Size NN::get_inference_size(const cv::Size& image_size) const
+{
+	if (!enable_rectangular || !is_dynamic_input || !preprocess_config.maintain_aspect_ratio || image_size.width <= 0 || image_size.height <= 0)
+	{
+		return input_size;
+	}
+
+	// same scale as the letterbox in blob_from_image(), so the objects are exactly the same size as with the full input size
+	const float ratio = std::min((float)input_size.width / (float)image_size.width, (float)input_size.height / (float)image_size.height);
+
+	auto align = [this](float length, int limit)
+	{
+		// the small tolerance prevents rounding errors from adding an entire stride of padding
+		const int aligned = static_cast<int>(std::ceil(length / rectangular_stride - 0.001f)) * rectangular_stride;
+		return std::max(std::min(aligned, limit), std::min(rectangular_stride, limit));
+	};
+
+	return cv::Size(align(image_size.width * ratio, input_size.width), align(image_size.height * ratio, input_size.height));
+}
+
+void NN::set_rectangular(bool enable, int stride)
+{
+	enable_rectangular = enable;
+	rectangular_stride = std::max(1, stride);
+	dm::Log("ONNX rectangular inference: " + std::string(enable_rectangular ? "enabled" : "disabled") + " stride=" + std::to_string(rectangular_stride) +
+		(enable_rectangular && !is_dynamic_input ? " (ignored, the model has static height/width dimensions)" : ""));
+}
+
+void NN::run_batch(const std::vector<cv::Mat>& images, const std::vector<size_t>& indexes, const cv::Size& shape, float min_threshold, std::vector<PredictionResults>& all_candidates) const
+{
+	const size_t count = indexes.size();
+	const size_t image_floats = 3 * shape.area();
+
+	// The tensor buffer only ever grows, so once the largest batch has been seen there are no more allocations.
+	// Rectangular shapes are never larger than the input size, so they re-use the same buffer.
+	if (input_tensor_values.size() < count * image_floats)
+	{
+		input_tensor_values.resize(count * image_floats);
+	}
+	input_shape[0] = static_cast<int64_t>(count);
+	input_shape[2] = shape.height;
+	input_shape[3] = shape.width;
+
+	const auto preprocess_start = std::chrono::high_resolution_clock::now();
+	std::vector<float> scale_x(count);
+	std::vector<float> scale_y(count);
+	for (size_t b = 0; b < count; b++)
+	{
+		blob_from_image(images[indexes[b]], shape, preprocess_config, input_tensor_values.data() + b * image_floats, scale_x[b], scale_y[b]);
+	}
+
+	auto input_tensor = Ort::Value::CreateTensor<float>(memory_info, input_tensor_values.data(), count * image_floats, input_shape.data(), input_shape.size());
+
+	const auto inference_start = std::chrono::high_resolution_clock::now();
+	auto output_tensors = session->Run(Ort::RunOptions{nullptr}, input_names.data(), &input_tensor, 1, output_names.data(), output_names.size());
+	const auto inference_end = std::chrono::high_resolution_clock::now();
 
-	auto output_tensors = session.Run(Ort::RunOptions{nullptr}, input_names.data(), &input_tensor, 1, output_names.data(), output_names.size());
+	stage_times.preprocess_ms	+= std::chrono::duration<double, std::milli>(inference_start - preprocess_start).count();
+	stage_times.inference_ms	+= std::chrono::duration<double, std::milli>(inference_end - inference_start).count();
+	stage_times.batches			++;
+	stage_times.images			+= count;
 
 	// DeepStream-compatible output format: [batch, N, 6] where N is number of detections
 	// and 6 is [x1, y1, x2, y2, score, class_id]
@@ -288,25 +705,33 @@ PredictionResults NN::predict(const cv::Mat& image, float conf_threshold, float
 	auto output_shape = output_tensors[0].GetTensorTypeAndShapeInfo().GetShape();
 	
 	// Runtime validation of output shape
-	if (output_shape.size() != 3 || output_shape[2] != 6)
+	if (output_shape.size() != 3 || output_shape[2] != 6 || output_shape[0] != static_cast<int64_t>(count))
 	{
-		dm::Log("Error: Unexpected ONNX output shape. Expected [batch, N, 6], got [" +
+		// returning empty results would look like "no objects found" and would be stored in the prediction cache
+		throw std::runtime_error("Unexpected ONNX output shape. Expected [" + std::to_string(count) + ", N, 6], got [" +
 			std::to_string(output_shape.size() > 0 ? output_shape[0] : 0) + ", " +
 			std::to_string(output_shape.size() > 1 ? output_shape[1] : 0) + ", " +
 			std::to_string(output_shape.size() > 2 ? output_shape[2] : 0) + "]");
-		return results;
 	}
 	
-	size_t num_detections = output_shape[1];
+	const size_t num_detections = output_shape[1];
+
+	for (size_t b = 0; b < count; b++)
+	{
+		all_candidates[indexes[b]] = decode(raw_output + b * num_detections * 6, num_detections, images[indexes[b]].size(), scale_x[b], scale_y[b], min_threshold);
+	}
+
+	stage_times.decode_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - inference_end).count();
+}
 
-	std::vector<cv::Rect> boxes;
-	std::vector<float> scores;
-	std::vector<int> class_indices;
+PredictionResults NN::decode(const float* raw_output, size_t num_detections, const cv::Size& image_size, float scale_x, float scale_y, float min_threshold)
+{
+	PredictionResults candidates;
 
 	for(size_t i = 0; i < num_detections; ++i)
 	{
 		float score = raw_output[i * 6 + 4];
-		if(score > conf_threshold)
+		if(score > min_threshold)
 		{
 			float x1 = raw_output[i * 6 + 0];
 			float y1 = raw_output[i * 6 + 1];
@@ -326,10 +751,10 @@ PredictionResults NN::predict(const cv::Mat& image, float conf_threshold, float
 			if (y1 > y2) std::swap(y1, y2);
 
 			// Clamp to image boundaries
-			x1 = std::max(0.0f, std::min(x1, (float)image.cols - 1.0f));
-			y1 = std::max(0.0f, std::min(y1, (float)image.rows - 1.0f));
-			x2 = std::max(0.0f, std::min(x2, (float)image.cols - 1.0f));
-			y2 = std::max(0.0f, std::min(y2, (float)image.rows - 1.0f));
+			x1 = std::max(0.0f, std::min(x1, (float)image_size.width - 1.0f));
+			y1 = std::max(0.0f, std::min(y1, (float)image_size.height - 1.0f));
+			x2 = std::max(0.0f, std::min(x2, (float)image_size.width - 1.0f));
+			y2 = std::max(0.0f, std::min(y2, (float)image_size.height - 1.0f));
 
 			// Calculate width and height
 			int ix1 = static_cast<int>(x1);
@@ -345,38 +770,40 @@ PredictionResults NN::predict(const cv::Mat& image, float conf_threshold, float
 				continue;
 			}
 
-			boxes.push_back(cv::Rect(ix1, iy1, width, height));
-			scores.push_back(score);
-			class_indices.push_back((int)raw_output[i * 6 + 5]);
+			PredictionResult res;
+			res.rect = cv::Rect(ix1, iy1, width, height);
+			res.probability = score;
+			res.class_idx = (int)raw_output[i * 6 + 5];
+			candidates.push_back(res);
 		}
 	}
 
-	std::vector<int> nms_result;
-	cv::dnn::NMSBoxes(boxes, scores, conf_threshold, nms_threshold, nms_result);
+	return candidates;
+}
+
+PredictionResults NN::filter(const PredictionResults& candidates, float conf_threshold, float nms_threshold, size_t top_k)
+{
+	const auto indexes = filter_indexes(candidates, conf_threshold, nms_threshold, top_k);
 
-	for (int idx : nms_result)
+	PredictionResults results;
+	results.reserve(indexes.size());
+	for (const size_t idx : indexes)
 	{
-		PredictionResult res;
-		res.rect = boxes[idx];
-		res.probability = scores[idx];
-		res.class_idx = class_indices[idx];
-		if (static_cast<size_t>(res.class_idx) < class_names.size())
-		{
-			// Format name with confidence percentage like Darknet does
-			int confidence_percentage = static_cast<int>(std::round(scores[idx] * 100.0f));
-			res.name = class_names[res.class_idx] + " " + std::to_string(confidence_percentage) + "%";
-		}
-		else
-		{
-			int confidence_percentage = static_cast<int>(std::round(scores[idx] * 100.0f));
-			res.name = "class_" + std::to_string(res.class_idx) + " " + std::to_string(confidence_percentage) + "%";
-		}
-		results.push_back(res);
+		results.push_back(candidates[idx]);
 	}
 
 	return results;
 }
 
+std::vector<size_t> NN::filter_indexes(const PredictionResults& candidates, float conf_threshold, float nms_threshold, size_t top_k)
+{
+	// one instance per thread so the scratch buffers are re-used between calls
+	thread_local NMS nms;
+	nms.top_k = top_k;
+
+	return nms.run(candidates, conf_threshold, nms_threshold);
+}
+
 void NN::set_input_size(const cv::Size& size)
 {
 	if (!is_dynamic_input)
@@ -407,9 +834,18 @@ void NN::set_input_size(const cv::Size& size)
 	
 	input_size = size;
 	
-	// Update cached vectors for new size
+	// Update cached vectors for new size (larger batches will grow the buffer as needed)
 	input_tensor_values.resize(1 * 3 * input_size.height * input_size.width);
 	input_shape = {1, 3, input_size.height, input_size.width};
 }
 
+void NN::set_max_batch_size(size_t size)
+{
+	max_batch_size = std::max(size_t(1), size);
+	if (!is_dynamic_batch && max_batch_size > 1)
+	{
+		dm::Log("ONNX model has a fixed batch size - images will be processed one at a time");
+	}
+}
+
 } // namespace OnnxHelp
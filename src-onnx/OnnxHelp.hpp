@@ -45,6 +45,61 @@ namespace OnnxHelp
 		}
 	};
 
+	/** ONNX Runtime session settings.  These are applied when a model is loaded, and are part of the session cache key.
+	 *
+	 * Thread counts of zero mean "auto":  when DarkMark's own worker pools are idle the sessions share the global thread
+	 * pool, otherwise each session gets a smaller pool which leaves one core for each busy DarkMark worker thread.
+	 */
+	struct SessionSettings
+	{
+		int intra_op_threads = 0;           ///< threads used within a single operator, or 0 for auto
+		int inter_op_threads = 0;           ///< threads used to run independent operators in parallel, or 0 for auto
+		bool parallel_execution = false;    ///< ORT_PARALLEL instead of ORT_SEQUENTIAL
+		bool memory_pattern = true;         ///< pre-allocate memory based on the previous runs
+		bool cpu_arena = true;              ///< use an arena for CPU memory instead of calling malloc/free
+	};
+
+	/** Non-maximal suppression for ONNX results.  By default boxes only suppress other boxes of the same class, so
+	 * overlapping objects of different classes are all kept.  Before NMS runs, the candidates are cut down to the
+	 * @p top_k highest scores, which keeps the cost bounded for models which emit hundreds of candidates per image.
+	 *
+	 * The scratch buffers are kept between calls, so an instance should be re-used rather than created for every image.
+	 * An instance must not be shared between threads.
+	 */
+	class NMS
+	{
+		public:
+			NMS(bool class_aware = true, size_t top_k = 1000);
+
+			// Get the indexes of the candidates scoring above conf_threshold which are not suppressed by a higher-scoring
+			// box.  The indexes are sorted by descending score, and remain valid until the next call.
+			const std::vector<size_t>& run(const PredictionResults& candidates, float conf_threshold, float nms_threshold);
+
+			// When false, boxes of any class suppress each other (same as cv::dnn::NMSBoxes)
+			bool class_aware;
+
+			// Maximum number of candidates given to NMS, or zero for no limit
+			size_t top_k;
+
+		private:
+			std::vector<size_t> order;
+			std::vector<size_t> kept;
+			std::vector<float> areas;
+			std::vector<uint8_t> suppressed;
+	};
+
+	/** Time spent in each stage of the ONNX inference, accumulated over every batch since the counters were last reset.
+	 * Used by the benchmarks to see where the time goes.
+	 */
+	struct StageTimes
+	{
+		double preprocess_ms = 0.0;         ///< letterbox or resize, and copy the pixels into the input tensor
+		double inference_ms = 0.0;          ///< Ort::Session::Run()
+		double decode_ms = 0.0;             ///< convert the output tensor to candidates in image coordinates
+		size_t batches = 0;
+		size_t images = 0;
+	};
+
 	/** Neural network class for ONNX models with DeepStream-compatible output format.
 	 * 
 	 * Supports any ONNX object detection model that outputs the DeepStream format:
@@ -62,15 +117,80 @@ namespace OnnxHelp
 			NN(const std::string & onnx_filename, const std::vector<std::string>& class_names = {});
 			~NN();
 			PredictionResults predict(const cv::Mat& image, float conf_threshold = 0.3f, float nms_threshold = 0.45f) const;
+
+			// Run the network and return every candidate scoring above min_threshold, before the confidence threshold and NMS are applied.
+			// The results can be cached and later passed to filter() as many times as needed, without running the network again.
+			PredictionResults predict_candidates(const cv::Mat& image, float min_threshold = 0.01f) const;
+
+			// Same as predict(), but for several images at once.  When the model has a dynamic batch dimension, up to
+			// get_max_batch_size() images are packed into a single tensor; otherwise the images are processed one at a time.
+			// The results are returned in the same order as the images.  Empty images have empty results.
+			std::vector<PredictionResults> predict_batch(const std::vector<cv::Mat>& images, float conf_threshold = 0.3f, float nms_threshold = 0.45f) const;
+
+			// Same as predict_candidates(), but for several images at once.  See predict_batch().
+			std::vector<PredictionResults> predict_candidates_batch(const std::vector<cv::Mat>& images, float min_threshold = 0.01f) const;
+
+			// Apply the confidence threshold and class-aware NMS to the results of predict_candidates().  Names are not set.
+			// Only the top_k highest scores are kept (see NMS), or every candidate when top_k is zero.
+			static PredictionResults filter(const PredictionResults& candidates, float conf_threshold, float nms_threshold, size_t top_k = 1000);
+
+			// Same as filter(), but returns the indexes of the candidates which are kept, sorted by descending score.
+			static std::vector<size_t> filter_indexes(const PredictionResults& candidates, float conf_threshold, float nms_threshold, size_t top_k = 1000);
 			
 			// Check if the model has dynamic input dimensions
 			bool is_dynamic() const { return is_dynamic_input; }
+
+			// Check if the model has a dynamic batch dimension, meaning predict_batch() can process several images with one call
+			bool is_dynamic_batch_size() const { return is_dynamic_batch; }
+
+			// Set the maximum number of images packed into a single tensor by predict_batch() (ignored for static batch models)
+			void set_max_batch_size(size_t size);
+
+			// Get the maximum number of images packed into a single tensor
+			size_t get_max_batch_size() const { return is_dynamic_batch ? max_batch_size : 1; }
 			
 			// Set custom input size for models with dynamic height/width dimensions (ignored for static models)
 			void set_input_size(const cv::Size& size);
 			
 			// Get current input size
 			cv::Size get_input_size() const { return input_size; }
+
+			// Enable or disable tiling.  When enabled, images larger than the network are sliced into overlapping tiles of
+			// the network size, which are processed as a batch together with a downscaled copy of the entire image.  The
+			// results are mapped back to the original image, and duplicates along the tile seams are merged with NMS.
+			// The overlap is the fraction of the network size shared by adjacent tiles.
+			void set_tiling(bool enable, float overlap = 0.2f);
+
+			// Check if tiling is enabled
+			bool get_tiling() const { return enable_tiles; }
+
+			// Get the fraction of the network size shared by adjacent tiles
+			float get_tile_overlap() const { return tile_overlap; }
+
+			// Set the NMS threshold used to merge the duplicate boxes found along the tile seams.  This should be the same
+			// NMS threshold used to filter the results, otherwise the seams behave differently than the rest of the image.
+			void set_tile_nms_threshold(float nms_threshold);
+
+			// Get the NMS threshold used to merge the duplicate boxes found along the tile seams
+			float get_tile_nms_threshold() const { return tile_nms_threshold; }
+
+			// Enable or disable rectangular inference for models with dynamic height/width dimensions.  Instead of always
+			// letterboxing into the square (or fixed) input size, each image is given the smallest shape which is a multiple
+			// of the stride and still fits the image at the same scale.  A 16:9 frame at 640x640 becomes 640x384, so less
+			// time is spent on padding while the objects keep the same size in pixels.  Images with different shapes are
+			// processed in separate batches.  Only used with letterbox preprocessing.
+			void set_rectangular(bool enable, int stride = 32);
+
+			// Check if rectangular inference is enabled
+			bool get_rectangular() const { return enable_rectangular; }
+
+			// Get the network input shape used for an image of the given size.  This is the input size unless
+			// rectangular inference is enabled and applies to this model.
+			cv::Size get_inference_size(const cv::Size& image_size) const;
+
+			// Get the rectangles used to slice an image of the given size, or a single rectangle covering the entire image
+			// when tiling is disabled or the image is not larger than the network.
+			std::vector<cv::Rect> get_tiles(const cv::Size& image_size) const;
 			
 			// Set preprocessing configuration
 			void set_preprocess_config(const PreprocessConfig& config);
@@ -78,12 +198,43 @@ namespace OnnxHelp
 			// Get current preprocessing configuration
 			PreprocessConfig get_preprocess_config() const { return preprocess_config; }
 
+			// Letterbox or resize the image, scale the pixels, and write them as NCHW planes directly into blob, which must
+			// have room for 3 * input_size.area() floats.  This uses vectorized OpenCV calls instead of a per-pixel loop.
+			// The scale factors needed to map the results back to the original image are returned in scale_x and scale_y.
+			static void blob_from_image(const cv::Mat& image, const cv::Size& input_size, const PreprocessConfig& config, float* blob, float& scale_x, float& scale_y);
+
+			// Get the time spent in each stage since the last call to reset_stage_times()
+			StageTimes get_stage_times() const { return stage_times; }
+
+			// Set the stage times back to zero
+			void reset_stage_times() { stage_times = StageTimes(); }
+
+			// Save a copy of each model after ONNX Runtime has optimized the graph, so the next time the same model is
+			// loaded the (slow) graph optimization can be skipped.  An empty directory disables this.
+			static void set_optimized_model_directory(const std::string& directory);
+
+			// Forget the sessions kept by the session cache.  Sessions still used by an instance of NN remain valid.
+			static void clear_session_cache();
+
+			// Set the options used to create the next sessions.  Models which are already loaded are not modified.
+			static void set_session_settings(const SessionSettings& settings);
+
+			// Get the options used to create new sessions
+			static SessionSettings get_session_settings();
+
 		private:
-			static Ort::SessionOptions GetSessionOptions();
-			static cv::Size GetModelInputSize(Ort::Session& session, bool& is_dynamic);
+			static Ort::SessionOptions GetSessionOptions(const SessionSettings& settings, bool use_global_thread_pool);
+
+			// The environment is shared by every session in the process, and owns the global thread pools
+			static Ort::Env& GetEnvironment();
+
+			// Get the session for this model from the session cache, or create a new one
+			static std::shared_ptr<Ort::Session> GetSession(const std::string& onnx_filename);
+			static cv::Size GetModelInputSize(Ort::Session& session, bool& is_dynamic, bool& is_dynamic_batch);
 			static void ValidateOutputFormat(Ort::Session& session);
-			Ort::Env env;
-			mutable Ort::Session session;
+			// Sessions are shared by every instance which loads the same model.  ONNX Runtime allows Run() to be called
+			// from several threads at once, so this is safe.
+			std::shared_ptr<Ort::Session> session;
 			Ort::AllocatorWithDefaultOptions allocator;
 			Ort::MemoryInfo memory_info;
 
@@ -92,6 +243,13 @@ namespace OnnxHelp
 
 			cv::Size input_size;
 			bool is_dynamic_input;
+			bool is_dynamic_batch;
+			size_t max_batch_size;
+			bool enable_tiles;
+			float tile_overlap;
+			float tile_nms_threshold;
+			bool enable_rectangular;
+			int rectangular_stride;
 			std::vector<std::string> class_names;
 			PreprocessConfig preprocess_config;
 
@@ -100,7 +258,19 @@ namespace OnnxHelp
 			mutable std::vector<int64_t> input_shape;
 			mutable std::vector<const char*> input_names;
 			mutable std::vector<const char*> output_names;
+			mutable StageTimes stage_times;
+
+			// Run the given images through the network in chunks of max_batch_size, without tiling.  Images are grouped by
+			// the shape returned by get_inference_size() since every image in a tensor must have the same shape.
+			std::vector<PredictionResults> run_all(const std::vector<cv::Mat>& images, float min_threshold) const;
+
+			// Preprocess the given images into one tensor of the given shape, run the network, and store the candidates at the same indexes
+			void run_batch(const std::vector<cv::Mat>& images, const std::vector<size_t>& indexes, const cv::Size& shape, float min_threshold, std::vector<PredictionResults>& all_candidates) const;
+
+			// Convert the raw [N, 6] output for a single image back to the coordinates of the original image
+			static PredictionResults decode(const float* raw_output, size_t num_detections, const cv::Size& image_size, float scale_x, float scale_y, float min_threshold);
 
-			void preprocess_image(const cv::Mat& mat, cv::Mat& mat_rs, float& scale_x, float& scale_y) const;
+			// Set the name of each result to the class name and confidence
+			void set_names(PredictionResults& results) const;
 	};
 }
@@ -0,0 +1,118 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+#include "OnnxHelp.hpp"
+
+namespace OnnxHelp
+{
+NMS::NMS(bool class_aware, size_t top_k) :
+	class_aware(class_aware),
+	top_k(top_k)
+{
+}
+
+const std::vector<size_t>& NMS::run(const PredictionResults& candidates, float conf_threshold, float nms_threshold)
+{
+	order.clear();
+	kept.clear();
+
+	// same as cv::dnn::NMSBoxes(), only the candidates strictly above the threshold are considered
+	for (size_t idx = 0; idx < candidates.size(); idx++)
+	{
+		if (candidates[idx].probability > conf_threshold)
+		{
+			order.push_back(idx);
+		}
+	}
+
+	auto by_score = [&candidates](size_t lhs, size_t rhs)
+	{
+		if (candidates[lhs].probability != candidates[rhs].probability)
+		{
+			return candidates[lhs].probability > candidates[rhs].probability;
+		}
+		return lhs < rhs;
+	};
+
+	// partition instead of sorting everything, since the candidates beyond top_k are discarded anyway
+	if (top_k > 0 && order.size() > top_k)
+	{
+		std::nth_element(order.begin(), order.begin() + top_k, order.end(), by_score);
+		order.resize(top_k);
+	}
+
+	// Group the candidates by class so each box only needs to be compared against the rest of its own group.
+	// Within a group the candidates are sorted by descending score, which is the order greedy NMS needs.
+	if (class_aware)
+	{
+		std::sort(order.begin(), order.end(), [&candidates, &by_score](size_t lhs, size_t rhs)
+		{
+			if (candidates[lhs].class_idx != candidates[rhs].class_idx)
+			{
+				return candidates[lhs].class_idx < candidates[rhs].class_idx;
+			}
+			return by_score(lhs, rhs);
+		});
+	}
+	else
+	{
+		std::sort(order.begin(), order.end(), by_score);
+	}
+
+	const size_t count = order.size();
+	areas.resize(count);
+	suppressed.assign(count, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		areas[i] = static_cast<float>(candidates[order[i]].rect.area());
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (suppressed[i])
+		{
+			continue;
+		}
+		kept.push_back(order[i]);
+
+		const auto& a = candidates[order[i]];
+		for (size_t j = i + 1; j < count; j++)
+		{
+			const auto& b = candidates[order[j]];
+			if (class_aware && b.class_idx != a.class_idx)
+			{
+				// the rest of the candidates belong to a different class
+				break;
+			}
+
+			if (suppressed[j])
+			{
+				continue;
+			}
+
+			const int w = std::min(a.rect.x + a.rect.width, b.rect.x + b.rect.width) - std::max(a.rect.x, b.rect.x);
+			const int h = std::min(a.rect.y + a.rect.height, b.rect.y + b.rect.height) - std::max(a.rect.y, b.rect.y);
+			if (w <= 0 || h <= 0)
+			{
+				continue;
+			}
+
+			// computed in double precision like cv::dnn::NMSBoxes() so boxes right at the threshold are treated the same way
+			const double intersection = static_cast<double>(w) * static_cast<double>(h);
+			const double iou = intersection / (static_cast<double>(areas[i]) + areas[j] - intersection);
+			if (iou > nms_threshold)
+			{
+				suppressed[j] = 1;
+			}
+		}
+	}
+
+	// return the results in the same order as cv::dnn::NMSBoxes(), highest score first
+	if (class_aware)
+	{
+		std::sort(kept.begin(), kept.end(), by_score);
+	}
+
+	return kept;
+}
+}
@@ -0,0 +1,98 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+#include "OnnxHelp.hpp"
+
+namespace OnnxHelp
+{
+void NN::blob_from_image(const cv::Mat& image, const cv::Size& input_size, const PreprocessConfig& config, float* blob, float& scale_x, float& scale_y)
+{
+	// Scratch buffers are re-used between calls to avoid allocating several MiB per frame.
+	// They are thread_local so several networks (or several threads) can preprocess images at the same time.
+	thread_local cv::Mat resized;
+	thread_local cv::Mat converted;
+
+	// the network expects 3 channels, but the images themselves can be greyscale or have an alpha channel
+	cv::Mat bgr = image;
+	if (image.channels() == 1)
+	{
+		cv::cvtColor(image, bgr, cv::COLOR_GRAY2BGR);
+	}
+	else if (image.channels() == 4)
+	{
+		cv::cvtColor(image, bgr, cv::COLOR_BGRA2BGR);
+	}
+
+	const int plane_size = input_size.width * input_size.height;
+
+	// Wrap each of the 3 planes of the NCHW blob in a cv::Mat so OpenCV writes directly into the tensor buffer.
+	// When converting BGR to RGB, the planes are simply listed in the opposite order.
+	std::vector<cv::Mat> planes(3);
+	for (int c = 0; c < 3; c++)
+	{
+		const int plane_idx = config.bgr_to_rgb ? 2 - c : c;
+		planes[c] = cv::Mat(input_size, CV_32FC1, blob + plane_idx * plane_size);
+	}
+
+	cv::Rect roi(0, 0, input_size.width, input_size.height);
+
+	if (config.maintain_aspect_ratio)
+	{
+		// Letterbox mode (YOLOX-style): maintain aspect ratio with padding
+		const float ratio = std::min((float)input_size.width / (float)bgr.cols, (float)input_size.height / (float)bgr.rows);
+		scale_x = ratio;
+		scale_y = ratio;
+
+		roi.width = static_cast<int>((float)bgr.cols * ratio);
+		roi.height = static_cast<int>((float)bgr.rows * ratio);
+
+		// Only the padding needs to be filled, the rest of the blob is overwritten below.
+		const float padding = 114.0f * config.scale_factor;
+		for (auto& plane : planes)
+		{
+			if (roi.width < input_size.width)
+			{
+				plane(cv::Rect(roi.width, 0, input_size.width - roi.width, roi.height)).setTo(padding);
+			}
+			if (roi.height < input_size.height)
+			{
+				plane(cv::Rect(0, roi.height, input_size.width, input_size.height - roi.height)).setTo(padding);
+			}
+		}
+	}
+	else
+	{
+		// Direct resize mode (D-FINE/RT-DETR-style): resize to exact input size, ignore aspect ratio
+		scale_x = (float)input_size.width / (float)bgr.cols;
+		scale_y = (float)input_size.height / (float)bgr.rows;
+	}
+
+	if (bgr.size() == roi.size())
+	{
+		bgr.convertTo(converted, CV_32F, config.scale_factor);
+	}
+	else
+	{
+		cv::resize(bgr, resized, roi.size());
+		resized.convertTo(converted, CV_32F, config.scale_factor);
+	}
+
+	// cv::split() does not re-allocate output Mats which already have the right size and type,
+	// so each channel is written straight into its plane of the blob
+	std::vector<cv::Mat> dst(3);
+	for (int c = 0; c < 3; c++)
+	{
+		dst[c] = planes[c](roi);
+	}
+	cv::split(converted, dst);
+
+	// make sure nothing caused OpenCV to silently re-allocate one of the planes
+	for (int c = 0; c < 3; c++)
+	{
+		if (dst[c].data != planes[c](roi).data)
+		{
+			throw std::logic_error("ONNX preprocessing failed to write directly into the input tensor");
+		}
+	}
+}
+}
@@ -0,0 +1,232 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+#include "OpenCVNN.hpp"
+#include "Tools.hpp" // for Log
+
+namespace OnnxHelp
+{
+OpenCVNN::OpenCVNN(const std::string& cfg_filename, const std::string& weights_filename, const std::vector<std::string>& class_names, bool use_openvino) :
+	class_names(class_names),
+	input_size(GetNetworkSize(cfg_filename)),
+	using_openvino(false)
+{
+	net = cv::dnn::readNetFromDarknet(cfg_filename, weights_filename);
+	if (net.empty())
+	{
+		throw std::runtime_error("OpenCV failed to load the Darknet network " + cfg_filename + " / " + weights_filename);
+	}
+
+	if (use_openvino && is_openvino_available())
+	{
+		net.setPreferableBackend(cv::dnn::DNN_BACKEND_INFERENCE_ENGINE);
+		using_openvino = true;
+	}
+	else
+	{
+		if (use_openvino)
+		{
+			dm::Log("OpenVINO is not available in this build of OpenCV, using the default CPU target instead");
+		}
+		net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+	}
+	net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+	output_layer_names = net.getUnconnectedOutLayersNames();
+
+	dm::Log("OpenCV DNN loaded " + weights_filename +
+		" backend=" + std::string(using_openvino ? "OpenVINO" : "OpenCV") +
+		" network=" + std::to_string(input_size.width) + "x" + std::to_string(input_size.height) +
+		" outputs=" + std::to_string(output_layer_names.size()));
+}
+
+OpenCVNN::~OpenCVNN()
+{
+}
+
+bool OpenCVNN::is_openvino_available()
+{
+	try
+	{
+		for (const auto target : cv::dnn::getAvailableTargets(cv::dnn::DNN_BACKEND_INFERENCE_ENGINE))
+		{
+			if (target == cv::dnn::DNN_TARGET_CPU)
+			{
+				return true;
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		dm::Log(std::string("failed to query the OpenVINO targets: ") + e.what());
+	}
+
+	return false;
+}
+
+cv::Size OpenCVNN::GetNetworkSize(const std::string& cfg_filename)
+{
+	std::ifstream ifs(cfg_filename);
+	if (!ifs.good())
+	{
+		throw std::invalid_argument("failed to read the Darknet configuration " + cfg_filename);
+	}
+
+	cv::Size size(0, 0);
+	bool in_net_section = false;
+	std::string line;
+	while (std::getline(ifs, line))
+	{
+		// remove comments and whitespace
+		line = line.substr(0, line.find_first_of("#;"));
+		line.erase(std::remove_if(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); }), line.end());
+		if (line.empty())
+		{
+			continue;
+		}
+
+		if (line[0] == '[')
+		{
+			if (in_net_section)
+			{
+				// [net] is always the first section, so we're done
+				break;
+			}
+			in_net_section = (line == "[net]" || line == "[network]");
+			continue;
+		}
+
+		if (in_net_section)
+		{
+			const size_t pos = line.find('=');
+			if (pos == std::string::npos)
+			{
+				continue;
+			}
+			const std::string key = line.substr(0, pos);
+			if (key == "width")
+			{
+				size.width = std::stoi(line.substr(pos + 1));
+			}
+			else if (key == "height")
+			{
+				size.height = std::stoi(line.substr(pos + 1));
+			}
+		}
+	}
+
+	if (size.width <= 0 || size.height <= 0)
+	{
+		throw std::invalid_argument("failed to find the network dimensions in " + cfg_filename);
+	}
+
+	return size;
+}
+
+PredictionResults OpenCVNN::predict(const cv::Mat& image, float conf_threshold, float nms_threshold) const
+{
+	return predict_batch({image}, conf_threshold, nms_threshold).at(0);
+}
+
+std::vector<PredictionResults> OpenCVNN::predict_batch(const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold) const
+{
+	std::vector<PredictionResults> all_results = predict_candidates_batch(images, conf_threshold);
+	for (auto& results : all_results)
+	{
+		results = NN::filter(results, conf_threshold, nms_threshold);
+		set_names(results);
+	}
+
+	return all_results;
+}
+
+PredictionResults OpenCVNN::predict_candidates(const cv::Mat& image, float min_threshold) const
+{
+	return predict_candidates_batch({image}, min_threshold).at(0);
+}
+
+std::vector<PredictionResults> OpenCVNN::predict_candidates_batch(const std::vector<cv::Mat>& images, float min_threshold) const
+{
+	std::vector<PredictionResults> all_candidates(images.size());
+
+	// The images are processed one at a time.  Unlike ONNX Runtime, batching in OpenCV DNN does not make CPU inference
+	// any faster, and the YOLO layers change the shape of their output when the batch size is not 1.
+	for (size_t idx = 0; idx < images.size(); idx++)
+	{
+		const cv::Mat& image = images[idx];
+		if (image.empty())
+		{
+			continue;
+		}
+
+		// Darknet stretches the image to the network size, and expects RGB values in [0, 1]
+		cv::dnn::blobFromImage(image, blob, 1.0 / 255.0, input_size, cv::Scalar(), true, false, CV_32F);
+		net.setInput(blob);
+		net.forward(outputs, output_layer_names);
+
+		for (const auto& output : outputs)
+		{
+			decode(output, image.size(), min_threshold, all_candidates[idx]);
+		}
+	}
+
+	return all_candidates;
+}
+
+void OpenCVNN::decode(const cv::Mat& output, const cv::Size& image_size, float min_threshold, PredictionResults& results)
+{
+	// each row is [cx, cy, w, h, objectness, class scores...] relative to the network size, and the class scores have
+	// already been multiplied by the objectness
+	if (output.dims != 2 || output.cols <= 5)
+	{
+		return;
+	}
+
+	const int number_of_classes = output.cols - 5;
+	const cv::Rect image_rect(0, 0, image_size.width, image_size.height);
+
+	for (int row = 0; row < output.rows; row++)
+	{
+		const float* data = output.ptr<float>(row);
+		const float* scores = data + 5;
+		const float* best = std::max_element(scores, scores + number_of_classes);
+		if (*best <= min_threshold)
+		{
+			continue;
+		}
+
+		const float w = data[2] * image_size.width;
+		const float h = data[3] * image_size.height;
+		const float x = data[0] * image_size.width - w / 2.0f;
+		const float y = data[1] * image_size.height - h / 2.0f;
+
+		PredictionResult res;
+		res.rect = cv::Rect(std::round(x), std::round(y), std::round(w), std::round(h)) & image_rect;
+		if (res.rect.area() <= 0)
+		{
+			continue;
+		}
+		res.probability = *best;
+		res.class_idx = static_cast<int>(best - scores);
+		results.push_back(res);
+	}
+}
+
+void OpenCVNN::set_names(PredictionResults& results) const
+{
+	for (auto& res : results)
+	{
+		// Format name with confidence percentage like Darknet does
+		int confidence_percentage = static_cast<int>(std::round(res.probability * 100.0f));
+		if (static_cast<size_t>(res.class_idx) < class_names.size())
+		{
+			res.name = class_names[res.class_idx] + " " + std::to_string(confidence_percentage) + "%";
+		}
+		else
+		{
+			res.name = "class_" + std::to_string(res.class_idx) + " " + std::to_string(confidence_percentage) + "%";
+		}
+	}
+}
+
+} // namespace OnnxHelp
@@ -0,0 +1,65 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "OnnxHelp.hpp"
+#include <opencv2/dnn.hpp>
+
+namespace OnnxHelp
+{
+	/** Neural network class for Darknet .cfg/.weights models, using OpenCV's DNN module instead of libdarknet.
+	 *
+	 * On machines without a GPU this is usually several times faster than DarkHelp::NN.  The results use the same
+	 * structures as the ONNX models, so predict_candidates() and NN::filter_indexes() can be used exactly the same way.
+	 *
+	 * Forward passes modify the network, so an instance must not be used by several threads at the same time.
+	 */
+	class OpenCVNN
+	{
+		public:
+			// When use_openvino is set but OpenCV was not built with OpenVINO, the default OpenCV CPU target is used instead.
+			OpenCVNN(const std::string& cfg_filename, const std::string& weights_filename, const std::vector<std::string>& class_names = {}, bool use_openvino = false);
+			~OpenCVNN();
+
+			PredictionResults predict(const cv::Mat& image, float conf_threshold = 0.25f, float nms_threshold = 0.45f) const;
+
+			// Run the network and return the best class of every box scoring above min_threshold, before the confidence
+			// threshold and NMS are applied.  See NN::predict_candidates().
+			PredictionResults predict_candidates(const cv::Mat& image, float min_threshold = 0.01f) const;
+
+			// Same as predict(), but for several images.  The results are returned in the same order as the images.
+			std::vector<PredictionResults> predict_batch(const std::vector<cv::Mat>& images, float conf_threshold = 0.25f, float nms_threshold = 0.45f) const;
+
+			// Same as predict_candidates(), but for several images.  Empty images have empty results.
+			std::vector<PredictionResults> predict_candidates_batch(const std::vector<cv::Mat>& images, float min_threshold = 0.01f) const;
+
+			// Get the network size from the [net] section of the .cfg file
+			cv::Size get_input_size() const { return input_size; }
+
+			// Check if the network ended up on the OpenVINO backend
+			bool is_using_openvino() const { return using_openvino; }
+
+			// Check if OpenCV was built with OpenVINO (Inference Engine) support for the CPU
+			static bool is_openvino_available();
+
+		private:
+			// Read width= and height= from the [net] section
+			static cv::Size GetNetworkSize(const std::string& cfg_filename);
+
+			// Convert the rows of a YOLO/region output [cx, cy, w, h, objectness, class scores...] to image coordinates
+			static void decode(const cv::Mat& output, const cv::Size& image_size, float min_threshold, PredictionResults& results);
+
+			// Set the name of each result to the class name and confidence
+			void set_names(PredictionResults& results) const;
+
+			mutable cv::dnn::Net net;
+			std::vector<std::string> output_layer_names;
+			std::vector<std::string> class_names;
+			cv::Size input_size;
+			bool using_openvino;
+
+			// Cached to avoid repeated allocations
+			mutable cv::Mat blob;
+			mutable std::vector<cv::Mat> outputs;
+	};
+}
@@ -0,0 +1,111 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include <gtest/gtest.h>
+#include "DarkMark.hpp"
+
+
+namespace
+{
+	/// Create an empty project directory with a single image and the given .json annotations.
+	File create_project(const std::string & json_text)
+	{
+		File dir = File::getSpecialLocation(File::SpecialLocationType::tempDirectory).getNonexistentChildFile("darkmark_test_", "", false);
+		dir.createDirectory();
+		dir.getChildFile("image.jpg").replaceWithText("not really an image");
+		dir.getChildFile("image.json").replaceWithText(json_text);
+
+		return dir;
+	}
+}
+
+
+TEST(AnnotationIndex, RoundTrip)
+{
+	File dir = create_project(R"({
+		"completely_empty": false,
+		"timestamp": 1234,
+		"mark": [ {"class_idx": 3}, {"class_idx": 3}, {"class_idx": 300} ],
+		"predictions":
+		{
+			"IoU": {"min": 0.25, "avg": 0.5, "max": 0.75},
+			"count": 4,
+			"number_of_differences": 2,
+			"predictions_without_annotations": 1,
+			"annotations_without_predictions": 1
+		}
+	})");
+	const std::string image = dir.getChildFile("image.jpg").getFullPathName().toStdString();
+
+	dm::AnnotationIndex index;
+	index.open(dir.getFullPathName().toStdString());
+	const auto entry = index.get(image);
+
+	ASSERT_FALSE(entry.parse_error);
+	ASSERT_EQ(entry.number_of_marks, 3);
+	ASSERT_EQ(entry.timestamp, 1234);
+	ASSERT_EQ(entry.histogram.size(), 2);
+	ASSERT_EQ(entry.histogram.at(3), 2);
+	ASSERT_EQ(entry.histogram.at(300), 1);	// classes beyond 255 must not be dropped
+	ASSERT_TRUE(entry.has_predictions);
+	ASSERT_FLOAT_EQ(entry.minimum_iou, 0.25f);
+	ASSERT_FLOAT_EQ(entry.average_iou, 0.5f);
+	ASSERT_FLOAT_EQ(entry.maximum_iou, 0.75f);
+	ASSERT_EQ(entry.number_of_predictions, 4);
+	ASSERT_EQ(entry.number_of_differences, 2);
+
+	index.save();
+	ASSERT_TRUE(index.index_file.existsAsFile());
+
+	// a new index loaded from disk must return exactly the same values without parsing the .json file again
+	dm::AnnotationIndex reloaded;
+	reloaded.open(dir.getFullPathName().toStdString());
+	const auto loaded = reloaded.peek(image);
+
+	ASSERT_EQ(loaded.json_mtime, entry.json_mtime);
+	ASSERT_EQ(loaded.json_size, entry.json_size);
+	ASSERT_EQ(loaded.timestamp, entry.timestamp);
+	ASSERT_EQ(loaded.number_of_marks, entry.number_of_marks);
+	ASSERT_EQ(loaded.histogram, entry.histogram);
+	ASSERT_EQ(loaded.has_predictions, entry.has_predictions);
+	ASSERT_FLOAT_EQ(loaded.average_iou, entry.average_iou);
+	ASSERT_EQ(loaded.number_of_predictions, entry.number_of_predictions);
+	ASSERT_EQ(loaded.predictions_without_annotations, entry.predictions_without_annotations);
+	ASSERT_EQ(loaded.annotations_without_predictions, entry.annotations_without_predictions);
+
+	dir.deleteRecursively();
+}
+
+
+TEST(AnnotationIndex, StaleEntry)
+{
+	File dir = create_project(R"({"mark": [ {"class_idx": 1} ]})");
+	const std::string image = dir.getChildFile("image.jpg").getFullPathName().toStdString();
+
+	dm::AnnotationIndex index;
+	index.open(dir.getFullPathName().toStdString());
+	ASSERT_EQ(index.get(image).number_of_marks, 1);
+
+	// the size of the .json file changes, so the entry must be parsed again
+	dir.getChildFile("image.json").replaceWithText(R"({"mark": [ {"class_idx": 1}, {"class_idx": 2} ]})");
+	ASSERT_EQ(index.get(image).number_of_marks, 2);
+
+	dir.deleteRecursively();
+}
+
+
+TEST(AnnotationIndex, ParseError)
+{
+	File dir = create_project("{ this is not valid json");
+	const std::string image = dir.getChildFile("image.jpg").getFullPathName().toStdString();
+
+	dm::AnnotationIndex index;
+	index.open(dir.getFullPathName().toStdString());
+	ASSERT_TRUE(index.get(image).parse_error);
+	index.save();
+
+	dm::AnnotationIndex reloaded;
+	reloaded.open(dir.getFullPathName().toStdString());
+	ASSERT_TRUE(reloaded.peek(image).parse_error);
+
+	dir.deleteRecursively();
+}
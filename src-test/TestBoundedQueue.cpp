@@ -0,0 +1,140 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include <gtest/gtest.h>
+#include "DarkMark.hpp"
+
+
+TEST(BoundedQueue, FirstInFirstOut)
+{
+	dm::BoundedQueue<int> queue(5);
+	for (int i = 0; i < 5; i ++)
+	{
+		ASSERT_TRUE(queue.push(i));
+	}
+	ASSERT_EQ(queue.size(), 5);
+
+	for (int i = 0; i < 5; i ++)
+	{
+		int value = -1;
+		ASSERT_TRUE(queue.pop(value));
+		ASSERT_EQ(value, i);
+	}
+	ASSERT_EQ(queue.size(), 0);
+}
+
+
+TEST(BoundedQueue, CloseDrainsRemainingItems)
+{
+	dm::BoundedQueue<int> queue(5);
+	queue.push(1);
+	queue.push(2);
+	queue.close();
+
+	// nothing can be added once the queue is closed...
+	ASSERT_FALSE(queue.push(3));
+
+	// ...but the items already in the queue can still be removed
+	int value = -1;
+	ASSERT_TRUE(queue.pop(value));
+	ASSERT_EQ(value, 1);
+	ASSERT_TRUE(queue.pop(value));
+	ASSERT_EQ(value, 2);
+	ASSERT_FALSE(queue.pop(value));
+	ASSERT_EQ(value, 2);
+}
+
+
+TEST(BoundedQueue, CloseWakesBlockedConsumer)
+{
+	dm::BoundedQueue<int> queue(1);
+
+	std::atomic<bool> returned(false);
+	bool result = true;
+	std::thread consumer([&]
+		{
+			int value = 0;
+			result = queue.pop(value);
+			returned = true;
+		});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_FALSE(returned);
+
+	queue.close();
+	consumer.join();
+	ASSERT_TRUE(returned);
+	ASSERT_FALSE(result);
+}
+
+
+TEST(BoundedQueue, CloseWakesBlockedProducer)
+{
+	dm::BoundedQueue<int> queue(1);
+	ASSERT_TRUE(queue.push(1));
+
+	// the queue is full, so this producer blocks until the queue is closed
+	std::atomic<bool> returned(false);
+	bool result = true;
+	std::thread producer([&]
+		{
+			result = queue.push(2);
+			returned = true;
+		});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_FALSE(returned);
+
+	queue.close();
+	producer.join();
+	ASSERT_TRUE(returned);
+	ASSERT_FALSE(result);
+	ASSERT_EQ(queue.size(), 1);
+}
+
+
+TEST(BoundedQueue, ManyProducersAndConsumers)
+{
+	const int items_per_producer = 1000;
+	dm::BoundedQueue<int> queue(3);
+
+	std::atomic<int> producers_running(4);
+	std::atomic<long> total(0);
+	std::atomic<int> count(0);
+
+	dm::VThreads threads;
+	for (int p = 0; p < 4; p ++)
+	{
+		threads.emplace_back([&]
+			{
+				for (int i = 1; i <= items_per_producer; i ++)
+				{
+					queue.push(i);
+				}
+
+				// the last producer closes the queue, same as DMContentPreAnnotate::decode()
+				if (-- producers_running == 0)
+				{
+					queue.close();
+				}
+			});
+	}
+	for (int c = 0; c < 3; c ++)
+	{
+		threads.emplace_back([&]
+			{
+				int value = 0;
+				while (queue.pop(value))
+				{
+					total += value;
+					count ++;
+				}
+			});
+	}
+	for (auto & t : threads)
+	{
+		t.join();
+	}
+
+	ASSERT_EQ(count.load(), 4 * items_per_producer);
+	ASSERT_EQ(total.load(), 4L * items_per_producer * (items_per_producer + 1) / 2);
+}
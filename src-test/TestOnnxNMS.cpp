@@ -0,0 +1,151 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include <gtest/gtest.h>
+#include "DarkMark.hpp"
+
+
+namespace
+{
+	OnnxHelp::PredictionResult make_result(const cv::Rect & rect, const float probability, const int class_idx)
+	{
+		OnnxHelp::PredictionResult result;
+		result.rect			= rect;
+		result.probability	= probability;
+		result.class_idx	= class_idx;
+
+		return result;
+	}
+}
+
+
+TEST(OnnxNMS, SameClassIsSuppressed)
+{
+	const OnnxHelp::PredictionResults candidates =
+	{
+		make_result(cv::Rect(10, 10, 100, 100), 0.6f, 0),
+		make_result(cv::Rect(12, 12, 100, 100), 0.9f, 0),	// IoU with the first box is ~0.92
+		make_result(cv::Rect(500, 500, 50, 50), 0.7f, 0),	// does not overlap anything
+	};
+
+	OnnxHelp::NMS nms;
+	const auto & kept = nms.run(candidates, 0.3f, 0.45f);
+
+	ASSERT_EQ(kept.size(), 2);
+	ASSERT_EQ(kept[0], 1);	// highest score first
+	ASSERT_EQ(kept[1], 2);
+}
+
+
+TEST(OnnxNMS, ClassAware)
+{
+	const OnnxHelp::PredictionResults candidates =
+	{
+		make_result(cv::Rect(10, 10, 100, 100), 0.9f, 0),
+		make_result(cv::Rect(10, 10, 100, 100), 0.8f, 1),
+	};
+
+	// identical boxes of different classes are both kept by default...
+	OnnxHelp::NMS class_aware;
+	ASSERT_EQ(class_aware.run(candidates, 0.3f, 0.45f).size(), 2);
+
+	// ...but suppress each other when NMS is not class-aware
+	OnnxHelp::NMS class_agnostic(false);
+	const auto & kept = class_agnostic.run(candidates, 0.3f, 0.45f);
+	ASSERT_EQ(kept.size(), 1);
+	ASSERT_EQ(kept[0], 0);
+}
+
+
+TEST(OnnxNMS, ConfidenceThreshold)
+{
+	const OnnxHelp::PredictionResults candidates =
+	{
+		make_result(cv::Rect(0, 0, 10, 10), 0.30f, 0),	// same as cv::dnn::NMSBoxes(), the threshold itself is excluded
+		make_result(cv::Rect(100, 0, 10, 10), 0.31f, 0),
+		make_result(cv::Rect(200, 0, 10, 10), 0.10f, 0),
+	};
+
+	OnnxHelp::NMS nms;
+	const auto & kept = nms.run(candidates, 0.3f, 0.45f);
+
+	ASSERT_EQ(kept.size(), 1);
+	ASSERT_EQ(kept[0], 1);
+}
+
+
+TEST(OnnxNMS, TopK)
+{
+	OnnxHelp::PredictionResults candidates;
+	for (int idx = 0; idx < 10; idx ++)
+	{
+		// none of these boxes overlap, so only top_k limits how many are kept
+		candidates.push_back(make_result(cv::Rect(idx * 20, 0, 10, 10), 0.5f + idx * 0.01f, idx % 3));
+	}
+
+	OnnxHelp::NMS nms(true, 4);
+	const auto & kept = nms.run(candidates, 0.3f, 0.45f);
+
+	ASSERT_EQ(kept.size(), 4);
+	ASSERT_EQ(kept[0], 9);
+	ASSERT_EQ(kept[1], 8);
+	ASSERT_EQ(kept[2], 7);
+	ASSERT_EQ(kept[3], 6);
+
+	// re-using the same instance must not leak results from the previous call
+	nms.top_k = 0;
+	ASSERT_EQ(nms.run(candidates, 0.3f, 0.45f).size(), 10);
+	ASSERT_TRUE(nms.run({}, 0.3f, 0.45f).empty());
+}
+
+
+TEST(OnnxNMS, SameAsOpenCV)
+{
+	// when NMS is not class-aware, the results must be identical to cv::dnn::NMSBoxes()
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> position(0, 300);
+	std::uniform_int_distribution<int> size(5, 120);
+	std::uniform_real_distribution<float> probability(0.0f, 1.0f);
+
+	for (int attempt = 0; attempt < 20; attempt ++)
+	{
+		OnnxHelp::PredictionResults candidates;
+		std::vector<cv::Rect> boxes;
+		std::vector<float> scores;
+		for (int idx = 0; idx < 200; idx ++)
+		{
+			const cv::Rect r(position(rng), position(rng), size(rng), size(rng));
+			const float p = probability(rng);
+			candidates.push_back(make_result(r, p, idx % 5));
+			boxes.push_back(r);
+			scores.push_back(p);
+		}
+
+		std::vector<int> expected;
+		cv::dnn::NMSBoxes(boxes, scores, 0.25f, 0.45f, expected);
+
+		OnnxHelp::NMS nms(false, 0);
+		const auto & kept = nms.run(candidates, 0.25f, 0.45f);
+
+		ASSERT_EQ(kept.size(), expected.size());
+		for (size_t idx = 0; idx < kept.size(); idx ++)
+		{
+			ASSERT_EQ(kept[idx], static_cast<size_t>(expected[idx]));
+		}
+	}
+}
+
+
+TEST(OnnxNMS, FilterTopK)
+{
+	OnnxHelp::PredictionResults candidates;
+	for (int idx = 0; idx < 1500; idx ++)
+	{
+		// none of these boxes overlap, so only top_k limits how many are kept
+		candidates.push_back(make_result(cv::Rect((idx % 50) * 20, (idx / 50) * 20, 10, 10), 0.5f, 0));
+	}
+
+	// the default limit is for the final results, while the tile seams are merged without any limit
+	ASSERT_EQ(OnnxHelp::NN::filter(candidates, 0.01f, 0.45f).size(), 1000);
+	ASSERT_EQ(OnnxHelp::NN::filter(candidates, 0.01f, 0.45f, 0).size(), 1500);
+	ASSERT_EQ(OnnxHelp::NN::filter(candidates, 0.01f, 0.45f).size(), 1000);
+}
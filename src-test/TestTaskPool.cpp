@@ -0,0 +1,135 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include <gtest/gtest.h>
+#include "DarkMark.hpp"
+
+
+TEST(TaskPool, EveryTaskRunsOnce)
+{
+	const size_t number_of_tasks = 1000;
+	std::vector<std::atomic<int>> counters(number_of_tasks);
+	for (auto & c : counters)
+	{
+		c = 0;
+	}
+
+	size_t last_done	= 0;
+	size_t last_total	= 0;
+
+	dm::TaskPool pool(4);
+	pool.run(number_of_tasks,
+		[&](const size_t task_idx)
+		{
+			counters[task_idx] ++;
+		},
+		[&](const size_t tasks_done, const size_t tasks_total)
+		{
+			last_done	= tasks_done;
+			last_total	= tasks_total;
+		});
+
+	for (size_t idx = 0; idx < number_of_tasks; idx ++)
+	{
+		ASSERT_EQ(counters[idx].load(), 1) << "task #" << idx;
+	}
+	ASSERT_EQ(last_done, number_of_tasks);
+	ASSERT_EQ(last_total, number_of_tasks);
+
+	// zero tasks is not an error
+	pool.run(0, [](const size_t) { FAIL(); });
+}
+
+
+TEST(TaskPool, SlowTasksAreStolen)
+{
+	// Worker #0 starts with tasks 0-9 and worker #1 with tasks 10-19.  Task #0 is very slow, so worker #1 should run out
+	// of work and steal the tasks which were initially given to worker #0.
+	const size_t number_of_tasks = 20;
+	std::vector<std::thread::id> thread_ids(number_of_tasks);
+
+	dm::TaskPool pool(2);
+	pool.run(number_of_tasks,
+		[&](const size_t task_idx)
+		{
+			if (task_idx == 0)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			}
+			thread_ids[task_idx] = std::this_thread::get_id();
+		});
+
+	size_t stolen = 0;
+	for (size_t idx = 1; idx < number_of_tasks / 2; idx ++)
+	{
+		if (thread_ids[idx] != thread_ids[0])
+		{
+			stolen ++;
+		}
+	}
+	ASSERT_GT(stolen, 0);
+}
+
+
+TEST(TaskPool, ExceptionIsRethrown)
+{
+	std::atomic<size_t> tasks_started(0);
+
+	dm::TaskPool pool(4);
+	ASSERT_THROW(
+		pool.run(10000,
+			[&](const size_t task_idx)
+			{
+				tasks_started ++;
+				if (task_idx == 5)
+				{
+					throw std::runtime_error("task #5 failed");
+				}
+			}),
+		std::runtime_error);
+
+	// once a task throws, the remaining tasks are skipped
+	ASSERT_LT(tasks_started.load(), 10000);
+
+	// the pool can be re-used after an exception
+	std::atomic<size_t> tasks_done(0);
+	pool.run(100, [&](const size_t) { tasks_done ++; });
+	ASSERT_EQ(tasks_done.load(), 100);
+}
+
+
+TEST(TaskPool, RandomEngineIsDeterministic)
+{
+	auto e1 = dm::TaskPool::random_engine(7);
+	auto e2 = dm::TaskPool::random_engine(7);
+	auto e3 = dm::TaskPool::random_engine(8);
+
+	bool different = false;
+	for (size_t idx = 0; idx < 100; idx ++)
+	{
+		const auto v1 = e1();
+		const auto v2 = e2();
+		const auto v3 = e3();
+
+		ASSERT_EQ(v1, v2);
+		if (v1 != v3)
+		{
+			different = true;
+		}
+	}
+	ASSERT_TRUE(different);
+
+	// the results must not depend on the number of workers or which worker ran the task
+	auto first_values = [](const size_t workers)
+	{
+		std::vector<uint64_t> values(50);
+		dm::TaskPool pool(workers);
+		pool.run(values.size(),
+			[&](const size_t task_idx)
+			{
+				auto engine = dm::TaskPool::random_engine(task_idx);
+				values[task_idx] = engine();
+			});
+		return values;
+	};
+	ASSERT_EQ(first_values(1), first_values(5));
+}
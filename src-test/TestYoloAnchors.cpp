@@ -0,0 +1,112 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include <gtest/gtest.h>
+#include "DarkMark.hpp"
+#include "yolo_anchors.hpp"
+
+
+namespace
+{
+	/// Create boxes which are already at the network dimensions, all of them of class #0.
+	AnchorBoxes create_boxes(const std::vector<std::pair<float, float>> & sizes)
+	{
+		AnchorBoxes boxes;
+		for (const auto & [w, h] : sizes)
+		{
+			boxes.widths	.push_back(w);
+			boxes.heights	.push_back(h);
+		}
+		boxes.counter_per_class = {static_cast<int>(sizes.size()), 0};
+
+		return boxes;
+	}
+}
+
+
+TEST(YoloAnchors, LoadAnchorBoxes)
+{
+	File dir = File::getSpecialLocation(File::SpecialLocationType::tempDirectory).getNonexistentChildFile("darkmark_test_", "", false);
+	dir.createDirectory();
+
+	dir.getChildFile("a.txt").replaceWithText(
+		"0 0.5 0.5 0.25 0.5\n"
+		"1 0.5 0.5 0.1 0.1\n");
+	dir.getChildFile("b.txt").replaceWithText(
+		"1 0.2 0.2 0.5 0.25\n"
+		"2 0.5 0.5 0.0 0.1\n"		// counted, but an annotation without a width cannot be used for anchors
+		"7 0.5 0.5 0.5 0.5\n");		// class is out of range, so the size is used but it isn't counted
+
+	// "c.jpg" does not have any annotations, and the blank line must be ignored
+	const std::string train_filename = dir.getChildFile("train.txt").getFullPathName().toStdString();
+	dir.getChildFile("train.txt").replaceWithText(
+		dir.getChildFile("a.jpg").getFullPathName() + "\n" +
+		dir.getChildFile("b.png").getFullPathName() + "\n" +
+		"\n" +
+		dir.getChildFile("c.jpg").getFullPathName() + "\n");
+
+	const AnchorBoxes boxes = load_anchor_boxes(train_filename, 416, 320, 3);
+
+	// boxes are scaled to the network dimensions, and must stay in the order of the images in train.txt
+	ASSERT_EQ(boxes.widths.size(), 4);
+	ASSERT_EQ(boxes.heights.size(), 4);
+	ASSERT_FLOAT_EQ(boxes.widths[0], 104.0f);
+	ASSERT_FLOAT_EQ(boxes.heights[0], 160.0f);
+	ASSERT_FLOAT_EQ(boxes.widths[1], 41.6f);
+	ASSERT_FLOAT_EQ(boxes.heights[1], 32.0f);
+	ASSERT_FLOAT_EQ(boxes.widths[2], 208.0f);
+	ASSERT_FLOAT_EQ(boxes.heights[2], 80.0f);
+	ASSERT_FLOAT_EQ(boxes.widths[3], 208.0f);
+	ASSERT_FLOAT_EQ(boxes.heights[3], 160.0f);
+
+	ASSERT_EQ(boxes.counter_per_class.size(), 3);
+	ASSERT_EQ(boxes.counter_per_class[0], 1);
+	ASSERT_EQ(boxes.counter_per_class[1], 2);
+	ASSERT_EQ(boxes.counter_per_class[2], 1);
+
+	// the network dimensions must be multiples of 32
+	ASSERT_THROW(load_anchor_boxes(train_filename, 400, 320, 3), std::invalid_argument);
+
+	dir.deleteRecursively();
+}
+
+
+TEST(YoloAnchors, CalcAnchors)
+{
+	// three groups of boxes which are very far apart, so k-means must find the average size of each group
+	const AnchorBoxes boxes = create_boxes(
+	{
+		{100.0f, 190.0f}, {9.0f, 9.0f}, {45.0f, 30.0f},
+		{100.0f, 210.0f}, {11.0f, 11.0f}, {55.0f, 30.0f}
+	});
+
+	std::string anchors;
+	std::string counters;
+	float avg_iou = 0.0f;
+	size_t last_done = 0;
+	calc_anchors(boxes, 3, 10, 60.0, anchors, counters, avg_iou,
+		[&](const size_t attempts_done, const size_t attempts)
+		{
+			last_done = attempts_done;
+		});
+
+	// anchors are sorted by area
+	ASSERT_EQ(anchors, "10, 10, 50, 30, 100, 200");
+	ASSERT_EQ(counters, "6, 0");
+	ASSERT_EQ(last_done, 10);
+
+	// (81/100 + 100/121 + 45/50 + 50/55 + 190/200 + 200/210) / 6
+	ASSERT_NEAR(avg_iou, 89.132f, 0.01f);
+}
+
+
+TEST(YoloAnchors, CalcAnchorsInvalid)
+{
+	const AnchorBoxes boxes = create_boxes({{10.0f, 10.0f}, {20.0f, 20.0f}});
+
+	std::string anchors;
+	std::string counters;
+	float avg_iou = 0.0f;
+	ASSERT_THROW(calc_anchors(boxes, 1, 10, 60.0, anchors, counters, avg_iou), std::invalid_argument);
+	ASSERT_THROW(calc_anchors(boxes, 3, 10, 60.0, anchors, counters, avg_iou), std::invalid_argument);
+	ASSERT_TRUE(anchors.empty());
+}
@@ -0,0 +1,332 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace
+{
+	/// Magic number at the start of the index file:  "DMAI" (DarkMark Annotation Index).
+	const int index_magic = 0x49414d44;
+
+	/// Increment this every time the layout of an entry changes.  Files with a different version are ignored.
+	const int index_version = 3;
+}
+
+
+dm::AnnotationIndex::Entry::Entry() :
+	json_mtime(0),
+	json_size(0),
+	timestamp(0),
+	number_of_marks(0),
+	completely_empty(false),
+	has_predictions(false),
+	parse_error(false),
+	minimum_iou(0.0f),
+	average_iou(0.0f),
+	maximum_iou(0.0f),
+	number_of_predictions(0),
+	number_of_differences(0),
+	predictions_without_annotations(0),
+	annotations_without_predictions(0)
+{
+	return;
+}
+
+
+dm::AnnotationIndex::AnnotationIndex() :
+	dirty(false)
+{
+	return;
+}
+
+
+dm::AnnotationIndex::~AnnotationIndex()
+{
+	return;
+}
+
+
+dm::AnnotationIndex & dm::AnnotationIndex::open(const std::string & project_directory)
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+
+	entries.clear();
+	dirty = false;
+
+	index_file = File(project_directory).getChildFile("darkmark_image_cache").getChildFile("annotation_index.bin");
+	if (index_file.existsAsFile() == false)
+	{
+		Log("annotation index does not exist: " + index_file.getFullPathName().toStdString());
+		return *this;
+	}
+
+	MemoryMappedFile mmf(index_file, MemoryMappedFile::AccessMode::readOnly);
+	if (mmf.getData() == nullptr or mmf.getSize() < 16)
+	{
+		Log("failed to map the annotation index " + index_file.getFullPathName().toStdString());
+		return *this;
+	}
+
+	MemoryInputStream is(mmf.getData(), mmf.getSize(), false);
+	const int magic		= is.readInt();
+	const int version	= is.readInt();
+	const int64 count	= is.readInt64();
+
+	if (magic != index_magic or version != index_version or count < 0)
+	{
+		Log("ignoring incompatible annotation index " + index_file.getFullPathName().toStdString());
+		return *this;
+	}
+
+	for (int64 idx = 0; idx < count; idx ++)
+	{
+		if (is.isExhausted())
+		{
+			Log("annotation index is truncated after " + std::to_string(idx) + " entries");
+			entries.clear();
+			break;
+		}
+
+		const std::string filename = is.readString().toStdString();
+
+		Entry entry;
+		entry.json_mtime						= is.readInt64();
+		entry.json_size							= is.readInt64();
+		entry.timestamp							= is.readInt64();
+		entry.number_of_marks					= is.readInt64();
+		const int flags							= is.readByte();
+		entry.completely_empty					= (flags & 0x01);
+		entry.has_predictions					= (flags & 0x02);
+		entry.parse_error						= (flags & 0x04);
+		const int64 histogram_size				= is.readInt64();
+		for (int64 i = 0; i < histogram_size and is.isExhausted() == false; i ++)
+		{
+			const size_t class_idx	= is.readInt64();
+			const size_t count		= is.readInt64();
+			entry.histogram[class_idx] = count;
+		}
+		entry.minimum_iou						= is.readFloat();
+		entry.average_iou						= is.readFloat();
+		entry.maximum_iou						= is.readFloat();
+		entry.number_of_predictions				= is.readInt64();
+		entry.number_of_differences				= is.readInt64();
+		entry.predictions_without_annotations	= is.readInt64();
+		entry.annotations_without_predictions	= is.readInt64();
+
+		entries[filename] = entry;
+	}
+
+	Log("annotation index loaded " + std::to_string(entries.size()) + " entries from " + index_file.getFullPathName().toStdString());
+
+	return *this;
+}
+
+
+dm::AnnotationIndex & dm::AnnotationIndex::save()
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+
+	if (dirty == false or index_file == File())
+	{
+		return *this;
+	}
+
+	MemoryOutputStream os;
+	os.writeInt(index_magic);
+	os.writeInt(index_version);
+	os.writeInt64(entries.size());
+
+	for (const auto & [filename, entry] : entries)
+	{
+		os.writeString(filename);
+		os.writeInt64(entry.json_mtime);
+		os.writeInt64(entry.json_size);
+		os.writeInt64(entry.timestamp);
+		os.writeInt64(entry.number_of_marks);
+		os.writeByte(
+			(entry.completely_empty	? 0x01 : 0x00) |
+			(entry.has_predictions	? 0x02 : 0x00) |
+			(entry.parse_error		? 0x04 : 0x00));
+		os.writeInt64(entry.histogram.size());
+		for (const auto & [class_idx, count] : entry.histogram)
+		{
+			os.writeInt64(class_idx);
+			os.writeInt64(count);
+		}
+		os.writeFloat(entry.minimum_iou);
+		os.writeFloat(entry.average_iou);
+		os.writeFloat(entry.maximum_iou);
+		os.writeInt64(entry.number_of_predictions);
+		os.writeInt64(entry.number_of_differences);
+		os.writeInt64(entry.predictions_without_annotations);
+		os.writeInt64(entry.annotations_without_predictions);
+	}
+
+	// write to a temporary file first so an interrupted save never leaves behind a corrupt index
+	index_file.getParentDirectory().createDirectory();
+	TemporaryFile tmp(index_file);
+	if (tmp.getFile().replaceWithData(os.getData(), os.getDataSize()) and tmp.overwriteTargetFileWithTemporary())
+	{
+		Log("annotation index saved " + std::to_string(entries.size()) + " entries to " + index_file.getFullPathName().toStdString());
+		dirty = false;
+	}
+	else
+	{
+		Log("failed to save the annotation index " + index_file.getFullPathName().toStdString());
+	}
+
+	return *this;
+}
+
+
+dm::AnnotationIndex::Entry dm::AnnotationIndex::get(const std::string & image_filename)
+{
+	const File json_file	= File(image_filename).withFileExtension(".json");
+	const int64_t mtime		= json_file.getLastModificationTime().toMilliseconds();
+	const int64_t size		= json_file.getSize();
+
+	{
+		std::lock_guard<std::mutex> lock(index_mutex);
+
+		auto iter = entries.find(image_filename);
+		if (iter != entries.end() and iter->second.json_mtime == mtime and iter->second.json_size == size)
+		{
+			return iter->second;
+		}
+	}
+
+	// if we get here then the entry is either missing or stale, so the .json file needs to be parsed
+	// (this is done without holding the lock so other threads can continue to use the index)
+
+	const Entry entry = parse(json_file, mtime, size);
+
+	std::lock_guard<std::mutex> lock(index_mutex);
+	entries[image_filename] = entry;
+	dirty = true;
+
+	return entry;
+}
+
+
+dm::AnnotationIndex::Entry dm::AnnotationIndex::peek(const std::string & image_filename)
+{
+	{
+		std::lock_guard<std::mutex> lock(index_mutex);
+
+		auto iter = entries.find(image_filename);
+		if (iter != entries.end())
+		{
+			return iter->second;
+		}
+	}
+
+	return get(image_filename);
+}
+
+
+dm::AnnotationIndex::Entry dm::AnnotationIndex::update(const std::string & image_filename, const VMarks & marks, const bool completely_empty, const std::time_t timestamp)
+{
+	const File json_file = File(image_filename).withFileExtension(".json");
+
+	Entry entry;
+	entry.json_mtime		= json_file.getLastModificationTime().toMilliseconds();
+	entry.json_size			= json_file.getSize();
+	entry.timestamp			= timestamp;
+	entry.completely_empty	= completely_empty;
+
+	for (const auto & m : marks)
+	{
+		if (m.is_prediction)
+		{
+			continue;
+		}
+
+		entry.number_of_marks ++;
+		entry.histogram[m.class_idx] ++;
+	}
+
+	std::lock_guard<std::mutex> lock(index_mutex);
+	entries[image_filename] = entry;
+	dirty = true;
+
+	return entry;
+}
+
+
+dm::AnnotationIndex & dm::AnnotationIndex::remove(const std::string & image_filename)
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+
+	if (entries.erase(image_filename))
+	{
+		dirty = true;
+	}
+
+	return *this;
+}
+
+
+dm::AnnotationIndex & dm::AnnotationIndex::clear()
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+
+	entries.clear();
+	dirty = true;
+
+	return *this;
+}
+
+
+dm::AnnotationIndex::Entry dm::AnnotationIndex::parse(const File & json_file, const int64_t mtime, const int64_t size)
+{
+	Entry entry;
+	entry.json_mtime	= mtime;
+	entry.json_size		= size;
+
+	if (mtime == 0 or json_file.existsAsFile() == false)
+	{
+		// no .json file, meaning this image has not been annotated
+		return entry;
+	}
+
+	try
+	{
+		json root = json::parse(json_file.loadFileAsString().toStdString());
+
+		entry.number_of_marks = root["mark"].size();
+		for (const auto & m : root["mark"])
+		{
+			const size_t class_idx = m["class_idx"];
+			entry.histogram[class_idx] ++;
+		}
+
+		entry.completely_empty	= root.value("completely_empty", false);
+		entry.timestamp			= root.value("timestamp", static_cast<std::time_t>(0));
+
+		if (root.contains("predictions"))
+		{
+			auto & predictions = root["predictions"];
+			entry.has_predictions					= true;
+			entry.minimum_iou						= predictions["IoU"]["min"];
+			entry.average_iou						= predictions["IoU"]["avg"];
+			entry.maximum_iou						= predictions["IoU"]["max"];
+			entry.number_of_predictions				= predictions["count"];
+			entry.number_of_differences				= predictions["number_of_differences"];
+			entry.predictions_without_annotations	= predictions["predictions_without_annotations"];
+			entry.annotations_without_predictions	= predictions["annotations_without_predictions"];
+		}
+	}
+	catch (const std::exception & e)
+	{
+		Log("Error parsing " + json_file.getFullPathName().toStdString() + ": " + e.what());
+		entry = Entry();
+		entry.json_mtime	= mtime;
+		entry.json_size		= size;
+		entry.parse_error	= true;
+	}
+
+	return entry;
+}
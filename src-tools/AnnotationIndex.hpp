@@ -0,0 +1,95 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Persistent per-project index of the information stored in every .json annotation file.  Sorting the images
+	 * (@see @ref ESort) used to require parsing every single .json file, which takes minutes on large projects.  The
+	 * index keeps the few values needed for sorting in memory, and saves them to a binary sidecar file so the next time
+	 * the project is opened the .json files don't need to be parsed again.
+	 *
+	 * Each entry is keyed by the image filename, and is considered valid only as long as the modification time and the
+	 * size of the corresponding .json file have not changed.  Stale entries are transparently rebuilt by @ref get().
+	 *
+	 * The same entries are also used to draw the @ref ScrollField, so opening a project only needs to parse the .json
+	 * files which were modified since the previous session.
+	 *
+	 * This class is thread-safe.
+	 */
+	class AnnotationIndex final
+	{
+		public:
+
+			/// The information cached for a single image.
+			struct Entry
+			{
+				int64_t				json_mtime;		///< Modification time of the .json file in milliseconds, or zero if the file does not exist.
+				int64_t				json_size;		///< Size of the .json file in bytes.
+				int64_t				timestamp;		///< The @p "timestamp" value stored in the .json file, or zero.
+				size_t				number_of_marks;
+				bool				completely_empty;
+				bool				has_predictions;	///< Whether the .json file contains the IoU @p "predictions" section.
+				bool				parse_error;		///< Set when the .json file exists but could not be parsed.
+				MIdxSize			histogram;			///< Number of marks for each class which appears in the image.  There is no limit on the number of classes.
+				float				minimum_iou;
+				float				average_iou;
+				float				maximum_iou;
+				size_t				number_of_predictions;
+				size_t				number_of_differences;
+				size_t				predictions_without_annotations;
+				size_t				annotations_without_predictions;
+
+				Entry();
+			};
+
+			AnnotationIndex();
+
+			~AnnotationIndex();
+
+			/** Load the index associated with the given project directory.  If the index file does not exist or cannot be
+			 * read then the index starts out empty, and will be populated as images are accessed.
+			 */
+			AnnotationIndex & open(const std::string & project_directory);
+
+			/// Write the index back to disk, but only if something has changed since it was loaded.
+			AnnotationIndex & save();
+
+			/** Get the entry for the given image.  If the .json file has been modified since the entry was created (or if
+			 * the image is not yet in the index) then the .json file is parsed and the index is updated.
+			 */
+			Entry get(const std::string & image_filename);
+
+			/** Similar to @ref get(), but if the image is already in the index then the entry is returned without checking
+			 * whether the .json file has been modified.  This avoids touching the disk when many entries are needed at once.
+			 */
+			Entry peek(const std::string & image_filename);
+
+			/** Update the entry for an image using the marks which were just saved to the .json file.  This way the .json
+			 * file does not need to be read back and parsed again.  Predictions within @p marks are ignored.
+			 * @returns the new entry, which can be given directly to @ref ScrollField::update_index().
+			 */
+			Entry update(const std::string & image_filename, const VMarks & marks, const bool completely_empty, const std::time_t timestamp);
+
+			/// Forget the entry for the given image, such as when the image has been deleted.
+			AnnotationIndex & remove(const std::string & image_filename);
+
+			/// Forget all entries.
+			AnnotationIndex & clear();
+
+			/// The binary file where the index is stored.  @see @ref open()
+			File index_file;
+
+		private:
+
+			/// Parse the .json file associated with an image.
+			Entry parse(const File & json_file, const int64_t mtime, const int64_t size);
+
+			std::mutex index_mutex;
+			std::map<std::string, Entry> entries;
+			bool dirty;
+	};
+}
@@ -6,7 +6,7 @@
 
 Image dm::DarkMarkLogo()
 {
-	return ImageCache::getFromMemory(swirl_300x300_green_jpg, sizeof(swirl_300x300_green_jpg));
+	return juce::ImageCache::getFromMemory(swirl_300x300_green_jpg, sizeof(swirl_300x300_green_jpg));
 }
 
 
@@ -17,20 +17,37 @@ Image dm::convert_opencv_mat_to_juce_image(const cv::Mat & mat)
 		return {};
 	}
 
-	const int width  = mat.cols;
-	const int height = mat.rows;
-
 	// Image::RGB is usually 32-bit (0xXXRRGGBB) but ignores the alpha channel during rendering
 	// skip zero init because it will overwritten
-	Image image(Image::RGB, width, height, false);
+	Image image(Image::RGB, mat.cols, mat.rows, false);
+
+	copy_opencv_mat_to_juce_image(mat, image, cv::Rect(0, 0, mat.cols, mat.rows));
+
+	return image;
+}
 
-	// lock the underlying pixel data for writing
-	Image::BitmapData dest(image, Image::BitmapData::writeOnly);
+
+void dm::copy_opencv_mat_to_juce_image(const cv::Mat & mat, Image & image, const cv::Rect & r)
+{
+	if (mat.empty() or r.area() <= 0)
+	{
+		return;
+	}
+
+	if (image.getWidth() != mat.cols or image.getHeight() != mat.rows)
+	{
+		throw std::logic_error("cv::Mat and juce::Image have different dimensions");
+	}
+
+	// lock the underlying pixel data for writing (only the rectangle we need)
+	Image::BitmapData dest(image, r.x, r.y, r.width, r.height, Image::BitmapData::writeOnly);
 
 	// wrap JUCE memory in an OpenCV Mat header
 	const int destType = (dest.pixelStride == 4) ? CV_8UC4 : CV_8UC3;
 
-	cv::Mat juceWrapper(height, width, destType, dest.getLinePointer(0), dest.lineStride);
+	cv::Mat juceWrapper(r.height, r.width, destType, dest.getLinePointer(0), dest.lineStride);
+
+	const cv::Mat src = mat(r);
 
 	// perform conversion directly from Source to Destination
 	// OpenCV handles the channel shuffling and padding logic efficiently
@@ -38,29 +55,29 @@ Image dm::convert_opencv_mat_to_juce_image(const cv::Mat & mat)
 	{
 		// I suspect 4-channel images is what gets used by default in MacOS?  To be confirmed...
 
-		switch (mat.channels())
+		switch (src.channels())
 		{
 			case 3:
 			{
 				// most common case: BGR -> BGRA (JUCE RGB is usually stored as BGRA on LE)
-				cv::cvtColor(mat, juceWrapper, cv::COLOR_BGR2BGRA);
+				cv::cvtColor(src, juceWrapper, cv::COLOR_BGR2BGRA);
 				break;
 			}
 			case 4:
 			{
 				// exact match: fast memory copy (may handle stride differences automatically)
-				mat.copyTo(juceWrapper);
+				src.copyTo(juceWrapper);
 				break;
 			}
 			case 1:
 			{
 				// Grayscale -> BGRA
-				cv::cvtColor(mat, juceWrapper, cv::COLOR_GRAY2BGRA);
+				cv::cvtColor(src, juceWrapper, cv::COLOR_GRAY2BGRA);
 				break;
 			}
 			default:
 			{
-				throw std::logic_error("cv::Mat has an unexpected number of channels (" + std::to_string(mat.channels()) + ")");
+				throw std::logic_error("cv::Mat has an unexpected number of channels (" + std::to_string(src.channels()) + ")");
 			}
 		}
 	}
@@ -68,38 +85,38 @@ Image dm::convert_opencv_mat_to_juce_image(const cv::Mat & mat)
 	{
 		// On Linux, 3-channel images is the default.
 
-		if (mat.channels() == 3)
+		if (src.channels() == 3)
 		{
 			// exact match: fast memory copy (may handle stride differences automatically)
-			mat.copyTo(juceWrapper);
+			src.copyTo(juceWrapper);
 		}
-		else if (mat.channels() == 1)
+		else if (src.channels() == 1)
 		{
-			cv::cvtColor(mat, juceWrapper, cv::COLOR_GRAY2BGR);
+			cv::cvtColor(src, juceWrapper, cv::COLOR_GRAY2BGR);
 		}
 		else
 		{
-			throw std::logic_error("cv::Mat has an unexpected number of channels (" + std::to_string(mat.channels()) + ")");
+			throw std::logic_error("cv::Mat has an unexpected number of channels (" + std::to_string(src.channels()) + ")");
 		}
 	}
 
-	return image;
+	return;
 }
 
 
 Image dm::AboutLogoWhiteBackground()
 {
-	return ImageCache::getFromMemory(ccr_darkmark_logo_white_background_png, sizeof(ccr_darkmark_logo_white_background_png));
+	return juce::ImageCache::getFromMemory(ccr_darkmark_logo_white_background_png, sizeof(ccr_darkmark_logo_white_background_png));
 }
 
 
 Image dm::AboutLogoRedSwirl()
 {
-	return ImageCache::getFromMemory(ccr_darkmark_logo_red_swirl_png, sizeof(ccr_darkmark_logo_red_swirl_png));
+	return juce::ImageCache::getFromMemory(ccr_darkmark_logo_red_swirl_png, sizeof(ccr_darkmark_logo_red_swirl_png));
 }
 
 
 Image dm::AboutLogoDarknet()
 {
-	return ImageCache::getFromMemory(ccr_darkmark_logo_darknet_png, sizeof(ccr_darkmark_logo_darknet_png));
+	return juce::ImageCache::getFromMemory(ccr_darkmark_logo_darknet_png, sizeof(ccr_darkmark_logo_darknet_png));
 }
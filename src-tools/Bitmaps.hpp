@@ -11,6 +11,9 @@ namespace dm
 
 	Image convert_opencv_mat_to_juce_image(const cv::Mat & mat);
 
+	/// Copy only the given rectangle from @p mat into @p image, which must already be the same size as @p mat.
+	void copy_opencv_mat_to_juce_image(const cv::Mat & mat, Image & image, const cv::Rect & r);
+
 	Image AboutLogoWhiteBackground();
 	Image AboutLogoRedSwirl();
 	Image AboutLogoDarknet();
@@ -0,0 +1,93 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Queue used to pass work from one thread to the next.  The queue holds at most @p limit items, so a producer which
+	 * is faster than its consumer is blocked instead of using an unbounded amount of memory.  Once the producers have
+	 * finished, call @ref close() so the consumers know to stop once the queue is empty.
+	 *
+	 * This class is thread-safe.
+	 */
+	template <typename T>
+	class BoundedQueue final
+	{
+		public:
+
+			BoundedQueue(const size_t limit) :
+				limit(std::max(size_t(1), limit)),
+				closed(false)
+			{
+				return;
+			}
+
+			/// Add an item, blocking while the queue is full.  Returns @p false if the queue has been closed.
+			bool push(T item)
+			{
+				{
+					std::unique_lock<std::mutex> lock(queue_mutex);
+					not_full.wait(lock, [&]{ return closed or items.size() < limit; });
+					if (closed)
+					{
+						return false;
+					}
+					items.push_back(std::move(item));
+				}
+				not_empty.notify_one();
+
+				return true;
+			}
+
+			/// Remove the oldest item, blocking while the queue is empty.  Returns @p false once the queue is closed and empty.
+			bool pop(T & item)
+			{
+				{
+					std::unique_lock<std::mutex> lock(queue_mutex);
+					not_empty.wait(lock, [&]{ return closed or items.empty() == false; });
+					if (items.empty())
+					{
+						return false;
+					}
+					item = std::move(items.front());
+					items.pop_front();
+				}
+				not_full.notify_one();
+
+				return true;
+			}
+
+			/// No more items will be added.  Items already in the queue can still be removed with @ref pop().
+			BoundedQueue & close()
+			{
+				{
+					std::lock_guard<std::mutex> lock(queue_mutex);
+					closed = true;
+				}
+				not_empty.notify_all();
+				not_full.notify_all();
+
+				return *this;
+			}
+
+			/// The number of items waiting in the queue.
+			size_t size() const
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex);
+
+				return items.size();
+			}
+
+		private:
+
+			const size_t limit;
+			mutable std::mutex queue_mutex;
+			std::condition_variable not_empty;
+			std::condition_variable not_full;
+			std::deque<T> items;
+			bool closed;
+	};
+}
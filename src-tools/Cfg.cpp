@@ -66,7 +66,22 @@ dm::Cfg & dm::Cfg::first_time_initialization(void)
 	insert_if_not_exist("darknet_nms_threshold"			, 45												); // https://www.ccoderun.ca/DarkHelp/api/classDarkHelp.html#ac533cda5d4cbba691deb4df5d89da318
 	insert_if_not_exist("onnx_threshold"				, 30												); // ONNX confidence threshold (0-100)
 	insert_if_not_exist("onnx_nms_threshold"			, 45												); // ONNX NMS threshold (0-100)
+	insert_if_not_exist("onnx_batch_size"				, 8													); // images per call when the ONNX model has a dynamic batch size
+	insert_if_not_exist("inference_replicas"			, 2													); // copies of the neural network used by bulk operations such as IoU review (0 = disabled)
+	insert_if_not_exist("darkhelp_inference_replicas"	, 0													); // same as inference_replicas, but for Darknet models run by DarkHelp
+	insert_if_not_exist("inference_megabytes_in_flight"	, 512												); // decoded images waiting on the neural network during bulk operations
+	insert_if_not_exist("onnx_tile_overlap"				, 20												); // percentage of the network size shared by adjacent ONNX tiles
+	insert_if_not_exist("onnx_save_optimized_models"	, true												); // skip graph optimization the next time a model is loaded
 	insert_if_not_exist("darknet_image_tiling"			, false												);
+	insert_if_not_exist("image_cache_megabytes"			, 1024												); // memory used to cache decoded images
+	insert_if_not_exist("image_cache_threads"			, 2													); // threads used to decode images in the background
+	insert_if_not_exist("image_cache_prefetch_next"		, 5													); // number of images to prefetch in the direction of travel
+	insert_if_not_exist("image_cache_prefetch_previous"	, 2													); // number of images to prefetch in the opposite direction
+	insert_if_not_exist("darknet_read_threads"			, 2													); // threads reading source images from disk when creating the Darknet files
+	insert_if_not_exist("darknet_decode_threads"		, 0													); // threads decoding the source images (0 = split the cores with the other CPU-bound stages)
+	insert_if_not_exist("darknet_transform_threads"		, 0													); // threads resizing, tiling, and zooming the images (0 = split the cores with the other CPU-bound stages)
+	insert_if_not_exist("darknet_encode_threads"		, 0													); // threads encoding the new images as JPG or PNG (0 = split the cores with the other CPU-bound stages)
+	insert_if_not_exist("darknet_write_threads"			, 1													); // threads writing the new images to disk
 	insert_if_not_exist("review_table_row_height"		, 75												);
 	insert_if_not_exist("scrollfield_width"				, 100												);
 	insert_if_not_exist("scrollfield_marker_size"		, 7													);
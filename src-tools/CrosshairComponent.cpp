@@ -21,7 +21,8 @@ dm::CrosshairComponent::CrosshairComponent(DMContent & c) :
 	mouse_down_loc(invalid_point),
 	mouse_drag_rectangle(invalid_rectangle),
 	need_to_rebuild_cache_image(true),
-	zoom_image_offset(0, 0)
+	zoom_image_offset(0, 0),
+	cached_image_offset(0, 0)
 {
 	setBufferedToImage(false);
 
@@ -80,7 +81,8 @@ void dm::CrosshairComponent::paint(Graphics & g)
 	{
 		const int h = getHeight();
 		const int w = getWidth();
-		g.drawImage(cached_image, 0, 0, w, h, zoom_image_offset.x, zoom_image_offset.y, w, h);
+		const cv::Point offset = zoom_image_offset - cached_image_offset;
+		g.drawImage(cached_image, 0, 0, w, h, offset.x, offset.y, w, h);
 
 		if (mouse_drag_is_enabled and mouse_drag_rectangle != invalid_rectangle and content.canvas.is_panning == false)
 		{
@@ -76,5 +76,10 @@ namespace dm
 			 * in the coordinate space of the zoomed image, not the original image.
 			 */
 			cv::Point zoom_image_offset;
+
+			/** The position of @ref cached_image within the zoomed image.  This is normally (0, 0), but when zoomed in
+			 * only the visible portion of the zoomed image might be rendered into @ref cached_image.
+			 */
+			cv::Point cached_image_offset;
 	};
 }
@@ -0,0 +1,316 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+
+
+namespace
+{
+	size_t bytes_needed(const cv::Mat & mat)
+	{
+		return mat.total() * mat.elemSize();
+	}
+}
+
+
+dm::ImageCache::ImageCache() :
+	hits(0),
+	misses(0),
+	bytes_used(0),
+	bytes_budget(0),
+	usage_counter(0),
+	number_of_workers(0),
+	stop_requested(false)
+{
+	return;
+}
+
+
+dm::ImageCache::~ImageCache()
+{
+	stop_workers();
+
+	return;
+}
+
+
+dm::ImageCache & dm::ImageCache::configure(const size_t megabytes, const size_t number_of_threads)
+{
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		bytes_budget = megabytes * 1024 * 1024;
+		evict("");
+	}
+
+	if (number_of_threads != number_of_workers)
+	{
+		stop_workers();
+		start_workers(number_of_threads);
+	}
+
+	Log("image cache: budget=" + std::to_string(megabytes) + " MiB, threads=" + std::to_string(number_of_threads));
+
+	return *this;
+}
+
+
+cv::Mat dm::ImageCache::get(const std::string & filename)
+{
+	const File file(filename);
+	const int64_t mtime	= file.getLastModificationTime().toMilliseconds();
+	const int64_t size	= file.getSize();
+
+	cv::Mat mat;
+
+	std::unique_lock<std::mutex> lock(cache_mutex);
+
+	// if a worker is already decoding this image then wait for it instead of decoding it a 2nd time
+	cache_condition.wait(lock, [&]{ return in_progress.count(filename) == 0; });
+
+	if (find(filename, mtime, size, mat))
+	{
+		hits ++;
+		return mat;
+	}
+
+	misses ++;
+	in_progress.insert(filename);
+	lock.unlock();
+
+	try
+	{
+		mat = cv::imread(filename);
+	}
+	catch (...)
+	{
+		// make sure nobody is left waiting on this image before we pass on the exception
+		lock.lock();
+		in_progress.erase(filename);
+		lock.unlock();
+		cache_condition.notify_all();
+		throw;
+	}
+
+	lock.lock();
+	in_progress.erase(filename);
+	if (mat.empty() == false)
+	{
+		insert(filename, {mat, mtime, size, 0});
+	}
+	lock.unlock();
+	cache_condition.notify_all();
+
+	return mat;
+}
+
+
+dm::ImageCache & dm::ImageCache::prefetch(const VStr & filenames)
+{
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+
+		queue.clear();
+		for (const auto & fn : filenames)
+		{
+			if (entries.count(fn) == 0 and in_progress.count(fn) == 0)
+			{
+				queue.push_back(fn);
+			}
+			else if (entries.count(fn))
+			{
+				// this image is still needed, so make sure it isn't the next one evicted
+				entries[fn].last_used = ++ usage_counter;
+			}
+		}
+	}
+	cache_condition.notify_all();
+
+	return *this;
+}
+
+
+dm::ImageCache & dm::ImageCache::invalidate(const std::string & filename)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	auto iter = entries.find(filename);
+	if (iter != entries.end())
+	{
+		bytes_used -= bytes_needed(iter->second.mat);
+		entries.erase(iter);
+	}
+	queue.erase(std::remove(queue.begin(), queue.end(), filename), queue.end());
+
+	return *this;
+}
+
+
+dm::ImageCache & dm::ImageCache::clear()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	entries.clear();
+	queue.clear();
+	bytes_used = 0;
+
+	return *this;
+}
+
+
+void dm::ImageCache::worker()
+{
+	while (true)
+	{
+		std::string filename;
+
+		{
+			std::unique_lock<std::mutex> lock(cache_mutex);
+			cache_condition.wait(lock, [&]{ return stop_requested or queue.empty() == false; });
+			if (stop_requested)
+			{
+				break;
+			}
+
+			filename = queue.front();
+			queue.pop_front();
+
+			if (entries.count(filename) or in_progress.count(filename))
+			{
+				continue;
+			}
+			in_progress.insert(filename);
+		}
+
+		const File file(filename);
+		const int64_t mtime	= file.getLastModificationTime().toMilliseconds();
+		const int64_t size	= file.getSize();
+		cv::Mat mat;
+		try
+		{
+			// only count this thread as busy while it decodes, since the workers spend most of their time waiting
+			ScopedWorkerThreads busy_thread(1);
+			mat = cv::imread(filename);
+		}
+		catch (const std::exception & e)
+		{
+			Log("image cache: failed to decode " + filename + ": " + e.what());
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(cache_mutex);
+			in_progress.erase(filename);
+			if (mat.empty() == false)
+			{
+				insert(filename, {mat, mtime, size, 0});
+			}
+		}
+		cache_condition.notify_all();
+	}
+
+	return;
+}
+
+
+void dm::ImageCache::start_workers(const size_t number_of_threads)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	stop_requested = false;
+	number_of_workers = number_of_threads;
+	for (size_t idx = 0; idx < number_of_workers; idx ++)
+	{
+		threads.emplace_back(&ImageCache::worker, this);
+	}
+
+	return;
+}
+
+
+void dm::ImageCache::stop_workers()
+{
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		stop_requested = true;
+		queue.clear();
+	}
+	cache_condition.notify_all();
+
+	for (auto & t : threads)
+	{
+		if (t.joinable())
+		{
+			t.join();
+		}
+	}
+	threads.clear();
+	number_of_workers = 0;
+
+	return;
+}
+
+
+void dm::ImageCache::insert(const std::string & filename, const CacheEntry & entry)
+{
+	auto iter = entries.find(filename);
+	if (iter != entries.end())
+	{
+		bytes_used -= bytes_needed(iter->second.mat);
+	}
+
+	entries[filename] = entry;
+	entries[filename].last_used = ++ usage_counter;
+	bytes_used += bytes_needed(entry.mat);
+
+	evict(filename);
+
+	return;
+}
+
+
+void dm::ImageCache::evict(const std::string & filename_to_keep)
+{
+	while (bytes_used > bytes_budget)
+	{
+		auto oldest = entries.end();
+		for (auto iter = entries.begin(); iter != entries.end(); iter ++)
+		{
+			if (iter->first != filename_to_keep and (oldest == entries.end() or iter->second.last_used < oldest->second.last_used))
+			{
+				oldest = iter;
+			}
+		}
+
+		if (oldest == entries.end())
+		{
+			// nothing left to evict
+			break;
+		}
+
+		bytes_used -= bytes_needed(oldest->second.mat);
+		entries.erase(oldest);
+	}
+
+	return;
+}
+
+
+bool dm::ImageCache::find(const std::string & filename, const int64_t mtime, const int64_t size, cv::Mat & mat)
+{
+	auto iter = entries.find(filename);
+	if (iter == entries.end())
+	{
+		return false;
+	}
+
+	if (iter->second.mtime != mtime or iter->second.size != size)
+	{
+		// the file on disk has changed since it was decoded
+		bytes_used -= bytes_needed(iter->second.mat);
+		entries.erase(iter);
+		return false;
+	}
+
+	iter->second.last_used = ++ usage_counter;
+	mat = iter->second.mat;
+
+	return true;
+}
@@ -0,0 +1,88 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Memory-budgeted LRU cache of decoded images.  Worker threads decode the images which are likely to be needed next
+	 * (see @ref prefetch()) so when the user moves to the next or previous image, @ref get() can return immediately
+	 * instead of waiting on @p cv::imread().
+	 *
+	 * Cached images are shared, not copied, so callers must not modify the returned @p cv::Mat in-place.  Entries are
+	 * also validated against the file's modification time and size, but callers which modify images on disk should still
+	 * call @ref invalidate() or @ref clear().
+	 *
+	 * This class is thread-safe.
+	 */
+	class ImageCache final
+	{
+		public:
+
+			ImageCache();
+
+			~ImageCache();
+
+			/** Set the maximum amount of memory used by decoded images, and the number of threads used to decode images
+			 * in the background.  If needed, images are immediately evicted to fit within the new budget.
+			 */
+			ImageCache & configure(const size_t megabytes, const size_t number_of_threads);
+
+			/// Get the given image, either from the cache or by decoding it immediately if it has not yet been cached.
+			cv::Mat get(const std::string & filename);
+
+			/** Replace the list of images to be decoded in the background.  The images should be given in order of
+			 * importance, such as the next few images in the direction the user is moving.
+			 */
+			ImageCache & prefetch(const VStr & filenames);
+
+			/// Remove a single image from the cache, such as when it was deleted or modified.
+			ImageCache & invalidate(const std::string & filename);
+
+			/// Remove all images from the cache and forget any pending prefetch requests.
+			ImageCache & clear();
+
+			std::atomic<size_t> hits;
+			std::atomic<size_t> misses;
+
+		private:
+
+			struct CacheEntry
+			{
+				cv::Mat		mat;
+				int64_t		mtime;
+				int64_t		size;
+				uint64_t	last_used;
+			};
+
+			/// Threads which decode images requested by @ref prefetch().
+			void worker();
+
+			/// Start or stop the threads which run @ref worker().
+			void start_workers(const size_t number_of_threads);
+			void stop_workers();
+
+			/// Add a decoded image and evict the least recently used images until we're within budget.  The lock must be held.
+			void insert(const std::string & filename, const CacheEntry & entry);
+
+			/// Evict the least recently used images (except @p filename_to_keep) until we're within budget.  The lock must be held.
+			void evict(const std::string & filename_to_keep);
+
+			/// Look up a valid entry.  The lock must be held.
+			bool find(const std::string & filename, const int64_t mtime, const int64_t size, cv::Mat & mat);
+
+			std::mutex cache_mutex;
+			std::condition_variable cache_condition;
+			std::map<std::string, CacheEntry> entries;
+			std::deque<std::string> queue;
+			SStr in_progress;
+			size_t bytes_used;
+			size_t bytes_budget;
+			uint64_t usage_counter;
+			size_t number_of_workers;
+			bool stop_requested;
+			VThreads threads;
+	};
+}
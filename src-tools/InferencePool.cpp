@@ -0,0 +1,135 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+
+
+dm::InferencePool::InferencePool(const std::vector<Replica> & replicas, const size_t batch_size, const size_t queue_limit) :
+	batch_size(std::max(size_t(1), batch_size)),
+	queue_limit(std::max(size_t(1), queue_limit)),
+	stop_requested(false)
+{
+	for (const auto & replica : replicas)
+	{
+		threads.emplace_back(&InferencePool::worker, this, replica);
+	}
+
+	Log("inference pool: replicas=" + std::to_string(threads.size()) + ", batch size=" + std::to_string(this->batch_size) + ", queue limit=" + std::to_string(this->queue_limit));
+
+	return;
+}
+
+
+dm::InferencePool::~InferencePool()
+{
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		stop_requested = true;
+
+		// destroying the promises breaks the futures, so nobody is left waiting on an image which will never be processed
+		jobs.clear();
+	}
+	job_available.notify_all();
+	room_available.notify_all();
+
+	for (auto & t : threads)
+	{
+		if (t.joinable())
+		{
+			t.join();
+		}
+	}
+
+	return;
+}
+
+
+std::future<dm::PredictionCache::Detections> dm::InferencePool::submit(const cv::Mat & mat, Finish finish)
+{
+	Job job;
+	job.mat		= mat;
+	job.finish	= finish;
+	auto future	= job.promise.get_future();
+
+	{
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		room_available.wait(lock, [&]{ return stop_requested or jobs.size() < queue_limit; });
+		if (stop_requested)
+		{
+			job.promise.set_exception(std::make_exception_ptr(std::runtime_error("the inference pool has been stopped")));
+			return future;
+		}
+		jobs.push_back(std::move(job));
+	}
+	job_available.notify_one();
+
+	return future;
+}
+
+
+void dm::InferencePool::worker(Replica replica)
+{
+	std::vector<Job> batch;
+	std::vector<cv::Mat> mats;
+
+	while (true)
+	{
+		batch.clear();
+		mats.clear();
+
+		{
+			std::unique_lock<std::mutex> lock(pool_mutex);
+			job_available.wait(lock, [&]{ return stop_requested or jobs.empty() == false; });
+			if (stop_requested)
+			{
+				break;
+			}
+
+			// take whatever is available (up to the batch size) instead of waiting for a full batch
+			while (jobs.empty() == false and batch.size() < batch_size)
+			{
+				batch.push_back(std::move(jobs.front()));
+				jobs.pop_front();
+			}
+		}
+		room_available.notify_all();
+
+		for (const auto & job : batch)
+		{
+			mats.push_back(job.mat);
+		}
+
+		std::vector<PredictionCache::Detections> all_candidates;
+		try
+		{
+			all_candidates = replica(mats);
+			if (all_candidates.size() != batch.size())
+			{
+				throw std::logic_error("expected results for " + std::to_string(batch.size()) + " images but got " + std::to_string(all_candidates.size()));
+			}
+		}
+		catch (...)
+		{
+			Log("inference pool: failed to process a batch of " + std::to_string(batch.size()) + " images");
+			for (auto & job : batch)
+			{
+				job.promise.set_exception(std::current_exception());
+			}
+			continue;
+		}
+
+		for (size_t idx = 0; idx < batch.size(); idx ++)
+		{
+			auto & job = batch[idx];
+			try
+			{
+				job.promise.set_value(job.finish ? job.finish(all_candidates[idx]) : all_candidates[idx]);
+			}
+			catch (...)
+			{
+				job.promise.set_exception(std::current_exception());
+			}
+		}
+	}
+
+	return;
+}
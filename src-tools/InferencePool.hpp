@@ -0,0 +1,71 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Runs the neural network on many images at once for bulk operations such as reviewing the IoU of a project.  The
+	 * pool owns several replicas of the neural network, each used by a dedicated worker thread.  The interactive network
+	 * in @ref DarkMarkApplication is not part of the pool, so the editor can still get predictions for the current image
+	 * without waiting behind a bulk job.
+	 *
+	 * Images are given to @ref submit(), which returns a future.  The queue of pending images is bounded, so when the
+	 * workers cannot keep up, @ref submit() blocks until there is room.  This keeps the memory used by decoded images
+	 * bounded regardless of how quickly the caller can load images.
+	 *
+	 * This class is thread-safe.
+	 */
+	class InferencePool final
+	{
+		public:
+
+			/// Runs a replica of the neural network on several images, and returns the unfiltered candidates for each image.
+			using Replica = std::function<std::vector<PredictionCache::Detections>(const std::vector<cv::Mat> &)>;
+
+			/** Called on the worker thread with the candidates of a single image.  This can be used to store the candidates
+			 * in the prediction cache and apply the detection thresholds.  The value returned is passed to the future.
+			 */
+			using Finish = std::function<PredictionCache::Detections(const PredictionCache::Detections &)>;
+
+			/** Start one worker thread per replica.  Each worker gives up to @p batch_size images at a time to its replica.
+			 * @p queue_limit is the number of images which can be waiting before @ref submit() blocks.
+			 */
+			InferencePool(const std::vector<Replica> & replicas, const size_t batch_size, const size_t queue_limit);
+
+			/// Stop the workers.  Images which are still queued are abandoned, and their futures throw @p std::future_error.
+			~InferencePool();
+
+			/// Queue an image.  This blocks while the queue is full.
+			std::future<PredictionCache::Detections> submit(const cv::Mat & mat, Finish finish = nullptr);
+
+			/// The number of replicas (and worker threads).
+			size_t size() const { return threads.size(); }
+
+			/// The maximum number of images given to a replica at once.
+			size_t get_batch_size() const { return batch_size; }
+
+		private:
+
+			struct Job
+			{
+				cv::Mat										mat;
+				Finish										finish;
+				std::promise<PredictionCache::Detections>	promise;
+			};
+
+			void worker(Replica replica);
+
+			const size_t batch_size;
+			const size_t queue_limit;
+
+			std::mutex pool_mutex;
+			std::condition_variable job_available;
+			std::condition_variable room_available;
+			std::deque<Job> jobs;
+			bool stop_requested;
+			VThreads threads;
+	};
+}
@@ -2,6 +2,9 @@
 
 #include "DarkMark.hpp"
 
+#include "json.hpp"
+using json = nlohmann::json;
+
 
 dm::Mark::~Mark()
 {
@@ -402,3 +405,115 @@ std::string dm::Mark::as_debug_string() const
 
 	return ss.str();
 }
+
+
+size_t dm::save_json_annotations(const std::string & json_filename, const VMarks & marks, const cv::Size & image_size, const double scale_factor, const bool completely_empty, const std::time_t timestamp)
+{
+	json root;
+	size_t next_id = 0;
+	for (const auto & m : marks)
+	{
+		if (m.is_prediction)
+		{
+			// skip this one since it is a prediction, not a full mark
+			continue;
+		}
+
+		root["mark"][next_id]["class_idx"	] = m.class_idx;
+		root["mark"][next_id]["name"		] = m.name;
+
+		const cv::Rect2d	r1 = m.get_normalized_bounding_rect();
+		const cv::Rect		r2 = m.get_bounding_rect(image_size);
+
+		root["mark"][next_id]["rect"]["x"]		= r1.x;
+		root["mark"][next_id]["rect"]["y"]		= r1.y;
+		root["mark"][next_id]["rect"]["w"]		= r1.width;
+		root["mark"][next_id]["rect"]["h"]		= r1.height;
+		root["mark"][next_id]["rect"]["int_x"]	= r2.x;
+		root["mark"][next_id]["rect"]["int_y"]	= r2.y;
+		root["mark"][next_id]["rect"]["int_w"]	= r2.width;
+		root["mark"][next_id]["rect"]["int_h"]	= r2.height;
+
+		for (size_t point_idx = 0; point_idx < m.normalized_all_points.size(); point_idx ++)
+		{
+			const cv::Point2d & p = m.normalized_all_points.at(point_idx);
+			root["mark"][next_id]["points"][point_idx]["x"] = p.x;
+			root["mark"][next_id]["points"][point_idx]["y"] = p.y;
+
+			// DarkMark doesn't use these integer values, but make them available for 3rd party software which wants to reads the .json file
+			root["mark"][next_id]["points"][point_idx]["int_x"] = (int)(std::round(p.x * (double)image_size.width));
+			root["mark"][next_id]["points"][point_idx]["int_y"] = (int)(std::round(p.y * (double)image_size.height));
+		}
+
+		next_id ++;
+	}
+	root["image"]["scale"]	= scale_factor;
+	root["image"]["width"]	= image_size.width;
+	root["image"]["height"]	= image_size.height;
+	root["timestamp"]		= timestamp;
+	root["version"]			= DARKMARK_VERSION;
+
+	// if no marks were written out, then this must be an empty image
+	root["completely_empty"] = (next_id == 0 and completely_empty);
+
+	if (next_id > 0 or completely_empty)
+	{
+		std::ofstream fs(json_filename);
+		fs.imbue(std::locale("C"));
+		fs << root.dump(1, '\t') << std::endl;
+
+		if (fs.fail())
+		{
+			throw std::runtime_error("failed to save the annotations to " + json_filename);
+		}
+	}
+	else
+	{
+		// image has no markup -- delete the .json file if it existed
+		std::remove(json_filename.c_str());
+	}
+
+	return next_id;
+}
+
+
+void dm::save_text_annotations(const std::string & text_filename, const VMarks & marks, const bool completely_empty)
+{
+	bool delete_txt_file = (completely_empty == false);
+
+	std::ofstream fs(text_filename);
+	fs.imbue(std::locale("C"));
+
+	for (const auto & m : marks)
+	{
+		if (m.is_prediction)
+		{
+			// skip this one since it is a prediction, not a full mark
+			continue;
+		}
+
+		delete_txt_file = false;
+
+		const cv::Rect2d r	= m.get_normalized_bounding_rect();
+		const double w		= r.width;
+		const double h		= r.height;
+		const double x		= r.x + w / 2.0;
+		const double y		= r.y + h / 2.0;
+		fs << std::fixed << std::setprecision(10) << m.class_idx << " " << x << " " << y << " " << w << " " << h << std::endl;
+	}
+
+	fs.close();
+
+	if (fs.fail())
+	{
+		throw std::runtime_error("failed to save the text annotations to " + text_filename);
+	}
+
+	if (delete_txt_file)
+	{
+		// there was no legitimate reason to keep the .txt file
+		std::remove(text_filename.c_str());
+	}
+
+	return;
+}
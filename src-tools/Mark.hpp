@@ -100,4 +100,19 @@ namespace dm
 			std::string description;
 			bool is_prediction;
 	};
+
+	/** Write the marks to a DarkMark .json annotation file.  Marks which are predictions are skipped.  If no marks are left
+	 * and the image is not @p completely_empty then the .json file is deleted instead.  This is the only place where the
+	 * format of the .json files is defined, so the editor and the tools which create annotations all write the same thing.
+	 *
+	 * Returns the number of marks written.  Throws @p std::runtime_error if the file cannot be written.
+	 */
+	size_t save_json_annotations(const std::string & json_filename, const VMarks & marks, const cv::Size & image_size, const double scale_factor, const bool completely_empty, const std::time_t timestamp);
+
+	/** Write the marks to a Darknet .txt annotation file.  Marks which are predictions are skipped.  If no marks are left
+	 * and the image is not @p completely_empty then the .txt file is deleted instead.
+	 *
+	 * Throws @p std::runtime_error if the file cannot be written.
+	 */
+	void save_text_annotations(const std::string & text_filename, const VMarks & marks, const bool completely_empty);
 }
@@ -0,0 +1,291 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+
+
+namespace
+{
+	/// Magic number at the start of the cache file:  "DMPC" (DarkMark Prediction Cache).
+	const int cache_magic = 0x43504d44;
+
+	/// Increment this every time the layout of an entry changes.  Files with a different version are ignored.
+	const int cache_version = 1;
+}
+
+
+dm::PredictionCache::PredictionCache() :
+	dirty(false),
+	last_save(0.0)
+{
+	return;
+}
+
+
+dm::PredictionCache::~PredictionCache()
+{
+	save();
+
+	return;
+}
+
+
+std::string dm::PredictionCache::model_key(const std::string & weights_filename, const cv::Size & input_size, const std::string & settings)
+{
+	// hashing a large weights file takes a moment, so remember the hash for as long as the file is not modified
+	static std::mutex hash_mutex;
+	static std::map<std::string, std::string> hashes;
+
+	const File file(weights_filename);
+	const std::string file_id =
+		weights_filename + "|" +
+		std::to_string(file.getSize()) + "|" +
+		std::to_string(file.getLastModificationTime().toMilliseconds());
+
+	std::string hash;
+	{
+		std::lock_guard<std::mutex> lock(hash_mutex);
+		if (hashes.count(file_id))
+		{
+			hash = hashes.at(file_id);
+		}
+	}
+
+	if (hash.empty())
+	{
+		const double start_time = Time::getMillisecondCounterHiRes();
+		hash = MD5(file).toHexString().toStdString();
+		Log("hashed " + weights_filename + " in " + std::to_string(std::round(Time::getMillisecondCounterHiRes() - start_time)) + " milliseconds: " + hash);
+
+		std::lock_guard<std::mutex> lock(hash_mutex);
+		hashes[file_id] = hash;
+	}
+
+	return hash + "_" + std::to_string(input_size.width) + "x" + std::to_string(input_size.height) + "_" + settings;
+}
+
+
+dm::PredictionCache & dm::PredictionCache::open(const std::string & project_directory, const std::string & new_key)
+{
+	const File new_file = File(project_directory)
+		.getChildFile("darkmark_image_cache")
+		.getChildFile("predictions")
+		.getChildFile(MD5(new_key.c_str(), new_key.size()).toHexString() + ".bin");
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	if (new_file == cache_file and new_key == key)
+	{
+		// this cache is already open
+		return *this;
+	}
+
+	save_locked();
+
+	entries.clear();
+	dirty = false;
+	last_save = Time::getMillisecondCounterHiRes();
+	key = new_key;
+	cache_file = new_file;
+
+	if (cache_file.existsAsFile() == false)
+	{
+		Log("prediction cache does not exist: " + cache_file.getFullPathName().toStdString() + " (key=" + key + ")");
+		return *this;
+	}
+
+	MemoryMappedFile mmf(cache_file, MemoryMappedFile::AccessMode::readOnly);
+	if (mmf.getData() == nullptr or mmf.getSize() < 16)
+	{
+		Log("failed to map the prediction cache " + cache_file.getFullPathName().toStdString());
+		return *this;
+	}
+
+	MemoryInputStream is(mmf.getData(), mmf.getSize(), false);
+	const int magic					= is.readInt();
+	const int version				= is.readInt();
+	const std::string stored_key	= is.readString().toStdString();
+	const int64 count				= is.readInt64();
+
+	if (magic != cache_magic or version != cache_version or stored_key != key or count < 0)
+	{
+		Log("ignoring incompatible prediction cache " + cache_file.getFullPathName().toStdString());
+		return *this;
+	}
+
+	for (int64 idx = 0; idx < count; idx ++)
+	{
+		if (is.isExhausted())
+		{
+			Log("prediction cache is truncated after " + std::to_string(idx) + " entries");
+			entries.clear();
+			break;
+		}
+
+		const std::string filename = is.readString().toStdString();
+
+		Entry entry;
+		entry.image_mtime	= is.readInt64();
+		entry.image_size	= is.readInt64();
+
+		const int number_of_detections = is.readInt();
+		for (int i = 0; i < number_of_detections and is.isExhausted() == false; i ++)
+		{
+			Detection d;
+			d.rect.x		= is.readFloat();
+			d.rect.y		= is.readFloat();
+			d.rect.width	= is.readFloat();
+			d.rect.height	= is.readFloat();
+			d.class_idx		= is.readInt();
+			d.probability	= is.readFloat();
+
+			const int number_of_probabilities = is.readInt();
+			for (int j = 0; j < number_of_probabilities and is.isExhausted() == false; j ++)
+			{
+				const int class_idx		= is.readInt();
+				const float probability	= is.readFloat();
+				d.all_probabilities[class_idx] = probability;
+			}
+
+			entry.detections.push_back(d);
+		}
+
+		entries[filename] = entry;
+	}
+
+	Log("prediction cache loaded " + std::to_string(entries.size()) + " entries from " + cache_file.getFullPathName().toStdString());
+
+	return *this;
+}
+
+
+dm::PredictionCache & dm::PredictionCache::save()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	save_locked();
+
+	return *this;
+}
+
+
+dm::PredictionCache & dm::PredictionCache::save_periodically(const double seconds)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	if (dirty and Time::getMillisecondCounterHiRes() - last_save >= seconds * 1000.0)
+	{
+		save_locked();
+	}
+
+	return *this;
+}
+
+
+void dm::PredictionCache::save_locked()
+{
+	if (dirty == false or cache_file == File())
+	{
+		return;
+	}
+
+	MemoryOutputStream os;
+	os.writeInt(cache_magic);
+	os.writeInt(cache_version);
+	os.writeString(key);
+	os.writeInt64(entries.size());
+
+	for (const auto & [filename, entry] : entries)
+	{
+		os.writeString(filename);
+		os.writeInt64(entry.image_mtime);
+		os.writeInt64(entry.image_size);
+		os.writeInt(entry.detections.size());
+		for (const auto & d : entry.detections)
+		{
+			os.writeFloat(d.rect.x);
+			os.writeFloat(d.rect.y);
+			os.writeFloat(d.rect.width);
+			os.writeFloat(d.rect.height);
+			os.writeInt(d.class_idx);
+			os.writeFloat(d.probability);
+			os.writeInt(d.all_probabilities.size());
+			for (const auto & [class_idx, probability] : d.all_probabilities)
+			{
+				os.writeInt(class_idx);
+				os.writeFloat(probability);
+			}
+		}
+	}
+
+	// write to a temporary file first so an interrupted save never leaves behind a corrupt cache
+	cache_file.getParentDirectory().createDirectory();
+	TemporaryFile tmp(cache_file);
+	if (tmp.getFile().replaceWithData(os.getData(), os.getDataSize()) and tmp.overwriteTargetFileWithTemporary())
+	{
+		Log("prediction cache saved " + std::to_string(entries.size()) + " entries to " + cache_file.getFullPathName().toStdString());
+		dirty = false;
+	}
+	else
+	{
+		Log("failed to save the prediction cache " + cache_file.getFullPathName().toStdString());
+	}
+
+	// even if the save failed, don't immediately try again on the next call to save_periodically()
+	last_save = Time::getMillisecondCounterHiRes();
+
+	return;
+}
+
+
+bool dm::PredictionCache::get(const std::string & image_filename, Detections & detections)
+{
+	const File file(image_filename);
+	const int64_t mtime	= file.getLastModificationTime().toMilliseconds();
+	const int64_t size	= file.getSize();
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	auto iter = entries.find(image_filename);
+	if (iter == entries.end() or iter->second.image_mtime != mtime or iter->second.image_size != size)
+	{
+		return false;
+	}
+
+	detections = iter->second.detections;
+
+	return true;
+}
+
+
+dm::PredictionCache & dm::PredictionCache::set(const std::string & image_filename, const Detections & detections, const std::string & expected_key)
+{
+	const File file(image_filename);
+
+	Entry entry;
+	entry.image_mtime	= file.getLastModificationTime().toMilliseconds();
+	entry.image_size	= file.getSize();
+	entry.detections	= detections;
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	if (expected_key.empty() == false and expected_key != key)
+	{
+		// these detections were made with the previous neural network or settings
+		return *this;
+	}
+
+	entries[image_filename] = entry;
+	dirty = true;
+
+	return *this;
+}
+
+
+dm::PredictionCache & dm::PredictionCache::clear()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	entries.clear();
+	dirty = true;
+
+	return *this;
+}
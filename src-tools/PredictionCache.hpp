@@ -0,0 +1,93 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Persistent per-project store of the detections returned by the neural network.  Running the network is by far
+	 * the slowest part of showing predictions or reviewing the IoU of a project, especially on machines without a GPU.
+	 * Since the results only change when the image or the neural network changes, they can be stored on disk and reused.
+	 *
+	 * Each cache file belongs to one "model key", which combines a hash of the weights (or .onnx) file with the network
+	 * input size and any settings which change the detections.  When any of these change, a different cache file is
+	 * used.  Within a cache file, each entry is only valid as long as the modification time and size of the image have
+	 * not changed.
+	 *
+	 * This class is thread-safe.
+	 */
+	class PredictionCache final
+	{
+		public:
+
+			/// A single detection, stored independently of DarkHelp and OnnxHelp.
+			struct Detection
+			{
+				cv::Rect2f				rect;				///< Normalized coordinates, where 0.0 to 1.0 spans the entire image.
+				int						class_idx;			///< The class with the highest probability.
+				float					probability;		///< Probability of @ref class_idx.
+				std::map<int, float>	all_probabilities;	///< Every class with a non-zero probability, including @ref class_idx.
+			};
+			using Detections = std::vector<Detection>;
+
+			PredictionCache();
+
+			~PredictionCache();
+
+			/** Calculate the key used to identify the neural network.  The weights file is hashed only once per filename,
+			 * size, and timestamp, so calling this repeatedly is cheap.
+			 */
+			static std::string model_key(const std::string & weights_filename, const cv::Size & input_size, const std::string & settings);
+
+			/** Use the cache file for the given project directory and model key.  If this is the same project and key which
+			 * is already open then nothing happens.  Otherwise, the previous cache is saved before the new one is loaded.
+			 */
+			PredictionCache & open(const std::string & project_directory, const std::string & key);
+
+			/// Write the cache back to disk, but only if something has changed.
+			PredictionCache & save();
+
+			/** Write the cache back to disk if something has changed and the last save was more than @p seconds ago.  This
+			 * is cheap to call often, and limits how many predictions are lost if DarkMark is killed or crashes.
+			 */
+			PredictionCache & save_periodically(const double seconds = 30.0);
+
+			/// Get the cached detections for an image.  Returns @p false if the image is not in the cache, or is stale.
+			bool get(const std::string & image_filename, Detections & detections);
+
+			/** Remember the detections for an image.  If @p expected_key is set, the detections are only stored when the cache
+			 * is still open with that key.  This is used for predictions which may complete after the settings have changed.
+			 */
+			PredictionCache & set(const std::string & image_filename, const Detections & detections, const std::string & expected_key = "");
+
+			/// Forget all entries for the current model key.
+			PredictionCache & clear();
+
+			/// The key passed to @ref open().
+			std::string key;
+
+			/// The binary file where the detections are stored.
+			File cache_file;
+
+		private:
+
+			/// Same as @ref save() but the lock on @ref cache_mutex must already be held.
+			void save_locked();
+
+			struct Entry
+			{
+				int64_t		image_mtime;
+				int64_t		image_size;
+				Detections	detections;
+			};
+
+			std::mutex cache_mutex;
+			std::map<std::string, Entry> entries;
+			bool dirty;
+
+			/// Timestamp (from @p Time::getMillisecondCounterHiRes()) of the last time the cache was saved or loaded.
+			double last_save;
+	};
+}
@@ -0,0 +1,202 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#include "DarkMark.hpp"
+
+
+dm::TaskPool::TaskPool(const size_t workers) :
+	number_of_workers(workers ? workers : std::max(2U, std::thread::hardware_concurrency())),
+	tasks_done(0),
+	workers_running(0),
+	stop_requested(false)
+{
+	return;
+}
+
+
+dm::TaskPool::~TaskPool()
+{
+	return;
+}
+
+
+dm::TaskPool & dm::TaskPool::run(const size_t number_of_tasks, Task task, Progress progress)
+{
+	if (number_of_tasks == 0)
+	{
+		return *this;
+	}
+
+	// there is no point in starting more workers than we have tasks
+	const size_t workers = std::min(number_of_workers, number_of_tasks);
+
+	ranges.clear();
+	for (size_t idx = 0; idx < workers; idx ++)
+	{
+		auto range = std::make_unique<Range>();
+		range->begin	= number_of_tasks * idx / workers;
+		range->end		= number_of_tasks * (idx + 1) / workers;
+		ranges.push_back(std::move(range));
+	}
+
+	current_task	= task;
+	tasks_done		= 0;
+	workers_running	= workers;
+	stop_requested	= false;
+	first_exception	= nullptr;
+
+	Log("task pool: running " + std::to_string(number_of_tasks) + " tasks on " + std::to_string(workers) + " workers");
+
+	ScopedWorkerThreads busy_threads(workers);
+	VThreads threads;
+	for (size_t idx = 0; idx < workers; idx ++)
+	{
+		threads.emplace_back(&TaskPool::worker, this, idx);
+	}
+
+	if (true)
+	{
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		while (workers_running > 0)
+		{
+			if (progress)
+			{
+				lock.unlock();
+				progress(tasks_done, number_of_tasks);
+				lock.lock();
+			}
+			all_done.wait_for(lock, std::chrono::milliseconds(250), [&]{ return workers_running == 0; });
+		}
+	}
+
+	for (auto & t : threads)
+	{
+		t.join();
+	}
+
+	if (progress)
+	{
+		progress(tasks_done, number_of_tasks);
+	}
+
+	current_task = nullptr;
+
+	if (first_exception)
+	{
+		std::rethrow_exception(first_exception);
+	}
+
+	return *this;
+}
+
+
+std::default_random_engine dm::TaskPool::random_engine(const size_t task_idx)
+{
+	// consecutive seeds give very similar sequences with some engines, so scramble the index with a seed sequence
+	std::seed_seq seed{static_cast<uint32_t>(task_idx), static_cast<uint32_t>(static_cast<uint64_t>(task_idx) >> 32), 0x444d5450u};
+
+	return std::default_random_engine(seed);
+}
+
+
+bool dm::TaskPool::next_task(const size_t worker_idx, size_t & task_idx)
+{
+	if (stop_requested)
+	{
+		return false;
+	}
+
+	auto & own = *ranges[worker_idx];
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(own.range_mutex);
+		if (own.begin < own.end)
+		{
+			task_idx = own.begin ++;
+			return true;
+		}
+	}
+
+	while (stop_requested == false)
+	{
+		// find the worker with the most tasks remaining (only one lock is ever held at a time so this cannot deadlock)
+		size_t victim_idx	= 0;
+		size_t most_tasks	= 0;
+		for (size_t idx = 0; idx < ranges.size(); idx ++)
+		{
+			auto & range = *ranges[idx];
+			std::lock_guard<std::mutex> lock(range.range_mutex);
+			const size_t remaining = range.end - range.begin;
+			if (remaining > most_tasks)
+			{
+				victim_idx	= idx;
+				most_tasks	= remaining;
+			}
+		}
+
+		if (most_tasks == 0)
+		{
+			// every task has been handed out
+			return false;
+		}
+
+		// take the second half of the victim's remaining tasks
+		size_t stolen_begin	= 0;
+		size_t stolen_end	= 0;
+		if (true)
+		{
+			auto & victim = *ranges[victim_idx];
+			std::lock_guard<std::mutex> lock(victim.range_mutex);
+			const size_t remaining = victim.end - victim.begin;
+			if (remaining == 0)
+			{
+				// someone else got to these tasks first, so look for another victim
+				continue;
+			}
+
+			stolen_end		= victim.end;
+			stolen_begin	= victim.end - (remaining + 1) / 2;
+			victim.end		= stolen_begin;
+		}
+
+		std::lock_guard<std::mutex> lock(own.range_mutex);
+		own.begin	= stolen_begin + 1;
+		own.end		= stolen_end;
+		task_idx	= stolen_begin;
+
+		return true;
+	}
+
+	return false;
+}
+
+
+void dm::TaskPool::worker(const size_t worker_idx)
+{
+	size_t task_idx = 0;
+	while (next_task(worker_idx, task_idx))
+	{
+		try
+		{
+			current_task(task_idx);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			if (not first_exception)
+			{
+				first_exception = std::current_exception();
+			}
+			stop_requested = true;
+		}
+		tasks_done ++;
+	}
+
+	if (-- workers_running == 0)
+	{
+		// hold the lock so the notification cannot be missed by run() between checking the predicate and waiting
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		all_done.notify_all();
+	}
+
+	return;
+}
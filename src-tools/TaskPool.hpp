@@ -0,0 +1,67 @@
+// DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
+
+#pragma once
+
+#include "DarkMark.hpp"
+
+
+namespace dm
+{
+	/** Run a large number of independent tasks across several threads.  Tasks are identified by their index.  Each worker
+	 * starts out with an equal slice of the indexes, and once a worker runs out of tasks it steals the second half of the
+	 * largest slice which remains.  This way a worker which happens to get several very large images to process doesn't
+	 * keep everyone else waiting once all the other tasks are done.
+	 *
+	 * Tasks must not depend on which worker runs them, or in which order they run.  For example, anything random should
+	 * use a random engine seeded with the task index instead of sharing @ref get_random_engine().
+	 */
+	class TaskPool final
+	{
+		public:
+
+			using Task		= std::function<void(const size_t task_idx)>;
+			using Progress	= std::function<void(const size_t tasks_done, const size_t number_of_tasks)>;
+
+			/// When @p workers is zero, an attempt is made to determine the number of available cores.
+			TaskPool(const size_t workers = 0);
+
+			~TaskPool();
+
+			/** Call @p task once for every index from zero to @p number_of_tasks - 1, and wait for all of them to finish.
+			 * While waiting, @p progress (if set) is regularly called from the calling thread.
+			 *
+			 * If a task throws, the tasks which have not yet started are skipped, and the first exception is re-thrown
+			 * once all the workers have stopped.
+			 */
+			TaskPool & run(const size_t number_of_tasks, Task task, Progress progress = nullptr);
+
+			/// Create a random engine for a task.  The sequence only depends on the task index, not the worker or the order.
+			static std::default_random_engine random_engine(const size_t task_idx);
+
+			const size_t number_of_workers;
+
+		private:
+
+			/// The indexes which still need to be processed by one worker.  Other workers steal from the end of the range.
+			struct Range
+			{
+				std::mutex	range_mutex;
+				size_t		begin;
+				size_t		end;
+			};
+
+			/// Get the next task for this worker.  Returns @p false once there is nothing left to run or steal.
+			bool next_task(const size_t worker_idx, size_t & task_idx);
+
+			void worker(const size_t worker_idx);
+
+			std::vector<std::unique_ptr<Range>> ranges;
+			Task current_task;
+			std::atomic<size_t> tasks_done;
+			std::atomic<size_t> workers_running;
+			std::atomic<bool> stop_requested;
+			std::exception_ptr first_exception;
+			std::mutex pool_mutex;
+			std::condition_variable all_done;
+	};
+}
@@ -88,3 +88,28 @@ std::default_random_engine & dm::get_random_engine()
 
 	return engine;
 }
+
+
+std::atomic<size_t> & dm::worker_threads_in_use()
+{
+	static std::atomic<size_t> count(0);
+
+	return count;
+}
+
+
+dm::ScopedWorkerThreads::ScopedWorkerThreads(const size_t count) :
+	count(count)
+{
+	worker_threads_in_use() += count;
+
+	return;
+}
+
+
+dm::ScopedWorkerThreads::~ScopedWorkerThreads()
+{
+	worker_threads_in_use() -= count;
+
+	return;
+}
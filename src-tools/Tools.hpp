@@ -5,6 +5,12 @@
 #include "DarkMark.hpp"
 
 
+/// Convert command-line option values.  Invalid numbers are returned as zero.  See ProjectInfo.cpp.
+int toInt(const std::string & str);
+float toFloat(const std::string & str);
+bool toBool(const std::string & str);
+
+
 namespace dm
 {
 	/// Get all of the image and .json markup files (recursively) for the given directory.  The @p done flag is to abort early.
@@ -12,4 +18,23 @@ namespace dm
 
 	/// Used to generate random numbers.
 	std::default_random_engine & get_random_engine();
+
+	/** Number of threads currently used by DarkMark's own worker pools, such as image decoding and the creation of the
+	 * Darknet files.  ONNX Runtime uses this to avoid oversubscribing the CPU when the thread counts are set to "auto".
+	 */
+	std::atomic<size_t> & worker_threads_in_use();
+
+	/// Adds to @ref worker_threads_in_use() for as long as this object exists.
+	class ScopedWorkerThreads final
+	{
+		public:
+
+			ScopedWorkerThreads(const size_t count);
+
+			~ScopedWorkerThreads();
+
+		private:
+
+			const size_t count;
+	};
 }
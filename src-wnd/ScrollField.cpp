@@ -1,15 +1,15 @@
 // DarkMark (C) 2019-2024 Stephane Charette <stephanecharette@gmail.com>
 
 #include "DarkMark.hpp"
-#include "json.hpp"
-using json = nlohmann::json;
 
 
 dm::ScrollField::ScrollField(DMContent & c) :
 	CrosshairComponent(c),
 	Thread("scrollfield loading thread"),
 	content(c),
-	line_width(0),
+	building(false),
+	images_per_bin(1),
+	number_of_classes(0),
 	triangle_size(cfg().get_int("scrollfield_marker_size"))
 {
 	setName("ScrollField");
@@ -36,7 +36,11 @@ void dm::ScrollField::rebuild_entire_field_on_thread()
 {
 	if (content.images_are_loading == false and content.scrollfield_width > 0 and isThreadRunning() == false)
 	{
-		field			= cv::Mat();
+		if (true)
+		{
+			std::lock_guard<std::mutex> lock(bins_mutex);
+			bins.clear();
+		}
 		resized_image	= cv::Mat();
 		cached_image	= juce::Image();
 		map_idx_imagesets.clear();
@@ -54,7 +58,12 @@ void dm::ScrollField::run()
 {
 	Log("ScrollField: running thread");
 
-	field			= cv::Mat();
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(bins_mutex);
+		bins.clear();
+		pending_updates.clear();
+	}
 	resized_image	= cv::Mat();
 	cached_image	= juce::Image();
 	map_idx_imagesets.clear();
@@ -77,10 +86,10 @@ void dm::ScrollField::run()
 		return;
 	}
 
-	const size_t number_of_images = content.image_filenames.size();
-	const size_t number_of_classes = content.names.size();
+	const size_t number_of_images	= content.image_filenames.size();
+	const size_t classes			= content.names.size();
 
-	if (number_of_images < 1 or number_of_classes < 1)
+	if (number_of_images < 1 or classes < 1)
 	{
 		// things are still loading, so return now and we'll try again later
 		Log("ScrollField: ending thread since app is still loading");
@@ -88,23 +97,56 @@ void dm::ScrollField::run()
 		return;
 	}
 
-	Log("Scrollfield: creating a new image, 200x" + std::to_string(number_of_images) + ", for " + std::to_string(number_of_classes) + " classes");
-	field = cv::Mat(number_of_images, 200, CV_8UC3, {0.0, 0.0, 0.0});
-	line_width = static_cast<double>(field.cols) / static_cast<double>(number_of_classes);
-	Log("Scrollfield: size of field is " + std::to_string(field.cols) + "x" + std::to_string(field.rows) + ", and the width of each line is " + std::to_string(line_width) + " pixels");
+	const size_t new_images_per_bin	= (number_of_images + maximum_number_of_bins - 1) / maximum_number_of_bins;
+	const size_t number_of_bins		= (number_of_images + new_images_per_bin - 1) / new_images_per_bin;
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(bins_mutex);
+		number_of_classes	= classes;
+		images_per_bin		= new_images_per_bin;
+		building			= true;
+	}
+	Log("Scrollfield: creating " + std::to_string(number_of_bins) + " bins of " + std::to_string(images_per_bin) + " image(s) each for " + std::to_string(number_of_images) + " images and " + std::to_string(number_of_classes) + " classes");
 
+	// the bins are created without holding the lock, and only replace the visible bins once they are complete
+	std::vector<Bin> new_bins(number_of_bins, create_bin());
+	bool cancelled = false;
 	for (size_t idx = 0; idx < number_of_images; idx ++)
 	{
 		if (threadShouldExit() or content.scrollfield_width < 1)
 		{
 			Log("ScrollField: 1: thread has been cancelled (idx=" + std::to_string(idx) + ")");
-			field = cv::Mat();
+			cancelled = true;
 			break;
 		}
 
-		update_index(idx);
+		// the index only re-parses the .json file if it was modified since the entry was created
+		add_to_bin(new_bins.at(idx / images_per_bin), content.annotation_index.get(content.image_filenames.at(idx)));
+	}
+
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(bins_mutex);
+		if (not cancelled)
+		{
+			bins.swap(new_bins);
+
+			// images which were saved while we were busy may have been read before they were modified
+			for (const size_t idx : pending_updates)
+			{
+				if (idx < content.image_filenames.size())
+				{
+					rebuild_bin(idx, content.annotation_index.peek(content.image_filenames.at(idx)));
+				}
+			}
+		}
+		pending_updates.clear();
+		building = false;
 	}
 
+	// remember whatever had to be parsed so the next time the project is opened the field can be drawn immediately
+	content.annotation_index.save();
+
 	if (content.sort_order == dm::ESort::kAlphabetical)
 	{
 		File previous_parent;
@@ -117,7 +159,8 @@ void dm::ScrollField::run()
 			if (threadShouldExit() or content.scrollfield_width < 1)
 			{
 				Log("ScrollField: 2: thread has been cancelled (idx=" + std::to_string(idx) + ")");
-				field = cv::Mat();
+				std::lock_guard<std::mutex> lock(bins_mutex);
+				bins.clear();
 				break;
 			}
 
@@ -155,95 +198,151 @@ void dm::ScrollField::run()
 
 void dm::ScrollField::update_index(const size_t idx)
 {
-	if (field.empty())
+	bool nothing_to_draw = true;
+	if (true)
+	{
+		std::lock_guard<std::mutex> lock(bins_mutex);
+		nothing_to_draw = (bins.empty() and building == false);
+	}
+
+	if (nothing_to_draw or content.scrollfield_width < 1)
 	{
-		// if we don't have an image to draw into, then return immediately
+		// no need to look up the entry if there is nothing to draw
 		return;
 	}
 
 	if (idx >= content.image_filenames.size())
 	{
-		// nothing we can do with an index that is out of range
 		Log("ScrollField: idx=" + std::to_string(idx) + " but we only have " + std::to_string(content.image_filenames.size()) + " images");
 		return;
 	}
 
-	if (static_cast<size_t>(field.rows) != content.image_filenames.size())
+	// the index only re-parses the .json file if it was modified since the entry was created
+	update_index(idx, content.annotation_index.get(content.image_filenames.at(idx)));
+
+	return;
+}
+
+
+void dm::ScrollField::update_index(const size_t idx, const AnnotationIndex::Entry & entry)
+{
+	std::lock_guard<std::mutex> lock(bins_mutex);
+
+	if (building)
 	{
-		Log("Scrollfield: height=" + std::to_string(field.rows) + " but we have " + std::to_string(content.image_filenames.size()) + " images");
+		// the thread is creating new bins, so this image is updated once the new bins are ready
+		pending_updates.insert(idx);
 		return;
 	}
 
-	if (content.scrollfield_width < 1)
+	if (bins.empty())
 	{
+		// if we don't have anything to update, then return immediately
 		return;
 	}
 
-	const std::string & filename = content.image_filenames.at(idx);
-//	Log("ScrollField: updating for idx=" + std::to_string(idx));
-
-	File f = File(filename).withFileExtension(".json");
-	if (f.existsAsFile() == false)
+	if (idx >= content.image_filenames.size())
 	{
-		// nothing to show for this index, draw a blank line
-		cv::line(field, cv::Point(0, idx), cv::Point(field.cols, idx), {32.0, 32.0, 32.0}, 1, cv::LINE_4);
+		// nothing we can do with an index that is out of range
+		Log("ScrollField: idx=" + std::to_string(idx) + " but we only have " + std::to_string(content.image_filenames.size()) + " images");
 		return;
 	}
 
-	std::string msg;
-	try
+	if (content.scrollfield_width < 1)
 	{
-		const std::string fn = f.getFullPathName().toStdString();
-		msg = "loading " + fn;
-		json root = json::parse(f.loadFileAsString().toStdString());
-		msg = "done " + msg;
+		return;
+	}
 
-		if (root.value("completely_empty", false) == true)
-		{
-			// create a fake entry so "empty" images show up as marked
-			root["mark"][0]["class_idx"] = content.empty_image_name_index;
-		}
+	rebuild_bin(idx, entry);
 
-		msg = "checking marks in " + fn;
-		if (root["mark"].size() == 0)
+	return;
+}
+
+
+void dm::ScrollField::rebuild_bin(const size_t idx, const AnnotationIndex::Entry & entry)
+{
+	const size_t bin_idx = idx / images_per_bin;
+	if (bin_idx >= bins.size() or number_of_classes != content.names.size())
+	{
+		Log("Scrollfield: " + std::to_string(bins.size()) + " bins but we have " + std::to_string(content.image_filenames.size()) + " images and " + std::to_string(content.names.size()) + " classes");
+		return;
+	}
+
+	// rebuild the entire bin; the other images in the same bin should already be in the index
+	Bin bin = create_bin();
+	const size_t first_idx	= bin_idx * images_per_bin;
+	const size_t last_idx	= std::min(first_idx + images_per_bin, content.image_filenames.size());
+	for (size_t i = first_idx; i < last_idx; i ++)
+	{
+		if (i == idx)
 		{
-			// What is going on here?  Why do we have a JSON, but it isn't marked "empty" and doesn't have any marks?
-			Log("ScrollField: error detected while processing " + filename + " (no marks, but non-empty image?)");
-			cv::line(field, cv::Point(0, idx), cv::Point(field.cols, idx), {0.0, 0.0, 255.0}, 1, cv::LINE_4);
+			add_to_bin(bin, entry);
 		}
 		else
 		{
-			msg = "drawing scrollfield line for " + fn;
-			cv::line(field, cv::Point(0, idx), cv::Point(field.cols, idx), {0.0, 0.0, 0.0}, 1, cv::LINE_4); // start with a black background
-			for (auto m : root["mark"])
-			{
-				const int class_idx = m["class_idx"];
-				const cv::Point p1(line_width * class_idx, idx);
-				const cv::Point p2 = p1 + cv::Point(line_width, 0);
-				msg = "drawing scrollfield line (class #" + std::to_string(class_idx) + ") for " + fn;
-				cv::line(field, p1, p2, content.annotation_colours.at(class_idx % content.annotation_colours.size()), 1, cv::LINE_4);
-			}
-			msg = "done " + msg;
+			add_to_bin(bin, content.annotation_index.peek(content.image_filenames.at(i)));
 		}
+	}
+	bins[bin_idx] = bin;
 
-		if (root.contains("predictions"))
-		{
-			content.IoU_info_found = true;
-		}
+	return;
+}
+
+
+dm::ScrollField::Bin dm::ScrollField::create_bin() const
+{
+	Bin bin;
+	bin.number_of_images	= 0;
+	bin.not_annotated		= 0;
+	bin.errors				= 0;
+	bin.classes				= std::vector<uint32_t>(number_of_classes, 0);
+
+	return bin;
+}
+
+
+void dm::ScrollField::add_to_bin(Bin & bin, const AnnotationIndex::Entry & entry)
+{
+	bin.number_of_images ++;
+
+	if (entry.json_mtime == 0)
+	{
+		// nothing to show for this image
+		bin.not_annotated ++;
+		return;
+	}
+
+	if (entry.parse_error)
+	{
+		// the .json file is broken somehow
+		bin.errors ++;
+		return;
+	}
+
+	MIdxSize histogram = entry.histogram;
+	if (entry.completely_empty)
+	{
+		// create a fake entry so "empty" images show up as marked
+		histogram[content.empty_image_name_index] ++;
+	}
+
+	if (histogram.empty())
+	{
+		// What is going on here?  Why do we have a JSON, but it isn't marked "empty" and doesn't have any marks?
+		bin.errors ++;
 	}
-	catch (const std::exception & e)
+
+	for (const auto & [class_idx, count] : histogram)
 	{
-		// the .json file is broken somehow, so use a pure red line
-		Log("Scrollfield: msg: " + msg);
-		Log("ScrollField: error detected at idx #" + std::to_string(idx) + " (" + filename + "): " + e.what());
-		cv::line(field, cv::Point(0, idx), cv::Point(field.cols, idx), {0.0, 0.0, 255.0}, 1, cv::LINE_4);
+		if (class_idx < bin.classes.size())
+		{
+			bin.classes[class_idx] ++;
+		}
 	}
-	catch (...)
+
+	if (entry.has_predictions)
 	{
-		// the .json file is broken somehow, so use a pure red line
-		Log("Scrollfield: msg: " + msg);
-		Log("ScrollField: error detected at idx #" + std::to_string(idx) + " (" + filename + ")");
-		cv::line(field, cv::Point(0, idx), cv::Point(field.cols, idx), {0.0, 0.0, 255.0}, 1, cv::LINE_4);
+		content.IoU_info_found = true;
 	}
 
 	return;
@@ -384,19 +483,72 @@ void dm::ScrollField::rebuild_cache_image()
 	resized_image	= cv::Mat();
 	cached_image	= juce::Image();
 
-	if (field.empty())
+	std::unique_lock<std::mutex> lock(bins_mutex);
+	if (bins.empty())
 	{
+		lock.unlock();
 		Log("ScrollField: starting thread to rebuild the image");
 		rebuild_entire_field_on_thread();
 	}
 	else
 	{
-		Log("ScrollField: scale and redrawing image");
+		Log("ScrollField: drawing " + std::to_string(bins.size()) + " bins");
 
 		const int w = getWidth();
 		const int h = getHeight();
 
-		resized_image = DarkHelp::slow_resize_ignore_aspect_ratio(field, cv::Size(w, h));
+		resized_image = cv::Mat(std::max(1, h), std::max(1, w), CV_8UC3, {0.0, 0.0, 0.0});
+
+		const cv::Vec3d not_annotated_colour(32.0, 32.0, 32.0);
+		const cv::Vec3d error_colour(0.0, 0.0, 255.0);
+		const double number_of_bins = bins.size();
+
+		for (int y = 0; y < resized_image.rows; y ++)
+		{
+			// combine all of the bins which fall on this row of pixels
+			const size_t first_bin	= std::min(bins.size() - 1, static_cast<size_t>(y * number_of_bins / resized_image.rows));
+			const size_t last_bin	= std::max(first_bin + 1, std::min(bins.size(), static_cast<size_t>((y + 1) * number_of_bins / resized_image.rows)));
+
+			Bin row = create_bin();
+			for (size_t bin_idx = first_bin; bin_idx < last_bin; bin_idx ++)
+			{
+				const auto & bin = bins[bin_idx];
+				row.number_of_images	+= bin.number_of_images;
+				row.not_annotated		+= bin.not_annotated;
+				row.errors				+= bin.errors;
+				for (size_t class_idx = 0; class_idx < row.classes.size() and class_idx < bin.classes.size(); class_idx ++)
+				{
+					row.classes[class_idx] += bin.classes[class_idx];
+				}
+			}
+
+			if (row.number_of_images == 0)
+			{
+				continue;
+			}
+
+			// the colour of each class is the average of every image in this row:  grey when not annotated, red for
+			// errors, the class colour when the class is used, and black for annotated images without this class
+			const double n = row.number_of_images;
+			for (size_t class_idx = 0; class_idx < number_of_classes; class_idx ++)
+			{
+				const int x1 = std::round(static_cast<double>(class_idx		) * resized_image.cols / number_of_classes);
+				const int x2 = std::round(static_cast<double>(class_idx + 1	) * resized_image.cols / number_of_classes);
+				if (x2 <= x1)
+				{
+					continue;
+				}
+
+				const auto & class_colour = content.annotation_colours.at(class_idx % content.annotation_colours.size());
+				cv::Vec3d colour = (not_annotated_colour * static_cast<double>(row.not_annotated) + error_colour * static_cast<double>(row.errors)) / n;
+				for (int channel = 0; channel < 3; channel ++)
+				{
+					colour[channel] += class_colour[channel] * row.classes[class_idx] / n;
+				}
+
+				resized_image(cv::Rect(x1, y, x2 - x1, 1)).setTo(cv::Scalar(colour[0], colour[1], colour[2]));
+			}
+		}
 
 		draw_triangles_at_image_sets();
 		draw_marker_at_current_image();
@@ -19,8 +19,12 @@ namespace dm
 
 			virtual void run() override;
 
+			/// Update a single line in the field, using the annotation index to avoid parsing the .json file when possible.
 			virtual void update_index(const size_t idx);
 
+			/// Update a single line in the field using an entry which was just created, such as by @ref DMContent::save_json().
+			virtual void update_index(const size_t idx, const AnnotationIndex::Entry & entry);
+
 			virtual void mouseUp(const MouseEvent & event) override;
 			virtual void mouseDown(const MouseEvent & event) override;
 			virtual void mouseDrag(const MouseEvent & event) override;
@@ -35,13 +39,52 @@ namespace dm
 			/// Link to the parent which manages the content.
 			DMContent & content;
 
-			/// The width of a single class "line" in the field.
-			double line_width;
+			/// Aggregated markup for a range of consecutive images.  @see @ref bins
+			struct Bin
+			{
+				size_t number_of_images;		///< Number of images which have been added to this bin.
+				size_t not_annotated;			///< Images which don't have a .json file.
+				size_t errors;					///< Images where the .json file is broken, or has no marks and isn't empty.
+				std::vector<uint32_t> classes;	///< For each class, the number of images in which the class appears.
+			};
+
+			/// Create a new empty bin with enough room for every class.
+			virtual Bin create_bin() const;
+
+			/// Add the markup from a single image to the given bin.
+			virtual void add_to_bin(Bin & bin, const AnnotationIndex::Entry & entry);
+
+			/// Re-create the bin which contains the image at @p idx.  The caller must hold @ref bins_mutex.
+			virtual void rebuild_bin(const size_t idx, const AnnotationIndex::Entry & entry);
+
+			/** The scrollfield is never larger than this many bins regardless of the number of images in the project.  When
+			 * a project has fewer images than this, then each bin represents exactly 1 image.  Otherwise, consecutive images
+			 * are aggregated into the same bin.  This keeps memory usage proportional to the height of the screen instead of
+			 * the size of the dataset.
+			 */
+			static constexpr size_t maximum_number_of_bins = 4096;
+
+			/** Protects @ref bins, @ref images_per_bin, @ref number_of_classes, @ref building, and @ref pending_updates.
+			 * The bins are created on the scrollfield thread, but updated from the message thread when images are saved.
+			 */
+			std::mutex bins_mutex;
+
+			/// The markup from the .json files, aggregated into at most @ref maximum_number_of_bins bins.
+			std::vector<Bin> bins;
+
+			/// Set while the thread is creating new bins.  @see @ref run()
+			bool building;
+
+			/// Images which were modified while the thread was creating new bins, and must be updated once it finishes.
+			SId pending_updates;
+
+			/// The number of consecutive images aggregated into each bin.
+			size_t images_per_bin;
 
-			/// The full-size scrollfield with all the markup from the .json files.
-			cv::Mat field;
+			/// The number of classes (including the "empty image" class) at the time the @ref bins were created.
+			size_t number_of_classes;
 
-			/// The @ref field image resized to fit exactly within the window.
+			/// The @ref bins rendered to fit exactly within the window.
 			cv::Mat resized_image;
 
 			/// Track at which index the image sets can be found so we can draw our little triangles.
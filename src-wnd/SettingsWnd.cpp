@@ -86,10 +86,21 @@ dm::SettingsWnd::SettingsWnd(dm::DMContent & c) :
 		v_image_tiling									= cfg().get_bool("darknet_image_tiling");
 	}
 
+	// the inference backend used for Darknet models is stored per project
+	v_darknet_backend = cfg().get_int(content.cfg_prefix + "darknet_backend", 0);
+
 	// Initialize ONNX threshold settings
 	v_onnx_threshold = cfg().get_int("onnx_threshold");
 	v_onnx_nms_threshold = cfg().get_int("onnx_nms_threshold");
 
+	// ONNX Runtime session options are stored per project
+	v_onnx_intra_threads		= cfg().get_int	(content.cfg_prefix + "onnx_intra_threads"		, 0		);
+	v_onnx_inter_threads		= cfg().get_int	(content.cfg_prefix + "onnx_inter_threads"		, 0		);
+	v_onnx_parallel_execution	= cfg().get_bool(content.cfg_prefix + "onnx_parallel_execution"	, false	);
+	v_onnx_memory_pattern		= cfg().get_bool(content.cfg_prefix + "onnx_memory_pattern"		, true	);
+	v_onnx_cpu_arena			= cfg().get_bool(content.cfg_prefix + "onnx_cpu_arena"			, true	);
+	v_onnx_rectangular			= cfg().get_bool(content.cfg_prefix + "onnx_rectangular"		, false	);
+
 	v_scrollfield_width			= content.scrollfield_width;
 	v_scrollfield_marker_size	= content.scrollfield.triangle_size;
 	v_show_mouse_pointer		= content.show_mouse_pointer;
@@ -179,13 +190,46 @@ dm::SettingsWnd::SettingsWnd(dm::DMContent & c) :
 	s->setTooltip("ONNX Non-Maximal Suppression (NMS) suppresses overlapping bounding boxes and only retains the bounding box that has the maximum probability of object detection associated with it. Default value is 45%.");
 	properties.add(s);
 
+	auto backend = new ChoicePropertyComponent(v_darknet_backend, "inference backend", {"libdarknet (DarkHelp)", "OpenCV DNN (CPU)", "OpenCV DNN (OpenVINO)"}, {0, 1, 2});
+	backend->setTooltip("Determines how Darknet .cfg/.weights models are run in this project. OpenCV DNN is usually several times faster than libdarknet on machines without a GPU, but does not support image tiling nor heatmaps. OpenVINO is only used when OpenCV was built with it. Takes effect the next time the project is loaded. Default is \"libdarknet\".");
+	properties.add(backend);
+
 	b = new BooleanPropertyComponent(v_image_tiling, "enable image tiling", "enable image tiling");
-	b->setTooltip("Determines if images will be tiled when sent to darknet for processing. The default value is \"off\".");
+	b->setTooltip("Determines if images will be tiled when sent to darknet or to the ONNX model for processing. ONNX tiles overlap, and are merged back together using NMS. The default value is \"off\".");
 	properties.add(b);
 
 	pp.addSection("darknet", properties, true);
 	properties.clear();
 
+	const int hardware_threads = std::max(1U, std::thread::hardware_concurrency());
+
+	s = new SliderPropertyComponent(v_onnx_intra_threads, "intra-op threads", 0, hardware_threads, 1);
+	s->setTooltip("Number of threads ONNX Runtime uses within a single operator. Set to zero for \"auto\", which uses the shared thread pool, or fewer threads when DarkMark is busy with other work. Takes effect the next time the model is loaded. Default is \"auto\".");
+	properties.add(s);
+
+	s = new SliderPropertyComponent(v_onnx_inter_threads, "inter-op threads", 0, hardware_threads, 1);
+	s->setTooltip("Number of threads ONNX Runtime uses to run independent operators at the same time. This only matters when parallel execution is enabled. Set to zero for \"auto\". Takes effect the next time the model is loaded. Default is \"auto\".");
+	properties.add(s);
+
+	b = new BooleanPropertyComponent(v_onnx_parallel_execution, "parallel execution", "parallel execution");
+	b->setTooltip("Run independent branches of the model at the same time instead of sequentially. This rarely helps object detection models. Takes effect the next time the model is loaded. Default is \"off\".");
+	properties.add(b);
+
+	b = new BooleanPropertyComponent(v_onnx_memory_pattern, "memory pattern", "memory pattern");
+	b->setTooltip("Pre-allocate memory based on the previous runs. Takes effect the next time the model is loaded. Default is \"on\".");
+	properties.add(b);
+
+	b = new BooleanPropertyComponent(v_onnx_cpu_arena, "CPU memory arena", "CPU memory arena");
+	b->setTooltip("Keep CPU memory in an arena instead of allocating and releasing it for every image. Disabling this uses less memory but is slower. Takes effect the next time the model is loaded. Default is \"on\".");
+	properties.add(b);
+
+	b = new BooleanPropertyComponent(v_onnx_rectangular, "rectangular inference", "rectangular inference");
+	b->setTooltip("For ONNX models with dynamic height/width dimensions, give each image the smallest input shape (a multiple of 32) which fits the image at the configured input size, instead of padding every image to the full input size. Wide images such as video frames are processed faster, and objects keep the same size. Default is \"off\".");
+	properties.add(b);
+
+	pp.addSection("ONNX runtime", properties, false);
+	properties.clear();
+
 //	b = new CrosshairColourPicker("crosshair colour");
 //	b->setEnabled(false);
 //	properties.add(b);
@@ -381,6 +425,20 @@ void dm::SettingsWnd::closeButtonPressed()
 	cfg().setValue("heatmap_alpha_blend"				, v_heatmap_alpha_blend							.getValue());
 	cfg().setValue("heatmap_threshold"					, v_heatmap_threshold							.getValue());
 	cfg().setValue("heatmap_visualize"					, v_heatmap_visualize							.getValue());
+	cfg().setValue(content.cfg_prefix + "darknet_backend"			, v_darknet_backend			.getValue());
+	cfg().setValue(content.cfg_prefix + "onnx_intra_threads"		, v_onnx_intra_threads		.getValue());
+	cfg().setValue(content.cfg_prefix + "onnx_inter_threads"		, v_onnx_inter_threads		.getValue());
+	cfg().setValue(content.cfg_prefix + "onnx_parallel_execution"	, v_onnx_parallel_execution	.getValue());
+	cfg().setValue(content.cfg_prefix + "onnx_memory_pattern"		, v_onnx_memory_pattern		.getValue());
+	cfg().setValue(content.cfg_prefix + "onnx_cpu_arena"			, v_onnx_cpu_arena			.getValue());
+	cfg().setValue(content.cfg_prefix + "onnx_rectangular"			, v_onnx_rectangular		.getValue());
+	content.apply_onnx_session_settings();
+
+	if (dmapp().onnx_nn and dmapp().onnx_nn->get_rectangular() != content.use_rectangular_inference())
+	{
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+		dmapp().onnx_nn->set_rectangular(content.use_rectangular_inference());
+	}
 
 	dmapp().settings_wnd.reset(nullptr);
 
@@ -435,13 +493,31 @@ void dm::SettingsWnd::valueChanged(Value & value)
 {
 	if (dmapp().darkhelp_nn)
 	{
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
 //		dmapp().darkhelp_nn->config.hierarchy_threshold					= static_cast<float>(v_darkhelp_hierchy_threshold					.getValue()) / 100.0f;
 		dmapp().darkhelp_nn->config.non_maximal_suppression_threshold	= static_cast<float>(v_darkhelp_non_maximal_suppression_threshold	.getValue()) / 100.0f;
 		dmapp().darkhelp_nn->config.threshold							= static_cast<float>(v_darkhelp_threshold							.getValue()) / 100.0f;
 		dmapp().darkhelp_nn->config.enable_tiles						= static_cast<bool>(v_image_tiling.getValue());
 	}
+
+	if (dmapp().onnx_nn and dmapp().onnx_nn->get_tiling() != static_cast<bool>(v_image_tiling.getValue()))
+	{
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+		dmapp().onnx_nn->set_tiling(static_cast<bool>(v_image_tiling.getValue()), dmapp().onnx_nn->get_tile_overlap());
+	}
+
+	// with tiling, the ONNX NMS threshold is also used to merge the duplicates along the tile seams so the candidates change
+	bool tile_nms_changed = false;
+	if (dmapp().onnx_nn and dmapp().onnx_nn->get_tile_nms_threshold() != static_cast<float>(v_onnx_nms_threshold.getValue()) / 100.0f)
+	{
+		std::lock_guard<std::mutex> lock(dmapp().inference_mutex);
+		dmapp().onnx_nn->set_tile_nms_threshold(static_cast<float>(v_onnx_nms_threshold.getValue()) / 100.0f);
+		tile_nms_changed = dmapp().onnx_nn->get_tiling();
+	}
 	
-	// Save ONNX threshold settings to configuration
+	// Save threshold settings to configuration
+	cfg().setValue("darknet_threshold", static_cast<int>(v_darkhelp_threshold.getValue()));
+	cfg().setValue("darknet_nms_threshold", static_cast<int>(v_darkhelp_non_maximal_suppression_threshold.getValue()));
 	cfg().setValue("onnx_threshold", static_cast<int>(v_onnx_threshold.getValue()));
 	cfg().setValue("onnx_nms_threshold", static_cast<int>(v_onnx_nms_threshold.getValue()));
 	content.scrollfield_width					= v_scrollfield_width					.getValue();
@@ -465,6 +541,17 @@ void dm::SettingsWnd::valueChanged(Value & value)
 	content.heatmap_threshold					= v_heatmap_threshold					.getValue();
 	content.heatmap_visualize					= v_heatmap_visualize					.getValue();
 
+	// when Darknet models are run by OpenCV, the Darknet NMS threshold is applied by filter_detections() instead of Darknet
+	if (value.refersToSameSourceAs(v_darkhelp_threshold) or
+		value.refersToSameSourceAs(v_onnx_threshold) or
+		(value.refersToSameSourceAs(v_onnx_nms_threshold) and tile_nms_changed == false) or
+		(value.refersToSameSourceAs(v_darkhelp_non_maximal_suppression_threshold) and dmapp().opencv_nn))
+	{
+		// thresholds are applied to the cached candidates, so there is no need to reload the image or run the network
+		content.refilter_predictions();
+		return;
+	}
+
 	startTimer(250); // request a callback -- in milliseconds -- at which point in time we'll fully reload the current image
 
 	return;
@@ -27,8 +27,15 @@ namespace dm
 			Value v_darkhelp_threshold;
 //			Value v_darkhelp_hierchy_threshold;
 			Value v_darkhelp_non_maximal_suppression_threshold;
+			Value v_darknet_backend;
 			Value v_onnx_threshold;
 			Value v_onnx_nms_threshold;
+			Value v_onnx_intra_threads;
+			Value v_onnx_inter_threads;
+			Value v_onnx_parallel_execution;
+			Value v_onnx_memory_pattern;
+			Value v_onnx_cpu_arena;
+			Value v_onnx_rectangular;
 			Value v_scrollfield_width;
 			Value v_scrollfield_marker_size;
 			Value v_show_mouse_pointer;